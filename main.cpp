@@ -1,38 +1,395 @@
 #include <unistd.h>
+#include <stdlib.h>
+#include <signal.h>
 #include <iostream>
 #include "monitor_info_collect.h"
+#include "monitor_info_output.h"
+#include "monitor_info_preprocess.h"
+#include "monitor_info_shm.h"
+#include "monitor_info_alert.h"
+#include "monitor_info_remote.h"
 #include "common.h"
 
-int main() {
+// -c 时输出的最繁忙的 cpu 个数
+#define TOP_BUSY_CPUS 8
+// -f 时输出的 fd 使用率最高的进程个数
+#define TOP_FD_TASKS 5
+// -G 时输出的分组个数
+#define TOP_GROUPS 10
+// 默认的采集间隔
+#define DEFAULT_INTERVAL_MS 2000
+// 默认的预热间隔，预热之后立即输出第一次结果
+#define DEFAULT_WARMUP_MS 200
+// collector 模式输出的任务个数
+#define COLLECTOR_TOP_TASKS 20
+// collector 模式输出的间隔
+#define COLLECTOR_OUTPUT_INTERVAL_MS 2000
+// collector 模式中断开超过该时间的主机被删除
+#define COLLECTOR_HOST_EXPIRE_MS (10 * 60 * 1000)
+
+// 收到退出信号后结束主循环，保证共享内存等资源被清理
+static volatile sig_atomic_t g_stop = 0;
+
+static void handle_stop_signal(int) {
+    g_stop = 1;
+}
+
+static void usage(const char* prog) {
+    std::cout << "usage: " << prog << " [-s shm_name] [-n] [-c] [-q] [-r rules_file] [-A sink]..."
+        << " [-a address [-H host_name]]" << std::endl
+        << "       " << "[-p pid,...] [-P pid] [-g cgroup] [-m regex] [-i interval_ms] [-e max_tasks]" << std::endl
+        << "       " << "[-K max_tasks] [-M budget] [-f ticks] [-F]" << std::endl
+        << "       " << "[-w max_tasks[,hz[,budget]]] [-Y sys_root] [-G keys[:metrics]]" << std::endl
+        << "       " << "[-W warmup_ms] [-S state_file]" << std::endl
+        << "       " << prog << " -C address [-q]" << std::endl
+        << "  -s shm_name  publish every snapshot into POSIX shared memory (e.g. "
+        << SHM_SNAPSHOT_DEFAULT_NAME << ")" << std::endl
+        << "  -n           collect per-process tcp/udp connections and tcp throughput" << std::endl
+        << "  -c           print per-cpu breakdown and the busiest cpus" << std::endl
+        << "  -q           do not print snapshots to stdout" << std::endl
+        << "  -r file      evaluate alert rules in file after every snapshot" << std::endl
+        << "  -A sink      send alerts to file:<path>, unix:<path> or exec:<command>" << std::endl
+        << "               (may be repeated, alerts go to stderr by default)" << std::endl
+        << "  -a address   stream snapshots as binary deltas to a collector at tcp:<host>:<port>"
+        << " or unix:<path>" << std::endl
+        << "  -H host_name host name reported to the collector (default: gethostname)" << std::endl
+        << "  -p pid,...   only monitor the given processes (and their threads)" << std::endl
+        << "  -P pid       only monitor the process and all its descendants" << std::endl
+        << "  -g cgroup    only monitor processes in the cgroup (relative to " << CGROUP_ROOT_DIR << ")"
+        << std::endl
+        << "  -m regex     only monitor processes whose cmdline matches the extended regex" << std::endl
+        << "               (-p, -P, -g and -m may be repeated and are combined as a union)" << std::endl
+        << "  -i ms        sampling interval in milliseconds (default " << DEFAULT_INTERVAL_MS << ")"
+        << std::endl
+        << "  -e max_tasks count cycles/instructions/cache-misses/branch-misses (IPC, MPKI) of the"
+        << std::endl
+        << "               busiest tasks with perf_event_open, or software events without a PMU" << std::endl
+        << "  -K max_tasks keep full detail only for the most active tasks, the rest are"
+        << " aggregated as others" << std::endl
+        << "  -M budget    memory budget of internal structures, e.g. 8M; the detailed task limit"
+        << std::endl
+        << "               adapts to stay within it" << std::endl
+        << "  -f ticks     count open fds and RLIMIT_NOFILE of every process every ticks samplings"
+        << " (default " << TASK_FD_DEFAULT_TIER_TICKS << ")" << std::endl
+        << "  -F           also break fds down by type (socket, pipe, file, eventfd, anon_inode)" << std::endl
+        << "  -w max_tasks sample thread state, wchan and syscall of the busiest processes on a"
+        << " background thread" << std::endl
+        << "               at hz rounds per second (default " << TASK_SAMPLE_DEFAULT_HZ
+        << "), at most budget thread samples per interval (default " << TASK_SAMPLE_DEFAULT_BUDGET << ")"
+        << std::endl
+        << "  -Y sys_root  root of sysfs for cpufreq/cpuidle/thermal_throttle/powercap (default " << SYSFS_ROOT_DIR
+        << ")" << std::endl
+        << "  -G spec      print the top groups of processes, e.g. comm,uid:cpu,rss; keys: tgid, ppid, pgrp,"
+        << std::endl
+        << "               session, uid, comm; groups are sorted by the sum of the first metric" << std::endl
+        << "  -W ms        take a baseline sample and wait ms before the first report (default "
+        << DEFAULT_WARMUP_MS << ", 0 disables)" << std::endl
+        << "  -S file      restore counters from file at start and save them at exit, so a restarted"
+        << " agent" << std::endl
+        << "               reports correct rates immediately (the warm-up is skipped when restored)" << std::endl
+        << "  -C address   run as a collector, merge the streams of many agents listening on address"
+        << std::endl;
+}
+
+/**
+ * @brief 解析带 K、M、G 后缀的字节数
+ *
+ * @return 0 表示格式错误
+ */
+static size_t parse_bytes(const char* text) {
+    char* end = nullptr;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text) return 0;
+    switch (*end) {
+    case 'K': case 'k': value <<= 10; end++; break;
+    case 'M': case 'm': value <<= 20; end++; break;
+    case 'G': case 'g': value <<= 30; end++; break;
+    default: break;
+    }
+    return *end == '\0' ? value : 0;
+}
+
+/**
+ * @brief collector 模式的主循环，不采集本机数据
+ *
+ */
+static int run_collector(const char* address, bool quiet) {
+    RemoteCollector collector;
+    if (collector.listen(address) < 0) {
+        FATAL_LOG("collector listen on: %s failed", address);
+        return -1;
+    }
+    std::vector<RemoteTaskRef> top_tasks;
+    uint64_t now = Util::get_monotonic_ns() / 1000000;
+    uint64_t next_output_ms = now + COLLECTOR_OUTPUT_INTERVAL_MS;
+    while (!g_stop) {
+        int timeout = next_output_ms > now ? static_cast<int>(next_output_ms - now) : 0;
+        if (collector.poll(timeout) < 0) return -1;
+        now = Util::get_monotonic_ns() / 1000000;
+        if (now < next_output_ms) continue;
+        next_output_ms = now + COLLECTOR_OUTPUT_INTERVAL_MS;
+        collector.expire_hosts(COLLECTOR_HOST_EXPIRE_MS);
+        if (quiet) continue;
+        size_t task_count = 0;
+        for (const auto& item : collector.hosts()) {
+            output_remote_host(std::cout, item.second, now);
+            task_count += item.second.tasks.size();
+        }
+        std::cout << "hosts: " << collector.hosts().size() << ", connections: " << collector.connection_count()
+            << ", tasks: " << task_count << std::endl;
+        collector.get_top_tasks_by_cpu(COLLECTOR_TOP_TASKS, &top_tasks);
+        for (const auto& ref : top_tasks) {
+            output_remote_task(std::cout, ref, collector.string_arena());
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    const char* shm_name = nullptr;
+    bool quiet = false;
+    bool task_net = false;
+    bool cpu_breakdown = false;
+    const char* rules_file = nullptr;
+    const char* agent_address = nullptr;
+    const char* host_name = nullptr;
+    const char* collector_address = nullptr;
+    unsigned long interval_ms = DEFAULT_INTERVAL_MS;
+    bool task_limit = false;
+    uint32_t fd_tier_ticks = 0;
+    bool fd_type_breakdown = false;
+    unsigned long sample_args[3] = {0, 0, 0};
+    bool group_by_enabled = false;
+    unsigned long warmup_ms = DEFAULT_WARMUP_MS;
+    const char* state_file = nullptr;
+    TaskGroupBy group_by;
+    TaskFilter& task_filter = MonitorInfoCollection::get_instance().task_filter();
+    MonitorInfoAlert alert;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:ncqr:A:a:H:C:p:P:g:m:i:e:K:M:f:Fw:Y:G:W:S:h")) != -1) {
+        switch (opt) {
+        case 's':
+            shm_name = optarg;
+            break;
+        case 'n':
+            task_net = true;
+            break;
+        case 'c':
+            cpu_breakdown = true;
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        case 'r':
+            rules_file = optarg;
+            break;
+        case 'A':
+            if (alert.add_sink(optarg) < 0) {
+                FATAL_LOG("add alert sink: %s failed", optarg);
+                return -1;
+            }
+            break;
+        case 'a':
+            agent_address = optarg;
+            break;
+        case 'H':
+            host_name = optarg;
+            break;
+        case 'C':
+            collector_address = optarg;
+            break;
+        case 'p':
+            if (task_filter.add_pids(optarg) < 0) return -1;
+            break;
+        case 'P':
+            if (task_filter.add_descendants(strtol(optarg, nullptr, 10)) < 0) return -1;
+            break;
+        case 'g':
+            if (task_filter.add_cgroup(optarg) < 0) return -1;
+            break;
+        case 'm':
+            if (task_filter.add_cmdline_pattern(optarg) < 0) return -1;
+            break;
+        case 'e':
+            MonitorInfoCollection::get_instance().set_task_perf_max_tasks(strtoul(optarg, nullptr, 10));
+            break;
+        case 'K':
+            MonitorInfoCollection::get_instance().set_max_detailed_tasks(strtoul(optarg, nullptr, 10));
+            task_limit = true;
+            break;
+        case 'M': {
+            size_t budget = parse_bytes(optarg);
+            if (budget == 0) {
+                std::cout << "invalid memory budget: " << optarg << std::endl;
+                return -1;
+            }
+            MonitorInfoCollection::get_instance().set_memory_budget(budget);
+            task_limit = true;
+            break;
+        }
+        case 'f':
+            fd_tier_ticks = strtoul(optarg, nullptr, 10);
+            if (fd_tier_ticks == 0) {
+                std::cout << "invalid fd ticks: " << optarg << std::endl;
+                return -1;
+            }
+            break;
+        case 'F':
+            fd_type_breakdown = true;
+            break;
+        case 'w': {
+            // max_tasks[,hz[,budget]]
+            char* location = optarg;
+            for (unsigned long& value : sample_args) {
+                value = strtoul(location, &location, 10);
+                if (*location != ',') break;
+                location++;
+            }
+            if (sample_args[0] == 0 || *location != '\0') {
+                std::cout << "invalid sampler arguments: " << optarg << std::endl;
+                return -1;
+            }
+            break;
+        }
+        case 'G':
+            if (group_by.parse(optarg) < 0) {
+                std::cout << "invalid group by: " << optarg << std::endl;
+                return -1;
+            }
+            group_by_enabled = true;
+            break;
+        case 'W':
+            warmup_ms = strtoul(optarg, nullptr, 10);
+            break;
+        case 'S':
+            state_file = optarg;
+            break;
+        case 'Y':
+            MonitorInfoCollection::get_instance().set_sys_root(optarg);
+            break;
+        case 'i':
+            interval_ms = strtoul(optarg, nullptr, 10);
+            if (interval_ms == 0) {
+                std::cout << "invalid interval: " << optarg << std::endl;
+                return -1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : -1;
+        }
+    }
+
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+    if (collector_address) {
+        return run_collector(collector_address, quiet);
+    }
+
+    MonitorInfoCollection::get_instance().set_task_net_enabled(task_net);
+    if (fd_type_breakdown && !fd_tier_ticks) fd_tier_ticks = TASK_FD_DEFAULT_TIER_TICKS;
+    if (sample_args[0]) {
+        MonitorInfoCollection::get_instance().set_task_sampler(sample_args[0], sample_args[1], sample_args[2],
+            interval_ms);
+    }
+    if (fd_tier_ticks) {
+        MonitorInfoCollection::get_instance().set_task_fd_tier(fd_tier_ticks, fd_type_breakdown);
+    }
     int res = MonitorInfoCollection::get_instance().initialize();
     if (res < 0) {
         FATAL_LOG("MonitorInfoCollection init failed");
+        return -1;
+    }
+    ShmSnapshotPublisher shm_publisher;
+    if (shm_name && shm_publisher.create(shm_name, SHM_SNAPSHOT_DEFAULT_MAX_CPUS,
+        SHM_SNAPSHOT_DEFAULT_MAX_TASKS) < 0) {
+        FATAL_LOG("create shm: %s failed", shm_name);
+        return -1;
+    }
+    if (rules_file && alert.load_rules(rules_file) < 0) {
+        FATAL_LOG("load alert rules: %s failed", rules_file);
+        return -1;
     }
-    for (;;) {
+    RemoteAgent agent;
+    if (agent_address && agent.initialize(agent_address, host_name) < 0) {
+        FATAL_LOG("initialize agent for: %s failed", agent_address);
+        return -1;
+    }
+    MonitorInfoPreprocess preprocess;
+    std::vector<const TaskDerivedInfo*> top_tasks;
+    std::vector<uint32_t> top_cpus;
+    std::vector<const ProcessInfo*> top_fd_tasks;
+    std::vector<const TaskGroup*> top_groups;
+    // 恢复了上一次的计数时第一次采集即为有效数据，否则先预热一次基线
+    bool restored = state_file && MonitorInfoCollection::get_instance().load_state(state_file) >= 0;
+    if (!restored && warmup_ms && MonitorInfoCollection::get_instance().prime(warmup_ms) < 0) {
+        FATAL_LOG("take baseline sample failed");
+        return -1;
+    }
+    while (!g_stop) {
         auto monitor_info = MonitorInfoCollection::get_instance().finish_once_monitor();
         if (monitor_info == nullptr) {
             std::cout << "finish once monitor failed" << std::endl;
             return -1;
         }
-        // std::cout << monitor_info->existing_cpus << std::endl;
-        // std::cout << monitor_info->sys_cpu_data[1]->total_period << std::endl;
-
-        // 输出 cpu 汇总值
-        double total_cpu = 1;
-        if (monitor_info->sys_cpu_data[0]->total_period != 0) {
-            total_cpu = monitor_info->sys_cpu_data[0]->total_period;
+        if (shm_name) {
+            shm_publisher.publish(*monitor_info);
         }
-        double cpu_percent = (total_cpu - monitor_info->sys_cpu_data[0]->idle_all_period) / total_cpu;
-        std::cout << "cpu total usage: " << cpu_percent << std::endl;
-
-        // 输出每个 pid 的监控
-        for (const auto& task_info : monitor_info->all_process_info) {
-            if (task_info->percent_cpu > 0.0001) {
-                std::cout << task_info->pid << ", cmdline: " << task_info->cmdline
-                    << ", cpu usage: " << task_info->percent_cpu
-                    << ", mem usage: " << task_info->percent_mem << std::endl;
+        if (agent_address) {
+            // 发送失败时下一个周期重连，不影响本地输出
+            agent.send_snapshot(*monitor_info);
+        }
+        alert.evaluate(*monitor_info);
+        preprocess.process(monitor_info);
+        MonitorInfoCollection::get_instance().set_consumer_memory(preprocess.memory_bytes());
+        if (!quiet) {
+            // 输出 cpu 汇总值
+            output_cpu_usage(std::cout, preprocess.sys_cpu_usage());
+            std::cout << "scan skew: " << monitor_info->scan_skew_ms << " ms" << std::endl;
+            output_energy(std::cout, monitor_info->energy_packages);
+            if (cpu_breakdown) {
+                output_cpu_breakdown(std::cout, monitor_info->sys_cpu_data);
+                monitor_info->sys_cpu_data.get_top_busy_cpus(TOP_BUSY_CPUS, &top_cpus);
+                output_top_busy_cpus(std::cout, monitor_info->sys_cpu_data, top_cpus);
+                output_cpu_frequency(std::cout, monitor_info->sys_cpu_data, monitor_info->cpu_idle_state_names);
+            }
+            // 按平滑后的 cpu 使用率输出每个 pid 的监控
+            preprocess.get_top_tasks_by_cpu(monitor_info->all_process_info.size(), &top_tasks);
+            for (const auto* derived : top_tasks) {
+                auto iter = monitor_info->all_process_info_table.find(derived->pid);
+                if (iter != monitor_info->all_process_info_table.end()) {
+                    const ProcessInfo& task = *iter->second;
+                    output_task_info(std::cout, task, monitor_info->string_arena->get(task.cmdline_id),
+                        monitor_info->string_arena->get(task.user_id),
+                        monitor_info->energy_packages.empty() ? -1 : task.energy_watts);
+                    output_task_perf(std::cout, task, monitor_info->perf_mode);
+                }
+            }
+            for (const auto& profile : monitor_info->task_samples) {
+                auto iter = monitor_info->all_process_info_table.find(profile.pid);
+                const char* cmdline = iter != monitor_info->all_process_info_table.end() ? (
+                    monitor_info->string_arena->get(iter->second->cmdline_id)) : "";
+                output_task_sample(std::cout, profile, cmdline);
+            }
+            if (task_limit) {
+                output_task_limit(std::cout, *monitor_info);
+            }
+            if (fd_tier_ticks) {
+                TaskFdCollection::get_top_tasks_by_fd_usage(*monitor_info, TOP_FD_TASKS, &top_fd_tasks);
+                output_top_fd_tasks(std::cout, *monitor_info, top_fd_tasks, fd_type_breakdown);
+            }
+            if (group_by_enabled) {
+                uint64_t start_ns = Util::get_monotonic_ns();
+                group_by.aggregate(*monitor_info);
+                group_by.get_top_groups(0, TASK_GROUP_AGG_SUM, TOP_GROUPS, &top_groups);
+                uint64_t elapsed_us = (Util::get_monotonic_ns() - start_ns) / 1000;
+                output_top_groups(std::cout, *monitor_info, group_by, top_groups, elapsed_us);
             }
         }
-        sleep(2);
+        usleep(interval_ms * 1000);
+    }
+    if (state_file) {
+        MonitorInfoCollection::get_instance().save_state(state_file);
     }
+    return 0;
 }
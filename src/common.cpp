@@ -6,8 +6,19 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <atomic>
+#include <mutex>
 #include "common.h"
 
+// 读取整个文件时缓冲区的初始大小
+#define READ_FILE_INIT_SIZE 4096
+
+// 进程内唯一的日志配置，所有编译单元共用
+static std::atomic<int> global_log_level{LOG_INFO_LEVEL};
+static std::mutex global_log_sink_mutex;
+static LogSink global_log_sink = nullptr;
+static void* global_log_sink_arg = nullptr;
+
 const char* get_log_level_str(LOG_LEVEL log_level) {
     switch (log_level) {
     case LOG_FATAL_LEVEL:
@@ -30,7 +41,6 @@ void Util::fatal_log(const char* fmt, ...) {
     va_start(ap, fmt);
     log_internal(LOG_FATAL_LEVEL, fmt, ap);
     va_end(ap);
-    exit(-1);
 }
 
 void Util::error_log(const char* fmt, ...) {
@@ -61,8 +71,22 @@ void Util::debug_log(const char* fmt, ...) {
     va_end(ap);
 }
 
+void Util::set_log_level(LOG_LEVEL level) {
+    global_log_level.store(level, std::memory_order_relaxed);
+}
+
+LOG_LEVEL Util::log_level() {
+    return static_cast<LOG_LEVEL>(global_log_level.load(std::memory_order_relaxed));
+}
+
+void Util::set_log_sink(LogSink sink, void* arg) {
+    std::lock_guard<std::mutex> lock(global_log_sink_mutex);
+    global_log_sink = sink;
+    global_log_sink_arg = arg;
+}
+
 void Util::log_internal(LOG_LEVEL log_level, const char* fmt, va_list ap) {
-    if (log_level > global_log_level) {
+    if (log_level > global_log_level.load(std::memory_order_relaxed)) {
         return;
     }
     char buf[1024];
@@ -73,6 +97,17 @@ void Util::log_internal(LOG_LEVEL log_level, const char* fmt, va_list ap) {
     } else {
         buf[0] = '\0';
     }
+    LogSink sink;
+    void* arg;
+    {
+        std::lock_guard<std::mutex> lock(global_log_sink_mutex);
+        sink = global_log_sink;
+        arg = global_log_sink_arg;
+    }
+    if (sink) {
+        sink(log_level, buf, arg);
+        return;
+    }
     fprintf(stdout, "[top-cpp %s] %s \n", get_log_level_str(log_level), buf);
 }
 
@@ -110,6 +145,37 @@ ssize_t Util::read_file(int dir_fd, const char* path_name, void* buffer, size_t
     }
 }
 
+ssize_t Util::read_file(int dir_fd, const char* path_name, std::string* buffer) {
+    int fd = openat(dir_fd, path_name, O_RDONLY);
+    if (fd < 0) {
+        return -errno;
+    }
+    if (buffer->size() < READ_FILE_INIT_SIZE) {
+        buffer->resize(READ_FILE_INIT_SIZE);
+    }
+    size_t already_read = 0;
+    for (;;) {
+        // 预留一个空字符
+        if (already_read + 1 >= buffer->size()) {
+            buffer->resize(buffer->size() * 2);
+        }
+        ssize_t res = read(fd, &(*buffer)[already_read], buffer->size() - already_read - 1);
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            return -errno;
+        }
+        if (res == 0) {
+            close(fd);
+            (*buffer)[already_read] = '\0';
+            return already_read;
+        }
+        already_read += res;
+    }
+}
+
 FILE* Util::fopenat(int perent_fd, const char* path_name, const char* mode) {
     int fd = openat(perent_fd, path_name, O_RDONLY);
     if (fd < 0) {
@@ -122,6 +188,12 @@ FILE* Util::fopenat(int perent_fd, const char* path_name, const char* mode) {
     return stream;
 }
 
+uint64_t Util::get_monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 int Util::get_real_time(struct timeval* tvp, uint64_t* msec) {
     struct timespec ts;
     if (clock_gettime(CLOCK_REALTIME, &ts) == 0) {
@@ -12,32 +12,24 @@
 #pragma once
 
 #include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
 #include <memory>
+#include <string>
+#include "top_cpp_log.h"
 
 // 获取两个数的最小值
 #define MINIMUM(a, b) ((a) < (b) ? (a) : (b))
 // 获取两个数的最大值
 #define MAXIMUM(a, b) ((a) > (b) ? (a) : (b))
 
-// 定义日志级别
-enum LOG_LEVEL {
-    LOG_FATAL_LEVEL = 0,
-    LOG_ERROR_LEVEL,
-    LOG_WARN_LEVEL,
-    LOG_INFO_LEVEL,
-    LOG_DEBUG_LEVEL,
-};
-
-// 封装日志宏
+// 封装日志宏，FATAL_LOG 只输出日志，不退出进程，由调用者返回错误
 #define FATAL_LOG(fmt, ...) Util::fatal_log(fmt, ##__VA_ARGS__)
 #define ERROR_LOG(fmt, ...) Util::error_log(fmt, ##__VA_ARGS__)
 #define WARN_LOG(fmt, ...) Util::warn_log(fmt, ##__VA_ARGS__)
 #define INFO_LOG(fmt, ...) Util::info_log(fmt, ##__VA_ARGS__)
 #define DEBUG_LOG(fmt, ...) Util::debug_log(fmt, ##__VA_ARGS__)
 
-static LOG_LEVEL global_log_level = LOG_INFO_LEVEL;
-
 /**
  * @brief 工具类，提供需要的工具函数
  * 
@@ -50,7 +42,48 @@ class Util {
     static void info_log(const char* fmt, ...);
     static void debug_log(const char* fmt, ...);
 
+    /**
+     * @brief 设置日志级别，高于该级别的日志不输出，默认为 LOG_INFO_LEVEL
+     * @note 进程内全局，对所有采集对象生效
+     */
+    static void set_log_level(LOG_LEVEL level);
+    static LOG_LEVEL log_level();
+    /**
+     * @brief 设置日志的输出回调
+     * @note sink 为 nullptr 时恢复默认，输出到 stdout
+     */
+    static void set_log_sink(LogSink sink, void* arg);
+
     static ssize_t read_file(int dir_fd, const char* path_name, void* buffer, size_t count);
+    /**
+     * @brief 读取整个文件，buffer 不够时自动扩容
+     * @note buffer 可以在多次调用之间复用，避免重复分配
+     */
+    static ssize_t read_file(int dir_fd, const char* path_name, std::string* buffer);
+    /**
+     * @brief 跳过空白字符并解析一个十进制无符号整数
+     * @note 用于代替 sscanf 解析 /proc 文件，location 会移动到数字之后
+     */
+    static inline uint64_t parse_uint64(char** location) {
+        char* p = *location;
+        while (*p == ' ' || *p == '\t') p++;
+        uint64_t value = 0;
+        while (*p >= '0' && *p <= '9') {
+            value = value * 10 + (*p - '0');
+            p++;
+        }
+        *location = p;
+        return value;
+    }
+    /**
+     * @brief 估算 unordered_map 占用的内存（字节）
+     * @note 按 libstdc++ 的实现估算：每个节点为 next 指针、键值对与缓存的哈希值，另有一个桶数组
+     */
+    template <typename Map>
+    static inline size_t hash_map_bytes(const Map& map) {
+        return map.size() * (sizeof(void*) + sizeof(typename Map::value_type) + sizeof(size_t))
+            + map.bucket_count() * sizeof(void*);
+    }
     static inline bool wrap_strncmp(const char* s, const char* match) {
         return strncmp(s, match, strlen(match)) == 0;
     }
@@ -58,6 +91,12 @@ class Util {
 
     static int get_real_time(struct timeval* tvp, uint64_t* msec);
 
+    /**
+     * @brief 获取单调时钟的当前时间（纳秒）
+     *
+     */
+    static uint64_t get_monotonic_ns();
+
  private:
     static void log_internal(LOG_LEVEL log_level, const char* fmt, va_list ap);
 };
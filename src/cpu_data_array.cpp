@@ -0,0 +1,321 @@
+#include <string.h>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_DATA_X86 1
+#endif
+#include "common.h"
+#include "cpu_data_array.h"
+
+// 百分比对应的时间
+static const CpuTimeField percent_time_fields[CPU_PERCENT_FIELDS - 1] = {
+    CPU_TIME_USER,
+    CPU_TIME_NICE,
+    CPU_TIME_SYSTEM,
+    CPU_TIME_IRQ,
+    CPU_TIME_SOFT_IRQ,
+    CPU_TIME_IO_WAIT,
+    CPU_TIME_STEAL,
+    CPU_TIME_GUEST,
+    CPU_TIME_IDLE_ALL,
+};
+
+/**
+ * @brief out[i] = a[i] > b[i] ? a[i] - b[i] : 0
+ * @note 计数器回退（例如 cpu 热插拔后重新计数）时周期时间为 0
+ */
+static void sub_clamp_scalar(const uint64_t* a, const uint64_t* b, uint64_t* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = a[i] > b[i] ? a[i] - b[i] : 0;
+    }
+}
+
+/**
+ * @brief out[i] = part[i] / total[i] * 100，total 为 0 时结果为 0
+ *
+ */
+static void percent_scalar(const uint64_t* part, const uint64_t* total, float* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = total[i] == 0 ? 0.0F : static_cast<float>(100.0 * part[i] / total[i]);
+    }
+}
+
+#ifdef CPU_DATA_X86
+// cpu 时间以 jiffies 为单位，远小于 2^63，可以直接使用有符号比较
+__attribute__((target("avx2")))
+static void sub_clamp_avx2(const uint64_t* a, const uint64_t* b, uint64_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i mask = _mm256_cmpgt_epi64(va, vb);
+        __m256i diff = _mm256_and_si256(_mm256_sub_epi64(va, vb), mask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), diff);
+    }
+    sub_clamp_scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("sse4.2")))
+static void sub_clamp_sse42(const uint64_t* a, const uint64_t* b, uint64_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        __m128i mask = _mm_cmpgt_epi64(va, vb);
+        __m128i diff = _mm_and_si128(_mm_sub_epi64(va, vb), mask);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), diff);
+    }
+    sub_clamp_scalar(a + i, b + i, out + i, n - i);
+}
+
+// uint64 转 double：小于 2^52 的整数放进尾数后减去 2^52。一个周期的时间远小于 2^52
+#define CPU_DATA_MAGIC_BITS 0x4330000000000000LL
+#define CPU_DATA_MAGIC_DOUBLE 4503599627370496.0
+
+__attribute__((target("avx2")))
+static void percent_avx2(const uint64_t* part, const uint64_t* total, float* out, size_t n) {
+    const __m256i magic_bits = _mm256_set1_epi64x(CPU_DATA_MAGIC_BITS);
+    const __m256d magic = _mm256_set1_pd(CPU_DATA_MAGIC_DOUBLE);
+    const __m256d hundred = _mm256_set1_pd(100.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d zero = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i vp = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(part + i));
+        __m256i vt = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(total + i));
+        __m256d dp = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(vp, magic_bits)), magic);
+        __m256d dt = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(vt, magic_bits)), magic);
+        // total 为 0 时除以 1，part 也一定为 0
+        __m256d valid = _mm256_cmp_pd(dt, zero, _CMP_GT_OQ);
+        dt = _mm256_blendv_pd(one, dt, valid);
+        __m256d result = _mm256_mul_pd(_mm256_div_pd(dp, dt), hundred);
+        _mm_storeu_ps(out + i, _mm256_cvtpd_ps(result));
+    }
+    percent_scalar(part + i, total + i, out + i, n - i);
+}
+
+static void percent_sse2(const uint64_t* part, const uint64_t* total, float* out, size_t n) {
+    const __m128i magic_bits = _mm_set1_epi64x(CPU_DATA_MAGIC_BITS);
+    const __m128d magic = _mm_set1_pd(CPU_DATA_MAGIC_DOUBLE);
+    const __m128d hundred = _mm_set1_pd(100.0);
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d zero = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i vp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(part + i));
+        __m128i vt = _mm_loadu_si128(reinterpret_cast<const __m128i*>(total + i));
+        __m128d dp = _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(vp, magic_bits)), magic);
+        __m128d dt = _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(vt, magic_bits)), magic);
+        __m128d valid = _mm_cmpgt_pd(dt, zero);
+        dt = _mm_or_pd(_mm_and_pd(valid, dt), _mm_andnot_pd(valid, one));
+        __m128d result = _mm_mul_pd(_mm_div_pd(dp, dt), hundred);
+        // 低 64 位为两个 float
+        _mm_storel_pi(reinterpret_cast<__m64*>(out + i), _mm_cvtpd_ps(result));
+    }
+    percent_scalar(part + i, total + i, out + i, n - i);
+}
+#endif
+
+typedef void (*SubClampFunc)(const uint64_t*, const uint64_t*, uint64_t*, size_t);
+typedef void (*PercentFunc)(const uint64_t*, const uint64_t*, float*, size_t);
+
+/**
+ * @brief 根据 cpu 支持的指令集选择实现，只在第一次调用时检测
+ *
+ */
+static SubClampFunc select_sub_clamp() {
+#ifdef CPU_DATA_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return sub_clamp_avx2;
+    if (__builtin_cpu_supports("sse4.2")) return sub_clamp_sse42;
+#endif
+    return sub_clamp_scalar;
+}
+
+static PercentFunc select_percent() {
+#ifdef CPU_DATA_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return percent_avx2;
+    return percent_sse2;
+#else
+    return percent_scalar;
+#endif
+}
+
+/**
+ * @brief 按新的列长度重新排列 fields 列数据，每列保留前 keep 个元素
+ *
+ */
+template <typename T>
+static void relayout_columns(std::vector<T>* columns, size_t fields, size_t old_stride, size_t new_stride,
+    size_t keep) {
+    std::vector<T> result(fields * new_stride, T());
+    for (size_t field = 0; field < fields; field++) {
+        for (size_t i = 0; i < keep; i++) {
+            result[field * new_stride + i] = (*columns)[field * old_stride + i];
+        }
+    }
+    columns->swap(result);
+}
+
+/**
+ * @brief 清空每列下标 from 之后的元素
+ *
+ */
+template <typename T>
+static void clear_columns(std::vector<T>* columns, size_t fields, size_t stride, size_t from) {
+    for (size_t field = 0; field < fields; field++) {
+        for (size_t i = from; i < stride; i++) {
+            (*columns)[field * stride + i] = T();
+        }
+    }
+}
+
+void CpuDataArray::resize(size_t size) {
+    if (size == size_) return;
+    uint32_t stride = (size + CPU_DATA_ALIGN - 1) / CPU_DATA_ALIGN * CPU_DATA_ALIGN;
+    size_t keep = MINIMUM(size, size_);
+    if (stride != stride_) {
+        // 按新的列长度重新排列，保留已有 cpu 的数据
+        relayout_columns(&times_, CPU_TIME_FIELDS, stride_, stride, keep);
+        relayout_columns(&periods_, CPU_TIME_FIELDS, stride_, stride, keep);
+        relayout_columns(&percents_, CPU_PERCENT_FIELDS, stride_, stride, keep);
+        relayout_columns(&counters_, CPU_COUNTER_FIELDS, stride_, stride, keep);
+        relayout_columns(&counter_periods_, CPU_COUNTER_FIELDS, stride_, stride, keep);
+        relayout_columns(&idle_residency_, CPU_IDLE_MAX_STATES, stride_, stride, keep);
+        relayout_columns(&freq_khz_, 1, stride_, stride, keep);
+        relayout_columns(&max_freq_khz_, 1, stride_, stride, keep);
+        relayout_columns(&normalized_busy_, 1, stride_, stride, keep);
+        next_times_.assign(CPU_TIME_FIELDS * stride, 0);
+        next_counters_.assign(CPU_COUNTER_FIELDS * stride, 0);
+        busy_periods_.assign(stride, 0);
+        stride_ = stride;
+    } else {
+        // 列长度不变，清空被截断或新增的 cpu
+        clear_columns(&times_, CPU_TIME_FIELDS, stride_, keep);
+        clear_columns(&periods_, CPU_TIME_FIELDS, stride_, keep);
+        clear_columns(&percents_, CPU_PERCENT_FIELDS, stride_, keep);
+        clear_columns(&counters_, CPU_COUNTER_FIELDS, stride_, keep);
+        clear_columns(&counter_periods_, CPU_COUNTER_FIELDS, stride_, keep);
+        clear_columns(&idle_residency_, CPU_IDLE_MAX_STATES, stride_, keep);
+        clear_columns(&freq_khz_, 1, stride_, keep);
+        clear_columns(&max_freq_khz_, 1, stride_, keep);
+        clear_columns(&normalized_busy_, 1, stride_, keep);
+    }
+    on_line_.resize(size, 0);
+    size_ = size;
+}
+
+void CpuDataArray::begin_update() {
+    memcpy(next_times_.data(), times_.data(), sizeof(uint64_t) * times_.size());
+}
+
+void CpuDataArray::finish_update() {
+    static const SubClampFunc sub_clamp = select_sub_clamp();
+    static const PercentFunc percent = select_percent();
+    if (size_ == 0) return;
+    // 所有种类的时间连续存放，一次计算完所有 cpu 的周期时间
+    sub_clamp(next_times_.data(), times_.data(), periods_.data(), times_.size());
+    times_.swap(next_times_);
+
+    const uint64_t* total = &periods_[CPU_TIME_TOTAL * stride_];
+    for (int field = 0; field < CPU_PERCENT_FIELDS - 1; field++) {
+        percent(&periods_[percent_time_fields[field] * stride_], total,
+            &percents_[field * stride_], stride_);
+    }
+    sub_clamp(total, &periods_[CPU_TIME_IDLE_ALL * stride_], busy_periods_.data(), stride_);
+    percent(busy_periods_.data(), total, &percents_[CPU_PERCENT_BUSY * stride_], stride_);
+}
+
+void CpuDataArray::begin_freq_update() {
+    memcpy(next_counters_.data(), counters_.data(), sizeof(uint64_t) * counters_.size());
+}
+
+void CpuDataArray::finish_freq_update(size_t idle_state_count, uint64_t interval_us) {
+    static const SubClampFunc sub_clamp = select_sub_clamp();
+    if (size_ == 0) return;
+    idle_state_count_ = MINIMUM(idle_state_count, static_cast<size_t>(CPU_IDLE_MAX_STATES));
+    // 与 cpu 时间一样，所有计数连续存放，一次计算完所有周期差值
+    sub_clamp(next_counters_.data(), counters_.data(), counter_periods_.data(), counters_.size());
+    counters_.swap(next_counters_);
+    // 第一次更新没有上一次的计数
+    if (interval_us == 0) {
+        memset(counter_periods_.data(), 0, sizeof(uint64_t) * counter_periods_.size());
+    }
+
+    // 下标 0 为所有 cpu 之和；同一个 package 的 cpu 读到的是同一个计数，取最大值
+    for (int field = 0; field < CPU_COUNTER_FIELDS; field++) {
+        uint64_t* periods = &counter_periods_[field * stride_];
+        uint64_t* values = &counters_[field * stride_];
+        periods[0] = 0;
+        values[0] = 0;
+        for (size_t i = 1; i < size_; i++) {
+            if (field == CPU_COUNTER_PACKAGE_THROTTLE) {
+                periods[0] = MAXIMUM(periods[0], periods[i]);
+                values[0] = MAXIMUM(values[0], values[i]);
+            } else {
+                periods[0] += periods[i];
+                values[0] += values[i];
+            }
+        }
+    }
+    for (size_t state = 0; state < idle_state_count_; state++) {
+        const uint64_t* periods = &counter_periods_[(CPU_COUNTER_IDLE_STATE + state) * stride_];
+        float* residency = &idle_residency_[state * stride_];
+        for (size_t i = 1; i < size_; i++) {
+            residency[i] = interval_us ? MINIMUM(100.0F, static_cast<float>(100.0 * periods[i] / interval_us)) : 0.0F;
+        }
+        residency[0] = 0.0F;
+        size_t online = 0;
+        for (size_t i = 1; i < size_; i++) {
+            if (!on_line_[i]) continue;
+            residency[0] += residency[i];
+            online++;
+        }
+        if (online) residency[0] /= online;
+    }
+
+    // 归一化的使用率按周期时间加权汇总，频率为在线 cpu 的平均值
+    const float* busy = percents(CPU_PERCENT_BUSY);
+    const uint64_t* total = &periods_[CPU_TIME_TOTAL * stride_];
+    has_frequency_ = false;
+    double weighted_busy = 0, weight = 0;
+    uint64_t freq_sum = 0, max_freq_sum = 0;
+    size_t freq_cpus = 0;
+    for (size_t i = 1; i < size_; i++) {
+        double ratio = 1.0;
+        if (max_freq_khz_[i] && freq_khz_[i]) {
+            ratio = MINIMUM(1.0, static_cast<double>(freq_khz_[i]) / max_freq_khz_[i]);
+            has_frequency_ = true;
+            if (on_line_[i]) {
+                freq_sum += freq_khz_[i];
+                max_freq_sum += max_freq_khz_[i];
+                freq_cpus++;
+            }
+        }
+        normalized_busy_[i] = busy[i] * ratio;
+        weighted_busy += normalized_busy_[i] * total[i];
+        weight += total[i];
+    }
+    normalized_busy_[0] = weight > 0 ? weighted_busy / weight : busy[0];
+    freq_khz_[0] = freq_cpus ? freq_sum / freq_cpus : 0;
+    max_freq_khz_[0] = freq_cpus ? max_freq_sum / freq_cpus : 0;
+}
+
+void CpuDataArray::get_top_busy_cpus(size_t n, std::vector<uint32_t>* result) const {
+    result->clear();
+    const float* busy = percents(CPU_PERCENT_BUSY);
+    for (size_t i = 1; i < size_; i++) {
+        if (on_line_[i]) result->push_back(i - 1);
+    }
+    auto compare = [busy](uint32_t a, uint32_t b) {
+        if (busy[a + 1] != busy[b + 1]) return busy[a + 1] > busy[b + 1];
+        return a < b;
+    };
+    if (n < result->size()) {
+        std::partial_sort(result->begin(), result->begin() + n, result->end(), compare);
+        result->resize(n);
+    } else {
+        std::sort(result->begin(), result->end(), compare);
+    }
+}
@@ -0,0 +1,245 @@
+/**
+ * @file cpu_data_array.h
+ * @author zhangyi
+ * @brief 按列存储的所有 cpu 的时间数据
+ * @version 0.1
+ * @date 2022-12-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// 每列的长度按 8 个元素对齐，向量化时不需要处理尾部
+#define CPU_DATA_ALIGN 8
+
+/**
+ * @brief cpu 时间的种类，来自 /proc/stat
+ *
+ */
+enum CpuTimeField {
+    CPU_TIME_USER = 0,    // 不包括 guest
+    CPU_TIME_NICE,        // 不包括 guest_nice
+    CPU_TIME_SYSTEM,
+    CPU_TIME_SYSTEM_ALL,  // system + irq + softirq
+    CPU_TIME_IDLE_ALL,    // idle + iowait
+    CPU_TIME_IDLE,
+    CPU_TIME_IO_WAIT,
+    CPU_TIME_IRQ,
+    CPU_TIME_SOFT_IRQ,
+    CPU_TIME_STEAL,
+    CPU_TIME_GUEST,       // guest + guest_nice
+    CPU_TIME_TOTAL,
+    CPU_TIME_FIELDS,
+};
+
+/**
+ * @brief 一个周期内各部分时间占总时间的比例
+ *
+ */
+enum CpuPercentField {
+    CPU_PERCENT_USER = 0,
+    CPU_PERCENT_NICE,
+    CPU_PERCENT_SYSTEM,
+    CPU_PERCENT_IRQ,
+    CPU_PERCENT_SOFT_IRQ,
+    CPU_PERCENT_IO_WAIT,
+    CPU_PERCENT_STEAL,
+    CPU_PERCENT_GUEST,
+    CPU_PERCENT_IDLE,     // idle + iowait
+    CPU_PERCENT_BUSY,     // 100 - CPU_PERCENT_IDLE
+    CPU_PERCENT_FIELDS,
+};
+
+// cpuidle 最多统计的状态个数
+#define CPU_IDLE_MAX_STATES 8
+
+/**
+ * @brief 来自 sysfs 的累计计数，与 cpu 时间一样按列存储并批量计算周期差值
+ *
+ */
+enum CpuCounterField {
+    CPU_COUNTER_IDLE_STATE = 0,  // cpuidle/state<i>/time（微秒），共 CPU_IDLE_MAX_STATES 列
+    CPU_COUNTER_CORE_THROTTLE = CPU_IDLE_MAX_STATES,  // thermal_throttle/core_throttle_count
+    CPU_COUNTER_PACKAGE_THROTTLE,                      // thermal_throttle/package_throttle_count
+    CPU_COUNTER_FIELDS,
+};
+
+/**
+ * @brief 所有 cpu 的时间数据（structure of arrays）
+ * @note 下标 0 为所有 cpu 的汇总，下标 i 为 cpu i-1。
+ *       同一种时间的所有 cpu 连续存放，计算周期差值与百分比时对整列做向量化运算，
+ *       运行时根据 cpu 支持的指令集选择 AVX2、SSE4.2 或标量实现
+ */
+class CpuDataArray {
+ public:
+    inline size_t size() const {
+        return size_;
+    }
+
+    inline bool empty() const {
+        return size_ == 0;
+    }
+
+    /**
+     * @brief 调整 cpu 个数，已有 cpu 的数据保持不变
+     *
+     */
+    void resize(size_t size);
+
+    // 累计时间
+    inline uint64_t time(CpuTimeField field, size_t index) const {
+        return times_[field * stride_ + index];
+    }
+
+    // 上一个周期的时间
+    inline uint64_t period(CpuTimeField field, size_t index) const {
+        return periods_[field * stride_ + index];
+    }
+
+    // 上一个周期的百分比，范围为 [0, 100]
+    inline float percent(CpuPercentField field, size_t index) const {
+        return percents_[field * stride_ + index];
+    }
+
+    // 一种百分比的整列数据，长度为 size()
+    inline const float* percents(CpuPercentField field) const {
+        return &percents_[field * stride_];
+    }
+
+    inline bool on_line(size_t index) const {
+        return on_line_[index] != 0;
+    }
+
+    inline void set_on_line(size_t index, bool on_line) {
+        on_line_[index] = on_line ? 1 : 0;
+    }
+
+    /**
+     * @brief 开始一次更新，之后通过 next_time 写入本次读到的累计时间
+     * @note 本次没有读到的 cpu（例如已下线）沿用上一次的值，周期时间为 0
+     */
+    void begin_update();
+
+    /**
+     * @brief 直接设置上一次的累计时间，用于从状态文件恢复基线
+     *
+     */
+    inline void restore_time(CpuTimeField field, size_t index, uint64_t value) {
+        times_[field * stride_ + index] = value;
+    }
+
+    inline void set_next_time(CpuTimeField field, size_t index, uint64_t value) {
+        next_times_[field * stride_ + index] = value;
+    }
+
+    /**
+     * @brief 批量计算所有 cpu 的周期时间与百分比
+     *
+     */
+    void finish_update();
+
+    /**
+     * @brief 获取最繁忙的 cpu
+     *
+     * @param n 最多返回的个数
+     * @param result 输出参数，cpu 编号（不是下标），按 CPU_PERCENT_BUSY 从大到小排序，不包括下线的 cpu
+     */
+    void get_top_busy_cpus(size_t n, std::vector<uint32_t>* result) const;
+
+    /* ---------- 频率、idle 状态与温控降频，来自 sysfs，没有对应节点时为 0 -------------- */
+    // 是否读到了任意 cpu 的频率
+    inline bool has_frequency() const {
+        return has_frequency_;
+    }
+
+    // cpuidle 的状态个数，为 0 表示没有 cpuidle
+    inline size_t idle_state_count() const {
+        return idle_state_count_;
+    }
+
+    // 当前频率与最大频率（kHz），下标 0 为在线 cpu 的平均值
+    inline uint64_t frequency_khz(size_t index) const {
+        return freq_khz_[index];
+    }
+
+    inline uint64_t max_frequency_khz(size_t index) const {
+        return max_freq_khz_[index];
+    }
+
+    /**
+     * @brief 按频率归一化的使用率（百分比）：busy × 当前频率 / 最大频率
+     * @note 当前频率为采集时刻的瞬时值，没有频率的 cpu 等于 CPU_PERCENT_BUSY；
+     *       下标 0 为按周期时间加权的平均值
+     */
+    inline float normalized_busy(size_t index) const {
+        return normalized_busy_[index];
+    }
+
+    // 累计计数与上一个周期的差值，下标 0 为所有 cpu 之和（package 级别的计数为最大值）
+    inline uint64_t counter(CpuCounterField field, size_t index) const {
+        return counters_[field * stride_ + index];
+    }
+
+    inline uint64_t counter_period(CpuCounterField field, size_t index) const {
+        return counter_periods_[field * stride_ + index];
+    }
+
+    inline uint64_t idle_state_period_us(size_t state, size_t index) const {
+        return counter_periods_[(CPU_COUNTER_IDLE_STATE + state) * stride_ + index];
+    }
+
+    // 上一个周期中处于 idle 状态 state 的时间占比（百分比）
+    inline float idle_state_residency(size_t state, size_t index) const {
+        return idle_residency_[state * stride_ + index];
+    }
+
+    /**
+     * @brief 开始一次 sysfs 数据的更新，没有读到的计数沿用上一次的值
+     *
+     */
+    void begin_freq_update();
+
+    inline void set_frequency(size_t index, uint64_t freq_khz, uint64_t max_freq_khz) {
+        freq_khz_[index] = freq_khz;
+        max_freq_khz_[index] = max_freq_khz;
+    }
+
+    inline void set_next_counter(CpuCounterField field, size_t index, uint64_t value) {
+        next_counters_[field * stride_ + index] = value;
+    }
+
+    /**
+     * @brief 计算计数的周期差值、idle 状态的占比与按频率归一化的使用率
+     * @note 需要在 finish_update 之后调用
+     * @param idle_state_count cpuidle 的状态个数
+     * @param interval_us 距离上一次更新的时间
+     */
+    void finish_freq_update(size_t idle_state_count, uint64_t interval_us);
+
+ private:
+    uint32_t size_ = 0;
+    uint32_t stride_ = 0;
+    std::vector<uint64_t> times_;
+    std::vector<uint64_t> next_times_;
+    std::vector<uint64_t> periods_;
+    // total - idle_all 的周期时间，计算 CPU_PERCENT_BUSY 用
+    std::vector<uint64_t> busy_periods_;
+    std::vector<float> percents_;
+    std::vector<uint8_t> on_line_;
+
+    bool has_frequency_ = false;
+    size_t idle_state_count_ = 0;
+    std::vector<uint64_t> freq_khz_;
+    std::vector<uint64_t> max_freq_khz_;
+    std::vector<float> normalized_busy_;
+    std::vector<uint64_t> counters_;
+    std::vector<uint64_t> next_counters_;
+    std::vector<uint64_t> counter_periods_;
+    std::vector<float> idle_residency_;
+};
@@ -0,0 +1,143 @@
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "common.h"
+#include "cpu_freq_collect.h"
+
+CpuFreqCollection::~CpuFreqCollection() {
+    close_files();
+}
+
+void CpuFreqCollection::set_sys_root(const char* root) {
+    cpu_dir_ = std::string(root) + "/devices/system/cpu";
+}
+
+void CpuFreqCollection::close_files() {
+    auto close_file = [](CachedFile* file) {
+        if (file->fd >= 0) close(file->fd);
+        file->fd = -1;
+        file->path.clear();
+    };
+    for (CpuFiles& files : cpu_files_) {
+        close_file(&files.cur_freq);
+        for (CachedFile& file : files.idle_times) close_file(&file);
+        close_file(&files.core_throttle);
+        close_file(&files.package_throttle);
+    }
+    cpu_files_.clear();
+    cached_fds_ = 0;
+}
+
+void CpuFreqCollection::add_file(const std::string& path, CachedFile* file) {
+    if (access(path.c_str(), R_OK) != 0) return;
+    file->path = path;
+    if (cached_fds_ >= CPU_FREQ_MAX_CACHED_FDS) return;
+    file->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file->fd >= 0) cached_fds_++;
+}
+
+int CpuFreqCollection::read_value(const CachedFile& file, uint64_t* value) {
+    if (file.path.empty()) return -1;
+    char buf[32];
+    ssize_t res;
+    if (file.fd >= 0) {
+        // sysfs 的属性文件每次 pread 偏移 0 都会重新生成内容
+        res = pread(file.fd, buf, sizeof(buf) - 1, 0);
+        if (res >= 0) buf[res] = '\0';
+    } else {
+        res = Util::read_file(AT_FDCWD, file.path.c_str(), buf, sizeof(buf));
+    }
+    if (res <= 0) return -1;
+    char* location = buf;
+    *value = Util::parse_uint64(&location);
+    return 0;
+}
+
+int CpuFreqCollection::open_files(size_t cpu_count) {
+    close_files();
+    idle_state_names_.clear();
+    // 所有 cpu 的 idle 状态相同，以 cpu0 为准
+    char name[64];
+    for (size_t state = 0; state < CPU_IDLE_MAX_STATES; state++) {
+        std::string path = cpu_dir_ + "/cpu0/cpuidle/state" + std::to_string(state) + "/name";
+        ssize_t res = Util::read_file(AT_FDCWD, path.c_str(), name, sizeof(name));
+        if (res <= 0) break;
+        if (name[res - 1] == '\n') name[res - 1] = '\0';
+        idle_state_names_.push_back(name);
+    }
+    idle_state_count_ = idle_state_names_.size();
+
+    int found = 0;
+    cpu_files_.resize(cpu_count);
+    for (size_t cpu = 0; cpu < cpu_count; cpu++) {
+        CpuFiles& files = cpu_files_[cpu];
+        std::string cpu_path = cpu_dir_ + "/cpu" + std::to_string(cpu);
+        add_file(cpu_path + "/cpufreq/scaling_cur_freq", &files.cur_freq);
+        // 最大频率不会变化，只读取一次；优先使用硬件上限
+        CachedFile max_freq;
+        max_freq.path = cpu_path + "/cpufreq/cpuinfo_max_freq";
+        if (read_value(max_freq, &files.max_freq_khz) < 0) {
+            max_freq.path = cpu_path + "/cpufreq/scaling_max_freq";
+            if (read_value(max_freq, &files.max_freq_khz) < 0) files.max_freq_khz = 0;
+        }
+        for (size_t state = 0; state < idle_state_count_; state++) {
+            add_file(cpu_path + "/cpuidle/state" + std::to_string(state) + "/time", &files.idle_times[state]);
+        }
+        add_file(cpu_path + "/thermal_throttle/core_throttle_count", &files.core_throttle);
+        add_file(cpu_path + "/thermal_throttle/package_throttle_count", &files.package_throttle);
+
+        found += !files.cur_freq.path.empty() + !files.core_throttle.path.empty()
+            + !files.package_throttle.path.empty();
+        for (size_t state = 0; state < idle_state_count_; state++) {
+            found += !files.idle_times[state].path.empty();
+        }
+    }
+    cpu_count_ = cpu_count;
+    return found;
+}
+
+int CpuFreqCollection::collect(CpuDataArray* cpu_data) {
+    if (disabled_ || cpu_data->size() <= 1) return -1;
+    size_t cpu_count = cpu_data->size() - 1;
+    if (cpu_count != cpu_count_) {
+        if (open_files(cpu_count) == 0) {
+            INFO_LOG("no cpufreq, cpuidle or thermal_throttle under %s, frequency collection disabled",
+                cpu_dir_.c_str());
+            close_files();
+            disabled_ = true;
+            return -1;
+        }
+        INFO_LOG("cpu frequency collection enabled, cpus: %zu, idle states: %zu, cached fds: %zu",
+            cpu_count, idle_state_count_, cached_fds_);
+        // 文件重新打开后第一次的周期差值没有意义
+        last_time_ns_ = 0;
+    }
+
+    uint64_t now_ns = Util::get_monotonic_ns();
+    uint64_t interval_us = last_time_ns_ ? (now_ns - last_time_ns_) / 1000 : 0;
+    last_time_ns_ = now_ns;
+    cpu_data->begin_freq_update();
+    for (size_t cpu = 0; cpu < cpu_count; cpu++) {
+        const CpuFiles& files = cpu_files_[cpu];
+        size_t index = cpu + 1;
+        uint64_t value = 0;
+        // 离线 cpu 的 cpufreq 节点不可读，频率记为 0
+        if (read_value(files.cur_freq, &value) < 0) value = 0;
+        cpu_data->set_frequency(index, value, files.max_freq_khz);
+        for (size_t state = 0; state < idle_state_count_; state++) {
+            if (read_value(files.idle_times[state], &value) == 0) {
+                cpu_data->set_next_counter(static_cast<CpuCounterField>(CPU_COUNTER_IDLE_STATE + state), index, value);
+            }
+        }
+        if (read_value(files.core_throttle, &value) == 0) {
+            cpu_data->set_next_counter(CPU_COUNTER_CORE_THROTTLE, index, value);
+        }
+        if (read_value(files.package_throttle, &value) == 0) {
+            cpu_data->set_next_counter(CPU_COUNTER_PACKAGE_THROTTLE, index, value);
+        }
+    }
+    cpu_data->finish_freq_update(idle_state_count_, interval_us);
+    return 0;
+}
@@ -0,0 +1,97 @@
+/**
+ * @file cpu_freq_collect.h
+ * @author zhangyi
+ * @brief cpu 频率、idle 状态与温控降频的收集（sysfs）
+ * @version 0.1
+ * @date 2023-01-05
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "cpu_data_array.h"
+
+// sysfs 的默认挂载点
+#define SYSFS_ROOT_DIR "/sys"
+// 最多缓存的文件 fd 个数，超出后的文件每次重新打开
+#define CPU_FREQ_MAX_CACHED_FDS 1024
+
+/**
+ * @brief 读取每个 cpu 的 cpufreq、cpuidle 与 thermal_throttle 节点
+ * @note 文件在 cpu 个数变化时打开一次并缓存 fd，之后每次采集只调用 pread。
+ *       虚拟机、容器中通常没有这些节点，此时只在第一次记录日志，之后不再尝试
+ */
+class CpuFreqCollection {
+ public:
+    CpuFreqCollection() = default;
+    ~CpuFreqCollection();
+    CpuFreqCollection(const CpuFreqCollection&) = delete;
+    CpuFreqCollection& operator=(const CpuFreqCollection&) = delete;
+
+    /**
+     * @brief 设置 sysfs 的根目录，用于容器中挂载到其他位置的 sysfs
+     * @note 需要在第一次 collect 之前调用
+     */
+    void set_sys_root(const char* root);
+
+    /**
+     * @brief 完成一次采集，结果保存在 cpu_data 中
+     * @note 需要在 cpu_data.finish_update 之后调用
+     * @return int 小于 0 表示没有任何可用的节点
+     */
+    int collect(CpuDataArray* cpu_data);
+
+    /**
+     * @brief cpuidle 的状态名，下标与 idle_state_residency 的 state 对应
+     * @note 只在 cpu 个数变化、重新打开文件时改变
+     */
+    inline const std::vector<std::string>& idle_state_names() const {
+        return idle_state_names_;
+    }
+
+ private:
+    // 一个 sysfs 文件，fd 为 -1 时通过路径读取
+    struct CachedFile {
+        int fd = -1;
+        std::string path;
+    };
+
+    // 一个 cpu 的所有文件，不存在的文件路径为空
+    struct CpuFiles {
+        CachedFile cur_freq;
+        uint64_t max_freq_khz = 0;
+        CachedFile idle_times[CPU_IDLE_MAX_STATES];
+        CachedFile core_throttle;
+        CachedFile package_throttle;
+    };
+
+    /**
+     * @brief 按 cpu 个数重新打开所有文件
+     *
+     * @return int 找到的文件个数
+     */
+    int open_files(size_t cpu_count);
+    void close_files();
+    void add_file(const std::string& path, CachedFile* file);
+    /**
+     * @brief 读取一个只有一个整数的文件
+     *
+     * @return int 小于 0 表示读取失败
+     */
+    int read_value(const CachedFile& file, uint64_t* value);
+
+ private:
+    std::string cpu_dir_ = SYSFS_ROOT_DIR "/devices/system/cpu";
+    bool disabled_ = false;
+    size_t cpu_count_ = 0;
+    size_t idle_state_count_ = 0;
+    std::vector<std::string> idle_state_names_;
+    std::vector<CpuFiles> cpu_files_;
+    size_t cached_fds_ = 0;
+    uint64_t last_time_ns_ = 0;
+};
@@ -0,0 +1,257 @@
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <algorithm>
+#include "common.h"
+#include "energy_collect.h"
+
+EnergyCollection::~EnergyCollection() {
+    close_domains();
+}
+
+void EnergyCollection::set_sys_root(const char* root) {
+    powercap_dir_ = std::string(root) + "/class/powercap";
+    cpu_dir_ = std::string(root) + "/devices/system/cpu";
+}
+
+void EnergyCollection::close_domains() {
+    for (DomainFile& file : domains_) {
+        if (file.fd >= 0) close(file.fd);
+    }
+    domains_.clear();
+    cpu_packages_.clear();
+    cpu_count_ = 0;
+}
+
+int EnergyCollection::parse_domain_name(const char* name, bool top_level, uint32_t* package_id,
+    EnergyDomain* domain) {
+    if (top_level) {
+        // 多 die 的 package 名字为 "package-N-die-M"，按 package 汇总
+        if (sscanf(name, "package-%u", package_id) != 1) return -1;
+        *domain = ENERGY_DOMAIN_PACKAGE;
+        return 0;
+    }
+    if (strcmp(name, "core") == 0) {
+        *domain = ENERGY_DOMAIN_CORE;
+    } else if (strcmp(name, "uncore") == 0) {
+        *domain = ENERGY_DOMAIN_UNCORE;
+    } else if (strcmp(name, "dram") == 0) {
+        *domain = ENERGY_DOMAIN_DRAM;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+size_t EnergyCollection::find_package(uint32_t package_id, std::vector<EnergyPackageData>* packages) {
+    for (size_t i = 0; i < packages->size(); i++) {
+        if ((*packages)[i].package_id == package_id) return i;
+    }
+    packages->emplace_back();
+    EnergyPackageData& package = packages->back();
+    memset(&package, 0, sizeof(package));
+    package.package_id = package_id;
+    return packages->size() - 1;
+}
+
+int EnergyCollection::add_domain(const std::string& dir, size_t package_index, EnergyDomain domain) {
+    DomainFile file;
+    file.path = dir + "/energy_uj";
+    // 较新的内核中 energy_uj 只有 root 可读
+    if (access(file.path.c_str(), R_OK) != 0) return -1;
+    file.fd = open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+    file.package_index = package_index;
+    file.domain = domain;
+    // 计数范围不会变化，只读取一次；读取失败时无法处理回绕，计数变小时增量记为 0
+    char buf[32];
+    std::string range_path = dir + "/max_energy_range_uj";
+    if (Util::read_file(AT_FDCWD, range_path.c_str(), buf, sizeof(buf)) > 0) {
+        char* location = buf;
+        file.max_range_uj = Util::parse_uint64(&location);
+    }
+    domains_.push_back(file);
+    return 0;
+}
+
+int EnergyCollection::read_energy(const DomainFile& file, uint64_t* value) const {
+    char buf[32];
+    ssize_t res;
+    if (file.fd >= 0) {
+        // sysfs 的属性文件每次 pread 偏移 0 都会重新生成内容
+        res = pread(file.fd, buf, sizeof(buf) - 1, 0);
+        if (res >= 0) buf[res] = '\0';
+    } else {
+        res = Util::read_file(AT_FDCWD, file.path.c_str(), buf, sizeof(buf));
+    }
+    if (res <= 0) return -1;
+    char* location = buf;
+    *value = Util::parse_uint64(&location);
+    return 0;
+}
+
+int EnergyCollection::open_domains(size_t cpu_count, std::vector<EnergyPackageData>* packages) {
+    close_domains();
+    packages->clear();
+    DIR* dir = opendir(powercap_dir_.c_str());
+    if (!dir) return 0;
+    std::vector<std::string> names;
+    const struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (Util::wrap_strncmp(entry->d_name, ENERGY_RAPL_PREFIX)) names.push_back(entry->d_name);
+    }
+    closedir(dir);
+    // 顶层的域排在子域之前，子域需要先知道所属 package
+    std::sort(names.begin(), names.end(), [](const std::string& a, const std::string& b) {
+        size_t a_levels = std::count(a.begin(), a.end(), ':');
+        size_t b_levels = std::count(b.begin(), b.end(), ':');
+        return a_levels != b_levels ? a_levels < b_levels : a < b;
+    });
+
+    // 顶层域的编号（intel-rapl:N 中的 N）到 package 下标的映射，-1 表示不关心的域
+    std::vector<std::pair<uint32_t, int32_t>> top_domains;
+    char name[64];
+    for (const std::string& domain_name : names) {
+        const char* location = domain_name.c_str() + strlen(ENERGY_RAPL_PREFIX);
+        char* end;
+        uint32_t top_index = strtoul(location, &end, 10);
+        if (end == location) continue;
+        bool top_level = *end == '\0';
+        std::string domain_dir = powercap_dir_ + "/" + domain_name;
+        std::string name_path = domain_dir + "/name";
+        ssize_t res = Util::read_file(AT_FDCWD, name_path.c_str(), name, sizeof(name));
+        if (res <= 0) continue;
+        if (name[res - 1] == '\n') name[res - 1] = '\0';
+        uint32_t package_id = 0;
+        EnergyDomain domain;
+        if (parse_domain_name(name, top_level, &package_id, &domain) < 0) {
+            if (top_level) top_domains.emplace_back(top_index, -1);
+            continue;
+        }
+        int32_t package_index = -1;
+        if (top_level) {
+            package_index = find_package(package_id, packages);
+            top_domains.emplace_back(top_index, package_index);
+        } else {
+            for (const auto& top : top_domains) {
+                if (top.first == top_index) package_index = top.second;
+            }
+        }
+        if (package_index < 0) continue;
+        if (add_domain(domain_dir, package_index, domain) == 0) {
+            (*packages)[package_index].has_domain[domain] = true;
+        }
+    }
+    // 没有任何可读的域时不需要读取拓扑
+    if (domains_.empty()) {
+        packages->clear();
+        return 0;
+    }
+
+    cpu_packages_.assign(cpu_count, -1);
+    char buf[32];
+    for (size_t cpu = 0; cpu < cpu_count; cpu++) {
+        std::string path = cpu_dir_ + "/cpu" + std::to_string(cpu) + "/topology/physical_package_id";
+        uint32_t package_id = 0;
+        // 没有拓扑信息（例如部分虚拟机）时只有一个 package
+        if (Util::read_file(AT_FDCWD, path.c_str(), buf, sizeof(buf)) > 0) {
+            char* location = buf;
+            package_id = Util::parse_uint64(&location);
+        }
+        for (size_t i = 0; i < packages->size(); i++) {
+            if ((*packages)[i].package_id == package_id) cpu_packages_[cpu] = i;
+        }
+    }
+    cpu_count_ = cpu_count;
+    return domains_.size();
+}
+
+int EnergyCollection::collect(const CpuDataArray& cpu_data, std::vector<EnergyPackageData>* packages) {
+    if (disabled_ || cpu_data.size() <= 1) return -1;
+    size_t cpu_count = cpu_data.size() - 1;
+    if (cpu_count != cpu_count_) {
+        if (open_domains(cpu_count, packages) == 0) {
+            INFO_LOG("no readable RAPL domain under %s, energy collection disabled", powercap_dir_.c_str());
+            close_domains();
+            packages->clear();
+            disabled_ = true;
+            return -1;
+        }
+        INFO_LOG("energy collection enabled, packages: %zu, domains: %zu", packages->size(), domains_.size());
+        // 重新打开后第一次没有上一次的计数
+        last_time_ns_ = 0;
+    }
+
+    uint64_t now_ns = Util::get_monotonic_ns();
+    uint64_t interval_us = last_time_ns_ ? (now_ns - last_time_ns_) / 1000 : 0;
+    last_time_ns_ = now_ns;
+    for (EnergyPackageData& package : *packages) {
+        memset(package.watts, 0, sizeof(package.watts));
+        package.busy_cpus = 0;
+    }
+    for (DomainFile& file : domains_) {
+        uint64_t value;
+        if (read_energy(file, &value) < 0) continue;
+        if (file.has_last) {
+            uint64_t delta;
+            if (value >= file.last_uj) {
+                delta = value - file.last_uj;
+            } else {
+                // 计数器回绕，从 max_range_uj 到 0 也是一个单位
+                delta = file.max_range_uj >= file.last_uj ? file.max_range_uj - file.last_uj + value + 1 : 0;
+            }
+            EnergyPackageData& package = (*packages)[file.package_index];
+            package.energy_uj[file.domain] += delta;
+            // 微焦每微秒即为瓦
+            if (interval_us) package.watts[file.domain] += static_cast<double>(delta) / interval_us;
+        }
+        file.last_uj = value;
+        file.has_last = true;
+    }
+    for (size_t cpu = 0; cpu < cpu_count; cpu++) {
+        int32_t package_index = cpu_packages_[cpu];
+        if (package_index < 0 || !cpu_data.on_line(cpu + 1)) continue;
+        (*packages)[package_index].busy_cpus += cpu_data.percent(CPU_PERCENT_BUSY, cpu + 1) / 100.0;
+    }
+    return 0;
+}
+
+double EnergyCollection::task_watts(const std::vector<EnergyPackageData>& packages, int32_t processor,
+    float percent_cpu) const {
+    if (percent_cpu <= 0 || processor < 0 || static_cast<size_t>(processor) >= cpu_packages_.size()) return 0;
+    int32_t package_index = cpu_packages_[processor];
+    if (package_index < 0) return 0;
+    const EnergyPackageData& package = packages[package_index];
+    if (package.busy_cpus < ENERGY_MIN_BUSY_CPUS) return 0;
+    double watts = package.watts[ENERGY_DOMAIN_PACKAGE] + package.watts[ENERGY_DOMAIN_DRAM];
+    // 任务与 cpu 的采样时刻不同，任务的使用率可能略高于 package 的繁忙程度
+    double share = std::min(percent_cpu / 100.0 / package.busy_cpus, 1.0);
+    return watts * share;
+}
+
+void EnergyCollection::attribute(SysMonitorInfo* monitor_info) {
+    const std::vector<EnergyPackageData>& packages = monitor_info->energy_packages;
+    // 线程按自己所在的 package 与自己的 cpu 使用率分摊，并按进程汇总
+    thread_totals_.clear();
+    for (const auto& proc : monitor_info->all_process_info) {
+        if (proc->pid == proc->tgid) continue;
+        proc->energy_watts = task_watts(packages, proc->processor, proc->percent_cpu);
+        ThreadTotal& total = thread_totals_[proc->tgid];
+        total.percent_cpu += proc->percent_cpu;
+        total.watts += proc->energy_watts;
+    }
+    // 进程的 cpu 使用率包括所有线程，减去线程条目之后才是按主线程的 processor 分摊的部分
+    for (const auto& proc : monitor_info->all_process_info) {
+        if (proc->pid != proc->tgid) continue;
+        float own_cpu = proc->percent_cpu;
+        double thread_watts = 0;
+        auto iter = thread_totals_.find(proc->pid);
+        if (iter != thread_totals_.end()) {
+            own_cpu = MAXIMUM(own_cpu - iter->second.percent_cpu, 0.0F);
+            thread_watts = iter->second.watts;
+        }
+        proc->energy_watts = task_watts(packages, proc->processor, own_cpu) + thread_watts;
+    }
+}
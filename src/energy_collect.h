@@ -0,0 +1,122 @@
+/**
+ * @file energy_collect.h
+ * @author zhangyi
+ * @brief RAPL 能耗的收集与按 cpu 时间分摊到任务（powercap sysfs）
+ * @version 0.1
+ * @date 2023-01-09
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "cpu_data_array.h"
+#include "cpu_freq_collect.h"
+#include "monitor_info.h"
+
+// powercap 中 RAPL 能耗域目录名的前缀
+#define ENERGY_RAPL_PREFIX "intel-rapl:"
+// 分摊功率时 package 繁忙程度（cpu 个数）的下限，低于该值时不分摊，避免除以接近 0 的数
+#define ENERGY_MIN_BUSY_CPUS 0.01
+
+/**
+ * @brief 读取每个 package 的 RAPL 能耗计数，计算平均功率并按 cpu 时间分摊到任务
+ * @note 顶层的 intel-rapl:N 为 package（名字为 package-N 或 package-N-die-M），
+ *       其下的 intel-rapl:N:M 为 core、uncore、dram 等子域；psys 等与 package 无关的域被忽略。
+ *       计数器达到 max_energy_range_uj 后回绕，增量按回绕处理。
+ *       没有 RAPL 或者没有读权限（较新的内核中 energy_uj 只有 root 可读）时只在第一次记录日志，之后不再尝试
+ */
+class EnergyCollection {
+ public:
+    EnergyCollection() = default;
+    ~EnergyCollection();
+    EnergyCollection(const EnergyCollection&) = delete;
+    EnergyCollection& operator=(const EnergyCollection&) = delete;
+
+    /**
+     * @brief 设置 sysfs 的根目录，powercap 与 cpu 拓扑都从该目录下读取
+     * @note 需要在第一次 collect 之前调用
+     */
+    void set_sys_root(const char* root);
+
+    /**
+     * @brief 读取所有能耗域，计算每个 package 上一个周期的功率
+     * @note 需要在 cpu_data.finish_update 之后调用，繁忙程度来自本周期的 CPU_PERCENT_BUSY
+     * @return int 小于 0 表示没有可用的 RAPL 能耗域，此时 packages 被清空
+     */
+    int collect(const CpuDataArray& cpu_data, std::vector<EnergyPackageData>* packages);
+
+    /**
+     * @brief 把每个 package 的 package 与 dram 功率按 cpu 使用率分摊到任务
+     * @note 需要在所有任务的 cpu 使用率计算完之后调用。每个线程按自己 stat 中的 processor 所在的 package
+     *       与自己的 cpu 使用率分摊；进程条目同时代表主线程，进程的 cpu 使用率包括所有线程，
+     *       减去其他线程条目之后的部分（主线程自己，以及没有条目的线程、周期内退出的线程）按主线程的 processor 分摊，
+     *       再加上所有线程的功率作为进程的功率。
+     *       分母为 package 上所有 cpu 的繁忙程度之和（包括中断与没有完整信息的任务），
+     *       所以一个 package 上所有进程的功率之和不超过该 package 的功率
+     */
+    void attribute(SysMonitorInfo* monitor_info);
+
+ private:
+    // 一个能耗域
+    struct DomainFile {
+        int fd = -1;
+        std::string path;
+        // packages 中的下标
+        size_t package_index = 0;
+        EnergyDomain domain = ENERGY_DOMAIN_PACKAGE;
+        // 计数器的最大值，超过后从 0 开始
+        uint64_t max_range_uj = 0;
+        // 上一次读取的原始计数
+        uint64_t last_uj = 0;
+        bool has_last = false;
+    };
+
+    /**
+     * @brief 扫描 powercap 目录与 cpu 拓扑
+     *
+     * @return int 可用的能耗域个数
+     */
+    int open_domains(size_t cpu_count, std::vector<EnergyPackageData>* packages);
+    void close_domains();
+    /**
+     * @brief 把 "package-N" 与子域的名字转换为 package id 与能耗域
+     *
+     * @return int 小于 0 表示不关心的域
+     */
+    static int parse_domain_name(const char* name, bool top_level, uint32_t* package_id, EnergyDomain* domain);
+    /**
+     * @brief 找到 package id 对应的下标，不存在时追加一个
+     *
+     */
+    static size_t find_package(uint32_t package_id, std::vector<EnergyPackageData>* packages);
+    int add_domain(const std::string& dir, size_t package_index, EnergyDomain domain);
+    int read_energy(const DomainFile& file, uint64_t* value) const;
+    /**
+     * @brief 在 processor 上运行、cpu 使用率为 percent_cpu 的线程分摊到的功率
+     *
+     */
+    double task_watts(const std::vector<EnergyPackageData>& packages, int32_t processor, float percent_cpu) const;
+
+ private:
+    std::string powercap_dir_ = SYSFS_ROOT_DIR "/class/powercap";
+    std::string cpu_dir_ = SYSFS_ROOT_DIR "/devices/system/cpu";
+    bool disabled_ = false;
+    size_t cpu_count_ = 0;
+    std::vector<DomainFile> domains_;
+    // 每个 cpu 所在 package 在 packages 中的下标，-1 表示没有对应的 RAPL 域
+    std::vector<int32_t> cpu_packages_;
+    uint64_t last_time_ns_ = 0;
+    // 进程中除主线程外所有线程条目的汇总
+    struct ThreadTotal {
+        float percent_cpu = 0;
+        double watts = 0;
+    };
+    // tgid -> 线程的汇总，每次分摊时重建
+    std::unordered_map<pid_t, ThreadTotal> thread_totals_;
+};
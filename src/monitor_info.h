@@ -16,6 +16,8 @@
 #include <vector>
 #include <memory>
 #include <unordered_map>
+#include "cpu_data_array.h"
+#include "string_arena.h"
 
 /**
  * @brief 定义 /proc/xxx 文件系统的存储目录
@@ -25,6 +27,10 @@
 #define PROC_CPUINFO_FILE PROC_DIR "/cpuinfo"
 #define PROC_STAT_FILE PROC_DIR "/stat"
 #define PROC_MEMINFO_FILE PROC_DIR "/meminfo"
+#define PROC_DISKSTATS_FILE PROC_DIR "/diskstats"
+#define PROC_NET_DEV_FILE PROC_DIR "/net/dev"
+#define PROC_VMSTAT_FILE PROC_DIR "/vmstat"
+#define PROC_PRESSURE_DIR PROC_DIR "/pressure"
 
 // proc 文件系统每行最大的长度
 #define PROC_LINE_MAX_LENGTH 4096
@@ -32,40 +38,143 @@
 #define MAX_BYTES_ONCE_READ 2048
 // 任务名字最大的长度
 #define MAX_COMMAND_LENGTH 128
+// 完整命令行最大的长度，超出的部分被截断
+#define MAX_CMDLINE_LENGTH 4096
+// 设备名字最大的长度
+#define MAX_DEVICE_NAME_LENGTH 31
 
 /**
- * @brief 一个 cpu 的所有的监控信息
- * 
+ * @brief 一类资源的压力信息（pressure stall information）
+ * @note 来自 /proc/pressure/{cpu,memory,io}，some 表示至少有一个任务因该资源阻塞，
+ *       full 表示所有非空闲任务都因该资源阻塞（cpu 的 full 在旧内核上不存在）
+ */
+struct PressureData {
+    // 最近 10s、60s、300s 内阻塞时间的占比（百分比）
+    float some_avg10;
+    float some_avg60;
+    float some_avg300;
+    float full_avg10;
+    float full_avg60;
+    float full_avg300;
+    // 累计的阻塞时间（微秒）
+    uint64_t some_total_us;
+    uint64_t full_total_us;
+    // 上一个周期内的阻塞时间（微秒）
+    uint64_t some_delta_us;
+    uint64_t full_delta_us;
+};
+
+/**
+ * @brief 来自 /proc/vmstat 的换页相关速率
+ *
+ */
+struct VmstatData {
+    // 累计值
+    uint64_t pgfault;
+    uint64_t pgmajfault;
+    uint64_t pswpin;
+    uint64_t pswpout;
+    // kswapd、直接回收等所有来源之和
+    uint64_t pgscan;
+    uint64_t pgsteal;
+    uint64_t oom_kill;
+
+    // 上一个周期的速率（每秒）
+    double pgfault_ps;
+    double pgmajfault_ps;
+    double pswpin_ps;
+    double pswpout_ps;
+    double pgscan_ps;
+    double pgsteal_ps;
+    // 上一个周期内发生的 OOM kill 次数
+    uint64_t oom_kill_delta;
+};
+
+/**
+ * @brief 一个块设备的监控信息
+ * @note 来自 /proc/diskstats
+ */
+struct DiskData {
+    char name[MAX_DEVICE_NAME_LENGTH+1];
+    uint32_t major;
+    uint32_t minor;
+
+    // 累计值
+    uint64_t reads_completed;
+    uint64_t sectors_read;
+    uint64_t read_time_ms;
+    uint64_t writes_completed;
+    uint64_t sectors_written;
+    uint64_t write_time_ms;
+    uint64_t io_in_progress;
+    uint64_t io_time_ms;
+
+    // 上一个周期的速率
+    double read_iops;
+    double write_iops;
+    // 读写吞吐（字节每秒）
+    double read_bps;
+    double write_bps;
+    // 每个 IO 的平均耗时（毫秒）
+    double read_await_ms;
+    double write_await_ms;
+    // 设备繁忙时间的占比（百分比）
+    double util_percent;
+};
+
+/**
+ * @brief 一个网络接口的监控信息
+ * @note 来自 /proc/net/dev
+ */
+struct NetDevData {
+    char name[MAX_DEVICE_NAME_LENGTH+1];
+
+    // 累计值
+    uint64_t rx_bytes;
+    uint64_t rx_packets;
+    uint64_t rx_errors;
+    uint64_t rx_dropped;
+    uint64_t tx_bytes;
+    uint64_t tx_packets;
+    uint64_t tx_errors;
+    uint64_t tx_dropped;
+
+    // 上一个周期的速率（每秒）
+    double rx_bps;
+    double rx_pps;
+    double rx_drop_ps;
+    double tx_bps;
+    double tx_pps;
+    double tx_drop_ps;
+};
+
+/**
+ * @brief RAPL（powercap）的能耗域
+ *
+ */
+enum EnergyDomain : uint8_t {
+    ENERGY_DOMAIN_PACKAGE = 0,  // 整个 package，包括 core 与 uncore
+    ENERGY_DOMAIN_CORE,         // 所有核心
+    ENERGY_DOMAIN_UNCORE,       // 核显等 uncore 部分（通常只有客户端 cpu）
+    ENERGY_DOMAIN_DRAM,         // 内存，与 package 分开计量
+    ENERGY_DOMAIN_COUNT,
+};
+
+/**
+ * @brief 一个物理 package（socket）的能耗
+ * @note 来自 /sys/class/powercap/intel-rapl:*，多 die 的 package 为所有 die 之和
  */
-struct CpuData {
-    uint64_t total_time;
-    uint64_t user_time;
-    uint64_t system_time;
-    uint64_t system_all_time;
-    uint64_t idle_all_time;
-    uint64_t idle_time;
-    uint64_t nice_time;
-    uint64_t io_wait_time;
-    uint64_t irq_time;
-    uint64_t soft_irq_time;
-    uint64_t steal_time;
-    uint64_t guest_time;
-
-    uint64_t total_period;
-    uint64_t user_period;
-    uint64_t system_period;
-    uint64_t system_all_period;
-    uint64_t idle_all_period;
-    uint64_t idle_period;
-    uint64_t nice_period;
-    uint64_t io_wait_period;
-    uint64_t irq_period;
-    uint64_t soft_irq_period;
-    uint64_t steal_period;
-    uint64_t guest_period;
-
-    // double frequency;
-    bool on_line = false;
+struct EnergyPackageData {
+    // physical_package_id
+    uint32_t package_id;
+    // 是否存在对应的能耗域
+    bool has_domain[ENERGY_DOMAIN_COUNT];
+    // 累计的能耗（微焦），已处理计数器回绕
+    uint64_t energy_uj[ENERGY_DOMAIN_COUNT];
+    // 上一个周期的平均功率（瓦）
+    double watts[ENERGY_DOMAIN_COUNT];
+    // 上一个周期该 package 上所有在线 cpu 的繁忙程度之和（cpu 个数），分摊功率时作为分母
+    double busy_cpus;
 };
 
 /**
@@ -77,12 +186,12 @@ struct ProcessInfo {
     pid_t pid;
     // 当前进程的父进程
     pid_t ppid;
-    // // 线程组标志
-    // pid_t tgid;
-    // // 进程组标志
-    // pid_t pgrp;
-    // // session 标志
-    // int session;
+    // 线程组标志（所属进程的 pid）
+    pid_t tgid;
+    // 进程组标志
+    pid_t pgrp;
+    // session 标志
+    pid_t session;
     // // 是否为内核线程
     // bool is_kernel_thread;
     // // 是否为用户空间线程
@@ -90,8 +199,17 @@ struct ProcessInfo {
 
     // 进程运行时间（以百分之一秒为单位）
     // uint64_t time;
-    // 进程名（包括参数）
-    char cmdline[MAX_COMMAND_LENGTH+1];
+    // 以下字符串保存在 SysMonitorInfo::string_arena 中，这里只保存 id，任务对每个 id 持有一个引用
+    // 任务名（stat 中的 comm）
+    uint32_t comm_id;
+    // 完整的命令行，参数之间以空格分隔，内核线程为 "[comm]"
+    uint32_t cmdline_id;
+    // 任务的所有者（/proc/<pid> 目录的属主）
+    uint32_t uid;
+    // 所有者的用户名
+    uint32_t user_id;
+    // 需要重新读取命令行与所有者（新任务或者发生了 exec）
+    bool identity_stale;
 
     /* ---------- 任务的 cpu 相关统计 -------------- */
     // 任务运行在用户态的时间（包括 guest_time，被虚拟机抢占的时间）
@@ -102,8 +220,15 @@ struct ProcessInfo {
     uint64_t cutime;
     // 任务等待子任务被调度在内核态的时间
     uint64_t cstime;
+    // 任务的启动时间（系统启动后的时钟周期数），与 pid 一起唯一标识一个任务
+    uint64_t start_time;
     // 上一个周期的 CPU 使用率(百分比)
     float percent_cpu;
+    // 任务最后一次运行所在的 cpu 编号（stat 的第 39 个字段）
+    int32_t processor;
+    // 上一个周期按 cpu 时间分摊到任务的 package 与 dram 功率（瓦），没有 RAPL 时为 0；
+    // 线程按自己的 processor 分摊，进程为主线程与所有线程之和
+    float energy_watts;
 
     /* ---------- 任务的内存相关统计 -------------- */
     // 虚拟内存大小（单位为 KB）
@@ -134,12 +259,211 @@ struct ProcessInfo {
     uint64_t io_write_bytes;
     // 取消写的字节数
     uint64_t io_cancelled_write_bytes;
-    // 最后一次 IO 扫描的时间点
-    uint64_t io_last_scan_time_ms;
     // 实际读磁盘的速率（字节每秒）
     double io_rate_read_bps;
     // 实际写磁盘的速率（字节每秒）
     double io_rate_write_bps;
+
+    /* ---------- 任务的网络相关统计（只统计进程，线程与进程共享） -------------- */
+    // 多个进程共享的 socket 只计入其中一个进程
+    // 持有的 tcp 连接数（不包括 LISTEN 状态）
+    uint32_t net_tcp_conns;
+    // 持有的 udp socket 数
+    uint32_t net_udp_conns;
+    // 当前持有的 tcp 连接累计发送（被确认）的字节数
+    uint64_t net_tcp_bytes_sent;
+    // 当前持有的 tcp 连接累计接收的字节数
+    uint64_t net_tcp_bytes_received;
+    // tcp 发送速率（字节每秒）
+    double net_rate_send_bps;
+    // tcp 接收速率（字节每秒）
+    double net_rate_recv_bps;
+
+    /* ---------- 任务的性能计数（只统计 cpu 使用率最高的若干个任务） -------------- */
+    // 以下计数是否有效（任务被跟踪且至少读取过两次）
+    bool perf_valid;
+    // 上一个周期的硬件计数增量（按计数器复用的比例缩放）
+    uint64_t perf_cycles;
+    uint64_t perf_instructions;
+    uint64_t perf_cache_misses;
+    uint64_t perf_branch_misses;
+    // 每个时钟周期执行的指令数
+    float perf_ipc;
+    // 每千条指令的 cache miss 次数
+    float perf_mpki;
+    // 上一个周期的软件计数增量：运行时间（纳秒）、上下文切换、缺页
+    uint64_t perf_task_clock_ns;
+    uint64_t perf_context_switches;
+    uint64_t perf_page_faults;
+
+    /* ---------- 任务的文件描述符统计（只统计进程，采集频率低于 cpu） -------------- */
+    // 以下统计是否有效（进程至少被统计过一次）
+    bool fd_valid;
+    // 打开的 fd 个数
+    uint32_t fd_count;
+    // RLIMIT_NOFILE 的软限制，0 表示没有限制
+    uint64_t fd_limit;
+    // fd 个数占软限制的百分比
+    float percent_fd;
+    // 按类型统计的 fd 个数（只有开启了类型统计时有效）
+    uint32_t fd_sockets;
+    uint32_t fd_pipes;
+    uint32_t fd_files;
+    uint32_t fd_eventfds;
+    // 除 eventfd 以外的 anon_inode（epoll、timerfd、signalfd 等）
+    uint32_t fd_anon_inodes;
+
+    // 最后一次被扫描到时的扫描序号，用于清理已退出的任务
+    uint64_t last_scan_seq;
+    // 最后一次读取任务时的单调时钟（纳秒），为 0 表示还没有读取过。
+    // 任务级别的速率都以两次读取该任务的实际间隔为分母，不受扫描耗时的影响
+    uint64_t sample_time_ns;
+};
+
+/**
+ * @brief 任务性能计数的来源
+ *
+ */
+enum PerfMode : uint8_t {
+    PERF_MODE_NONE = 0,    // 没有开启或者 perf_event_open 不可用
+    PERF_MODE_HARDWARE,    // 硬件 PMU：cycles、instructions、cache-misses、branch-misses
+    PERF_MODE_SOFTWARE,    // 没有 PMU（例如虚拟机、CI）时的软件事件：task-clock、context-switches、page-faults
+};
+
+/**
+ * @brief 一个已退出任务的信息
+ * @note 由 proc connector 的 PROC_EVENT_EXIT 事件产生
+ */
+struct ExitedTaskInfo {
+    // 任务的标志
+    pid_t pid;
+    // 线程组标志
+    pid_t tgid;
+    // 父进程
+    pid_t ppid;
+    // 退出码（wait 语义）
+    uint32_t exit_code;
+    // 退出时发送给父进程的信号
+    uint32_t exit_signal;
+    // 退出的时间，单位为 ms
+    uint64_t exit_time_ms;
+    // 任务名，扫描到过时为命令行，否则为 comm
+    char cmdline[MAX_COMMAND_LENGTH+1];
+    // 最终的用户态、内核态耗时（以百分之一秒为单位）
+    uint64_t utime;
+    uint64_t stime;
+    // 最终的实际读写磁盘字节数
+    uint64_t io_read_bytes;
+    uint64_t io_write_bytes;
+    // 以上计数是否有效（退出时读取失败且从未被扫描到则无效）
+    bool counters_valid;
+    // 是否为短生命周期任务（在两次扫描之间创建并退出，从未被扫描到）
+    bool short_lived;
+};
+
+/**
+ * @brief proc connector 事件的累计计数
+ *
+ */
+struct ProcEventStats {
+    uint64_t fork_events = 0;
+    uint64_t exec_events = 0;
+    uint64_t exit_events = 0;
+    uint64_t comm_events = 0;
+    // 因接收缓冲区溢出而重新同步的次数
+    uint64_t resync_count = 0;
+};
+
+// 采样的直方图中保留的系统调用、wchan 个数
+#define TASK_SAMPLE_TOP_ENTRIES 5
+// wchan（内核函数名）的最大长度
+#define TASK_SAMPLE_WCHAN_LENGTH 47
+// 任务不在系统调用中（用户态）时的系统调用号
+#define TASK_SAMPLE_SYSCALL_USER (-1)
+
+/**
+ * @brief 采样得到的线程状态
+ *
+ */
+enum TaskSampleState : uint8_t {
+    TASK_SAMPLE_RUNNING = 0,   // R
+    TASK_SAMPLE_SLEEPING,      // S
+    TASK_SAMPLE_DISK_SLEEP,    // D
+    TASK_SAMPLE_OTHER,         // 其他（T、t、Z、I 等）
+    TASK_SAMPLE_STATE_COUNT,
+};
+
+/**
+ * @brief 一个进程在上一个采集间隔中的状态采样直方图
+ * @note 对进程的所有线程按较高的频率采样 stat 中的状态、wchan 与 syscall，
+ *       系统调用与 wchan 只统计不在运行的线程，只保留次数最多的 TASK_SAMPLE_TOP_ENTRIES 个
+ */
+struct TaskSampleProfile {
+    pid_t pid;
+    // 采样的次数（线程数 × 轮数）
+    uint32_t samples;
+    uint32_t state_counts[TASK_SAMPLE_STATE_COUNT];
+    // 次数从多到少排列
+    uint32_t syscall_entries;
+    struct {
+        // 系统调用号，TASK_SAMPLE_SYSCALL_USER 表示在用户态
+        int32_t nr;
+        uint32_t count;
+        // 最后一次采样到的第一个参数（通常为 fd）
+        uint64_t arg0;
+    } syscalls[TASK_SAMPLE_TOP_ENTRIES];
+    uint32_t wchan_entries;
+    struct {
+        char name[TASK_SAMPLE_WCHAN_LENGTH+1];
+        uint32_t count;
+    } wchans[TASK_SAMPLE_TOP_ENTRIES];
+};
+
+/**
+ * @brief 没有保存完整信息的任务的汇总
+ * @note 限制了完整信息的任务个数时，其余任务只保留 cpu 时间，在这里汇总
+ */
+struct OthersTaskInfo {
+    // 汇总的任务个数（包括线程）
+    uint32_t task_count;
+    // 汇总的进程个数
+    uint32_t process_count;
+    // 汇总进程的 cpu 使用率之和（百分比，不重复统计线程）
+    float percent_cpu;
+    // 汇总进程的常驻内存之和（单位为 KB）
+    uint64_t resident_mem;
+};
+
+/**
+ * @brief top-cpp 自身的内存占用
+ *
+ */
+struct SelfMemoryUsage {
+    // 进程的常驻内存（单位为 KB）
+    uint64_t self_rss_kb;
+    // 完整信息的任务占用的内存（估算，包括容器的开销）
+    uint64_t task_bytes;
+    // 只保留 cpu 时间的任务占用的内存
+    uint64_t light_task_bytes;
+    // 字符串池占用的内存
+    uint64_t string_bytes;
+    // 进程事件的存活任务集合占用的内存（包括每次扫描的拷贝）
+    uint64_t event_bytes;
+    // 进程网络统计的 socket 与进程缓存占用的内存
+    uint64_t net_bytes;
+    // uid 到用户名的缓存占用的内存
+    uint64_t user_name_bytes;
+    // 使用者按任务保存的数据（例如 MonitorInfoPreprocess）占用的内存
+    uint64_t consumer_bytes;
+    // 以上之和
+    uint64_t total_bytes;
+    // 内存预算，0 表示不限制
+    uint64_t budget_bytes;
+    // 保存完整信息的任务个数与当前的上限（0 表示不限制）
+    uint32_t detailed_tasks;
+    uint32_t max_detailed_tasks;
+    // 只保留 cpu 时间的任务个数
+    uint32_t light_tasks;
 };
 
 /**
@@ -151,6 +475,8 @@ struct SysMonitorInfo {
     struct timeval curr_real_time;
     // 当前时间，单位为 ms
     uint64_t curr_time_ms;
+    // 采集时的单调时钟，单位为 ns，计算时间间隔时使用，不受系统时间调整的影响
+    uint64_t curr_monotonic_ns;
 
     // 当前系统的可用内存，单位为 kb
     uint64_t available_mem;
@@ -165,20 +491,63 @@ struct SysMonitorInfo {
     uint64_t used_swap;
     uint64_t cached_swap;
 
+    // 换页相关的速率
+    VmstatData vmstat;
+    // 是否支持 pressure stall information
+    bool pressure_available;
+    // cpu、内存、IO 的压力
+    PressureData cpu_pressure;
+    PressureData memory_pressure;
+    PressureData io_pressure;
+
     // 活跃的 cpu 个数
     uint32_t active_cpus;
     // 存在的 cpu 个数
     uint32_t existing_cpus;
-    // 当前系统上每个 cpu 的数据
-    std::vector<std::shared_ptr<CpuData>> sys_cpu_data;
+    // 当前系统上每个 cpu 的数据，下标 0 为所有 cpu 的汇总
+    CpuDataArray sys_cpu_data;
+    // cpuidle 的状态名，下标与 CpuDataArray::idle_state_residency 的 state 对应
+    std::vector<std::string> cpu_idle_state_names;
+    // 每个 package 的能耗，没有 RAPL 时为空
+    std::vector<EnergyPackageData> energy_packages;
+
+    // 当前系统上每个块设备的数据，只在设备增减时重新分配
+    std::vector<DiskData> sys_disk_data;
+    // 当前系统上每个网络接口的数据，只在接口增减时重新分配
+    std::vector<NetDevData> sys_net_dev_data;
 
+    // 任务名、命令行、用户名等字符串的驻留池，在多次快照之间共享
+    std::shared_ptr<StringArena> string_arena;
     // 当前系统上所有进程的监控数据
     std::vector<std::shared_ptr<ProcessInfo>> all_process_info;
     // 所有进程的监控数据（以 pid 做为 key）
     std::unordered_map<uint64_t, std::shared_ptr<ProcessInfo>> all_process_info_table;
+    // 本次扫描中第一个与最后一个任务的读取时间之差（ms），即任务之间的时间偏差
+    double scan_skew_ms;
+
+    // 是否通过 proc connector 事件维护任务集合
+    bool proc_event_enabled;
+    // 本周期内退出的任务
+    std::vector<ExitedTaskInfo> exited_process_info;
+    // proc connector 事件的累计计数
+    ProcEventStats proc_event_stats;
+
+    // 任务性能计数的来源
+    PerfMode perf_mode;
+    // 正在跟踪性能计数的任务个数
+    uint32_t perf_tracked_tasks;
+
+    // 没有保存完整信息的任务的汇总
+    OthersTaskInfo others;
+    // top-cpp 自身的内存占用
+    SelfMemoryUsage self_usage;
+
+    // cpu 使用率最高的进程在上一个采集间隔中的状态采样
+    std::vector<TaskSampleProfile> task_samples;
 
     SysMonitorInfo()
         : curr_time_ms(0),
+          curr_monotonic_ns(0),
           available_mem(0),
           total_mem(0),
           used_mem(0),
@@ -189,6 +558,18 @@ struct SysMonitorInfo {
           total_swap(0),
           used_swap(0),
           cached_swap(0),
+          vmstat(),
+          pressure_available(false),
+          cpu_pressure(),
+          memory_pressure(),
+          io_pressure(),
           active_cpus(0),
-          existing_cpus(0) {}
+          existing_cpus(0),
+          string_arena(std::make_shared<StringArena>()),
+          scan_skew_ms(0),
+          proc_event_enabled(false),
+          perf_mode(PERF_MODE_NONE),
+          perf_tracked_tasks(0),
+          others(),
+          self_usage() {}
 };
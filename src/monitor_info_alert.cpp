@@ -0,0 +1,726 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "common.h"
+#include "monitor_info_alert.h"
+
+// 规则中最多的单词个数
+#define ALERT_MAX_TOKENS 16
+
+// 指标的编号
+enum AlertMetricId : uint8_t {
+    // task
+    ALERT_METRIC_TASK_CPU = 0,
+    ALERT_METRIC_TASK_MEM,
+    ALERT_METRIC_TASK_RSS,
+    ALERT_METRIC_TASK_VSZ,
+    ALERT_METRIC_TASK_IO_READ,
+    ALERT_METRIC_TASK_IO_WRITE,
+    ALERT_METRIC_TASK_NET_SEND,
+    ALERT_METRIC_TASK_NET_RECV,
+    ALERT_METRIC_TASK_TCP_CONNS,
+    ALERT_METRIC_TASK_UDP_CONNS,
+    ALERT_METRIC_TASK_FDS,
+    ALERT_METRIC_TASK_FD_USAGE,
+    // cpu
+    ALERT_METRIC_CPU_BUSY,
+    ALERT_METRIC_CPU_USER,
+    ALERT_METRIC_CPU_SYSTEM,
+    ALERT_METRIC_CPU_IOWAIT,
+    ALERT_METRIC_CPU_IRQ,
+    ALERT_METRIC_CPU_SOFTIRQ,
+    ALERT_METRIC_CPU_STEAL,
+    ALERT_METRIC_CPU_GUEST,
+    // sys
+    ALERT_METRIC_SYS_CPU_BUSY,
+    ALERT_METRIC_SYS_MEM_USED,
+    ALERT_METRIC_SYS_MEM_AVAILABLE,
+    ALERT_METRIC_SYS_SWAP_USED,
+    ALERT_METRIC_SYS_PGFAULT,
+    ALERT_METRIC_SYS_PGMAJFAULT,
+    ALERT_METRIC_SYS_PSWPIN,
+    ALERT_METRIC_SYS_PSWPOUT,
+    ALERT_METRIC_SYS_PGSCAN,
+    ALERT_METRIC_SYS_OOM_KILL,
+    ALERT_METRIC_SYS_CPU_SOME,
+    ALERT_METRIC_SYS_MEM_SOME,
+    ALERT_METRIC_SYS_MEM_FULL,
+    ALERT_METRIC_SYS_IO_SOME,
+    ALERT_METRIC_SYS_IO_FULL,
+};
+
+struct AlertMetricDef {
+    const char* name;
+    AlertScope scope;
+    AlertMetricId id;
+};
+
+/**
+ * @brief 规则中可以使用的指标
+ * @note 百分比的取值范围为 [0, 100]，内存、吞吐的单位为字节、字节每秒
+ */
+static const AlertMetricDef alert_metrics[] = {
+    {"cpu", ALERT_SCOPE_TASK, ALERT_METRIC_TASK_CPU},
+    {"mem", ALERT_SCOPE_TASK, ALERT_METRIC_TASK_MEM},
+    {"rss", ALERT_SCOPE_TASK, ALERT_METRIC_TASK_RSS},
+    {"vsz", ALERT_SCOPE_TASK, ALERT_METRIC_TASK_VSZ},
+    {"io_read", ALERT_SCOPE_TASK, ALERT_METRIC_TASK_IO_READ},
+    {"io_write", ALERT_SCOPE_TASK, ALERT_METRIC_TASK_IO_WRITE},
+    {"net_send", ALERT_SCOPE_TASK, ALERT_METRIC_TASK_NET_SEND},
+    {"net_recv", ALERT_SCOPE_TASK, ALERT_METRIC_TASK_NET_RECV},
+    {"tcp_conns", ALERT_SCOPE_TASK, ALERT_METRIC_TASK_TCP_CONNS},
+    {"udp_conns", ALERT_SCOPE_TASK, ALERT_METRIC_TASK_UDP_CONNS},
+    {"fds", ALERT_SCOPE_TASK, ALERT_METRIC_TASK_FDS},
+    {"fd_usage", ALERT_SCOPE_TASK, ALERT_METRIC_TASK_FD_USAGE},
+    {"busy", ALERT_SCOPE_CPU, ALERT_METRIC_CPU_BUSY},
+    {"user", ALERT_SCOPE_CPU, ALERT_METRIC_CPU_USER},
+    {"system", ALERT_SCOPE_CPU, ALERT_METRIC_CPU_SYSTEM},
+    {"iowait", ALERT_SCOPE_CPU, ALERT_METRIC_CPU_IOWAIT},
+    {"irq", ALERT_SCOPE_CPU, ALERT_METRIC_CPU_IRQ},
+    {"softirq", ALERT_SCOPE_CPU, ALERT_METRIC_CPU_SOFTIRQ},
+    {"steal", ALERT_SCOPE_CPU, ALERT_METRIC_CPU_STEAL},
+    {"guest", ALERT_SCOPE_CPU, ALERT_METRIC_CPU_GUEST},
+    {"cpu_busy", ALERT_SCOPE_SYS, ALERT_METRIC_SYS_CPU_BUSY},
+    {"mem_used", ALERT_SCOPE_SYS, ALERT_METRIC_SYS_MEM_USED},
+    {"mem_available", ALERT_SCOPE_SYS, ALERT_METRIC_SYS_MEM_AVAILABLE},
+    {"swap_used", ALERT_SCOPE_SYS, ALERT_METRIC_SYS_SWAP_USED},
+    {"pgfault", ALERT_SCOPE_SYS, ALERT_METRIC_SYS_PGFAULT},
+    {"pgmajfault", ALERT_SCOPE_SYS, ALERT_METRIC_SYS_PGMAJFAULT},
+    {"pswpin", ALERT_SCOPE_SYS, ALERT_METRIC_SYS_PSWPIN},
+    {"pswpout", ALERT_SCOPE_SYS, ALERT_METRIC_SYS_PSWPOUT},
+    {"pgscan", ALERT_SCOPE_SYS, ALERT_METRIC_SYS_PGSCAN},
+    {"oom_kill", ALERT_SCOPE_SYS, ALERT_METRIC_SYS_OOM_KILL},
+    {"cpu_some", ALERT_SCOPE_SYS, ALERT_METRIC_SYS_CPU_SOME},
+    {"mem_some", ALERT_SCOPE_SYS, ALERT_METRIC_SYS_MEM_SOME},
+    {"mem_full", ALERT_SCOPE_SYS, ALERT_METRIC_SYS_MEM_FULL},
+    {"io_some", ALERT_SCOPE_SYS, ALERT_METRIC_SYS_IO_SOME},
+    {"io_full", ALERT_SCOPE_SYS, ALERT_METRIC_SYS_IO_FULL},
+};
+
+static const char* alert_scope_names[] = {"task", "cpu", "sys"};
+
+static inline double percent_of(uint64_t part, uint64_t total) {
+    return total == 0 ? 0 : 100.0 * part / total;
+}
+
+static inline double task_metric(uint8_t metric, const ProcessInfo& task) {
+    switch (metric) {
+    case ALERT_METRIC_TASK_CPU: return task.percent_cpu;
+    case ALERT_METRIC_TASK_MEM: return task.percent_mem;
+    case ALERT_METRIC_TASK_RSS: return task.resident_mem * 1024.0;
+    case ALERT_METRIC_TASK_VSZ: return task.virtual_mem * 1024.0;
+    case ALERT_METRIC_TASK_IO_READ: return task.io_rate_read_bps;
+    case ALERT_METRIC_TASK_IO_WRITE: return task.io_rate_write_bps;
+    case ALERT_METRIC_TASK_NET_SEND: return task.net_rate_send_bps;
+    case ALERT_METRIC_TASK_NET_RECV: return task.net_rate_recv_bps;
+    case ALERT_METRIC_TASK_TCP_CONNS: return task.net_tcp_conns;
+    case ALERT_METRIC_TASK_UDP_CONNS: return task.net_udp_conns;
+    case ALERT_METRIC_TASK_FDS: return task.fd_count;
+    case ALERT_METRIC_TASK_FD_USAGE: return task.percent_fd;
+    default: return 0;
+    }
+}
+
+static inline double cpu_metric(uint8_t metric, const CpuDataArray& cpu_data, size_t index) {
+    switch (metric) {
+    case ALERT_METRIC_CPU_BUSY: return cpu_data.percent(CPU_PERCENT_BUSY, index);
+    case ALERT_METRIC_CPU_USER: return cpu_data.percent(CPU_PERCENT_USER, index);
+    case ALERT_METRIC_CPU_SYSTEM: return cpu_data.percent(CPU_PERCENT_SYSTEM, index);
+    case ALERT_METRIC_CPU_IOWAIT: return cpu_data.percent(CPU_PERCENT_IO_WAIT, index);
+    case ALERT_METRIC_CPU_IRQ: return cpu_data.percent(CPU_PERCENT_IRQ, index);
+    case ALERT_METRIC_CPU_SOFTIRQ: return cpu_data.percent(CPU_PERCENT_SOFT_IRQ, index);
+    case ALERT_METRIC_CPU_STEAL: return cpu_data.percent(CPU_PERCENT_STEAL, index);
+    case ALERT_METRIC_CPU_GUEST: return cpu_data.percent(CPU_PERCENT_GUEST, index);
+    default: return 0;
+    }
+}
+
+static inline double sys_metric(uint8_t metric, const SysMonitorInfo& info) {
+    switch (metric) {
+    case ALERT_METRIC_SYS_CPU_BUSY:
+        return info.sys_cpu_data.empty() ? 0 : info.sys_cpu_data.percent(CPU_PERCENT_BUSY, 0);
+    case ALERT_METRIC_SYS_MEM_USED: return percent_of(info.used_mem, info.total_mem);
+    case ALERT_METRIC_SYS_MEM_AVAILABLE: return info.avilable_mem * 1024.0;
+    case ALERT_METRIC_SYS_SWAP_USED: return percent_of(info.used_swap, info.total_swap);
+    case ALERT_METRIC_SYS_PGFAULT: return info.vmstat.pgfault_ps;
+    case ALERT_METRIC_SYS_PGMAJFAULT: return info.vmstat.pgmajfault_ps;
+    case ALERT_METRIC_SYS_PSWPIN: return info.vmstat.pswpin_ps;
+    case ALERT_METRIC_SYS_PSWPOUT: return info.vmstat.pswpout_ps;
+    case ALERT_METRIC_SYS_PGSCAN: return info.vmstat.pgscan_ps;
+    case ALERT_METRIC_SYS_OOM_KILL: return info.vmstat.oom_kill_delta;
+    case ALERT_METRIC_SYS_CPU_SOME: return info.cpu_pressure.some_avg10;
+    case ALERT_METRIC_SYS_MEM_SOME: return info.memory_pressure.some_avg10;
+    case ALERT_METRIC_SYS_MEM_FULL: return info.memory_pressure.full_avg10;
+    case ALERT_METRIC_SYS_IO_SOME: return info.io_pressure.some_avg10;
+    case ALERT_METRIC_SYS_IO_FULL: return info.io_pressure.full_avg10;
+    default: return 0;
+    }
+}
+
+static inline bool compare(AlertOp op, double value, double threshold) {
+    switch (op) {
+    case ALERT_OP_GT: return value > threshold;
+    case ALERT_OP_GE: return value >= threshold;
+    case ALERT_OP_LT: return value < threshold;
+    case ALERT_OP_LE: return value <= threshold;
+    default: return false;
+    }
+}
+
+static inline uint32_t hash_key(int32_t key) {
+    return static_cast<uint32_t>(key) * 2654435761U;
+}
+
+/**
+ * @brief 解析带 K/M/G/T 后缀（1024 进制）的数值，允许以 '%' 结尾
+ *
+ */
+static bool parse_value(const char* s, double* value) {
+    char* end = nullptr;
+    double v = strtod(s, &end);
+    if (end == s) return false;
+    switch (*end) {
+    case 'K': case 'k': v *= 1024.0; end++; break;
+    case 'M': case 'm': v *= 1024.0 * 1024; end++; break;
+    case 'G': case 'g': v *= 1024.0 * 1024 * 1024; end++; break;
+    case 'T': case 't': v *= 1024.0 * 1024 * 1024 * 1024; end++; break;
+    default: break;
+    }
+    if (*end == '%') end++;
+    if (*end != '\0' || !isfinite(v)) return false;
+    *value = v;
+    return true;
+}
+
+/**
+ * @brief 解析带 s/m/h 后缀的时长，没有后缀时单位为秒
+ *
+ */
+static bool parse_duration(const char* s, uint64_t* duration_ms) {
+    char* end = nullptr;
+    double v = strtod(s, &end);
+    if (end == s || v < 0) return false;
+    if (*end == 's') {
+        end++;
+    } else if (*end == 'm') {
+        v *= 60;
+        end++;
+    } else if (*end == 'h') {
+        v *= 3600;
+        end++;
+    }
+    if (*end != '\0') return false;
+    *duration_ms = static_cast<uint64_t>(v * 1000);
+    return true;
+}
+
+MonitorInfoAlert::~MonitorInfoAlert() {
+    for (uint32_t i = 0; i < rule_count_; i++) {
+        free_table(&runtimes_[i].tables[0]);
+        free_table(&runtimes_[i].tables[1]);
+    }
+    for (uint32_t i = 0; i < sink_count_; i++) {
+        if (sinks_[i].fd >= 0) close(sinks_[i].fd);
+    }
+    reap_children();
+}
+
+int MonitorInfoAlert::add_rule(const char* line) {
+    if (rule_count_ >= ALERT_MAX_RULES) {
+        ERROR_LOG("too many alert rules, max: %d", ALERT_MAX_RULES);
+        return -1;
+    }
+    char buffer[PROC_LINE_MAX_LENGTH];
+    snprintf(buffer, sizeof(buffer), "%s", line);
+    char* tokens[ALERT_MAX_TOKENS];
+    int token_count = 0;
+    char* save_ptr = nullptr;
+    for (char* token = strtok_r(buffer, " \t\r\n", &save_ptr); token != nullptr;
+        token = strtok_r(nullptr, " \t\r\n", &save_ptr)) {
+        if (token_count >= ALERT_MAX_TOKENS) {
+            ERROR_LOG("alert rule has too many tokens: %s", line);
+            return -2;
+        }
+        tokens[token_count++] = token;
+    }
+
+    AlertRule rule;
+    memset(&rule, 0, sizeof(rule));
+    int pos = 0;
+    // 名字与作用对象
+    if (token_count < 5 || strlen(tokens[0]) > ALERT_RULE_NAME_LENGTH) {
+        ERROR_LOG("invalid alert rule: %s", line);
+        return -2;
+    }
+    snprintf(rule.name, sizeof(rule.name), "%s", tokens[pos++]);
+    const char* scope = tokens[pos++];
+    if (strcmp(scope, "task") == 0) {
+        rule.scope = ALERT_SCOPE_TASK;
+    } else if (strcmp(scope, "cpu") == 0) {
+        rule.scope = ALERT_SCOPE_CPU;
+    } else if (strcmp(scope, "sys") == 0) {
+        rule.scope = ALERT_SCOPE_SYS;
+    } else {
+        ERROR_LOG("invalid alert scope: %s in rule: %s", scope, rule.name);
+        return -2;
+    }
+    // 可选的 cmdline 过滤
+    if (Util::wrap_strncmp(tokens[pos], "cmdline=")) {
+        const char* filter = tokens[pos++] + strlen("cmdline=");
+        if (rule.scope != ALERT_SCOPE_TASK || strlen(filter) > ALERT_FILTER_LENGTH) {
+            ERROR_LOG("invalid cmdline filter in rule: %s", rule.name);
+            return -2;
+        }
+        snprintf(rule.cmdline_filter, sizeof(rule.cmdline_filter), "%s", filter);
+    }
+    if (pos + 3 > token_count) {
+        ERROR_LOG("incomplete alert rule: %s", line);
+        return -2;
+    }
+    // 指标，可以带 /s、/min 表示变化率
+    char* metric = tokens[pos++];
+    char* suffix = strchr(metric, '/');
+    rule.mode = ALERT_VALUE_RAW;
+    if (suffix) {
+        *suffix++ = '\0';
+        if (strcmp(suffix, "s") == 0) {
+            rule.mode = ALERT_VALUE_PER_SECOND;
+        } else if (strcmp(suffix, "min") == 0) {
+            rule.mode = ALERT_VALUE_PER_MINUTE;
+        } else {
+            ERROR_LOG("invalid metric suffix: %s in rule: %s", suffix, rule.name);
+            return -2;
+        }
+    }
+    const AlertMetricDef* def = nullptr;
+    for (const auto& item : alert_metrics) {
+        if (item.scope == rule.scope && strcmp(item.name, metric) == 0) {
+            def = &item;
+            break;
+        }
+    }
+    if (!def) {
+        ERROR_LOG("unknown %s metric: %s in rule: %s", alert_scope_names[rule.scope], metric, rule.name);
+        return -2;
+    }
+    rule.metric = def->id;
+    // 比较操作与阈值
+    const char* op = tokens[pos++];
+    if (strcmp(op, ">") == 0) {
+        rule.op = ALERT_OP_GT;
+    } else if (strcmp(op, ">=") == 0) {
+        rule.op = ALERT_OP_GE;
+    } else if (strcmp(op, "<") == 0) {
+        rule.op = ALERT_OP_LT;
+    } else if (strcmp(op, "<=") == 0) {
+        rule.op = ALERT_OP_LE;
+    } else {
+        ERROR_LOG("invalid operator: %s in rule: %s", op, rule.name);
+        return -2;
+    }
+    if (!parse_value(tokens[pos++], &rule.threshold)) {
+        ERROR_LOG("invalid threshold: %s in rule: %s", tokens[pos-1], rule.name);
+        return -2;
+    }
+    rule.clear_threshold = rule.threshold;
+    // 可选的持续时间与解除阈值
+    while (pos < token_count) {
+        const char* key = tokens[pos++];
+        if (pos >= token_count) {
+            ERROR_LOG("missing value after: %s in rule: %s", key, rule.name);
+            return -2;
+        }
+        const char* value = tokens[pos++];
+        if (strcmp(key, "for") == 0) {
+            if (!parse_duration(value, &rule.duration_ms)) {
+                ERROR_LOG("invalid duration: %s in rule: %s", value, rule.name);
+                return -2;
+            }
+        } else if (strcmp(key, "clear") == 0) {
+            if (!parse_value(value, &rule.clear_threshold)) {
+                ERROR_LOG("invalid clear threshold: %s in rule: %s", value, rule.name);
+                return -2;
+            }
+        } else {
+            ERROR_LOG("unknown keyword: %s in rule: %s", key, rule.name);
+            return -2;
+        }
+    }
+    // 解除阈值必须比触发阈值更宽松，否则告警会在两个状态之间抖动
+    bool upward = (rule.op == ALERT_OP_GT || rule.op == ALERT_OP_GE);
+    if (upward ? rule.clear_threshold > rule.threshold : rule.clear_threshold < rule.threshold) {
+        ERROR_LOG("clear threshold must be looser than threshold in rule: %s", rule.name);
+        return -2;
+    }
+
+    // 状态表按照 50% 的负载因子分配
+    uint32_t capacity = 2;
+    if (rule.scope == ALERT_SCOPE_TASK) {
+        capacity = ALERT_DEFAULT_TASK_STATES * 2;
+    } else if (rule.scope == ALERT_SCOPE_CPU) {
+        capacity = ALERT_MAX_CPU_STATES * 2;
+    }
+    RuleRuntime& runtime = runtimes_[rule_count_];
+    if (alloc_table(capacity, &runtime.tables[0]) < 0 || alloc_table(capacity, &runtime.tables[1]) < 0) {
+        free_table(&runtime.tables[0]);
+        free_table(&runtime.tables[1]);
+        ERROR_LOG("alloc state table for rule: %s failed", rule.name);
+        return -3;
+    }
+    runtime.curr = 0;
+    rules_[rule_count_] = rule;
+    if (rule.scope == ALERT_SCOPE_TASK) {
+        task_rules_[task_rule_count_++] = rule_count_;
+    }
+    rule_count_++;
+    return 0;
+}
+
+int MonitorInfoAlert::load_rules(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        ERROR_LOG("open alert rules: %s failed, err: %s", path, strerror(errno));
+        return -1;
+    }
+    char line[PROC_LINE_MAX_LENGTH];
+    int line_no = 0;
+    int loaded = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line_no++;
+        char* p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+        if (add_rule(p) < 0) {
+            ERROR_LOG("invalid alert rule at %s:%d", path, line_no);
+            fclose(fp);
+            return -2;
+        }
+        loaded++;
+    }
+    fclose(fp);
+    return loaded;
+}
+
+int MonitorInfoAlert::add_sink(const char* spec) {
+    if (sink_count_ >= ALERT_MAX_SINKS) {
+        ERROR_LOG("too many alert sinks, max: %d", ALERT_MAX_SINKS);
+        return -1;
+    }
+    Sink sink;
+    sink.fd = -1;
+    const char* target = strchr(spec, ':');
+    if (!target || target[1] == '\0' || strlen(target + 1) >= sizeof(sink.target)) {
+        ERROR_LOG("invalid alert sink: %s", spec);
+        return -2;
+    }
+    target++;
+    snprintf(sink.target, sizeof(sink.target), "%s", target);
+    if (Util::wrap_strncmp(spec, "file:")) {
+        sink.type = SINK_FILE;
+        sink.fd = open(target, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (sink.fd < 0) {
+            ERROR_LOG("open alert file: %s failed, err: %s", target, strerror(errno));
+            return -3;
+        }
+    } else if (Util::wrap_strncmp(spec, "unix:")) {
+        sink.type = SINK_UNIX;
+        if (strlen(target) >= sizeof(((struct sockaddr_un*)nullptr)->sun_path)) {
+            ERROR_LOG("unix socket path too long: %s", target);
+            return -2;
+        }
+        // 接收方可能还没有启动，所以不 connect，每次发送时指定地址
+        sink.fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (sink.fd < 0) {
+            ERROR_LOG("create unix socket failed, err: %s", strerror(errno));
+            return -3;
+        }
+    } else if (Util::wrap_strncmp(spec, "exec:")) {
+        sink.type = SINK_EXEC;
+    } else {
+        ERROR_LOG("unknown alert sink type: %s", spec);
+        return -2;
+    }
+    sinks_[sink_count_++] = sink;
+    return 0;
+}
+
+int MonitorInfoAlert::evaluate(const SysMonitorInfo& monitor_info) {
+    if (rule_count_ == 0) return 0;
+    reap_children();
+    changed_ = 0;
+    // 持续时间与变化率使用单调时钟，系统时间只用于告警中显示的时间
+    uint64_t now_ms = monitor_info.curr_monotonic_ns / 1000000;
+    uint64_t curr_time_ms = monitor_info.curr_time_ms;
+
+    // 只遍历一次任务数组，每个任务依次执行所有 task 规则。
+    // 线程与进程共享内存、网络等数据，所以只对线程组的主线程求值
+    if (task_rule_count_ > 0) {
+        const StringArena& strings = *monitor_info.string_arena;
+        for (const auto& task_ptr : monitor_info.all_process_info) {
+            const ProcessInfo& task = *task_ptr;
+            if (task.pid != task.tgid) continue;
+            const char* cmdline = strings.get(task.cmdline_id);
+            for (uint32_t i = 0; i < task_rule_count_; i++) {
+                uint32_t rule_index = task_rules_[i];
+                const AlertRule& rule = rules_[rule_index];
+                if (rule.cmdline_filter[0] != '\0' && !strstr(cmdline, rule.cmdline_filter)) {
+                    continue;
+                }
+                eval_target(rule_index, task.pid, cmdline,
+                    task_metric(rule.metric, task), now_ms, curr_time_ms);
+            }
+        }
+    }
+    for (uint32_t rule_index = 0; rule_index < rule_count_; rule_index++) {
+        const AlertRule& rule = rules_[rule_index];
+        if (rule.scope == ALERT_SCOPE_CPU) {
+            // 下标 0 为所有 cpu 的汇总
+            const CpuDataArray& cpu_data = monitor_info.sys_cpu_data;
+            for (size_t i = 1; i < cpu_data.size(); i++) {
+                if (!cpu_data.on_line(i)) continue;
+                eval_target(rule_index, static_cast<int32_t>(i - 1), "",
+                    cpu_metric(rule.metric, cpu_data, i), now_ms, curr_time_ms);
+            }
+        } else if (rule.scope == ALERT_SCOPE_SYS) {
+            eval_target(rule_index, 0, "", sys_metric(rule.metric, monitor_info), now_ms, curr_time_ms);
+        }
+    }
+    for (uint32_t rule_index = 0; rule_index < rule_count_; rule_index++) {
+        finish_rule(rule_index, curr_time_ms);
+    }
+    return changed_;
+}
+
+void MonitorInfoAlert::eval_target(uint32_t rule_index, int32_t key, const char* target_name,
+    double raw, uint64_t now_ms, uint64_t curr_time_ms) {
+    const AlertRule& rule = rules_[rule_index];
+    RuleRuntime& runtime = runtimes_[rule_index];
+    StateTable& curr = runtime.tables[runtime.curr];
+    StateTable& next = runtime.tables[runtime.curr ^ 1];
+
+    TargetState state;
+    TargetState* prev = find_state(&curr, key);
+    if (prev) {
+        prev->visited = true;
+        state = *prev;
+    } else {
+        state.key = key;
+        state.status = TARGET_OK;
+        state.since_ms = 0;
+        state.prev_raw = 0;
+        state.prev_time_ms = 0;
+    }
+    state.visited = false;
+
+    // 变化率需要上一个周期的原始值，第一次看到对象时只记录不求值
+    double value = raw;
+    bool has_value = true;
+    if (rule.mode != ALERT_VALUE_RAW) {
+        if (!prev || now_ms <= prev->prev_time_ms) {
+            has_value = false;
+        } else {
+            double per_ms = (raw - prev->prev_raw) / (now_ms - prev->prev_time_ms);
+            value = per_ms * (rule.mode == ALERT_VALUE_PER_MINUTE ? 60000 : 1000);
+        }
+    }
+    state.prev_raw = raw;
+    state.prev_time_ms = now_ms;
+
+    if (has_value) {
+        AlertEvent event;
+        event.rule = &rule;
+        event.target = rule.scope == ALERT_SCOPE_SYS ? -1 : key;
+        event.target_name = target_name;
+        event.value = value;
+        event.time_ms = curr_time_ms;
+        switch (state.status) {
+        case TARGET_OK:
+            if (compare(rule.op, value, rule.threshold)) {
+                state.since_ms = now_ms;
+                state.status = TARGET_PENDING;
+            }
+            break;
+        case TARGET_PENDING:
+            if (!compare(rule.op, value, rule.threshold)) {
+                state.status = TARGET_OK;
+            }
+            break;
+        case TARGET_FIRING:
+            if (!compare(rule.op, value, rule.clear_threshold)) {
+                state.status = TARGET_OK;
+                event.firing = false;
+                emit(event);
+            }
+            break;
+        }
+        if (state.status == TARGET_PENDING && now_ms - state.since_ms >= rule.duration_ms) {
+            state.status = TARGET_FIRING;
+            event.firing = true;
+            emit(event);
+        }
+    }
+
+    // 处于 OK 状态且不需要历史值的对象不占用状态表
+    if (state.status == TARGET_OK && rule.mode == ALERT_VALUE_RAW) return;
+    TargetState* slot = insert_state(&next, key);
+    if (!slot) {
+        if (dropped_targets_++ == 0) {
+            WARN_LOG("alert state table of rule: %s is full, some targets are ignored", rule.name);
+        }
+        return;
+    }
+    *slot = state;
+}
+
+void MonitorInfoAlert::finish_rule(uint32_t rule_index, uint64_t curr_time_ms) {
+    const AlertRule& rule = rules_[rule_index];
+    RuleRuntime& runtime = runtimes_[rule_index];
+    StateTable& curr = runtime.tables[runtime.curr];
+    // 本周期没有出现的对象（任务退出、cpu 下线），正在告警的需要解除
+    for (uint32_t i = 0; i < curr.used_count; i++) {
+        const TargetState& state = curr.slots[curr.used[i]];
+        if (state.visited || state.status != TARGET_FIRING) continue;
+        AlertEvent event;
+        event.rule = &rule;
+        event.firing = false;
+        event.target = rule.scope == ALERT_SCOPE_SYS ? -1 : state.key;
+        event.target_name = "";
+        event.value = NAN;
+        event.time_ms = curr_time_ms;
+        emit(event);
+    }
+    clear_table(&curr);
+    runtime.curr ^= 1;
+}
+
+void MonitorInfoAlert::emit(const AlertEvent& event) {
+    changed_++;
+    const AlertRule& rule = *event.rule;
+    const char* state = event.firing ? "FIRING" : "RESOLVED";
+    char target[32];
+    if (event.target < 0) {
+        snprintf(target, sizeof(target), "-");
+    } else {
+        snprintf(target, sizeof(target), "%d", event.target);
+    }
+    char value[32];
+    snprintf(value, sizeof(value), "%.2f", event.value);
+    int length = snprintf(message_, sizeof(message_), "%lu %s %s %s=%s value=%s threshold=%.2f cmdline=%s\n",
+        event.time_ms, state, rule.name, alert_scope_names[rule.scope], target, value,
+        event.firing ? rule.threshold : rule.clear_threshold, event.target_name);
+    if (length < 0) return;
+    length = MINIMUM(length, static_cast<int>(sizeof(message_)) - 1);
+
+    for (uint32_t i = 0; i < sink_count_; i++) {
+        Sink& sink = sinks_[i];
+        switch (sink.type) {
+        case SINK_FILE:
+            if (write(sink.fd, message_, length) < 0) {
+                WARN_LOG("write alert to: %s failed, err: %s", sink.target, strerror(errno));
+            }
+            break;
+        case SINK_UNIX: {
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            memcpy(addr.sun_path, sink.target, strlen(sink.target));
+            // 接收方不在或者处理不过来时直接丢弃，不能阻塞采集
+            sendto(sink.fd, message_, length, MSG_DONTWAIT,
+                reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+            break;
+        }
+        case SINK_EXEC: {
+            if (running_children_ >= ALERT_MAX_EXEC_CHILDREN) {
+                WARN_LOG("too many running alert hooks, drop alert: %s", rule.name);
+                break;
+            }
+            pid_t pid = fork();
+            if (pid == 0) {
+                execl("/bin/sh", "sh", "-c", sink.target, "top_cpp_alert",
+                    state, rule.name, target, value, static_cast<char*>(nullptr));
+                _exit(127);
+            }
+            if (pid < 0) {
+                WARN_LOG("fork alert hook failed, err: %s", strerror(errno));
+                break;
+            }
+            children_[running_children_++] = pid;
+            break;
+        }
+        }
+    }
+    // 没有配置输出时写到标准错误
+    if (sink_count_ == 0) {
+        fwrite(message_, 1, length, stderr);
+    }
+}
+
+void MonitorInfoAlert::reap_children() {
+    // 只等待自己创建的钩子，不能用 waitpid(-1) 抢走宿主进程其他子进程的退出状态
+    uint32_t i = 0;
+    while (i < running_children_) {
+        pid_t pid = waitpid(children_[i], nullptr, WNOHANG);
+        // 返回 0 表示还在运行；出错（例如被宿主进程回收了，ECHILD）时同样不再跟踪
+        if (pid == 0 || (pid < 0 && errno == EINTR)) {
+            i++;
+            continue;
+        }
+        children_[i] = children_[--running_children_];
+    }
+}
+
+int MonitorInfoAlert::alloc_table(uint32_t capacity, StateTable* table) {
+    table->slots = static_cast<TargetState*>(malloc(sizeof(TargetState) * capacity));
+    table->used = static_cast<uint32_t*>(malloc(sizeof(uint32_t) * (capacity / 2)));
+    if (!table->slots || !table->used) return -1;
+    for (uint32_t i = 0; i < capacity; i++) {
+        table->slots[i].key = -1;
+    }
+    table->capacity = capacity;
+    table->used_count = 0;
+    return 0;
+}
+
+void MonitorInfoAlert::free_table(StateTable* table) {
+    free(table->slots);
+    free(table->used);
+    table->slots = nullptr;
+    table->used = nullptr;
+    table->capacity = 0;
+    table->used_count = 0;
+}
+
+MonitorInfoAlert::TargetState* MonitorInfoAlert::find_state(StateTable* table, int32_t key) {
+    uint32_t mask = table->capacity - 1;
+    for (uint32_t i = hash_key(key) & mask; ; i = (i + 1) & mask) {
+        TargetState* slot = &table->slots[i];
+        if (slot->key == key) return slot;
+        if (slot->key < 0) return nullptr;
+    }
+}
+
+MonitorInfoAlert::TargetState* MonitorInfoAlert::insert_state(StateTable* table, int32_t key) {
+    // 负载因子不超过 50%，保证查找一定能遇到空位
+    if (table->used_count >= table->capacity / 2) return nullptr;
+    uint32_t mask = table->capacity - 1;
+    uint32_t i = hash_key(key) & mask;
+    while (table->slots[i].key >= 0) {
+        i = (i + 1) & mask;
+    }
+    table->used[table->used_count++] = i;
+    return &table->slots[i];
+}
+
+void MonitorInfoAlert::clear_table(StateTable* table) {
+    for (uint32_t i = 0; i < table->used_count; i++) {
+        table->slots[table->used[i]].key = -1;
+    }
+    table->used_count = 0;
+}
@@ -0,0 +1,239 @@
+/**
+ * @file monitor_info_alert.h
+ * @author zhangyi
+ * @brief 基于监控快照的阈值告警
+ * @version 0.1
+ * @date 2022-12-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "monitor_info.h"
+
+// 最多的规则个数
+#define ALERT_MAX_RULES 64
+// 最多的告警输出个数
+#define ALERT_MAX_SINKS 8
+// 规则名字的最大长度
+#define ALERT_RULE_NAME_LENGTH 31
+// cmdline 过滤条件的最大长度
+#define ALERT_FILTER_LENGTH 63
+// 一条告警消息的最大长度
+#define ALERT_MESSAGE_LENGTH 511
+// 每条 task 规则最多同时跟踪的任务个数，超出的任务不参与该规则
+#define ALERT_DEFAULT_TASK_STATES 8192
+// 每条 cpu 规则最多跟踪的 cpu 个数
+#define ALERT_MAX_CPU_STATES 4096
+// 同时运行的 exec 告警钩子的最大个数，超出时丢弃告警
+#define ALERT_MAX_EXEC_CHILDREN 8
+
+// 规则的作用对象
+enum AlertScope : uint8_t {
+    ALERT_SCOPE_TASK = 0,  // 每个任务
+    ALERT_SCOPE_CPU,       // 每个 cpu（不包括汇总）
+    ALERT_SCOPE_SYS,       // 整个系统
+};
+
+// 比较操作
+enum AlertOp : uint8_t {
+    ALERT_OP_GT = 0,
+    ALERT_OP_GE,
+    ALERT_OP_LT,
+    ALERT_OP_LE,
+};
+
+// 指标的取值方式
+enum AlertValueMode : uint8_t {
+    ALERT_VALUE_RAW = 0,       // 当前值
+    ALERT_VALUE_PER_SECOND,    // 每秒的变化量
+    ALERT_VALUE_PER_MINUTE,    // 每分钟的变化量
+};
+
+/**
+ * @brief 编译后的一条规则
+ * @note 规则在加载时编译成这个定长结构，求值时不再解析字符串
+ */
+struct AlertRule {
+    char name[ALERT_RULE_NAME_LENGTH+1];
+    AlertScope scope;
+    uint8_t metric;
+    AlertOp op;
+    AlertValueMode mode;
+    // 只对 cmdline 包含该子串的任务生效，空串表示不过滤
+    char cmdline_filter[ALERT_FILTER_LENGTH+1];
+    double threshold;
+    // 告警解除的阈值（迟滞），与 threshold 相同表示没有迟滞
+    double clear_threshold;
+    // 条件需要持续满足的时间
+    uint64_t duration_ms;
+};
+
+/**
+ * @brief 一次告警状态的变化
+ *
+ */
+struct AlertEvent {
+    const AlertRule* rule;
+    // true 表示开始告警，false 表示告警解除
+    bool firing;
+    // 任务的 pid 或 cpu 编号，sys 规则为 -1
+    int32_t target;
+    // 任务的 cmdline，其它对象为空串
+    const char* target_name;
+    double value;
+    uint64_t time_ms;
+};
+
+/**
+ * @brief 阈值告警引擎
+ * @note 规则在 add_rule 时编译成定长的指令序列，每个规则对每个对象维护一个
+ *       OK -> PENDING -> FIRING 的状态机，用于实现持续时间与迟滞。
+ *       所有状态表在编译时一次性分配，evaluate 只遍历一次任务数组，不再分配内存
+ */
+class MonitorInfoAlert {
+ public:
+    MonitorInfoAlert() = default;
+    ~MonitorInfoAlert();
+    MonitorInfoAlert(const MonitorInfoAlert&) = delete;
+    MonitorInfoAlert& operator=(const MonitorInfoAlert&) = delete;
+
+    /**
+     * @brief 编译一条规则
+     * @note 格式为：
+     *       <name> <task|cpu|sys> [cmdline=<substr>] <metric>[/s|/min] <op> <value> [for <duration>] [clear <value>]
+     *       例如：
+     *       rss_leak task cmdline=nginx rss/min > 50M for 5m
+     *       cpu_steal cpu steal > 10
+     *       hot_task task cpu > 95 for 30s clear 80
+     *       value 可以带 K/M/G 后缀（1024 进制），duration 可以带 s/m/h 后缀
+     *
+     * @return int 小于 0 表示规则无效
+     */
+    int add_rule(const char* line);
+
+    /**
+     * @brief 从文件加载规则，每行一条，'#' 开头的行为注释
+     *
+     * @return int 加载的规则个数，小于 0 表示失败
+     */
+    int load_rules(const char* path);
+
+    /**
+     * @brief 添加一个告警输出
+     * @note 格式为 file:<path>、unix:<path>（SOCK_DGRAM）或 exec:<command>，
+     *       exec 钩子通过 /bin/sh -c 执行，参数依次为 状态、规则名、对象、当前值
+     *
+     * @return int 小于 0 表示失败
+     */
+    int add_sink(const char* spec);
+
+    /**
+     * @brief 对一次采集到的快照求值
+     *
+     * @return int 本次状态发生变化的告警个数
+     */
+    int evaluate(const SysMonitorInfo& monitor_info);
+
+    inline size_t rule_count() const {
+        return rule_count_;
+    }
+
+    /**
+     * @brief 因状态表已满而没有参与求值的次数
+     *
+     */
+    inline uint64_t dropped_targets() const {
+        return dropped_targets_;
+    }
+
+ private:
+    enum TargetStatus : uint8_t {
+        TARGET_OK = 0,
+        TARGET_PENDING,
+        TARGET_FIRING,
+    };
+
+    // 一个对象在一条规则下的状态
+    struct TargetState {
+        int32_t key;  // -1 表示空
+        TargetStatus status;
+        // 上一个周期是否被访问过，用于发现已经消失的对象
+        bool visited;
+        // 进入 PENDING 与上一次求值时的单调时钟
+        uint64_t since_ms;
+        double prev_raw;
+        uint64_t prev_time_ms;
+    };
+
+    // 定长的开放寻址表，used 记录已经占用的位置，清空时只需要遍历这些位置
+    struct StateTable {
+        TargetState* slots = nullptr;
+        uint32_t* used = nullptr;
+        uint32_t capacity = 0;  // 2 的幂
+        uint32_t used_count = 0;
+    };
+
+    // 一条规则的运行时数据，每个周期在 curr、next 两张表之间交换
+    struct RuleRuntime {
+        StateTable tables[2];
+        uint8_t curr;
+    };
+
+    enum SinkType : uint8_t {
+        SINK_FILE = 0,
+        SINK_UNIX,
+        SINK_EXEC,
+    };
+
+    struct Sink {
+        SinkType type;
+        int fd;
+        char target[256];
+    };
+
+    static int alloc_table(uint32_t capacity, StateTable* table);
+    static void free_table(StateTable* table);
+    static TargetState* find_state(StateTable* table, int32_t key);
+    static TargetState* insert_state(StateTable* table, int32_t key);
+    static void clear_table(StateTable* table);
+
+    /**
+     * @brief 对一个对象更新一条规则的状态机
+     *
+     * @param raw 指标的原始值
+     * @param now_ms 单调时钟，用于持续时间与变化率
+     * @param curr_time_ms 系统时间，只用于告警中显示的时间
+     */
+    void eval_target(uint32_t rule_index, int32_t key, const char* target_name,
+        double raw, uint64_t now_ms, uint64_t curr_time_ms);
+
+    /**
+     * @brief 本周期结束，对消失的对象解除告警并交换状态表
+     *
+     */
+    void finish_rule(uint32_t rule_index, uint64_t curr_time_ms);
+
+    void emit(const AlertEvent& event);
+    void reap_children();
+
+ private:
+    AlertRule rules_[ALERT_MAX_RULES];
+    RuleRuntime runtimes_[ALERT_MAX_RULES];
+    uint32_t rule_count_ = 0;
+    // 按作用对象分组的规则下标，求值时每类对象只遍历一次
+    uint32_t task_rules_[ALERT_MAX_RULES];
+    uint32_t task_rule_count_ = 0;
+    Sink sinks_[ALERT_MAX_SINKS];
+    uint32_t sink_count_ = 0;
+    // 正在运行的 exec 钩子，只回收这些子进程，嵌入使用时不影响宿主进程自己的子进程
+    pid_t children_[ALERT_MAX_EXEC_CHILDREN];
+    uint32_t running_children_ = 0;
+    uint64_t dropped_targets_ = 0;
+    int changed_ = 0;
+    char message_[ALERT_MESSAGE_LENGTH+1];
+};
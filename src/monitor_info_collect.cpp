@@ -1,3 +1,5 @@
+#include <errno.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/types.h>
 #include <dirent.h>
@@ -5,9 +7,22 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <math.h>
+#include <malloc.h>
+#include <algorithm>
 #include <iostream>
 #include "common.h"
 #include "monitor_info_collect.h"
+#include "task_proc_parse.h"
+
+MonitorInfoCollection::~MonitorInfoCollection() {
+    // 采样线程使用 proc_dir_fd_，需要先停止
+    task_state_sampler_.stop();
+    if (proc_dir_fd_ >= 0) close(proc_dir_fd_);
+    if (vmstat_fd_ >= 0) close(vmstat_fd_);
+    for (int fd : pressure_fds_) {
+        if (fd >= 0) close(fd);
+    }
+}
 
 int MonitorInfoCollection::initialize() {
     // 初始化 page_size_kb_
@@ -18,30 +33,149 @@ int MonitorInfoCollection::initialize() {
     }
     page_size_kb_ = page_size / 1024UL;
     // 初始化 jiffy_
-    jiffy_ = sysconf(_SC_CLK_TCK);
-    if (jiffy_ < 0) {
+    long clk_tck = sysconf(_SC_CLK_TCK);
+    if (clk_tck <= 0) {
         ERROR_LOG("get clk_tck by sysconf failed, err: %s", strerror(errno));
         return -2;
     }
+    jiffy_ = clk_tck;
     // 获取 cpu 的数量
     update_cpu_count();
+    proc_dir_fd_ = open(PROC_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (proc_dir_fd_ < 0) {
+        ERROR_LOG("open dir: %s failed, err: %s", PROC_DIR, strerror(errno));
+        return -3;
+    }
+    // 优先使用 proc connector 维护任务集合，不可用时回退到遍历 /proc
+    if (proc_event_listener_.start() == 0) {
+        sys_monitor_info_->proc_event_enabled = true;
+        INFO_LOG("proc connector enabled, tasks will be tracked by kernel events");
+    } else {
+        INFO_LOG("proc connector unavailable, fall back to scanning %s", PROC_DIR);
+    }
+    if (task_perf_max_tasks_ && task_perf_collection_.initialize(task_perf_max_tasks_) < 0) {
+        WARN_LOG("perf_event_open unavailable, task perf counters disabled");
+    }
+    if (task_sample_max_tasks_ && task_state_sampler_.start(proc_dir_fd_, task_sample_max_tasks_,
+        task_sample_hz_, task_sample_budget_, task_sample_interval_ms_) < 0) {
+        WARN_LOG("start task state sampler failed");
+    }
+    if (task_limit_enabled()) {
+        // 只有内存预算时按估算的单个任务开销确定初始上限，之后根据实际占用调整
+        max_detailed_tasks_ = max_detailed_tasks_limit_;
+        if (memory_budget_) {
+            size_t estimated = memory_budget_ / (sizeof(ProcessInfo) + TASK_CONTROL_BLOCK_BYTES
+                + TASK_TABLE_NODE_BYTES + TASK_ESTIMATED_STRING_BYTES);
+            max_detailed_tasks_ = max_detailed_tasks_ ? MINIMUM(max_detailed_tasks_, estimated) : estimated;
+        }
+        max_detailed_tasks_ = MAXIMUM(max_detailed_tasks_, static_cast<size_t>(MIN_DETAILED_TASKS));
+        sys_monitor_info_->self_usage.budget_bytes = memory_budget_;
+        INFO_LOG("task limit enabled, max detailed tasks: %zu, memory budget: %zu bytes",
+            max_detailed_tasks_, memory_budget_);
+    }
     return 0;
 }
 
 const std::shared_ptr<SysMonitorInfo> MonitorInfoCollection::finish_once_monitor() {
+    if (collect_counters() < 0) return std::shared_ptr<SysMonitorInfo>();
+    if (task_limit_enabled()) {
+        enforce_task_limit();
+    }
+    // 按 cpu 使用率把每个 package 的功率分摊到任务
+    if (!sys_monitor_info_->energy_packages.empty()) {
+        energy_collection_.attribute(sys_monitor_info_.get());
+    }
+    // 获取进程级别的网络监控信息
+    if (task_net_enabled_) {
+        task_net_collection_.collect(proc_dir_fd_, sys_monitor_info_.get());
+    }
+    // 获取进程的 fd 统计，频率低于 cpu 扫描
+    if (task_fd_tier_ticks_) {
+        task_fd_collection_.collect(proc_dir_fd_, sys_monitor_info_.get());
+    }
+    // 获取 cpu 使用率最高的任务的性能计数
+    if (task_perf_max_tasks_) {
+        task_perf_collection_.collect(sys_monitor_info_.get());
+    }
+    // 取出上一个间隔的状态采样，并选择下一个间隔的目标
+    if (task_sample_max_tasks_) {
+        task_state_sampler_.collect(sys_monitor_info_.get());
+    }
+    // 网络等组件的缓存在本次采集中已经淘汰了降级的任务，最后统计内存占用
+    update_self_usage();
+    return sys_monitor_info_;
+}
+
+int MonitorInfoCollection::collect_counters() {
     // 初始化时间
     if (Util::get_real_time(&sys_monitor_info_->curr_real_time,
         &sys_monitor_info_->curr_time_ms) < 0) {
         ERROR_LOG("get time failed, err: %s", strerror(errno));
-        return std::shared_ptr<SysMonitorInfo>();
+        return -1;
     }
+    sys_monitor_info_->curr_monotonic_ns = Util::get_monotonic_ns();
     // 获取系统整体的内存监控信息
-    if (get_sys_mem_info() < 0) return std::shared_ptr<SysMonitorInfo>();
+    if (get_sys_mem_info() < 0) return -1;
     // 获取系统每个 cpu 的监控信息
-    if (get_sys_cpu_info() < 0) return std::shared_ptr<SysMonitorInfo>();
-    // 递归的获取每个进程的监控信息
-    get_all_process_info_recurse(AT_FDCWD, PROC_DIR, nullptr);
-    return sys_monitor_info_;
+    if (get_sys_cpu_info() < 0) return -1;
+    // 获取系统每个块设备、网络接口的监控信息
+    uint64_t interval_ms = (last_time_ms_ && sys_monitor_info_->curr_time_ms > last_time_ms_) ? (
+        sys_monitor_info_->curr_time_ms - last_time_ms_) : 0;
+    last_time_ms_ = sys_monitor_info_->curr_time_ms;
+    get_sys_disk_info(interval_ms);
+    get_sys_net_dev_info(interval_ms);
+    // 获取系统的换页速率与资源压力
+    get_sys_vmstat_info(interval_ms);
+    get_sys_pressure_info();
+    scan_seq_++;
+    scan_first_ns_ = 0;
+    scan_last_ns_ = 0;
+    sys_monitor_info_->others = OthersTaskInfo();
+    if (sys_monitor_info_->proc_event_enabled && !proc_event_listener_.is_running()) {
+        WARN_LOG("proc connector listener stopped, fall back to scanning %s", PROC_DIR);
+        sys_monitor_info_->proc_event_enabled = false;
+    }
+    if (task_filter_.enabled()) {
+        if (sys_monitor_info_->proc_event_enabled) {
+            update_exited_process_info();
+            // 只保留目标进程的短生命周期任务，其他退出事件与目标无关
+            auto& exited = sys_monitor_info_->exited_process_info;
+            exited.erase(std::remove_if(exited.begin(), exited.end(), [this](const ExitedTaskInfo& info) {
+                return info.short_lived && !task_filter_.contains(info.tgid);
+            }), exited.end());
+            update_exec_process_info();
+            task_filter_.invalidate(exec_tasks_);
+            sys_monitor_info_->proc_event_stats = proc_event_listener_.get_event_stats();
+        }
+        get_all_process_info_by_filter();
+    } else if (sys_monitor_info_->proc_event_enabled) {
+        update_exited_process_info();
+        update_exec_process_info();
+        // 集合可信时直接按集合采集，否则重新遍历一次 /proc 并同步集合
+        if (!proc_event_synced_ || get_all_process_info_by_event() < 0) {
+            proc_event_listener_.reset_live_tasks();
+            get_all_process_info_recurse(AT_FDCWD, PROC_DIR, 0);
+            std::unordered_map<pid_t, pid_t> tasks;
+            for (const auto& proc : sys_monitor_info_->all_process_info) {
+                if (proc->last_scan_seq == scan_seq_) {
+                    tasks.emplace(proc->pid, proc->tgid);
+                }
+            }
+            // 没有完整信息的任务同样需要跟踪
+            for (const auto& state : next_light_tasks_) {
+                tasks.emplace(state.pid, state.tgid);
+            }
+            proc_event_listener_.add_live_tasks(tasks);
+            proc_event_synced_ = true;
+        }
+        sys_monitor_info_->proc_event_stats = proc_event_listener_.get_event_stats();
+    } else {
+        // 递归的获取每个进程的监控信息
+        get_all_process_info_recurse(AT_FDCWD, PROC_DIR, 0);
+    }
+    remove_stale_process_info();
+    sys_monitor_info_->scan_skew_ms = (scan_last_ns_ - scan_first_ns_) / 1E6;
+    return 0;
 }
 
 int MonitorInfoCollection::get_sys_mem_info() {
@@ -125,17 +259,17 @@ void MonitorInfoCollection::update_cpu_count() {
         ERROR_LOG("open dir: %s failed, err: %s", "/sys/devices/system/cpu", strerror(errno));
         return;
     }
-    if (sys_monitor_info_->sys_cpu_data.empty()) {
-        auto cpu_data = std::make_shared<CpuData>();
-        cpu_data->on_line = true;
-        sys_monitor_info_->sys_cpu_data.emplace_back(cpu_data);
+    CpuDataArray& cpu_data = sys_monitor_info_->sys_cpu_data;
+    if (cpu_data.empty()) {
+        cpu_data.resize(1);
+        cpu_data.set_on_line(0, true);
     }
     uint32_t curr_existing_cpu = sys_monitor_info_->existing_cpus;
     const struct dirent* entry;
     while ((entry = readdir(dir)) != NULL) {
         // 如果不是目录或者类型未知，则跳过
         if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN) continue;
-        // 如果目录名不是 cpu* ，则跳过
+        // 如果目录名不是 cpu* ，则跳过
         uint32_t cpu_str_len = strlen("cpu");
         if (strncmp(entry->d_name, "cpu", cpu_str_len) != 0) continue;
         // 获取 cpu 的 id，比如 cpu1，id 则为 1
@@ -151,10 +285,7 @@ void MonitorInfoCollection::update_cpu_count() {
         // 更新数组的长度
         uint32_t max_val = MAXIMUM(existing_cpus, id+1);
         if (max_val > curr_existing_cpu) {
-            for (size_t i = curr_existing_cpu+1; i <= max_val; i++) {
-                auto cpu_data = std::make_shared<CpuData>();
-                sys_monitor_info_->sys_cpu_data.emplace_back(cpu_data);
-            }
+            cpu_data.resize(max_val + 1);
             curr_existing_cpu = max_val;
         }
         // 判断此 cpu 是否在线
@@ -162,16 +293,16 @@ void MonitorInfoCollection::update_cpu_count() {
         ssize_t res = Util::read_file(cpu_dir_fd, "online", buffer, sizeof(buffer));
         if (res < 1 || buffer[0] != '0') {
             active_cpus++;
-            sys_monitor_info_->sys_cpu_data[id+1]->on_line = true;
+            cpu_data.set_on_line(id+1, true);
         } else {
-            sys_monitor_info_->sys_cpu_data[id+1]->on_line = false;
+            cpu_data.set_on_line(id+1, false);
         }
         close(cpu_dir_fd);
     }
     closedir(dir);
     if (existing_cpus < 1) return;
-    // 需要多分配一个元素，存储总 cpu 的数据
-    sys_monitor_info_->sys_cpu_data.resize(existing_cpus+1);
+    // 需要多分配一个元素，存储总 cpu 的数据
+    cpu_data.resize(existing_cpus+1);
     sys_monitor_info_->existing_cpus = existing_cpus;
     sys_monitor_info_->active_cpus = active_cpus;
     return;
@@ -179,96 +310,437 @@ void MonitorInfoCollection::update_cpu_count() {
 
 int MonitorInfoCollection::get_sys_cpu_info() {
     // 通过 /proc/stat 文件获取系统 cpu 信息
-    FILE* file = fopen(PROC_STAT_FILE, "r");
-    if (!file) {
-        ERROR_LOG("open file: %s failed, err: %s", PROC_STAT_FILE, strerror(errno));
+    ssize_t res = Util::read_file(proc_dir_fd_, "stat", &read_buffer_);
+    if (res < 0) {
+        ERROR_LOG("read file: %s failed, err: %s", PROC_STAT_FILE, strerror(-res));
         return -1;
     }
-    // 获取每个 cpu 的信息
-    for (size_t i = 0; i <= sys_monitor_info_->existing_cpus; i++) {
-        char buffer[PROC_LINE_MAX_LENGTH + 1];
-        uint64_t user_time = 0, nice_time = 0, system_time = 0, idle_time = 0;
-        uint64_t io_wait = 0, irq = 0, soft_irq = 0, steal = 0, guest = 0, guest_nice = 0;
-        const char* is_succ = fgets(buffer, sizeof(buffer), file);
-        if (!is_succ) {
-            ERROR_LOG("fgets file failed, err: %s", strerror(errno));
-            break;
-        }
-        if (strncmp(buffer, "cpu", strlen("cpu")) != 0) break;
-
-        uint32_t adj_cpu_id = 0;
-        int res = 0;
-        if (i == 0) {
-            res = sscanf(buffer, "cpu  %16lu %16lu %16lu %16lu %16lu %16lu %16lu %16lu %16lu %16lu",
-                &user_time, &nice_time, &system_time, &idle_time,
-                &io_wait, &irq, &soft_irq, &steal, &guest, &guest_nice);
-            if (res <= 0) {
-                ERROR_LOG("sscanf cpu failed, err: %s", strerror(errno));
-                continue;
-            }
-            adj_cpu_id = 0;
-        } else {
-            uint32_t cpu_id;
-            res = sscanf(buffer, "cpu%4u %16lu %16lu %16lu %16lu %16lu %16lu %16lu %16lu %16lu %16lu",
-                &cpu_id, &user_time, &nice_time, &system_time, &idle_time,
-                &io_wait, &irq, &soft_irq, &steal, &guest, &guest_nice);
-            if (res <= 0) {
-                ERROR_LOG("sscanf cpu%d failed, err: %s", cpu_id, strerror(errno));
-                continue;
-            }
-            adj_cpu_id = cpu_id + 1;
+    CpuDataArray& cpu_data = sys_monitor_info_->sys_cpu_data;
+    cpu_data.begin_update();
+    // 获取每个 cpu 的累计时间，周期时间与百分比在全部读完之后批量计算
+    char* line = &read_buffer_[0];
+    while (line && Util::wrap_strncmp(line, "cpu")) {
+        char* p = line + strlen("cpu");
+        char* next_line = strchr(p, '\n');
+        if (next_line) *next_line++ = '\0';
+        size_t adj_cpu_id = 0;
+        if (*p != ' ') {
+            adj_cpu_id = Util::parse_uint64(&p) + 1;
         }
-        if (adj_cpu_id > sys_monitor_info_->existing_cpus || adj_cpu_id >= sys_monitor_info_->sys_cpu_data.size()) {
+        if (adj_cpu_id > sys_monitor_info_->existing_cpus || adj_cpu_id >= cpu_data.size()) {
             break;
         }
+        uint64_t user_time = Util::parse_uint64(&p);
+        uint64_t nice_time = Util::parse_uint64(&p);
+        uint64_t system_time = Util::parse_uint64(&p);
+        uint64_t idle_time = Util::parse_uint64(&p);
+        uint64_t io_wait = Util::parse_uint64(&p);
+        uint64_t irq = Util::parse_uint64(&p);
+        uint64_t soft_irq = Util::parse_uint64(&p);
+        uint64_t steal = Util::parse_uint64(&p);
+        uint64_t guest = Util::parse_uint64(&p);
+        uint64_t guest_nice = Util::parse_uint64(&p);
         // guest 时间已经被计算在 user_time 中了
-        user_time -= guest;
-        nice_time -= guest_nice;
+        user_time = user_time > guest ? user_time - guest : 0;
+        nice_time = nice_time > guest_nice ? nice_time - guest_nice : 0;
         uint64_t idle_all_time = idle_time + io_wait;
         uint64_t system_all_time = system_time + irq + soft_irq;
         uint64_t virtual_all_time = guest + guest_nice;
         uint64_t total_time = user_time + nice_time + system_all_time + idle_all_time + steal + virtual_all_time;
 
-        auto tmp_cpu_data = sys_monitor_info_->sys_cpu_data[adj_cpu_id];
-        #define ULL_VALUE_SUB(a, b) (((a) > (b)) ? ((a)-(b)) : 0)
-        // 计算一个周期的 cpu 相关属性值
-        tmp_cpu_data->user_period = ULL_VALUE_SUB(user_time, tmp_cpu_data->user_time);
-        tmp_cpu_data->nice_period = ULL_VALUE_SUB(nice_time, tmp_cpu_data->nice_time);
-        tmp_cpu_data->system_period = ULL_VALUE_SUB(system_time, tmp_cpu_data->system_time);
-        tmp_cpu_data->system_all_period = ULL_VALUE_SUB(system_all_time, tmp_cpu_data->system_all_time);
-        tmp_cpu_data->idle_all_period = ULL_VALUE_SUB(idle_all_time, tmp_cpu_data->idle_all_time);
-        tmp_cpu_data->idle_period = ULL_VALUE_SUB(idle_time, tmp_cpu_data->idle_time);
-        tmp_cpu_data->io_wait_period = ULL_VALUE_SUB(io_wait, tmp_cpu_data->io_wait_time);
-        tmp_cpu_data->irq_period = ULL_VALUE_SUB(irq, tmp_cpu_data->irq_time);
-        tmp_cpu_data->soft_irq_period = ULL_VALUE_SUB(soft_irq, tmp_cpu_data->soft_irq_time);
-        tmp_cpu_data->steal_period = ULL_VALUE_SUB(steal, tmp_cpu_data->steal_time);
-        tmp_cpu_data->guest_period = ULL_VALUE_SUB(virtual_all_time, tmp_cpu_data->guest_time);
-        tmp_cpu_data->total_period = ULL_VALUE_SUB(total_time, tmp_cpu_data->total_time);
-        #undef ULL_VALUE_SUB
-        DEBUG_LOG("cpu id: %d, total: %lu, user: %lu, nice: %lu, system: %lu, idle: %lu", adj_cpu_id,
-            tmp_cpu_data->total_period, tmp_cpu_data->user_period, tmp_cpu_data->nice_period,
-            tmp_cpu_data->system_period, tmp_cpu_data->idle_period);
-        // 保存当前时刻的值
-        tmp_cpu_data->user_time = user_time;
-        tmp_cpu_data->nice_time = nice_time;
-        tmp_cpu_data->system_time = system_time;
-        tmp_cpu_data->system_all_time = system_all_time;
-        tmp_cpu_data->idle_all_time = idle_all_time;
-        tmp_cpu_data->idle_time = idle_time;
-        tmp_cpu_data->io_wait_time = io_wait;
-        tmp_cpu_data->irq_time = irq;
-        tmp_cpu_data->soft_irq_time = soft_irq;
-        tmp_cpu_data->steal_time = steal;
-        tmp_cpu_data->guest_time = virtual_all_time;
-        tmp_cpu_data->total_time = total_time;
+        cpu_data.set_next_time(CPU_TIME_USER, adj_cpu_id, user_time);
+        cpu_data.set_next_time(CPU_TIME_NICE, adj_cpu_id, nice_time);
+        cpu_data.set_next_time(CPU_TIME_SYSTEM, adj_cpu_id, system_time);
+        cpu_data.set_next_time(CPU_TIME_SYSTEM_ALL, adj_cpu_id, system_all_time);
+        cpu_data.set_next_time(CPU_TIME_IDLE_ALL, adj_cpu_id, idle_all_time);
+        cpu_data.set_next_time(CPU_TIME_IDLE, adj_cpu_id, idle_time);
+        cpu_data.set_next_time(CPU_TIME_IO_WAIT, adj_cpu_id, io_wait);
+        cpu_data.set_next_time(CPU_TIME_IRQ, adj_cpu_id, irq);
+        cpu_data.set_next_time(CPU_TIME_SOFT_IRQ, adj_cpu_id, soft_irq);
+        cpu_data.set_next_time(CPU_TIME_STEAL, adj_cpu_id, steal);
+        cpu_data.set_next_time(CPU_TIME_GUEST, adj_cpu_id, virtual_all_time);
+        cpu_data.set_next_time(CPU_TIME_TOTAL, adj_cpu_id, total_time);
+        line = next_line;
     }
-    fclose(file);
-    period_ = static_cast<double>(sys_monitor_info_->sys_cpu_data[0]->total_period) / sys_monitor_info_->active_cpus;
+    cpu_data.finish_update();
+    // 频率、idle 状态依赖本周期的 busy 百分比，没有对应的 sysfs 节点时不影响 cpu 时间的采集
+    cpu_freq_collection_.collect(&cpu_data);
+    // 状态名几乎不会变化，只在变化时复制
+    const std::vector<std::string>& idle_state_names = cpu_freq_collection_.idle_state_names();
+    if (idle_state_names != sys_monitor_info_->cpu_idle_state_names) {
+        sys_monitor_info_->cpu_idle_state_names = idle_state_names;
+    }
+    // 能耗与 cpu 时间在同一时刻读取，分摊时 package 的繁忙程度与功率对应同一个周期
+    energy_collection_.collect(cpu_data, &sys_monitor_info_->energy_packages);
+    DEBUG_LOG("cpu total: %lu, user: %lu, nice: %lu, system: %lu, idle: %lu",
+        cpu_data.period(CPU_TIME_TOTAL, 0), cpu_data.period(CPU_TIME_USER, 0),
+        cpu_data.period(CPU_TIME_NICE, 0), cpu_data.period(CPU_TIME_SYSTEM, 0),
+        cpu_data.period(CPU_TIME_IDLE, 0));
     return 0;
 }
 
+/**
+ * @brief 在设备数组中定位第 index 行对应的设备
+ * @note 设备列表没有变化时直接原地更新；有设备消失或顺序变化时，把同名设备交换到当前位置；
+ *       新设备插入到当前位置。全部定位完之后截断到实际的设备个数，消失的设备都被交换到了末尾
+ */
+template <typename DeviceT>
+static DeviceT* locate_device(std::vector<DeviceT>* devices, size_t index, const char* name, bool* is_new) {
+    *is_new = false;
+    if (index < devices->size() && strcmp((*devices)[index].name, name) == 0) {
+        return &(*devices)[index];
+    }
+    for (size_t i = index + 1; i < devices->size(); i++) {
+        if (strcmp((*devices)[i].name, name) == 0) {
+            std::swap((*devices)[index], (*devices)[i]);
+            return &(*devices)[index];
+        }
+    }
+    DeviceT device;
+    memset(&device, 0, sizeof(device));
+    snprintf(device.name, sizeof(device.name), "%s", name);
+    devices->insert(devices->begin() + MINIMUM(index, devices->size()), device);
+    *is_new = true;
+    return &(*devices)[index];
+}
+
+// 计算累计值在一个周期内的增量
+#define ULL_VALUE_SUB(a, b) (((a) > (b)) ? ((a)-(b)) : 0)
+
+// vmstat 中需要的字段
+enum VmstatField {
+    VMSTAT_PGFAULT = 0,
+    VMSTAT_PGMAJFAULT,
+    VMSTAT_PSWPIN,
+    VMSTAT_PSWPOUT,
+    VMSTAT_PGSCAN,
+    VMSTAT_PGSTEAL,
+    VMSTAT_OOM_KILL,
+    VMSTAT_FIELD_NUM,
+};
+
+// vmstat 中的 key 与字段的对应关系，多个 key 可以累加到同一个字段
+static const struct {
+    const char* key;
+    VmstatField field;
+} vmstat_keys[] = {
+    {"pgfault", VMSTAT_PGFAULT},
+    {"pgmajfault", VMSTAT_PGMAJFAULT},
+    {"pswpin", VMSTAT_PSWPIN},
+    {"pswpout", VMSTAT_PSWPOUT},
+    {"pgscan_kswapd", VMSTAT_PGSCAN},
+    {"pgscan_direct", VMSTAT_PGSCAN},
+    {"pgscan_khugepaged", VMSTAT_PGSCAN},
+    {"pgscan_proactive", VMSTAT_PGSCAN},
+    {"pgsteal_kswapd", VMSTAT_PGSTEAL},
+    {"pgsteal_direct", VMSTAT_PGSTEAL},
+    {"pgsteal_khugepaged", VMSTAT_PGSTEAL},
+    {"pgsteal_proactive", VMSTAT_PGSTEAL},
+    {"oom_kill", VMSTAT_OOM_KILL},
+};
+
+/**
+ * @brief 查找 vmstat 一行的 key 对应的表项
+ *
+ * @param key_len key 的长度
+ * @return int 表项的下标，-1 表示不关心这一行
+ */
+static int find_vmstat_key(const char* line, size_t key_len) {
+    for (size_t i = 0; i < sizeof(vmstat_keys) / sizeof(vmstat_keys[0]); i++) {
+        if (strlen(vmstat_keys[i].key) == key_len && memcmp(vmstat_keys[i].key, line, key_len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int MonitorInfoCollection::get_sys_vmstat_info(uint64_t interval_ms) {
+    if (vmstat_fd_ < 0) {
+        vmstat_fd_ = open(PROC_VMSTAT_FILE, O_RDONLY | O_CLOEXEC);
+        if (vmstat_fd_ < 0) {
+            ERROR_LOG("open file: %s failed, err: %s", PROC_VMSTAT_FILE, strerror(errno));
+            return -1;
+        }
+    }
+    if (read_buffer_.size() < 16384) {
+        read_buffer_.resize(16384);
+    }
+    ssize_t len = pread(vmstat_fd_, &read_buffer_[0], read_buffer_.size() - 1, 0);
+    if (len < 0) {
+        ERROR_LOG("read file: %s failed, err: %s", PROC_VMSTAT_FILE, strerror(errno));
+        return -2;
+    }
+    read_buffer_[len] = '\0';
+
+    uint64_t values[VMSTAT_FIELD_NUM] = {0};
+    // 文件的行布局在内核不变的情况下是固定的，第一次解析时记录每一行对应的表项，
+    // 之后只需要校验关心的行，其余的行直接跳过
+    bool rebuild = vmstat_line_fields_.empty();
+    for (int pass = 0; pass < 2; pass++) {
+        memset(values, 0, sizeof(values));
+        bool layout_changed = false;
+        size_t line_index = 0;
+        char* line = &read_buffer_[0];
+        while (*line) {
+            char* line_end = strchr(line, '\n');
+            int key_index = -1;
+            if (rebuild) {
+                const char* space = strchr(line, ' ');
+                if (space) key_index = find_vmstat_key(line, space - line);
+                vmstat_line_fields_.push_back(key_index);
+            } else if (line_index >= vmstat_line_fields_.size()) {
+                layout_changed = true;
+                break;
+            } else {
+                key_index = vmstat_line_fields_[line_index];
+                if (key_index >= 0) {
+                    size_t key_len = strlen(vmstat_keys[key_index].key);
+                    if (memcmp(line, vmstat_keys[key_index].key, key_len) != 0 || line[key_len] != ' ') {
+                        layout_changed = true;
+                        break;
+                    }
+                }
+            }
+            if (key_index >= 0) {
+                char* location = strchr(line, ' ');
+                values[vmstat_keys[key_index].field] += Util::parse_uint64(&location);
+            }
+            line_index++;
+            if (!line_end) break;
+            line = line_end + 1;
+        }
+        if (!layout_changed && line_index == vmstat_line_fields_.size()) break;
+        // 行布局发生了变化，重新建立行号表
+        vmstat_line_fields_.clear();
+        rebuild = true;
+    }
+
+    VmstatData& vmstat = sys_monitor_info_->vmstat;
+    if (interval_ms && vmstat.pgfault) {
+        #define VMSTAT_RATE(field, index) \
+            (((values[index] > vmstat.field) ? (values[index] - vmstat.field) : 0) * 1000.0 / interval_ms)
+        vmstat.pgfault_ps = VMSTAT_RATE(pgfault, VMSTAT_PGFAULT);
+        vmstat.pgmajfault_ps = VMSTAT_RATE(pgmajfault, VMSTAT_PGMAJFAULT);
+        vmstat.pswpin_ps = VMSTAT_RATE(pswpin, VMSTAT_PSWPIN);
+        vmstat.pswpout_ps = VMSTAT_RATE(pswpout, VMSTAT_PSWPOUT);
+        vmstat.pgscan_ps = VMSTAT_RATE(pgscan, VMSTAT_PGSCAN);
+        vmstat.pgsteal_ps = VMSTAT_RATE(pgsteal, VMSTAT_PGSTEAL);
+        #undef VMSTAT_RATE
+        vmstat.oom_kill_delta = values[VMSTAT_OOM_KILL] > vmstat.oom_kill ? (
+            values[VMSTAT_OOM_KILL] - vmstat.oom_kill) : 0;
+    }
+    vmstat.pgfault = values[VMSTAT_PGFAULT];
+    vmstat.pgmajfault = values[VMSTAT_PGMAJFAULT];
+    vmstat.pswpin = values[VMSTAT_PSWPIN];
+    vmstat.pswpout = values[VMSTAT_PSWPOUT];
+    vmstat.pgscan = values[VMSTAT_PGSCAN];
+    vmstat.pgsteal = values[VMSTAT_PGSTEAL];
+    vmstat.oom_kill = values[VMSTAT_OOM_KILL];
+    return 0;
+}
+
+/**
+ * @brief 解析 pressure 文件中的一行
+ * @note 格式为：some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+ */
+static void parse_pressure_line(char* line, float* avg10, float* avg60, float* avg300, uint64_t* total) {
+    char* location = strstr(line, "avg10=");
+    if (location) *avg10 = strtof(location + strlen("avg10="), nullptr);
+    location = strstr(line, "avg60=");
+    if (location) *avg60 = strtof(location + strlen("avg60="), nullptr);
+    location = strstr(line, "avg300=");
+    if (location) *avg300 = strtof(location + strlen("avg300="), nullptr);
+    location = strstr(line, "total=");
+    if (location) {
+        location += strlen("total=");
+        *total = Util::parse_uint64(&location);
+    }
+}
+
+int MonitorInfoCollection::get_sys_pressure_info() {
+    static const char* pressure_files[] = {
+        PROC_PRESSURE_DIR "/cpu",
+        PROC_PRESSURE_DIR "/memory",
+        PROC_PRESSURE_DIR "/io",
+    };
+    PressureData* pressures[] = {
+        &sys_monitor_info_->cpu_pressure,
+        &sys_monitor_info_->memory_pressure,
+        &sys_monitor_info_->io_pressure,
+    };
+    bool available = false;
+    for (int i = 0; i < 3; i++) {
+        // -2 表示文件不存在或者内核关闭了 psi，不再尝试
+        if (pressure_fds_[i] == -2) continue;
+        if (pressure_fds_[i] < 0) {
+            pressure_fds_[i] = open(pressure_files[i], O_RDONLY | O_CLOEXEC);
+            if (pressure_fds_[i] < 0) {
+                pressure_fds_[i] = -2;
+                continue;
+            }
+        }
+        char buf[256];
+        ssize_t len = pread(pressure_fds_[i], buf, sizeof(buf) - 1, 0);
+        if (len <= 0) {
+            close(pressure_fds_[i]);
+            pressure_fds_[i] = -2;
+            continue;
+        }
+        buf[len] = '\0';
+        PressureData& pressure = *pressures[i];
+        uint64_t some_total = pressure.some_total_us;
+        uint64_t full_total = pressure.full_total_us;
+        char* full_line = strstr(buf, "full ");
+        if (full_line) {
+            *(full_line - 1) = '\0';
+            parse_pressure_line(full_line, &pressure.full_avg10, &pressure.full_avg60,
+                &pressure.full_avg300, &full_total);
+        }
+        parse_pressure_line(buf, &pressure.some_avg10, &pressure.some_avg60, &pressure.some_avg300, &some_total);
+        // 第一次采集时没有上一个周期的值
+        if (pressure.some_total_us) {
+            pressure.some_delta_us = some_total > pressure.some_total_us ? some_total - pressure.some_total_us : 0;
+            pressure.full_delta_us = full_total > pressure.full_total_us ? full_total - pressure.full_total_us : 0;
+        }
+        pressure.some_total_us = some_total;
+        pressure.full_total_us = full_total;
+        available = true;
+    }
+    sys_monitor_info_->pressure_available = available;
+    return available ? 0 : -1;
+}
+
+int MonitorInfoCollection::get_sys_disk_info(uint64_t interval_ms) {
+    ssize_t res = Util::read_file(AT_FDCWD, PROC_DISKSTATS_FILE, &read_buffer_);
+    if (res < 0) {
+        ERROR_LOG("read file: %s failed, err: %s", PROC_DISKSTATS_FILE, strerror(-res));
+        return -1;
+    }
+    auto& disks = sys_monitor_info_->sys_disk_data;
+    size_t index = 0;
+    char* line = &read_buffer_[0];
+    while (*line) {
+        char* line_end = strchr(line, '\n');
+        if (line_end) *line_end = '\0';
+        // 每行的格式为：major minor name reads merged sectors read_ms writes merged sectors write_ms
+        //             in_progress io_ms weighted_io_ms ...
+        char* location = line;
+        uint64_t major = Util::parse_uint64(&location);
+        uint64_t minor = Util::parse_uint64(&location);
+        while (*location == ' ') location++;
+        char* name = location;
+        while (*location && *location != ' ') location++;
+        if (*location) *location++ = '\0';
+        if (*name) {
+            bool is_new;
+            DiskData* disk = locate_device(&disks, index++, name, &is_new);
+            disk->major = major;
+            disk->minor = minor;
+            uint64_t reads = Util::parse_uint64(&location);
+            Util::parse_uint64(&location);  // reads merged
+            uint64_t sectors_read = Util::parse_uint64(&location);
+            uint64_t read_time_ms = Util::parse_uint64(&location);
+            uint64_t writes = Util::parse_uint64(&location);
+            Util::parse_uint64(&location);  // writes merged
+            uint64_t sectors_written = Util::parse_uint64(&location);
+            uint64_t write_time_ms = Util::parse_uint64(&location);
+            uint64_t io_in_progress = Util::parse_uint64(&location);
+            uint64_t io_time_ms = Util::parse_uint64(&location);
+            if (!is_new && interval_ms) {
+                uint64_t delta_reads = ULL_VALUE_SUB(reads, disk->reads_completed);
+                uint64_t delta_writes = ULL_VALUE_SUB(writes, disk->writes_completed);
+                uint64_t delta_read_ms = ULL_VALUE_SUB(read_time_ms, disk->read_time_ms);
+                uint64_t delta_write_ms = ULL_VALUE_SUB(write_time_ms, disk->write_time_ms);
+                disk->read_iops = delta_reads * 1000.0 / interval_ms;
+                disk->write_iops = delta_writes * 1000.0 / interval_ms;
+                // 扇区大小固定为 512 字节
+                disk->read_bps = ULL_VALUE_SUB(sectors_read, disk->sectors_read) * 512000.0 / interval_ms;
+                disk->write_bps = ULL_VALUE_SUB(sectors_written, disk->sectors_written) * 512000.0 / interval_ms;
+                disk->read_await_ms = delta_reads ? static_cast<double>(delta_read_ms) / delta_reads : 0;
+                disk->write_await_ms = delta_writes ? static_cast<double>(delta_write_ms) / delta_writes : 0;
+                disk->util_percent = MINIMUM(ULL_VALUE_SUB(io_time_ms, disk->io_time_ms) * 100.0 / interval_ms, 100.0);
+            }
+            disk->reads_completed = reads;
+            disk->sectors_read = sectors_read;
+            disk->read_time_ms = read_time_ms;
+            disk->writes_completed = writes;
+            disk->sectors_written = sectors_written;
+            disk->write_time_ms = write_time_ms;
+            disk->io_in_progress = io_in_progress;
+            disk->io_time_ms = io_time_ms;
+        }
+        if (!line_end) break;
+        line = line_end + 1;
+    }
+    // 截掉已经消失的设备
+    if (index != disks.size()) {
+        disks.resize(index);
+    }
+    return 0;
+}
+
+int MonitorInfoCollection::get_sys_net_dev_info(uint64_t interval_ms) {
+    ssize_t res = Util::read_file(AT_FDCWD, PROC_NET_DEV_FILE, &read_buffer_);
+    if (res < 0) {
+        ERROR_LOG("read file: %s failed, err: %s", PROC_NET_DEV_FILE, strerror(-res));
+        return -1;
+    }
+    auto& devs = sys_monitor_info_->sys_net_dev_data;
+    size_t index = 0;
+    char* line = &read_buffer_[0];
+    int line_no = 0;
+    while (*line) {
+        char* line_end = strchr(line, '\n');
+        if (line_end) *line_end = '\0';
+        // 跳过前两行表头，每行的格式为：name: rx_bytes packets errs drop fifo frame compressed multicast
+        //                             tx_bytes packets errs drop fifo colls carrier compressed
+        char* colon = strchr(line, ':');
+        if (line_no++ >= 2 && colon) {
+            *colon = '\0';
+            char* name = line;
+            while (*name == ' ') name++;
+            bool is_new;
+            NetDevData* dev = locate_device(&devs, index++, name, &is_new);
+            char* location = colon + 1;
+            uint64_t rx_bytes = Util::parse_uint64(&location);
+            uint64_t rx_packets = Util::parse_uint64(&location);
+            uint64_t rx_errors = Util::parse_uint64(&location);
+            uint64_t rx_dropped = Util::parse_uint64(&location);
+            for (int i = 0; i < 4; i++) Util::parse_uint64(&location);  // fifo frame compressed multicast
+            uint64_t tx_bytes = Util::parse_uint64(&location);
+            uint64_t tx_packets = Util::parse_uint64(&location);
+            uint64_t tx_errors = Util::parse_uint64(&location);
+            uint64_t tx_dropped = Util::parse_uint64(&location);
+            if (!is_new && interval_ms) {
+                dev->rx_bps = ULL_VALUE_SUB(rx_bytes, dev->rx_bytes) * 1000.0 / interval_ms;
+                dev->rx_pps = ULL_VALUE_SUB(rx_packets, dev->rx_packets) * 1000.0 / interval_ms;
+                dev->rx_drop_ps = ULL_VALUE_SUB(rx_dropped, dev->rx_dropped) * 1000.0 / interval_ms;
+                dev->tx_bps = ULL_VALUE_SUB(tx_bytes, dev->tx_bytes) * 1000.0 / interval_ms;
+                dev->tx_pps = ULL_VALUE_SUB(tx_packets, dev->tx_packets) * 1000.0 / interval_ms;
+                dev->tx_drop_ps = ULL_VALUE_SUB(tx_dropped, dev->tx_dropped) * 1000.0 / interval_ms;
+            }
+            dev->rx_bytes = rx_bytes;
+            dev->rx_packets = rx_packets;
+            dev->rx_errors = rx_errors;
+            dev->rx_dropped = rx_dropped;
+            dev->tx_bytes = tx_bytes;
+            dev->tx_packets = tx_packets;
+            dev->tx_errors = tx_errors;
+            dev->tx_dropped = tx_dropped;
+        }
+        if (!line_end) break;
+        line = line_end + 1;
+    }
+    if (index != devs.size()) {
+        devs.resize(index);
+    }
+    return 0;
+}
+
+#undef ULL_VALUE_SUB
+
 int MonitorInfoCollection::get_all_process_info_recurse(int parent_fd,
-    const char* dir_name, const std::shared_ptr<ProcessInfo>& parent) {
+    const char* dir_name, pid_t parent_pid) {
     int dir_fd = openat(parent_fd, dir_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
     if (dir_fd < 0) {
         ERROR_LOG("openat parent_fd: %d, dir_name: %s failed, err: %s", parent_fd, dir_name, strerror(errno));
@@ -303,7 +775,7 @@ int MonitorInfoCollection::get_all_process_info_recurse(int parent_fd,
             continue;
         }
         // 这里是线程，并且跳过主线程，与进程是同一个 id
-        if (parent && pid == parent->pid) {
+        if (parent_pid && pid == static_cast<uint64_t>(parent_pid)) {
             continue;
         }
         // 获取进程 "/proc/pid" 对应的目录的 fd
@@ -312,58 +784,357 @@ int MonitorInfoCollection::get_all_process_info_recurse(int parent_fd,
             ERROR_LOG("openat dir_fd: %d, file: %s failed, err: %s", dir_fd, entry->d_name, strerror(errno));
             continue;
         }
-        // 获取 ProcessInfo 对象，如果不存在则创建
-        bool pid_prev_existed = false;
-        auto proc = get_process_info(pid, &pid_prev_existed);
         // 递归获取进程中的所有的线程的监控信息
         // 如果任务是线程，则不需要递归了
         if (!Util::wrap_strncmp(dir_name, "task")) {
-            get_all_process_info_recurse(proc_fd, "task", proc);
-        }
-        // 获取任务的 IO 监控信息
-        get_task_io_info(proc_fd, proc);
-        /**
-         * 也可以读取 smaps 或 smaps_rollup 文件来获取内存相关信息，
-         * 但是读取 smaps 或 smaps_rollup 文件很慢、很耗费性能。因此放弃
-         * 原因大概为：读取 smaps 的成本与进程的内存使用相关。看起来内核需要检查每个内存页的状态才能生成内容
-         * 参见 man 手册 /proc/[pid]/smaps
-         */
-        // 获取任务中的 statm 监控信息（主要是内存信息）
-        if (get_task_statm_info(proc_fd, proc) < 0)
-            goto errorReadingProcess;
-        {
-            // 在读取 stat 文件前先保存上一个周期的任务 cpu 耗时
-            uint64_t last_time = proc->utime + proc->stime;
-            // 获取任务中的 stat 文件监控信息
-            if (get_task_stat_info(proc_fd, proc) < 0)
-                goto errorReadingProcess;
-            // 计算 cpu、mem 的周期百分比
-            float percent_cpu = (period_ < 1E-6) ? 0.0F : ((proc->utime + proc->stime - last_time) / period_ * 100.0);
-            proc->percent_cpu = (percent_cpu > sys_monitor_info_->active_cpus * 100.0F) ? (
-                sys_monitor_info_->active_cpus * 100.0F) : (MAXIMUM(percent_cpu, 0.0F));
-            proc->percent_mem = proc->resident_mem / static_cast<double>(sys_monitor_info_->total_mem) * 100.0;
-        }
-        // 添加 ProcessInfo
-        // 如果这个任务是一个新任务
-        if (!pid_prev_existed) {
-            sys_monitor_info_->all_process_info.emplace_back(proc);
-            sys_monitor_info_->all_process_info_table.emplace(pid, proc);
+            get_all_process_info_recurse(proc_fd, "task", pid);
         }
+        get_task_info(proc_fd, pid, parent_pid ? parent_pid : pid);
         close(proc_fd);
-        continue;
+    }
+    closedir(dir);
+    return 0;
+}
 
-errorReadingProcess:
-        {
-            if (proc_fd >= 0) {
-                close(proc_fd);
+int MonitorInfoCollection::get_all_process_info_by_event() {
+    if (!proc_event_listener_.get_live_tasks(&live_tasks_)) {
+        return -1;
+    }
+    for (const auto& task : live_tasks_) {
+        char path[32];
+        if (task.first == task.second) {
+            snprintf(path, sizeof(path), "%d", task.first);
+        } else {
+            snprintf(path, sizeof(path), "%d/task/%d", task.second, task.first);
+        }
+        int proc_fd = openat(proc_dir_fd_, path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+        if (proc_fd < 0) {
+            // 任务已经退出，但退出事件还没有处理
+            if (errno == ENOENT) {
+                proc_event_listener_.remove_live_task(task.first);
             }
+            continue;
         }
+        get_task_info(proc_fd, task.first, task.second);
+        close(proc_fd);
     }
-    closedir(dir);
     return 0;
 }
 
-void MonitorInfoCollection::get_task_io_info(int proc_fd, std::shared_ptr<ProcessInfo> process) {
+int MonitorInfoCollection::get_all_process_info_by_filter() {
+    const std::vector<pid_t>& targets = task_filter_.refresh(proc_dir_fd_);
+    for (pid_t tgid : targets) {
+        char path[16];
+        snprintf(path, sizeof(path), "%d", tgid);
+        int proc_fd = openat(proc_dir_fd_, path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+        // 目标进程已经退出
+        if (proc_fd < 0) continue;
+        get_all_process_info_recurse(proc_fd, "task", tgid);
+        get_task_info(proc_fd, tgid, tgid);
+        close(proc_fd);
+    }
+    return 0;
+}
+
+int MonitorInfoCollection::get_task_info(int proc_fd, uint64_t pid, pid_t tgid) {
+    // 每个任务以自己的读取时间计算速率，扫描较慢时靠后的任务的速率不会偏大
+    uint64_t now_ns = Util::get_monotonic_ns();
+    if (!scan_first_ns_) scan_first_ns_ = now_ns;
+    scan_last_ns_ = now_ns;
+    // 限制了任务个数时，没有完整信息的任务只读取 stat，变得活跃时才晋升
+    LightTaskState light_state;
+    bool promoted = false;
+    if (task_limit_enabled() && sys_monitor_info_->all_process_info_table.count(pid) == 0) {
+        if (!update_light_task(proc_fd, pid, tgid, now_ns, &light_state)) return 0;
+        promoted = true;
+    }
+    // 获取 ProcessInfo 对象，如果不存在则创建
+    bool pid_prev_existed = false;
+    auto proc = get_process_info(pid, &pid_prev_existed);
+    proc->tgid = tgid;
+    if (promoted) {
+        proc->utime = light_state.utime;
+        proc->stime = light_state.stime;
+        proc->sample_time_ns = light_state.sample_time_ns;
+    }
+    uint64_t elapsed_ns = (proc->sample_time_ns && now_ns > proc->sample_time_ns) ? (
+        now_ns - proc->sample_time_ns) : 0;
+    proc->sample_time_ns = now_ns;
+    // 获取任务的 IO 监控信息
+    get_task_io_info(proc_fd, proc, elapsed_ns);
+    /**
+     * 也可以读取 smaps 或 smaps_rollup 文件来获取内存相关信息，
+     * 但是读取 smaps 或 smaps_rollup 文件很慢、很耗费性能。因此放弃
+     * 原因大概为：读取 smaps 的成本与进程的内存使用相关。看起来内核需要检查每个内存页的状态才能生成内容
+     * 参见 man 手册 /proc/[pid]/smaps
+     */
+    // 获取任务中的 statm 监控信息（主要是内存信息）
+    if (get_task_statm_info(proc_fd, proc) < 0) return -1;
+    // 在读取 stat 文件前先保存上一个周期的任务 cpu 耗时
+    uint64_t last_time = proc->utime + proc->stime;
+    uint64_t last_start_time = proc->start_time;
+    // 获取任务中的 stat 文件监控信息
+    if (get_task_stat_info(proc_fd, proc) < 0) return -2;
+    // 启动时间不同说明 pid 被复用（或者恢复的基线属于另一个任务），上一次的计数没有意义
+    if (last_start_time && proc->start_time != last_start_time) {
+        elapsed_ns = 0;
+        proc->io_rate_read_bps = 0;
+        proc->io_rate_write_bps = 0;
+        proc->identity_stale = true;
+    }
+    // 命令行与所有者只在第一次看到任务或者 exec 之后读取
+    if (proc->identity_stale) {
+        get_task_identity_info(proc_fd, proc);
+    }
+    // 计算 cpu、mem 的周期百分比，cpu 时间的单位为 1/100 秒，第一次读取的任务没有上一次的数据
+    float percent_cpu = elapsed_ns ? (
+        (static_cast<double>(proc->utime + proc->stime) - last_time) * 1E9 / elapsed_ns) : 0.0F;
+    proc->percent_cpu = (percent_cpu > sys_monitor_info_->active_cpus * 100.0F) ? (
+        sys_monitor_info_->active_cpus * 100.0F) : (MAXIMUM(percent_cpu, 0.0F));
+    proc->percent_mem = proc->resident_mem / static_cast<double>(sys_monitor_info_->total_mem) * 100.0;
+    proc->last_scan_seq = scan_seq_;
+    // 添加 ProcessInfo
+    // 如果这个任务是一个新任务
+    if (!pid_prev_existed) {
+        sys_monitor_info_->all_process_info.emplace_back(proc);
+        sys_monitor_info_->all_process_info_table.emplace(pid, proc);
+    }
+    return 0;
+}
+
+void MonitorInfoCollection::update_exited_process_info() {
+    auto& exited = sys_monitor_info_->exited_process_info;
+    proc_event_listener_.drain_exited_tasks(&exited);
+    auto& table = sys_monitor_info_->all_process_info_table;
+    for (auto& info : exited) {
+        auto iter = table.find(info.pid);
+        if (iter == table.end()) {
+            // 没有完整信息的任务已经被扫描到，不是短生命周期的任务
+            if (find_light_task(info.pid)) continue;
+            // 从未被扫描到，是在两次扫描之间创建并退出的任务
+            info.short_lived = true;
+            continue;
+        }
+        const auto& proc = iter->second;
+        if (!info.counters_valid) {
+            snprintf(info.cmdline, sizeof(info.cmdline), "%s",
+                sys_monitor_info_->string_arena->get(proc->cmdline_id));
+            info.utime = proc->utime;
+            info.stime = proc->stime;
+            info.io_read_bytes = proc->io_read_bytes;
+            info.io_write_bytes = proc->io_write_bytes;
+            info.counters_valid = true;
+        }
+        // 从表中移除，避免 pid 被复用时沿用旧任务的计数
+        table.erase(iter);
+    }
+}
+
+void MonitorInfoCollection::update_exec_process_info() {
+    proc_event_listener_.drain_exec_tasks(&exec_tasks_);
+    auto& table = sys_monitor_info_->all_process_info_table;
+    for (pid_t pid : exec_tasks_) {
+        auto iter = table.find(pid);
+        if (iter != table.end()) {
+            iter->second->identity_stale = true;
+        }
+    }
+}
+
+void MonitorInfoCollection::remove_stale_process_info() {
+    auto& all = sys_monitor_info_->all_process_info;
+    auto& table = sys_monitor_info_->all_process_info_table;
+    size_t keep = 0;
+    for (size_t i = 0; i < all.size(); i++) {
+        if (all[i]->last_scan_seq == scan_seq_) {
+            all[keep++] = all[i];
+            continue;
+        }
+        auto iter = table.find(all[i]->pid);
+        if (iter != table.end() && iter->second == all[i]) {
+            table.erase(iter);
+        }
+        sys_monitor_info_->string_arena->release(all[i]->comm_id);
+        sys_monitor_info_->string_arena->release(all[i]->cmdline_id);
+        sys_monitor_info_->string_arena->release(all[i]->user_id);
+    }
+    all.resize(keep);
+}
+
+bool MonitorInfoCollection::update_light_task(int proc_fd, pid_t pid, pid_t tgid, uint64_t now_ns,
+    LightTaskState* state) {
+    char buf[MAX_BYTES_ONCE_READ+1];
+    ssize_t res = Util::read_file(proc_fd, "stat", buf, sizeof(buf));
+    if (res < 0) return false;
+    buf[MINIMUM(static_cast<size_t>(res), sizeof(buf) - 1)] = '\0';
+    TaskStatFields stat;
+    if (parse_task_stat(buf, &stat) < 0) return false;
+    state->pid = pid;
+    state->tgid = tgid;
+    state->utime = adjust_time(stat.utime);
+    state->stime = adjust_time(stat.stime);
+    state->start_time = stat.start_time;
+    state->sample_time_ns = now_ns;
+
+    const LightTaskState* last = find_light_task(pid);
+    // 启动时间不同说明 pid 被复用，上一次的 cpu 时间属于另一个任务
+    if (last && last->start_time != state->start_time) last = nullptr;
+    float percent_cpu = 0.0F;
+    if (last && now_ns > last->sample_time_ns) {
+        double delta = static_cast<double>(state->utime + state->stime) - (last->utime + last->stime);
+        percent_cpu = MAXIMUM(delta * 1E9 / (now_ns - last->sample_time_ns), 0.0);
+    }
+    if (sys_monitor_info_->all_process_info.size() < max_detailed_tasks_
+        || percent_cpu > promote_threshold_ + TASK_PROMOTE_MARGIN) {
+        // 沿用上一次的 cpu 时间，晋升之后的第一次采集就能得到正确的使用率
+        if (last) {
+            state->utime = last->utime;
+            state->stime = last->stime;
+            state->sample_time_ns = last->sample_time_ns;
+        } else {
+            state->sample_time_ns = 0;
+        }
+        return true;
+    }
+    next_light_tasks_.push_back(*state);
+    OthersTaskInfo& others = sys_monitor_info_->others;
+    others.task_count++;
+    // 进程的 stat 已经包含了所有线程的 cpu 时间，线程不重复统计
+    if (pid == tgid) {
+        others.process_count++;
+        others.percent_cpu += percent_cpu;
+        res = Util::read_file(proc_fd, "statm", buf, sizeof(buf));
+        if (res > 0) {
+            buf[MINIMUM(static_cast<size_t>(res), sizeof(buf) - 1)] = '\0';
+            TaskStatmFields statm;
+            if (parse_task_statm(buf, &statm) == 0) others.resident_mem += statm.resident_mem * page_size_kb_;
+        }
+    }
+    return false;
+}
+
+const MonitorInfoCollection::LightTaskState* MonitorInfoCollection::find_light_task(pid_t pid) const {
+    auto iter = std::lower_bound(light_tasks_.begin(), light_tasks_.end(), pid,
+        [](const LightTaskState& state, pid_t value) { return state.pid < value; });
+    return (iter != light_tasks_.end() && iter->pid == pid) ? &*iter : nullptr;
+}
+
+void MonitorInfoCollection::enforce_task_limit() {
+    auto& all = sys_monitor_info_->all_process_info;
+    auto& table = sys_monitor_info_->all_process_info_table;
+    if (all.size() > max_detailed_tasks_) {
+        // 按 cpu 使用率、IO 速率、常驻内存排序，只需要找出前 max_detailed_tasks_ 个。
+        // 上一个周期已经有完整信息的任务加上晋升的余量，只有比本周期晋升的任务低出余量以上时才降级，
+        // 与晋升的条件对称，避免边界上的任务反复晋升、降级
+        auto cpu_rank = [this](const ProcessInfo& proc) {
+            return find_light_task(proc.pid) ? proc.percent_cpu : proc.percent_cpu + TASK_PROMOTE_MARGIN;
+        };
+        auto more_active = [&cpu_rank](const std::shared_ptr<ProcessInfo>& a,
+            const std::shared_ptr<ProcessInfo>& b) {
+            float a_cpu = cpu_rank(*a);
+            float b_cpu = cpu_rank(*b);
+            if (a_cpu != b_cpu) return a_cpu > b_cpu;
+            double a_io = (std::isnan(a->io_rate_read_bps) ? 0.0 : a->io_rate_read_bps)
+                + (std::isnan(a->io_rate_write_bps) ? 0.0 : a->io_rate_write_bps);
+            double b_io = (std::isnan(b->io_rate_read_bps) ? 0.0 : b->io_rate_read_bps)
+                + (std::isnan(b->io_rate_write_bps) ? 0.0 : b->io_rate_write_bps);
+            if (a_io != b_io) return a_io > b_io;
+            return a->resident_mem > b->resident_mem;
+        };
+        std::nth_element(all.begin(), all.begin() + max_detailed_tasks_ - 1, all.end(), more_active);
+        promote_threshold_ = all[max_detailed_tasks_ - 1]->percent_cpu;
+        OthersTaskInfo& others = sys_monitor_info_->others;
+        for (size_t i = max_detailed_tasks_; i < all.size(); i++) {
+            const auto& proc = all[i];
+            next_light_tasks_.push_back({proc->pid, proc->tgid, proc->utime, proc->stime, proc->start_time,
+                proc->sample_time_ns});
+            others.task_count++;
+            if (proc->pid == proc->tgid) {
+                others.process_count++;
+                others.percent_cpu += proc->percent_cpu;
+                others.resident_mem += proc->resident_mem;
+            }
+            auto iter = table.find(proc->pid);
+            if (iter != table.end() && iter->second == proc) {
+                table.erase(iter);
+            }
+            sys_monitor_info_->string_arena->release(proc->comm_id);
+            sys_monitor_info_->string_arena->release(proc->cmdline_id);
+            sys_monitor_info_->string_arena->release(proc->user_id);
+        }
+        all.resize(max_detailed_tasks_);
+    } else {
+        promote_threshold_ = 0.0F;
+    }
+    std::sort(next_light_tasks_.begin(), next_light_tasks_.end(),
+        [](const LightTaskState& a, const LightTaskState& b) { return a.pid < b.pid; });
+    light_tasks_.swap(next_light_tasks_);
+    next_light_tasks_.clear();
+
+    // 任务个数大幅减少之后归还多余的空间，否则 RSS 只增不减
+    bool shrunk = false;
+    if (table.bucket_count() > table.size() * 4 + 64) {
+        table.rehash(0);
+        all.shrink_to_fit();
+        shrunk = true;
+    }
+    if (next_light_tasks_.capacity() > light_tasks_.size() * 2 + 1024) {
+        next_light_tasks_.shrink_to_fit();
+        light_tasks_.shrink_to_fit();
+        shrunk = true;
+    }
+    if (shrunk) malloc_trim(0);
+}
+
+void MonitorInfoCollection::update_self_usage() {
+    SelfMemoryUsage& usage = sys_monitor_info_->self_usage;
+    char buf[128];
+    ssize_t res = Util::read_file(proc_dir_fd_, "self/statm", buf, sizeof(buf));
+    if (res > 0) {
+        buf[MINIMUM(static_cast<size_t>(res), sizeof(buf) - 1)] = '\0';
+        char* location = buf;
+        Util::parse_uint64(&location);
+        while (*location == ' ') location++;
+        usage.self_rss_kb = Util::parse_uint64(&location) * page_size_kb_;
+    }
+    const auto& all = sys_monitor_info_->all_process_info;
+    const auto& table = sys_monitor_info_->all_process_info_table;
+    usage.task_bytes = all.capacity() * sizeof(all[0])
+        + all.size() * (sizeof(ProcessInfo) + TASK_CONTROL_BLOCK_BYTES)
+        + table.size() * TASK_TABLE_NODE_BYTES + table.bucket_count() * sizeof(void*);
+    usage.light_task_bytes = (light_tasks_.capacity() + next_light_tasks_.capacity()) * sizeof(LightTaskState);
+    usage.string_bytes = sys_monitor_info_->string_arena->memory_bytes();
+    usage.event_bytes = sys_monitor_info_->proc_event_enabled ? (
+        proc_event_listener_.memory_bytes() + live_tasks_.capacity() * sizeof(live_tasks_[0])) : 0;
+    usage.net_bytes = task_net_enabled_ ? task_net_collection_.memory_bytes() : 0;
+    usage.user_name_bytes = user_names_.memory_bytes();
+    usage.consumer_bytes = consumer_bytes_;
+    usage.total_bytes = usage.task_bytes + usage.light_task_bytes + usage.string_bytes + usage.event_bytes
+        + usage.net_bytes + usage.user_name_bytes + usage.consumer_bytes;
+    usage.detailed_tasks = all.size();
+    usage.light_tasks = light_tasks_.size();
+    usage.max_detailed_tasks = max_detailed_tasks_;
+    if (!memory_budget_ || all.empty()) return;
+
+    // 超出预算时按平均每个任务的占用减小上限，远低于预算时逐渐增大；
+    // 任务表、字符串、网络缓存与使用者的数据随完整信息的任务个数增减，其余为与上限无关的开销
+    size_t per_task = (usage.task_bytes + usage.string_bytes + usage.net_bytes + usage.consumer_bytes)
+        / all.size() + 1;
+    if (usage.total_bytes > memory_budget_) {
+        size_t reduce = (usage.total_bytes - memory_budget_) / per_task + 1;
+        max_detailed_tasks_ = max_detailed_tasks_ > reduce + MIN_DETAILED_TASKS ? (
+            max_detailed_tasks_ - reduce) : MIN_DETAILED_TASKS;
+    } else if (usage.total_bytes < memory_budget_ / 4 * 3 && all.size() >= max_detailed_tasks_) {
+        size_t grow = MINIMUM(max_detailed_tasks_ / 8 + 1, (memory_budget_ - usage.total_bytes) / per_task);
+        max_detailed_tasks_ += grow;
+        if (max_detailed_tasks_limit_) {
+            max_detailed_tasks_ = MINIMUM(max_detailed_tasks_, max_detailed_tasks_limit_);
+        }
+    }
+}
+
+void MonitorInfoCollection::get_task_io_info(int proc_fd, std::shared_ptr<ProcessInfo> process,
+    uint64_t elapsed_ns) {
     char buffer[1024];
     ssize_t res = Util::read_file(proc_fd, "io", buffer, sizeof(buffer));
     if (res < 0) {
@@ -376,75 +1147,39 @@ void MonitorInfoCollection::get_task_io_info(int proc_fd, std::shared_ptr<Proces
         process->io_read_bytes = 0;
         process->io_write_bytes = 0;
         process->io_cancelled_write_bytes = 0;
-        process->io_last_scan_time_ms = sys_monitor_info_->curr_time_ms;
         return;
     }
 
     uint64_t last_read = process->io_read_bytes;
     uint64_t last_write = process->io_write_bytes;
-    uint64_t curr_time_ms = sys_monitor_info_->curr_time_ms;
-    uint64_t time_delta_ms = curr_time_ms > process->io_last_scan_time_ms ? (
-        curr_time_ms - process->io_last_scan_time_ms) : 0;
-
-    const char* line;
-    char* buf = buffer;
-    while ((line = strsep(&buf, "\n")) != nullptr) {
-        switch (line[0]) {
-        case 'r':
-            if (line[1] == 'c' && Util::wrap_strncmp(line+2, "har: ")) {
-                process->io_read_char = strtoll(line+7, nullptr, 10);
-            } else if (Util::wrap_strncmp(line+1, "ead_bytes: ")) {
-                process->io_read_bytes = strtoll(line+12, nullptr, 10);
-                process->io_rate_read_bps = time_delta_ms ? (
-                    process->io_read_bytes - last_read) * 1000.0 / time_delta_ms : NAN;
-            }
-            break;
-        case 'w':
-            if (line[1] == 'c' && Util::wrap_strncmp(line+2, "har: ")) {
-                process->io_write_char = strtoll(line+7, nullptr, 10);
-            } else if (Util::wrap_strncmp(line+1, "rite_bytes: ")) {
-                process->io_write_bytes = strtoll(line+13, nullptr, 10);
-                process->io_rate_write_bps = time_delta_ms ? (
-                    process->io_write_bytes - last_write) * 1000.0 / time_delta_ms : NAN;
-            }
-            break;
-        case 's':
-            if (line[4] == 'r' && Util::wrap_strncmp(line+1, "yscr: ")) {
-                process->io_read_syscalls = strtoll(line+7, nullptr, 10);
-            } else if (Util::wrap_strncmp(line+1, "yscw: ")) {
-                process->io_write_syscalls = strtoll(line+7, nullptr, 10);
-            }
-            break;
-        case 'c':
-            if (Util::wrap_strncmp(line+1, "ancelled_write_bytes: ")) {
-                process->io_cancelled_write_bytes = strtoll(line+23, nullptr, 10);
-            }
-        }
-    }
-    process->io_last_scan_time_ms = curr_time_ms;
+    TaskIoFields io;
+    parse_task_io(buffer, &io);
+    process->io_read_char = io.read_char;
+    process->io_write_char = io.write_char;
+    process->io_read_syscalls = io.read_syscalls;
+    process->io_write_syscalls = io.write_syscalls;
+    process->io_read_bytes = io.read_bytes;
+    process->io_write_bytes = io.write_bytes;
+    process->io_cancelled_write_bytes = io.cancelled_write_bytes;
+    process->io_rate_read_bps = elapsed_ns ? (process->io_read_bytes - last_read) * 1E9 / elapsed_ns : NAN;
+    process->io_rate_write_bps = elapsed_ns ? (process->io_write_bytes - last_write) * 1E9 / elapsed_ns : NAN;
 }
 
 int MonitorInfoCollection::get_task_statm_info(int proc_fd, std::shared_ptr<ProcessInfo> process) {
-    FILE* statm_file = Util::fopenat(proc_fd, "statm", "r");
-    if (!statm_file) {
-        ERROR_LOG("fopenat statm failed, err: %s", strerror(errno));
+    char buf[256];
+    ssize_t res = Util::read_file(proc_fd, "statm", buf, sizeof(buf));
+    if (res < 0) {
+        ERROR_LOG("read file statm failed, err: %s", strerror(-res));
         return -1;
     }
-    uint64_t dummy, dummy2;
-    int res = fscanf(statm_file, "%ld %ld %ld %ld %ld %ld %ld",
-        &process->virtual_mem,
-        &process->resident_mem,
-        &process->shared_mem,
-        &process->text_mem,
-        &dummy,  // library (unused since Linux 2.6; always 0)
-        &process->data_mem,
-        &dummy2);  // dirty pages (unused since Linux 2.6; always 0)
-    fclose(statm_file);
-    if (res == 7) {
-        process->virtual_mem *= page_size_kb_;
-        process->resident_mem *= page_size_kb_;
-    }
-    return (res == 7) ? 0 : -1;
+    TaskStatmFields statm;
+    if (parse_task_statm(buf, &statm) < 0) return -1;
+    process->virtual_mem = statm.virtual_mem * page_size_kb_;
+    process->resident_mem = statm.resident_mem * page_size_kb_;
+    process->shared_mem = statm.shared_mem;
+    process->text_mem = statm.text_mem;
+    process->data_mem = statm.data_mem;
+    return 0;
 }
 
 int MonitorInfoCollection::get_task_stat_info(int proc_fd, std::shared_ptr<ProcessInfo> process) {
@@ -454,166 +1189,74 @@ int MonitorInfoCollection::get_task_stat_info(int proc_fd, std::shared_ptr<Proce
         ERROR_LOG("read file stat failed, err: %s", strerror(errno));
         return -1;
     }
-    int index = 1;
-    char* endptr = nullptr;
-    char* p_save = nullptr;
-    char* p_token = strtok_r(buf, " ", &p_save);
-    while (p_token != nullptr) {
-        switch (index) {
-        case 1:  // pid
-            {
-                int curr_pid = atoi(p_token);
-                if (process->pid != curr_pid) {
-                    ERROR_LOG("gathered pid: %d stat info, expeed pid: %d", curr_pid, process->pid);
-                    return -2;
-                }
-            }
-            break;
-        case 2:  // command
-            {
-                size_t i = 0;
-                for (; i < strlen(p_token) && i < MAX_COMMAND_LENGTH; i++) {
-                    process->cmdline[i] = p_token[i];
-                }
-                process->cmdline[i] = '\0';
-            }
-            break;
-        case 4:  // ppid
-            process->ppid = atoi(p_token);
-            break;
-        case 14:  // utime
-            {
-                uint64_t utime = strtoull(p_token, &endptr, 10);
-                if (*endptr == '\0') {
-                    process->utime = adjust_time(utime);
-                } else {
-                    process->utime = 0;
-                }
-            }
-            break;
-        case 15:  // stime
-            {
-                uint64_t stime = strtoull(p_token, &endptr, 10);
-                if (*endptr == '\0') {
-                    process->stime = adjust_time(stime);
-                } else {
-                    process->stime = 0;
-                }
-            }
-            break;
-        case 16:  // cutime
-            {
-                uint64_t cutime = strtoull(p_token, &endptr, 10);
-                if (*endptr != '\0') {
-                    process->cutime = 0;
-                } else {
-                    process->cutime = adjust_time(cutime);
-                }
-            }
-            break;
-        case 17:  // cstime
-            {
-                uint64_t cstime = strtoull(p_token, &endptr, 10);
-                if (*endptr != '\0') {
-                    process->cstime = 0;
-                } else {
-                    process->cstime = adjust_time(cstime);
-                }
-            }
-            // 提高性能，取完第 17 个位置的 cstime，就可以直接退出，不用在循环了
-            return 0;
-        }
-        index++;
-        p_token = strtok_r(nullptr, " ", &p_save);
+    buf[MINIMUM(static_cast<size_t>(res), sizeof(buf) - 1)] = '\0';
+    TaskStatFields stat;
+    if (parse_task_stat(buf, &stat) < 0) {
+        ERROR_LOG("invalid stat format of pid: %d", process->pid);
+        return -3;
     }
-
-    /*
     // 判断 pid 是否有误
-    int curr_pid = atoi(buf);
-    if (process->pid != curr_pid) {
-        ERROR_LOG("gathered pid: %d stat info, expeed pid: %d", curr_pid, process->pid);
+    if (process->pid != stat.pid) {
+        ERROR_LOG("gathered pid: %d stat info, expeed pid: %d", stat.pid, process->pid);
         return -2;
     }
-    // 截取字符串中的 command
-    char* location = strchr(buf, ' ');
-    if (!location) {
-        ERROR_LOG("strchr buf: %s by ' ' failed, err: %s", buf, strerror(errno));
-        return -3;
+    size_t comm_length = MINIMUM(stat.comm_length, MAX_COMMAND_LENGTH);
+    StringArena* arena = sys_monitor_info_->string_arena.get();
+    if (arena->length(process->comm_id) != comm_length
+        || memcmp(arena->get(process->comm_id), stat.comm, comm_length) != 0) {
+        arena->release(process->comm_id);
+        process->comm_id = arena->intern(stat.comm, comm_length);
+        // comm 变化通常意味着发生了 exec，没有 proc connector 事件时以此为准
+        process->identity_stale = true;
     }
-    location += 2;
-    char* end = strrchr(location, ')');
-    if (!end) {
-        ERROR_LOG("strrchr buf: %s by ')' failed, err: %s", location, strerror(errno));
-        return -4;
-    }
-    // 复制 cmdline 信息
-    size_t command_size = MINIMUM((end-location+1), sizeof(process->cmdline));
-    size_t i = 0;
-    for (; i < command_size-1 && location[i]; i++) {
-        process->cmdline[i] = location[i];
-    }
-    process->cmdline[i] = '\0';
-    location = end+2;
-    // 跳过获取进程的状态
-    location += 2;
-    // 获取当前进程的父进程: ppid
-    process->ppid = strtol(location, &location, 10);
-    location += 1;
-    // 跳过进程的 pgrp、session、tty_nr、tpgin、flags、minflt、cminflt、majflt、cmajflt
-    // 一共跳过 9 个属性
-    location += 9;
-    // 获取 utime
-    process->utime = adjust_time(strtoll(location, &location, 10));
-    if (curr_pid == 20611) {
-        std::cout << "procss utime 20611: " << process->utime  << std::endl;
-    }
-    location += 1;
-    // 获取 stime
-    process->stime = adjust_time(strtoll(location, &location, 10));
-    location += 1;
-    // 获取 cutime
-    process->cutime = adjust_time(strtoll(location, &location, 10));
-    location += 1;
-    // 获取 cstime
-    process->cstime = adjust_time(strtoll(location, &location, 10));
-    // location += 1;
+    process->ppid = stat.ppid;
+    process->pgrp = stat.pgrp;
+    process->session = stat.session;
+    process->utime = adjust_time(stat.utime);
+    process->stime = adjust_time(stat.stime);
+    process->cutime = adjust_time(stat.cutime);
+    process->cstime = adjust_time(stat.cstime);
+    process->start_time = stat.start_time;
+    process->processor = stat.processor;
     // stat 文件中其他数据不再读取
-    */
     return 0;
 }
 
-// int MonitorInfoCollection::get_task_cmdline_info(int proc_fd) {
-//     char command[4096+1];  // linux 中 cmdline 最大的长度
-//     ssize_t read_size = Util::read_file(proc_fd, "cmdline", command, sizeof(command));
-//     if (read_size <= 0) {
-//         ERROR_LOG("read file: cmdline failed, err: %s", strerror(errno));
-//         return -1;
-//     }
-//     int token_end = 0;
-//     int token_start = 0;
-//     int last_char = 0;
-//     bool arg_seq_null = false;
-//     bool arg_seq_space = false;
-//     for (size_t i = 0; i < read_size; i++) {
-//         if (command[i] == '\0') {
-//             command[i] = '\n';
-//         } else {
-//             if (token_end) arg_seq_null = true;
-//             if (command[i] <= ' ') arg_seq_space = true;
-//         }
-
-//         if (command[i] == '\n') {
-//             if (token_end == 0) token_end = i;
-//         } else {
-//             if (!token_end && command[i] == '/') token_start = i + 1;
-//             last_char = i;
-//         }
-//     }
-//     command[last_char + 1] = '\0';
-//     if (!arg_seq_null && arg_seq_space) {
-
-//     }
-// }
+int MonitorInfoCollection::get_task_identity_info(int proc_fd, std::shared_ptr<ProcessInfo> process) {
+    StringArena* arena = sys_monitor_info_->string_arena.get();
+    process->identity_stale = false;
+    // /proc/<pid> 目录的属主为任务的有效用户
+    struct stat st;
+    if (fstat(proc_fd, &st) == 0) {
+        process->uid = st.st_uid;
+        // 任务持有自己的引用：/etc/passwd 变化时缓存会释放所有用户名，
+        // 否则任务中的 id 可能被字符串池回收并分配给其他字符串
+        uint32_t user_id = user_names_.get_name_id(st.st_uid);
+        arena->acquire(user_id);
+        arena->release(process->user_id);
+        process->user_id = user_id;
+    }
+    ssize_t res = Util::read_file(proc_fd, "cmdline", &read_buffer_);
+    size_t length = res > 0 ? MINIMUM(static_cast<size_t>(res), MAX_CMDLINE_LENGTH) : 0;
+    char* command = &read_buffer_[0];
+    // 参数之间以 '\0' 分隔，替换成空格并去掉末尾的空白
+    for (size_t i = 0; i < length; i++) {
+        if (command[i] == '\0' || command[i] == '\n') command[i] = ' ';
+    }
+    while (length > 0 && command[length - 1] == ' ') length--;
+    uint32_t cmdline_id;
+    if (length > 0) {
+        cmdline_id = arena->intern(command, length);
+    } else {
+        // 内核线程与僵尸进程没有命令行，与 ps 一样显示为 "[comm]"
+        char name[MAX_COMMAND_LENGTH + 3];
+        int name_length = snprintf(name, sizeof(name), "[%s]", arena->get(process->comm_id));
+        cmdline_id = arena->intern(name, MINIMUM(static_cast<size_t>(name_length), sizeof(name) - 1));
+    }
+    arena->release(process->cmdline_id);
+    process->cmdline_id = cmdline_id;
+    return res < 0 ? -1 : 0;
+}
 
 
 std::shared_ptr<ProcessInfo> MonitorInfoCollection::get_process_info(
@@ -626,6 +1269,131 @@ std::shared_ptr<ProcessInfo> MonitorInfoCollection::get_process_info(
         *prev_existed = false;
         auto process_info = std::make_shared<ProcessInfo>();
         process_info->pid = pid;
+        process_info->identity_stale = true;
         return process_info;
     }
 }
+
+int MonitorInfoCollection::prime(uint32_t warmup_ms) {
+    // 基线的 cpu 使用率都为 0，按使用率选择目标没有意义，只记录计数与时间
+    if (collect_counters() < 0) return -1;
+    // 进程的 tcp 字节数同样是累计计数，需要基线
+    if (task_net_enabled_) {
+        task_net_collection_.collect(proc_dir_fd_, sys_monitor_info_.get());
+    }
+    usleep(warmup_ms * 1000);
+    return 0;
+}
+
+int MonitorInfoCollection::get_boot_id(char* boot_id, size_t size) {
+    ssize_t res = Util::read_file(proc_dir_fd_, "sys/kernel/random/boot_id", boot_id, size);
+    if (res <= 0) return -1;
+    if (boot_id[res - 1] == '\n') boot_id[res - 1] = '\0';
+    return 0;
+}
+
+int MonitorInfoCollection::save_state(const char* path) {
+    char boot_id[BOOT_ID_LENGTH + 2];
+    if (get_boot_id(boot_id, sizeof(boot_id)) < 0) {
+        ERROR_LOG("read boot_id failed, state is not saved");
+        return -1;
+    }
+    std::string tmp_path = std::string(path) + ".tmp";
+    FILE* fp = fopen(tmp_path.c_str(), "we");
+    if (!fp) {
+        ERROR_LOG("open state file: %s failed, err: %s", tmp_path.c_str(), strerror(errno));
+        return -1;
+    }
+    // 第一行为格式、boot_id 与保存时的单调时钟，单调时钟在同一次启动内的进程之间可以比较
+    fprintf(fp, "%s %d %s %lu\n", STATE_FILE_MAGIC, STATE_FILE_VERSION, boot_id, Util::get_monotonic_ns());
+    const CpuDataArray& cpu_data = sys_monitor_info_->sys_cpu_data;
+    for (size_t i = 0; i < cpu_data.size(); i++) {
+        fprintf(fp, "cpu %zu", i);
+        for (int field = 0; field < CPU_TIME_FIELDS; field++) {
+            fprintf(fp, " %lu", cpu_data.time(static_cast<CpuTimeField>(field), i));
+        }
+        fputc('\n', fp);
+    }
+    size_t count = 0;
+    for (const auto& proc : sys_monitor_info_->all_process_info) {
+        if (!proc->sample_time_ns || !proc->start_time) continue;
+        fprintf(fp, "task %d %d %lu %lu %lu %lu %lu %lu\n", proc->pid, proc->tgid, proc->start_time,
+            proc->sample_time_ns, proc->utime, proc->stime, proc->io_read_bytes, proc->io_write_bytes);
+        count++;
+    }
+    bool failed = ferror(fp) != 0;
+    if (fclose(fp) != 0) failed = true;
+    if (failed || rename(tmp_path.c_str(), path) < 0) {
+        ERROR_LOG("write state file: %s failed, err: %s", path, strerror(errno));
+        unlink(tmp_path.c_str());
+        return -1;
+    }
+    INFO_LOG("state saved to %s, tasks: %zu", path, count);
+    return 0;
+}
+
+int MonitorInfoCollection::load_state(const char* path) {
+    ssize_t res = Util::read_file(AT_FDCWD, path, &read_buffer_);
+    if (res < 0) {
+        INFO_LOG("no state file: %s, err: %s", path, strerror(-res));
+        return -1;
+    }
+    char boot_id[BOOT_ID_LENGTH + 2];
+    if (get_boot_id(boot_id, sizeof(boot_id)) < 0) return -1;
+    // 校验格式、boot_id 与文件的新旧
+    char* line = &read_buffer_[0];
+    char* next_line = strchr(line, '\n');
+    if (!next_line) return -1;
+    *next_line++ = '\0';
+    char magic[32], saved_boot_id[BOOT_ID_LENGTH + 2];
+    int version = 0;
+    unsigned long saved_ns = 0;
+    if (sscanf(line, "%31s %d %37s %lu", magic, &version, saved_boot_id, &saved_ns) != 4
+        || strcmp(magic, STATE_FILE_MAGIC) != 0 || version != STATE_FILE_VERSION) {
+        WARN_LOG("invalid state file: %s", path);
+        return -1;
+    }
+    uint64_t now_ns = Util::get_monotonic_ns();
+    if (strcmp(saved_boot_id, boot_id) != 0 || saved_ns > now_ns
+        || (now_ns - saved_ns) / 1000000 > STATE_FILE_MAX_AGE_MS) {
+        INFO_LOG("state file: %s is from another boot or too old, ignored", path);
+        return -1;
+    }
+
+    CpuDataArray& cpu_data = sys_monitor_info_->sys_cpu_data;
+    int count = 0;
+    for (line = next_line; line && *line; line = next_line) {
+        next_line = strchr(line, '\n');
+        if (next_line) *next_line++ = '\0';
+        if (Util::wrap_strncmp(line, "cpu ")) {
+            char* location = line + strlen("cpu ");
+            size_t index = Util::parse_uint64(&location);
+            // cpu 个数发生了变化的部分没有基线
+            if (index >= cpu_data.size()) continue;
+            for (int field = 0; field < CPU_TIME_FIELDS; field++) {
+                cpu_data.restore_time(static_cast<CpuTimeField>(field), index, Util::parse_uint64(&location));
+            }
+        } else if (Util::wrap_strncmp(line, "task ")) {
+            char* location = line + strlen("task ");
+            pid_t pid = Util::parse_uint64(&location);
+            if (pid <= 0 || sys_monitor_info_->all_process_info_table.count(pid)) continue;
+            // 恢复的任务只有计数，命令行等信息在第一次采集时读取；没有被扫描到的任务在第一次采集后清理
+            auto proc = std::make_shared<ProcessInfo>();
+            proc->pid = pid;
+            proc->tgid = Util::parse_uint64(&location);
+            proc->start_time = Util::parse_uint64(&location);
+            proc->sample_time_ns = Util::parse_uint64(&location);
+            proc->utime = Util::parse_uint64(&location);
+            proc->stime = Util::parse_uint64(&location);
+            proc->io_read_bytes = Util::parse_uint64(&location);
+            proc->io_write_bytes = Util::parse_uint64(&location);
+            // 字符串为空（STRING_ID_EMPTY），不占用引用计数
+            proc->identity_stale = true;
+            sys_monitor_info_->all_process_info.emplace_back(proc);
+            sys_monitor_info_->all_process_info_table.emplace(pid, proc);
+            count++;
+        }
+    }
+    INFO_LOG("state restored from %s, tasks: %d, age: %lu ms", path, count, (now_ns - saved_ns) / 1000000);
+    return count;
+}
@@ -14,16 +14,45 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <string>
 #include "monitor_info.h"
+#include "proc_event_listen.h"
+#include "cpu_freq_collect.h"
+#include "energy_collect.h"
+#include "task_net_collect.h"
+#include "task_filter.h"
+#include "task_perf_collect.h"
+#include "task_fd_collect.h"
+#include "task_state_sample.h"
+#include "user_name_cache.h"
+
+// 限制任务个数时，完整信息的任务个数的最小上限
+#define MIN_DETAILED_TASKS 16
+// 估算的每个完整信息任务的额外开销：make_shared 的控制块、unordered_map 的节点（字节）
+#define TASK_CONTROL_BLOCK_BYTES 16
+#define TASK_TABLE_NODE_BYTES 48
+// 只有内存预算时，按每个任务平均的字符串长度估算初始上限（字节）
+#define TASK_ESTIMATED_STRING_BYTES 128
+// 其余任务的 cpu 使用率需要超过排名最后的完整任务多少（百分比）才晋升，完整任务同样需要低出该余量才降级，
+// 避免在边界上反复读取命令行
+#define TASK_PROMOTE_MARGIN 1.0F
+// 状态文件的格式标识与版本
+#define STATE_FILE_MAGIC "top_cpp_state"
+#define STATE_FILE_VERSION 1
+// 超过该时间的状态文件不再使用，过长的间隔得到的只是长期平均值
+#define STATE_FILE_MAX_AGE_MS (10 * 60 * 1000)
+// boot_id 的长度（UUID）
+#define BOOT_ID_LENGTH 36
 
 /**
  * @brief 监控信息收集
- * 
+ * @note 每个对象有独立的配置与状态，同一个进程中可以有多个采集对象（例如嵌入到服务中时），
+ *       同一个对象不能在多个线程中同时使用
  */
 class MonitorInfoCollection {
  public:
     /**
-     * @brief 单例模式
+     * @brief 进程内默认的采集对象，供 top_cpp 命令行使用
      * 
      * @return 全局唯一对象
      */
@@ -31,7 +60,10 @@ class MonitorInfoCollection {
        static MonitorInfoCollection instance;
        return instance;
     }
-    ~MonitorInfoCollection() = default;
+    MonitorInfoCollection()
+        : sys_monitor_info_(std::make_shared<SysMonitorInfo>()),
+          user_names_(sys_monitor_info_->string_arena.get()) {}
+    ~MonitorInfoCollection();
     MonitorInfoCollection(const MonitorInfoCollection&) = delete;
     MonitorInfoCollection& operator=(const MonitorInfoCollection&) = delete;
     MonitorInfoCollection(const MonitorInfoCollection&&) = delete;
@@ -44,6 +76,95 @@ class MonitorInfoCollection {
      */
     int initialize();
 
+    /**
+     * @brief 是否收集进程级别的网络监控信息
+     * @note 需要遍历进程的 fd 目录，默认关闭
+     */
+    inline void set_task_net_enabled(bool enabled) {
+       task_net_enabled_ = enabled;
+    }
+
+    /**
+     * @brief 是否收集 cpu 使用率最高的任务的性能计数（IPC、MPKI 等）
+     * @note 需要在 initialize 之前调用
+     * @param max_tasks 最多同时跟踪的任务个数，为 0 表示关闭
+     */
+    inline void set_task_perf_max_tasks(size_t max_tasks) {
+       task_perf_max_tasks_ = max_tasks;
+    }
+
+    /**
+     * @brief 是否统计进程的 fd 个数与 RLIMIT_NOFILE
+     * @note 统计的频率低于 cpu 扫描
+     * @param tier_ticks 每隔多少次采集统计一次，为 0 表示关闭
+     * @param type_breakdown 是否按类型（socket、pipe、文件等）统计，需要对每个 fd 调用 readlink
+     */
+    inline void set_task_fd_tier(uint32_t tier_ticks, bool type_breakdown) {
+       task_fd_tier_ticks_ = tier_ticks;
+       task_fd_collection_.initialize(tier_ticks, type_breakdown);
+    }
+
+    /**
+     * @brief 是否在后台对 cpu 使用率最高的进程采样线程的状态、wchan 与系统调用
+     * @note 需要在 initialize 之前调用
+     * @param max_tasks 采样的进程个数，为 0 表示关闭
+     * @param sample_hz 每秒采样的轮数
+     * @param budget 每个采集间隔最多采样的线程次数
+     * @param interval_ms 采集间隔
+     */
+    inline void set_task_sampler(size_t max_tasks, uint32_t sample_hz, uint32_t budget, uint32_t interval_ms) {
+       task_sample_max_tasks_ = max_tasks;
+       task_sample_hz_ = sample_hz;
+       task_sample_budget_ = budget;
+       task_sample_interval_ms_ = interval_ms;
+    }
+
+    /**
+     * @brief 设置 sysfs 的根目录（默认 SYSFS_ROOT_DIR），用于 cpu 频率、idle 状态、温控降频与 RAPL 能耗的采集
+     * @note 需要在第一次采集之前调用
+     */
+    inline void set_sys_root(const char* root) {
+       cpu_freq_collection_.set_sys_root(root);
+       energy_collection_.set_sys_root(root);
+    }
+
+    /**
+     * @brief 目标进程过滤器，配置了条件时只采集目标进程及其线程
+     * @note 需要在第一次采集之前配置
+     */
+    inline TaskFilter& task_filter() {
+       return task_filter_;
+    }
+
+    /**
+     * @brief 限制保存完整信息的任务个数
+     * @note 只有活跃度（cpu 使用率、IO 速率、常驻内存）最高的 max_tasks 个任务保存完整信息，
+     *       其余任务只保留 cpu 时间，汇总到 SysMonitorInfo::others 中，变得活跃时再读取完整信息
+     * @param max_tasks 为 0 表示不限制
+     */
+    inline void set_max_detailed_tasks(size_t max_tasks) {
+       max_detailed_tasks_limit_ = max_tasks;
+    }
+
+    /**
+     * @brief 设置自身数据结构的内存预算
+     * @note 每次采集之后统计数据结构的内存占用，超出预算时减小完整信息的任务个数的上限，
+     *       远低于预算时逐渐增大（不超过 set_max_detailed_tasks 设置的上限）
+     * @param budget_bytes 为 0 表示不限制
+     */
+    inline void set_memory_budget(size_t budget_bytes) {
+       memory_budget_ = budget_bytes;
+    }
+
+    /**
+     * @brief 报告使用者按任务保存的数据占用的内存，计入内存预算
+     * @note 例如 MonitorInfoPreprocess::memory_bytes()，每次处理完快照之后调用，下一次采集时生效。
+     *       这些数据需要随快照中的任务一起淘汰，否则减小完整信息的任务个数无法降低占用
+     */
+    inline void set_consumer_memory(size_t bytes) {
+       consumer_bytes_ = bytes;
+    }
+
  public:
     /**
      * @brief 完成一次监控
@@ -52,7 +173,48 @@ class MonitorInfoCollection {
      */
     const std::shared_ptr<SysMonitorInfo> finish_once_monitor();
 
+    /**
+     * @brief 预热：立即采集一次作为基线，等待 warmup_ms 之后返回
+     * @note 第一次采集没有上一次的计数，使用率与速率都没有意义；预热之后的第一次采集即为有效数据，
+     *       不需要等待一个完整的采集间隔。基线只记录系统与任务的计数（包括进程的 tcp 字节数）和时间，
+     *       不做任务数限制、性能计数、状态采样、fd 统计等按使用率选择目标的采集
+     * @return int 小于 0 表示采集失败
+     */
+    int prime(uint32_t warmup_ms);
+
+    /**
+     * @brief 把 cpu 时间与任务的累计计数保存到状态文件
+     * @note 任务以 pid 与启动时间标识，先写入临时文件再 rename，保证文件完整
+     * @return int 小于 0 表示失败
+     */
+    int save_state(const char* path);
+
+    /**
+     * @brief 从状态文件恢复基线，重启后的第一次采集即可得到正确的使用率与速率
+     * @note 需要在 initialize 之后、第一次采集之前调用。系统重启过（boot_id 不同）或者文件
+     *       超过 STATE_FILE_MAX_AGE_MS 时忽略；pid 被复用（启动时间不同）的任务按新任务处理
+     * @return int 恢复的任务个数，小于 0 表示没有可用的状态
+     */
+    int load_state(const char* path);
+
  private:
+    // 没有完整信息的任务只保留计算 cpu 使用率需要的状态
+    struct LightTaskState {
+        pid_t pid;
+        pid_t tgid;
+        uint64_t utime;
+        uint64_t stime;
+        uint64_t start_time;
+        uint64_t sample_time_ns;
+    };
+
+    /**
+     * @brief 采集系统与任务的计数并记录时间，不包含按使用率选择目标的采集
+     *
+     * @return int 小于 0 表示采集失败
+     */
+    int collect_counters();
+
     /**
      * @brief 获取系统整体的内存信息
      * @note 通过读取 /proc/meminfo 中的数据
@@ -65,19 +227,84 @@ class MonitorInfoCollection {
      */
     int get_sys_cpu_info();
 
+    /**
+     * @brief 读取本次启动的 boot_id
+     *
+     */
+    int get_boot_id(char* boot_id, size_t size);
+
+    /**
+     * @brief 获取系统的换页相关速率
+     * @note 通过读取 /proc/vmstat 中的数据，使用预先计算的行号表跳过无关的行
+     * @param interval_ms 距离上一次采集的时间间隔
+     */
+    int get_sys_vmstat_info(uint64_t interval_ms);
+
+    /**
+     * @brief 获取系统 cpu、内存、IO 的压力信息
+     * @note 通过读取 /proc/pressure/{cpu,memory,io} 中的数据
+     */
+    int get_sys_pressure_info();
+
+    /**
+     * @brief 获取系统每个块设备的 IO 信息
+     * @note 通过读取 /proc/diskstats 中的数据
+     * @param interval_ms 距离上一次采集的时间间隔
+     */
+    int get_sys_disk_info(uint64_t interval_ms);
+
+    /**
+     * @brief 获取系统每个网络接口的流量信息
+     * @note 通过读取 /proc/net/dev 中的数据
+     * @param interval_ms 距离上一次采集的时间间隔
+     */
+    int get_sys_net_dev_info(uint64_t interval_ms);
+
     /**
      * @brief 递归的获取所有的进程占用资源信息
      * @note 辅助函数
      */
-    int get_all_process_info_recurse(int parent_fd, const char* dir_name,
-        const std::shared_ptr<ProcessInfo>& parent);
+    int get_all_process_info_recurse(int parent_fd, const char* dir_name, pid_t parent_pid);
 
-    void get_task_io_info(int proc_fd, std::shared_ptr<ProcessInfo> process);
+    /**
+     * @brief 根据 proc connector 维护的存活任务集合获取所有任务的监控信息
+     * @note 不需要遍历 /proc 目录
+     * @return int 小于 0 表示集合不可信，需要回退到目录遍历
+     */
+    int get_all_process_info_by_event();
+
+    /**
+     * @brief 只获取目标进程及其线程的监控信息
+     * @note 开销与目标进程的个数成正比，不需要遍历 /proc 目录
+     */
+    int get_all_process_info_by_filter();
+
+    /**
+     * @brief 获取单个任务的监控信息
+     *
+     * @param proc_fd 任务目录 "/proc/pid" 或 "/proc/tgid/task/pid" 的 fd
+     * @param pid 任务 id
+     * @param tgid 任务所属的进程 id
+     */
+    int get_task_info(int proc_fd, uint64_t pid, pid_t tgid);
+
+    /**
+     * @brief 获取任务的 IO 监控信息
+     *
+     * @param elapsed_ns 距离上一次读取该任务的时间，为 0 时不计算速率
+     */
+    void get_task_io_info(int proc_fd, std::shared_ptr<ProcessInfo> process, uint64_t elapsed_ns);
 
     int get_task_statm_info(int proc_fd, std::shared_ptr<ProcessInfo> process);
 
     int get_task_stat_info(int proc_fd, std::shared_ptr<ProcessInfo> process);
 
+    /**
+     * @brief 获取任务的完整命令行与所有者
+     * @note 只在第一次看到任务或者发生 exec 之后调用
+     */
+    int get_task_identity_info(int proc_fd, std::shared_ptr<ProcessInfo> process);
+
  private:
     /**
      * @brief 更新 cpu 的数量
@@ -87,22 +314,104 @@ class MonitorInfoCollection {
 
     std::shared_ptr<ProcessInfo> get_process_info(uint64_t pid, bool* prev_existed);
 
+    /**
+     * @brief 处理上一个周期内退出的任务
+     * @note 用最后一次扫描到的数据补全退出任务的计数
+     */
+    void update_exited_process_info();
 
-    inline uint64_t adjust_time(uint64_t tm) {
-       return tm * 100 / jiffy_;
-    }
+    /**
+     * @brief 标记上一个周期内执行了 exec 的任务，下次扫描时重新读取命令行
+     *
+     */
+    void update_exec_process_info();
 
- private:
-    MonitorInfoCollection() {
-       sys_monitor_info_ = std::make_shared<SysMonitorInfo>();
+    /**
+     * @brief 清理本次扫描中没有出现的任务
+     *
+     */
+    void remove_stale_process_info();
+
+    inline bool task_limit_enabled() const {
+       return max_detailed_tasks_limit_ || memory_budget_;
     }
 
+    /**
+     * @brief 更新一个没有完整信息的任务的 cpu 时间
+     *
+     * @param now_ns 读取任务的单调时钟时间
+     * @param state 返回任务当前的状态，需要晋升时为上一次的 cpu 时间与读取时间
+     * @return true 表示任务变得活跃，需要晋升为完整信息的任务
+     */
+    bool update_light_task(int proc_fd, pid_t pid, pid_t tgid, uint64_t now_ns, LightTaskState* state);
+
+    const LightTaskState* find_light_task(pid_t pid) const;
+
+    /**
+     * @brief 只保留最活跃的任务的完整信息，其余的降级并汇总
+     *
+     */
+    void enforce_task_limit();
+
+    /**
+     * @brief 统计自身的内存占用，并根据预算调整完整信息的任务个数的上限
+     * @note 需要在所有按任务保存数据的组件采集完之后调用
+     */
+    void update_self_usage();
+
+
+    inline uint64_t adjust_time(uint64_t tm) {
+       return tm * 100 / jiffy_;
+    }
 
  private:
     std::shared_ptr<SysMonitorInfo> sys_monitor_info_;
 
-    double period_;
     int page_size_kb_;  // 一个 page 的大小
     uint64_t jiffy_;  // 一个时间周期的时长
+
+    int proc_dir_fd_ = -1;  // "/proc" 目录的 fd
+    uint64_t last_time_ms_ = 0;  // 上一次监控的时间
+    std::string read_buffer_;  // 读取整个 /proc 文件时复用的缓冲区
+
+    int vmstat_fd_ = -1;  // "/proc/vmstat" 的 fd，使用 pread 重复读取
+    std::vector<int8_t> vmstat_line_fields_;  // vmstat 每一行对应的字段，-1 表示不关心的行
+    int pressure_fds_[3] = {-1, -1, -1};  // "/proc/pressure/{cpu,memory,io}" 的 fd
+    uint64_t scan_first_ns_ = 0;  // 本次扫描第一个任务的读取时间
+    uint64_t scan_last_ns_ = 0;  // 本次扫描最后一个任务的读取时间
+    uint64_t scan_seq_ = 0;  // 扫描序号，每次监控加一
+    ProcEventListener proc_event_listener_;
+    bool proc_event_synced_ = false;  // 存活任务集合是否已与 /proc 同步
+    std::vector<std::pair<pid_t, pid_t>> live_tasks_;  // 避免每次扫描重新分配
+
+    CpuFreqCollection cpu_freq_collection_;
+    EnergyCollection energy_collection_;
+
+    bool task_net_enabled_ = false;
+    TaskNetCollection task_net_collection_;
+
+    size_t task_perf_max_tasks_ = 0;
+    TaskPerfCollection task_perf_collection_;
+
+    uint32_t task_fd_tier_ticks_ = 0;
+    TaskFdCollection task_fd_collection_;
+
+    size_t task_sample_max_tasks_ = 0;
+    uint32_t task_sample_hz_ = 0;
+    uint32_t task_sample_budget_ = 0;
+    uint32_t task_sample_interval_ms_ = 0;
+    TaskStateSampler task_state_sampler_;
+
+    UserNameCache user_names_;  // uid -> 用户名，保存在 sys_monitor_info_ 的字符串池中
+    std::vector<pid_t> exec_tasks_;  // 避免每次重新分配
+    TaskFilter task_filter_;
+
+    size_t max_detailed_tasks_limit_ = 0;  // 配置的完整信息任务个数上限，0 表示不限制
+    size_t memory_budget_ = 0;  // 数据结构的内存预算，0 表示不限制
+    size_t consumer_bytes_ = 0;  // 使用者报告的按任务保存的数据的内存
+    size_t max_detailed_tasks_ = 0;  // 当前生效的上限，预算模式下自适应调整
+    float promote_threshold_ = 0.0F;  // 排名最后的完整任务的 cpu 使用率
+    std::vector<LightTaskState> light_tasks_;  // 上一次采集的其余任务，按 pid 排序
+    std::vector<LightTaskState> next_light_tasks_;  // 本次采集的其余任务
 };
 
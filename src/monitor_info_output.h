@@ -0,0 +1,295 @@
+/**
+ * @file monitor_info_output.h
+ * @author zhangyi
+ * @brief 监控信息的文本输出
+ * @version 0.1
+ * @date 2022-12-08
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <ostream>
+#include <vector>
+#include "cpu_data_array.h"
+#include "monitor_info_remote.h"
+#include "task_group_by.h"
+
+/**
+ * @brief 输出 cpu 汇总值
+ * @note 使用率由 MonitorInfoPreprocess 计算
+ */
+inline void output_cpu_usage(std::ostream& os, double cpu_percent) {
+    os << "cpu total usage: " << cpu_percent << std::endl;
+}
+
+/**
+ * @brief 输出每个在线 cpu 的时间占比（百分比）
+ *
+ */
+inline void output_cpu_breakdown(std::ostream& os, const CpuDataArray& cpu_data) {
+    for (size_t i = 1; i < cpu_data.size(); i++) {
+        if (!cpu_data.on_line(i)) continue;
+        os << "cpu" << i - 1
+            << " busy: " << cpu_data.percent(CPU_PERCENT_BUSY, i)
+            << ", user: " << cpu_data.percent(CPU_PERCENT_USER, i)
+            << ", sys: " << cpu_data.percent(CPU_PERCENT_SYSTEM, i)
+            << ", irq: " << cpu_data.percent(CPU_PERCENT_IRQ, i)
+            << ", softirq: " << cpu_data.percent(CPU_PERCENT_SOFT_IRQ, i)
+            << ", steal: " << cpu_data.percent(CPU_PERCENT_STEAL, i)
+            << ", iowait: " << cpu_data.percent(CPU_PERCENT_IO_WAIT, i) << std::endl;
+    }
+}
+
+/**
+ * @brief 输出每个在线 cpu 的频率、按频率归一化的使用率、idle 状态占比与温控降频次数
+ * @note 没有 cpufreq、cpuidle、thermal_throttle 节点（例如虚拟机）时不输出
+ */
+inline void output_cpu_frequency(std::ostream& os, const CpuDataArray& cpu_data,
+    const std::vector<std::string>& idle_state_names) {
+    size_t idle_states = std::min(cpu_data.idle_state_count(), idle_state_names.size());
+    if (!cpu_data.has_frequency() && idle_states == 0 && cpu_data.counter(CPU_COUNTER_CORE_THROTTLE, 0) == 0
+        && cpu_data.counter(CPU_COUNTER_PACKAGE_THROTTLE, 0) == 0) {
+        return;
+    }
+    for (size_t i = 0; i < cpu_data.size(); i++) {
+        if (i > 0 && !cpu_data.on_line(i)) continue;
+        if (i == 0) {
+            os << "cpu all";
+        } else {
+            os << "cpu" << i - 1;
+        }
+        if (cpu_data.has_frequency()) {
+            os << " freq: " << cpu_data.frequency_khz(i) / 1000 << "/" << cpu_data.max_frequency_khz(i) / 1000
+                << " MHz, normalized busy: " << cpu_data.normalized_busy(i);
+        }
+        if (idle_states) {
+            os << " idle:";
+            for (size_t state = 0; state < idle_states; state++) {
+                os << " " << idle_state_names[state] << " " << cpu_data.idle_state_residency(state, i) << "%";
+            }
+        }
+        os << " throttle: core " << cpu_data.counter_period(CPU_COUNTER_CORE_THROTTLE, i)
+            << ", package " << cpu_data.counter_period(CPU_COUNTER_PACKAGE_THROTTLE, i) << std::endl;
+    }
+}
+
+/**
+ * @brief 输出最繁忙的 cpu
+ *
+ * @param top_cpus CpuDataArray::get_top_busy_cpus 的结果
+ */
+inline void output_top_busy_cpus(std::ostream& os, const CpuDataArray& cpu_data,
+    const std::vector<uint32_t>& top_cpus) {
+    os << "top busy cpus:";
+    for (uint32_t cpu : top_cpus) {
+        os << " cpu" << cpu << "(" << cpu_data.percent(CPU_PERCENT_BUSY, cpu + 1) << ")";
+    }
+    os << std::endl;
+}
+
+/**
+ * @brief 输出每个 package 上一个周期的平均功率
+ * @note 没有 RAPL 时不输出
+ */
+inline void output_energy(std::ostream& os, const std::vector<EnergyPackageData>& packages) {
+    static const char* domain_names[ENERGY_DOMAIN_COUNT] = {"package", "core", "uncore", "dram"};
+    for (const EnergyPackageData& package : packages) {
+        os << "package" << package.package_id << " power:";
+        for (size_t domain = 0; domain < ENERGY_DOMAIN_COUNT; domain++) {
+            if (package.has_domain[domain]) os << " " << domain_names[domain] << " " << package.watts[domain] << " W";
+        }
+        os << ", busy cpus: " << package.busy_cpus << std::endl;
+    }
+}
+
+/**
+ * @brief 输出一个任务的监控
+ * @note TaskT 需要有 pid、percent_cpu、percent_mem 字段，例如 ProcessInfo、ShmTaskInfo
+ *
+ * @param cmdline 任务的命令行
+ * @param user 任务的所有者
+ * @param energy_watts 分摊到任务的功率，小于 0 表示没有 RAPL，不输出
+ */
+template <typename TaskT>
+void output_task_info(std::ostream& os, const TaskT& task, const char* cmdline, const char* user,
+    float energy_watts = -1) {
+    if (task.percent_cpu > 0.0001) {
+        os << task.pid << ", user: " << user << ", cmdline: " << cmdline
+            << ", cpu usage: " << task.percent_cpu;
+        if (energy_watts >= 0) os << ", power: " << energy_watts << " W";
+        os << ", mem usage: " << task.percent_mem << std::endl;
+    }
+}
+
+/**
+ * @brief 输出一个任务的性能计数
+ * @note 只输出被跟踪并且计数有效的任务
+ */
+inline void output_task_perf(std::ostream& os, const ProcessInfo& task, PerfMode mode) {
+    if (!task.perf_valid || task.percent_cpu <= 0.0001) return;
+    if (mode == PERF_MODE_HARDWARE) {
+        os << "    perf: ipc: " << task.perf_ipc
+            << ", mpki: " << task.perf_mpki
+            << ", cycles: " << task.perf_cycles
+            << ", instructions: " << task.perf_instructions
+            << ", cache misses: " << task.perf_cache_misses
+            << ", branch misses: " << task.perf_branch_misses << std::endl;
+    } else if (mode == PERF_MODE_SOFTWARE) {
+        os << "    perf: task clock: " << task.perf_task_clock_ns / 1000000.0 << " ms"
+            << ", context switches: " << task.perf_context_switches
+            << ", page faults: " << task.perf_page_faults << std::endl;
+    }
+}
+
+/**
+ * @brief 输出一个进程的状态采样直方图
+ * @note 百分比为占采样次数的比例
+ */
+inline void output_task_sample(std::ostream& os, const TaskSampleProfile& profile, const char* cmdline) {
+    if (profile.samples == 0) return;
+    double scale = 100.0 / profile.samples;
+    os << "sample: " << profile.pid << ", cmdline: " << cmdline << ", samples: " << profile.samples
+        << ", R: " << profile.state_counts[TASK_SAMPLE_RUNNING] * scale << "%"
+        << ", S: " << profile.state_counts[TASK_SAMPLE_SLEEPING] * scale << "%"
+        << ", D: " << profile.state_counts[TASK_SAMPLE_DISK_SLEEP] * scale << "%"
+        << ", other: " << profile.state_counts[TASK_SAMPLE_OTHER] * scale << "%" << std::endl;
+    if (profile.syscall_entries) {
+        os << "    syscalls:";
+        for (uint32_t i = 0; i < profile.syscall_entries; i++) {
+            const auto& syscall = profile.syscalls[i];
+            if (syscall.nr == TASK_SAMPLE_SYSCALL_USER) {
+                os << " user";
+            } else {
+                os << " " << syscall.nr << "(0x" << std::hex << syscall.arg0 << std::dec << ")";
+            }
+            os << " " << syscall.count * scale << "%";
+        }
+        os << std::endl;
+    }
+    if (profile.wchan_entries) {
+        os << "    wchan:";
+        for (uint32_t i = 0; i < profile.wchan_entries; i++) {
+            os << " " << profile.wchans[i].name << " " << profile.wchans[i].count * scale << "%";
+        }
+        os << std::endl;
+    }
+}
+
+/**
+ * @brief 输出 fd 使用率最高的进程
+ *
+ * @param top_tasks TaskFdCollection::get_top_tasks_by_fd_usage 的结果
+ * @param type_breakdown 是否输出每种类型的 fd 个数
+ */
+inline void output_top_fd_tasks(std::ostream& os, const SysMonitorInfo& info,
+    const std::vector<const ProcessInfo*>& top_tasks, bool type_breakdown) {
+    os << "top fd usage:" << std::endl;
+    for (const ProcessInfo* task : top_tasks) {
+        os << "    " << task->pid << ", cmdline: " << info.string_arena->get(task->cmdline_id)
+            << ", fds: " << task->fd_count << "/";
+        if (task->fd_limit) {
+            os << task->fd_limit << " (" << task->percent_fd << "%)";
+        } else {
+            os << "unlimited";
+        }
+        if (type_breakdown) {
+            os << ", sockets: " << task->fd_sockets
+                << ", pipes: " << task->fd_pipes
+                << ", files: " << task->fd_files
+                << ", eventfds: " << task->fd_eventfds
+                << ", anon inodes: " << task->fd_anon_inodes;
+        }
+        os << std::endl;
+    }
+}
+
+/**
+ * @brief 输出分组汇总的结果
+ *
+ * @param top_groups TaskGroupBy::get_top_groups 的结果
+ * @param elapsed_us 分组汇总的耗时
+ */
+inline void output_top_groups(std::ostream& os, const SysMonitorInfo& info, const TaskGroupBy& group_by,
+    const std::vector<const TaskGroup*>& top_groups, uint64_t elapsed_us) {
+    const auto& keys = group_by.keys();
+    const auto& metrics = group_by.metrics();
+    os << "group by";
+    for (size_t i = 0; i < keys.size(); i++) {
+        os << (i ? "," : " ") << TaskGroupBy::key_name(keys[i]);
+    }
+    os << ": " << group_by.groups().size() << " groups, " << elapsed_us << " us" << std::endl;
+    for (const TaskGroup* group : top_groups) {
+        os << "   ";
+        for (size_t i = 0; i < keys.size(); i++) {
+            os << " " << TaskGroupBy::key_name(keys[i]) << "=";
+            if (keys[i] == TASK_GROUP_KEY_COMM) {
+                os << info.string_arena->get(group->keys[i]);
+            } else {
+                os << group->keys[i];
+            }
+        }
+        os << ", tasks: " << group->count;
+        for (size_t i = 0; i < metrics.size(); i++) {
+            os << ", " << TaskGroupBy::metric_name(metrics[i]) << ": " << group->sums[i]
+                << " (max " << group->maxima[i] << ")";
+        }
+        os << std::endl;
+    }
+}
+
+/**
+ * @brief 输出没有完整信息的任务的汇总与 top-cpp 自身的内存占用
+ *
+ */
+inline void output_task_limit(std::ostream& os, const SysMonitorInfo& info) {
+    const OthersTaskInfo& others = info.others;
+    const SelfMemoryUsage& usage = info.self_usage;
+    os << "others: " << others.process_count << " processes, " << others.task_count << " tasks"
+        << ", cpu usage: " << others.percent_cpu
+        << ", resident mem: " << others.resident_mem << " KB" << std::endl;
+    os << "self: rss: " << usage.self_rss_kb << " KB"
+        << ", structures: " << usage.total_bytes / 1024 << " KB"
+        << " (tasks: " << usage.task_bytes / 1024
+        << ", light tasks: " << usage.light_task_bytes / 1024
+        << ", strings: " << usage.string_bytes / 1024
+        << ", events: " << usage.event_bytes / 1024
+        << ", net: " << usage.net_bytes / 1024
+        << ", user names: " << usage.user_name_bytes / 1024
+        << ", consumer: " << usage.consumer_bytes / 1024 << ")"
+        << ", budget: " << usage.budget_bytes / 1024 << " KB"
+        << ", detailed tasks: " << usage.detailed_tasks << "/" << usage.max_detailed_tasks
+        << ", light tasks: " << usage.light_tasks << std::endl;
+}
+
+/**
+ * @brief 输出 collector 中一个主机的汇总
+ *
+ * @param now_ms 当前的单调时钟（ms），用于计算数据的新鲜程度
+ */
+inline void output_remote_host(std::ostream& os, const RemoteHostView& host, uint64_t now_ms) {
+    const uint64_t* sys = host.sys_values;
+    os << "host: " << host.host_name
+        << (host.connection_fd >= 0 ? "" : " (disconnected)")
+        << ", tasks: " << host.tasks.size()
+        << ", cpu busy: " << sys[REMOTE_SYS_CPU_BUSY] / 100.0
+        << ", mem used: " << sys[REMOTE_SYS_USED_MEM] << "/" << sys[REMOTE_SYS_TOTAL_MEM] << " KB"
+        << ", age: " << (now_ms > host.last_update_ms ? now_ms - host.last_update_ms : 0) << " ms"
+        << ", received: " << host.bytes << " bytes" << std::endl;
+}
+
+/**
+ * @brief 输出 collector 中的一个任务
+ *
+ */
+inline void output_remote_task(std::ostream& os, const RemoteTaskRef& ref, const StringArena& arena) {
+    const uint64_t* values = ref.task->values;
+    os << ref.host->host_name << " " << ref.pid
+        << ", user: " << arena.get(ref.task->user_id)
+        << ", cmdline: " << arena.get(ref.task->cmdline_id)
+        << ", cpu usage: " << values[REMOTE_TASK_PERCENT_CPU] / 100.0
+        << ", mem usage: " << values[REMOTE_TASK_PERCENT_MEM] / 100.0 << std::endl;
+}
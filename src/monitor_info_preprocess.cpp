@@ -0,0 +1,171 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "common.h"
+#include "monitor_info_preprocess.h"
+
+static_assert(PREPROCESS_WINDOW_SIZE < 256, "histogram uses 8-bit counters");
+
+// 1、5、15 分钟负载的时间常数（秒）
+static const double load_avg_periods[3] = {60.0, 300.0, 900.0};
+
+/**
+ * @brief cpu 使用率对应的直方图的桶
+ *
+ */
+static inline int histogram_bucket(float percent_cpu) {
+    if (!(percent_cpu > 0)) return 0;
+    if (percent_cpu < 100) return static_cast<int>(percent_cpu);
+    int bucket = 100 + static_cast<int>((percent_cpu - 100) / 100);
+    return MINIMUM(bucket, PREPROCESS_HIST_BUCKETS - 1);
+}
+
+/**
+ * @brief 直方图的桶的上界
+ *
+ */
+static inline float histogram_bucket_upper(int bucket) {
+    if (bucket < 100) return bucket + 1;
+    return (bucket - 99) * 100.0F + 100.0F;
+}
+
+float TaskDerivedInfo::window_p95_cpu() const {
+    if (sample_count == 0) return 0;
+    // p95 对应的排名（从 1 开始）
+    uint32_t rank = (sample_count * 95 + 99) / 100;
+    uint32_t accumulated = 0;
+    for (int i = 0; i < PREPROCESS_HIST_BUCKETS; i++) {
+        accumulated += histogram[i];
+        if (accumulated >= rank) {
+            return MINIMUM(histogram_bucket_upper(i), window_max_cpu);
+        }
+    }
+    return window_max_cpu;
+}
+
+int MonitorInfoPreprocess::process(const std::shared_ptr<SysMonitorInfo>& monitor_info) {
+    if (!monitor_info || monitor_info->sys_cpu_data.empty()) {
+        return -1;
+    }
+    seq_++;
+    // 系统整体的 cpu 使用率
+    const CpuDataArray& cpu_data = monitor_info->sys_cpu_data;
+    sys_cpu_usage_ = cpu_usage(cpu_data.period(CPU_TIME_TOTAL, 0), cpu_data.period(CPU_TIME_IDLE_ALL, 0));
+    sys_ewma_cpu_usage_ = (seq_ == 1) ? sys_cpu_usage_ : (
+        ewma_alpha_ * sys_cpu_usage_ + (1 - ewma_alpha_) * sys_ewma_cpu_usage_);
+
+    // 已经退出的任务先删除，避免 pid 被复用时沿用旧任务的历史
+    for (const auto& exited : monitor_info->exited_process_info) {
+        derived_info_.erase(exited.pid);
+    }
+    for (const auto& process : monitor_info->all_process_info) {
+        auto iter = derived_info_.find(process->pid);
+        if (iter == derived_info_.end()) {
+            TaskDerivedInfo derived;
+            memset(&derived, 0, sizeof(derived));
+            derived.pid = process->pid;
+            iter = derived_info_.emplace(process->pid, derived).first;
+        }
+        update_task(*process, monitor_info->curr_time_ms, &iter->second);
+        iter->second.seen_seq = seq_;
+    }
+    // 删除本次快照中不存在的任务
+    for (auto iter = derived_info_.begin(); iter != derived_info_.end();) {
+        if (iter->second.seen_seq != seq_) {
+            iter = derived_info_.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+    return 0;
+}
+
+void MonitorInfoPreprocess::update_task(const ProcessInfo& process, uint64_t curr_time_ms,
+    TaskDerivedInfo* derived) {
+    bool first = derived->sample_count == 0;
+    double percent_cpu = process.percent_cpu;
+    // EWMA 平滑，以第一个有效的采样为初值
+    #define EWMA_UPDATE(ewma, value, seeded) \
+        (ewma) = (seeded) ? (ewma_alpha_ * (value) + (1 - ewma_alpha_) * (ewma)) : (value)
+    EWMA_UPDATE(derived->ewma_cpu, percent_cpu, !first);
+    if (!isnan(process.io_rate_read_bps)) {
+        EWMA_UPDATE(derived->ewma_io_read_bps, process.io_rate_read_bps, derived->has_io_read);
+        derived->has_io_read = true;
+    }
+    if (!isnan(process.io_rate_write_bps)) {
+        EWMA_UPDATE(derived->ewma_io_write_bps, process.io_rate_write_bps, derived->has_io_write);
+        derived->has_io_write = true;
+    }
+    #undef EWMA_UPDATE
+
+    // 负载按照实际的时间间隔衰减：load = load * e + active * (1 - e)，e = exp(-dt / period)
+    double active = percent_cpu / 100.0;
+    if (first || curr_time_ms <= derived->last_time_ms) {
+        if (first) {
+            for (int i = 0; i < 3; i++) derived->load_avg[i] = active;
+        }
+    } else {
+        double dt = (curr_time_ms - derived->last_time_ms) / 1000.0;
+        for (int i = 0; i < 3; i++) {
+            double e = exp(-dt / load_avg_periods[i]);
+            derived->load_avg[i] = derived->load_avg[i] * e + active * (1 - e);
+        }
+    }
+    derived->last_time_ms = curr_time_ms;
+
+    update_window(process.percent_cpu, derived);
+}
+
+void MonitorInfoPreprocess::update_window(float percent_cpu, TaskDerivedInfo* derived) {
+    const uint16_t window = PREPROCESS_WINDOW_SIZE;
+    // 窗口已满时，淘汰最旧的采样
+    if (derived->sample_count == window) {
+        derived->histogram[histogram_bucket(derived->samples[derived->sample_pos])]--;
+    } else {
+        derived->sample_count++;
+    }
+    derived->samples[derived->sample_pos] = percent_cpu;
+    derived->sample_pos = (derived->sample_pos + 1) % window;
+    derived->histogram[histogram_bucket(percent_cpu)]++;
+    uint16_t seq = derived->sample_seq++;
+
+    // 单调队列：队首为窗口内的最值，过期的队首出队，新采样从队尾入队前弹出不再可能成为最值的采样
+    #define WINDOW_QUEUE_UPDATE(queue, head, size, cmp)                                             \
+        {                                                                                           \
+            while ((size) && static_cast<uint16_t>(seq - (queue)[(head)].seq) >= window) {          \
+                (head) = ((head) + 1) % window;                                                     \
+                (size)--;                                                                           \
+            }                                                                                       \
+            while ((size) && !((queue)[((head) + (size) - 1) % window].value cmp percent_cpu)) {    \
+                (size)--;                                                                           \
+            }                                                                                       \
+            TaskDerivedInfo::WindowEntry& entry = (queue)[((head) + (size)) % window];              \
+            entry.value = percent_cpu;                                                              \
+            entry.seq = seq;                                                                        \
+            (size)++;                                                                               \
+        }
+    WINDOW_QUEUE_UPDATE(derived->min_queue, derived->min_head, derived->min_size, <);
+    WINDOW_QUEUE_UPDATE(derived->max_queue, derived->max_head, derived->max_size, >);
+    #undef WINDOW_QUEUE_UPDATE
+    derived->window_min_cpu = derived->min_queue[derived->min_head].value;
+    derived->window_max_cpu = derived->max_queue[derived->max_head].value;
+}
+
+const TaskDerivedInfo* MonitorInfoPreprocess::get_task_derived_info(pid_t pid) const {
+    auto iter = derived_info_.find(pid);
+    return iter == derived_info_.end() ? nullptr : &iter->second;
+}
+
+void MonitorInfoPreprocess::get_top_tasks_by_cpu(size_t n, std::vector<const TaskDerivedInfo*>* result) const {
+    result->clear();
+    result->reserve(derived_info_.size());
+    for (const auto& item : derived_info_) {
+        result->emplace_back(&item.second);
+    }
+    n = MINIMUM(n, result->size());
+    std::partial_sort(result->begin(), result->begin() + n, result->end(),
+        [](const TaskDerivedInfo* a, const TaskDerivedInfo* b) {
+            return a->ewma_cpu > b->ewma_cpu;
+        });
+    result->resize(n);
+}
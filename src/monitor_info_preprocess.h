@@ -4,23 +4,158 @@
  * @brief 监控数据预处理
  * @version 0.1
  * @date 2022-11-24
- * 
+ *
  * @copyright Copyright (c) 2022
- * 
+ *
  */
 
 #pragma once
 
-#include "monitor_info_collect.h"
+#include <sys/types.h>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include "common.h"
+#include "monitor_info.h"
+
+// 滑动窗口的采样个数
+#define PREPROCESS_WINDOW_SIZE 60
+// cpu 使用率直方图的桶个数：[0, 100) 每 1% 一个桶，之后每 100% 一个桶
+#define PREPROCESS_HIST_BUCKETS 164
+// 默认的 EWMA 平滑系数
+#define PREPROCESS_DEFAULT_EWMA_ALPHA 0.3
+
+/**
+ * @brief 一个任务的衍生监控数据
+ * @note 所有的历史数据都保存在固定大小的环形缓冲区中，每次更新的开销为 O(1)
+ */
+struct TaskDerivedInfo {
+    pid_t pid;
+
+    // EWMA 平滑后的 cpu 使用率（百分比）
+    double ewma_cpu;
+    // EWMA 平滑后的实际读写磁盘的速率（字节每秒），还没有有效的速率时为 0
+    double ewma_io_read_bps;
+    double ewma_io_write_bps;
+    // 任务的 1、5、15 分钟负载，计算方式与系统的 load average 相同，
+    // 输入为任务占用的 cpu 个数（percent_cpu / 100）
+    double load_avg[3];
+
+    // 滑动窗口内 cpu 使用率的最小值、最大值
+    float window_min_cpu;
+    float window_max_cpu;
+
+    /**
+     * @brief 滑动窗口内 cpu 使用率的 p95
+     * @note 由直方图得到，100% 以下的精度为 1%，以上的精度为 100%
+     */
+    float window_p95_cpu() const;
+
+    // 以下为内部状态
+    struct WindowEntry {
+        float value;
+        uint16_t seq;
+    };
+    // 滑动窗口中的采样（环形缓冲区）
+    float samples[PREPROCESS_WINDOW_SIZE];
+    uint16_t sample_pos;
+    uint16_t sample_count;
+    // 已经采样的总次数（按 2^16 回绕）
+    uint16_t sample_seq;
+    // 滑动窗口中采样的直方图
+    uint8_t histogram[PREPROCESS_HIST_BUCKETS];
+    // 单调队列（环形缓冲区），保存窗口内可能成为最小值、最大值的采样
+    WindowEntry min_queue[PREPROCESS_WINDOW_SIZE];
+    WindowEntry max_queue[PREPROCESS_WINDOW_SIZE];
+    uint16_t min_head, min_size;
+    uint16_t max_head, max_size;
+    uint64_t last_time_ms;
+    uint64_t seen_seq;
+    // IO 速率的 EWMA 是否已经以第一个有效的速率为初值，任务第一次被读取时速率为 NaN
+    bool has_io_read;
+    bool has_io_write;
+};
 
 /**
  * @brief 监控数据预处理
- * 
+ * @note 位于采集与输出之间，对每次采集的快照计算平滑值、负载与滑动窗口统计，
+ *       使用者可以直接获得稳定的排序，不需要自己保存历史
  */
-class MonitorInfoPreprocess : public MonitorInfoCollection {
+class MonitorInfoPreprocess {
  public:
-    
+    explicit MonitorInfoPreprocess(double ewma_alpha = PREPROCESS_DEFAULT_EWMA_ALPHA)
+        : ewma_alpha_(ewma_alpha) {}
+
+    /**
+     * @brief 处理一次采集到的快照
+     *
+     * @param monitor_info finish_once_monitor 返回的快照
+     * @return int 小于 0 表示失败
+     */
+    int process(const std::shared_ptr<SysMonitorInfo>& monitor_info);
+
+    /**
+     * @brief 根据一个 cpu 的周期数据计算使用率
+     *
+     * @return double 使用率，范围为 [0, 1]
+     */
+    static inline double cpu_usage(uint64_t total_period, uint64_t idle_all_period) {
+        double total_cpu = 1;
+        if (total_period != 0) {
+            total_cpu = total_period;
+        }
+        return (total_cpu - idle_all_period) / total_cpu;
+    }
+
+    /**
+     * @brief 系统整体的 cpu 使用率，范围为 [0, 1]
+     *
+     */
+    inline double sys_cpu_usage() const {
+        return sys_cpu_usage_;
+    }
+
+    /**
+     * @brief EWMA 平滑后的系统整体 cpu 使用率，范围为 [0, 1]
+     *
+     */
+    inline double sys_ewma_cpu_usage() const {
+        return sys_ewma_cpu_usage_;
+    }
+
+    /**
+     * @brief 获取一个任务的衍生数据
+     *
+     * @return 任务不存在时返回 nullptr
+     */
+    const TaskDerivedInfo* get_task_derived_info(pid_t pid) const;
+
+    /**
+     * @brief 按平滑后的 cpu 使用率获取排名靠前的任务
+     *
+     * @param n 最多返回的个数
+     * @param result 输出参数，按 ewma_cpu 从大到小排序
+     */
+    void get_top_tasks_by_cpu(size_t n, std::vector<const TaskDerivedInfo*>* result) const;
+
+    /**
+     * @brief 衍生数据占用的内存（字节）
+     * @note 只保存快照中有完整信息的任务，随完整信息的任务个数增减；
+     *       有内存预算时通过 MonitorInfoCollection::set_consumer_memory 计入预算
+     */
+    inline size_t memory_bytes() const {
+        return Util::hash_map_bytes(derived_info_);
+    }
 
  private:
+    void update_task(const ProcessInfo& process, uint64_t curr_time_ms, TaskDerivedInfo* derived);
+    void update_window(float percent_cpu, TaskDerivedInfo* derived);
 
+ private:
+    double ewma_alpha_;
+    uint64_t seq_ = 0;
+    double sys_cpu_usage_ = 0;
+    double sys_ewma_cpu_usage_ = 0;
+    // pid -> 任务的衍生数据
+    std::unordered_map<pid_t, TaskDerivedInfo> derived_info_;
 };
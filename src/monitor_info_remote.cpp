@@ -0,0 +1,655 @@
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <algorithm>
+#include "common.h"
+#include "monitor_info_remote.h"
+
+// 百分比、速率转换成整数后传输，避免浮点数的微小抖动导致字段被判断为变化
+static inline uint64_t scaled_percent(double percent) {
+    return percent > 0 ? static_cast<uint64_t>(llround(percent * 100)) : 0;
+}
+
+static inline uint64_t rounded_rate(double rate) {
+    return rate > 0 ? static_cast<uint64_t>(llround(rate)) : 0;
+}
+
+// 主机的更新时间与过期只比较本地的时间间隔，使用单调时钟，不受系统时间调整的影响
+static inline uint64_t now_ms() {
+    return Util::get_monotonic_ns() / 1000000;
+}
+
+int RemoteAddress::parse(const char* spec) {
+    memset(&addr, 0, sizeof(addr));
+    if (Util::wrap_strncmp(spec, "unix:")) {
+        const char* path = spec + strlen("unix:");
+        struct sockaddr_un* un = reinterpret_cast<struct sockaddr_un*>(&addr);
+        if (path[0] == '\0' || strlen(path) >= sizeof(un->sun_path)) {
+            ERROR_LOG("invalid unix socket path: %s", path);
+            return -1;
+        }
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, path);
+        addr_len = sizeof(struct sockaddr_un);
+        family = AF_UNIX;
+        return 0;
+    }
+    if (Util::wrap_strncmp(spec, "tcp:")) {
+        spec += strlen("tcp:");
+    }
+    // 最后一个 ':' 之后为端口，ipv6 地址可以写成 [::1]:port
+    const char* colon = strrchr(spec, ':');
+    if (!colon || colon[1] == '\0') {
+        ERROR_LOG("invalid remote address: %s, expect tcp:<host>:<port> or unix:<path>", spec);
+        return -1;
+    }
+    std::string host(spec, colon - spec);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    // host 为空时监听所有地址
+    hints.ai_flags = host.empty() ? AI_PASSIVE : 0;
+    struct addrinfo* result = nullptr;
+    int res = getaddrinfo(host.empty() ? nullptr : host.c_str(), colon + 1, &hints, &result);
+    if (res != 0 || !result) {
+        ERROR_LOG("resolve remote address: %s failed, err: %s", spec, gai_strerror(res));
+        return -1;
+    }
+    memcpy(&addr, result->ai_addr, result->ai_addrlen);
+    addr_len = result->ai_addrlen;
+    family = result->ai_family;
+    freeaddrinfo(result);
+    return 0;
+}
+
+RemoteAgent::~RemoteAgent() {
+    if (fd_ >= 0) close(fd_);
+}
+
+int RemoteAgent::initialize(const char* address, const char* host_name) {
+    if (address_.parse(address) < 0) return -1;
+    if (host_name && host_name[0]) {
+        snprintf(host_name_, sizeof(host_name_), "%s", host_name);
+    } else if (gethostname(host_name_, sizeof(host_name_)) < 0) {
+        ERROR_LOG("gethostname failed, err: %s", strerror(errno));
+        return -1;
+    }
+    host_name_[sizeof(host_name_) - 1] = '\0';
+    return 0;
+}
+
+int RemoteAgent::start_connect(uint64_t now_ms) {
+    int fd = socket(address_.family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        ERROR_LOG("create remote socket failed, err: %s", strerror(errno));
+        disconnect(now_ms);
+        return -1;
+    }
+    if (address_.family != AF_UNIX) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    fd_ = fd;
+    connect_start_ms_ = now_ms;
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&address_.addr), address_.addr_len) == 0) {
+        on_connected(now_ms);
+        return 0;
+    }
+    // unix socket 的监听队列满时返回 EAGAIN，同样按失败处理
+    if (errno != EINPROGRESS) {
+        if (!connect_warned_) {
+            WARN_LOG("connect to collector failed, err: %s, will retry", strerror(errno));
+            connect_warned_ = true;
+        }
+        disconnect(now_ms);
+        return -1;
+    }
+    connect_state_ = CONNECT_IN_PROGRESS;
+    return -1;
+}
+
+void RemoteAgent::on_connected(uint64_t now_ms) {
+    connect_state_ = CONNECT_DONE;
+    connect_warned_ = false;
+    backoff_ms_ = REMOTE_RECONNECT_MIN_MS;
+    last_progress_ms_ = now_ms;
+    // 新连接从全量快照开始
+    tasks_.clear();
+    memset(sys_values_, 0, sizeof(sys_values_));
+    send_full_ = true;
+    out_.clear();
+    out_pos_ = 0;
+
+    encoder_.reset();
+    encoder_.put_string(host_name_, strlen(host_name_));
+    encoder_.put_varint(getpid());
+    queue_frame(REMOTE_FRAME_HELLO);
+    INFO_LOG("connected to collector as host: %s", host_name_);
+}
+
+int RemoteAgent::update_connection(uint64_t now_ms) {
+    if (connect_state_ == CONNECT_DONE) return 0;
+    if (connect_state_ == CONNECT_NONE) {
+        if (now_ms < next_connect_ms_) return -1;
+        if (start_connect(now_ms) < 0 && connect_state_ != CONNECT_IN_PROGRESS) return -1;
+        if (connect_state_ == CONNECT_DONE) return 0;
+    }
+    // 只检查连接是否完成，不等待
+    struct pollfd pfd = {fd_, POLLOUT, 0};
+    if (poll(&pfd, 1, 0) == 0) {
+        if (now_ms - connect_start_ms_ >= REMOTE_CONNECT_TIMEOUT_MS) {
+            if (!connect_warned_) {
+                WARN_LOG("connect to collector timed out, will retry");
+                connect_warned_ = true;
+            }
+            disconnect(now_ms);
+        }
+        return -1;
+    }
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &len) < 0) err = errno;
+    if (err != 0) {
+        if (!connect_warned_) {
+            WARN_LOG("connect to collector failed, err: %s, will retry", strerror(err));
+            connect_warned_ = true;
+        }
+        disconnect(now_ms);
+        return -1;
+    }
+    on_connected(now_ms);
+    return 0;
+}
+
+void RemoteAgent::disconnect(uint64_t now_ms) {
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+    connect_state_ = CONNECT_NONE;
+    out_.clear();
+    out_pos_ = 0;
+    next_connect_ms_ = now_ms + backoff_ms_;
+    backoff_ms_ = MINIMUM(backoff_ms_ * 2, static_cast<uint64_t>(REMOTE_RECONNECT_MAX_MS));
+}
+
+void RemoteAgent::queue_frame(RemoteFrameType type) {
+    std::vector<char>& buffer = encoder_.buffer();
+    RemoteFrameHeader header;
+    header.magic = REMOTE_FRAME_MAGIC;
+    header.version = REMOTE_PROTOCOL_VERSION;
+    header.type = type;
+    header.reserved = 0;
+    header.length = buffer.size() - sizeof(RemoteFrameHeader);
+    memcpy(buffer.data(), &header, sizeof(header));
+    if (out_pos_ == out_.size()) {
+        out_.clear();
+        out_pos_ = 0;
+    }
+    out_.insert(out_.end(), buffer.begin(), buffer.end());
+}
+
+int RemoteAgent::flush(uint64_t now_ms) {
+    while (out_pos_ < out_.size()) {
+        ssize_t res = send(fd_, out_.data() + out_pos_, out_.size() - out_pos_, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            WARN_LOG("send to collector failed, err: %s, reconnect later", strerror(errno));
+            return -1;
+        }
+        out_pos_ += res;
+        bytes_sent_ += res;
+        last_progress_ms_ = now_ms;
+    }
+    if (out_pos_ == out_.size()) {
+        out_.clear();
+        out_pos_ = 0;
+        last_progress_ms_ = now_ms;
+        return 0;
+    }
+    if (now_ms - last_progress_ms_ >= REMOTE_STALL_TIMEOUT_MS) {
+        WARN_LOG("collector has not read for %d ms, reconnect later", REMOTE_STALL_TIMEOUT_MS);
+        return -1;
+    }
+    return 0;
+}
+
+void RemoteAgent::encode_snapshot(const SysMonitorInfo& monitor_info) {
+    encoder_.reset();
+    seq_++;
+
+    // 系统级字段
+    uint64_t sys[REMOTE_SYS_FIELDS];
+    const CpuDataArray& cpu_data = monitor_info.sys_cpu_data;
+    bool has_cpu = cpu_data.size() > 0;
+    sys[REMOTE_SYS_TIME_MS] = monitor_info.curr_time_ms;
+    sys[REMOTE_SYS_TOTAL_MEM] = monitor_info.total_mem;
+    sys[REMOTE_SYS_USED_MEM] = monitor_info.used_mem;
+    sys[REMOTE_SYS_AVAILABLE_MEM] = monitor_info.avilable_mem;
+    sys[REMOTE_SYS_TOTAL_SWAP] = monitor_info.total_swap;
+    sys[REMOTE_SYS_USED_SWAP] = monitor_info.used_swap;
+    sys[REMOTE_SYS_ACTIVE_CPUS] = monitor_info.active_cpus;
+    sys[REMOTE_SYS_CPU_BUSY] = has_cpu ? scaled_percent(cpu_data.percent(CPU_PERCENT_BUSY, 0)) : 0;
+    sys[REMOTE_SYS_CPU_USER] = has_cpu ? scaled_percent(cpu_data.percent(CPU_PERCENT_USER, 0)) : 0;
+    sys[REMOTE_SYS_CPU_SYSTEM] = has_cpu ? scaled_percent(cpu_data.percent(CPU_PERCENT_SYSTEM, 0)) : 0;
+    sys[REMOTE_SYS_CPU_IO_WAIT] = has_cpu ? scaled_percent(cpu_data.percent(CPU_PERCENT_IO_WAIT, 0)) : 0;
+    sys[REMOTE_SYS_CPU_STEAL] = has_cpu ? scaled_percent(cpu_data.percent(CPU_PERCENT_STEAL, 0)) : 0;
+    sys[REMOTE_SYS_TASK_COUNT] = monitor_info.all_process_info.size();
+    uint32_t mask = 0;
+    for (int i = 0; i < REMOTE_SYS_FIELDS; i++) {
+        if (send_full_ || sys[i] != sys_values_[i]) mask |= 1U << i;
+    }
+    encoder_.put_varint(mask);
+    for (int i = 0; i < REMOTE_SYS_FIELDS; i++) {
+        if (!(mask & (1U << i))) continue;
+        encoder_.put_delta(sys[i], sys_values_[i]);
+        sys_values_[i] = sys[i];
+    }
+
+    // 变化的任务：掩码、pid 差值、变化字段的差值，以掩码 0 结束
+    uint64_t values[REMOTE_TASK_FIELDS];
+    pid_t last_pid = 0;
+    for (const auto& process : monitor_info.all_process_info) {
+        const ProcessInfo& task = *process;
+        values[REMOTE_TASK_PPID] = static_cast<uint32_t>(task.ppid);
+        values[REMOTE_TASK_TGID] = static_cast<uint32_t>(task.tgid);
+        values[REMOTE_TASK_UID] = task.uid;
+        values[REMOTE_TASK_UTIME] = task.utime;
+        values[REMOTE_TASK_STIME] = task.stime;
+        values[REMOTE_TASK_PERCENT_CPU] = scaled_percent(task.percent_cpu);
+        values[REMOTE_TASK_PERCENT_MEM] = scaled_percent(task.percent_mem);
+        values[REMOTE_TASK_VIRTUAL_MEM] = task.virtual_mem;
+        values[REMOTE_TASK_RESIDENT_MEM] = task.resident_mem;
+        values[REMOTE_TASK_IO_READ_BYTES] = task.io_read_bytes;
+        values[REMOTE_TASK_IO_WRITE_BYTES] = task.io_write_bytes;
+        values[REMOTE_TASK_IO_READ_BPS] = rounded_rate(task.io_rate_read_bps);
+        values[REMOTE_TASK_IO_WRITE_BPS] = rounded_rate(task.io_rate_write_bps);
+        values[REMOTE_TASK_NET_TCP_CONNS] = task.net_tcp_conns;
+        values[REMOTE_TASK_NET_SEND_BPS] = rounded_rate(task.net_rate_send_bps);
+        values[REMOTE_TASK_NET_RECV_BPS] = rounded_rate(task.net_rate_recv_bps);
+
+        auto result = tasks_.try_emplace(task.pid);
+        TaskState& state = result.first->second;
+        bool is_new = result.second;
+        state.seq = seq_;
+        uint32_t task_mask = 0;
+        for (int i = 0; i < REMOTE_TASK_FIELDS; i++) {
+            if (is_new || values[i] != state.values[i]) task_mask |= 1U << i;
+        }
+        if (is_new || task.cmdline_id != state.cmdline_id || task.user_id != state.user_id) {
+            task_mask |= REMOTE_TASK_STRINGS_BIT;
+        }
+        if (task_mask == 0) continue;
+
+        encoder_.put_varint(task_mask);
+        encoder_.put_delta(static_cast<uint32_t>(task.pid), static_cast<uint32_t>(last_pid));
+        last_pid = task.pid;
+        for (int i = 0; i < REMOTE_TASK_FIELDS; i++) {
+            if (!(task_mask & (1U << i))) continue;
+            encoder_.put_delta(values[i], is_new ? 0 : state.values[i]);
+            state.values[i] = values[i];
+        }
+        if (task_mask & REMOTE_TASK_STRINGS_BIT) {
+            const StringArena& arena = *monitor_info.string_arena;
+            encoder_.put_string(arena.get(task.cmdline_id), arena.length(task.cmdline_id));
+            encoder_.put_string(arena.get(task.user_id), arena.length(task.user_id));
+            state.cmdline_id = task.cmdline_id;
+            state.user_id = task.user_id;
+        }
+    }
+    encoder_.put_varint(0);
+
+    // 消失的任务
+    removed_.clear();
+    for (auto iter = tasks_.begin(); iter != tasks_.end();) {
+        if (iter->second.seq != seq_) {
+            removed_.push_back(iter->first);
+            iter = tasks_.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+    std::sort(removed_.begin(), removed_.end());
+    encoder_.put_varint(removed_.size());
+    last_pid = 0;
+    for (pid_t pid : removed_) {
+        encoder_.put_delta(static_cast<uint32_t>(pid), static_cast<uint32_t>(last_pid));
+        last_pid = pid;
+    }
+}
+
+int RemoteAgent::send_snapshot(const SysMonitorInfo& monitor_info) {
+    uint64_t now = Util::get_monotonic_ns() / 1000000;
+    if (update_connection(now) < 0) return -1;
+    if (flush(now) < 0) {
+        disconnect(now);
+        return -1;
+    }
+    // 上一帧还没有发完：不编码本次快照，增量以上一次编码的状态为基准，变化会合并到下一帧
+    if (out_pos_ < out_.size()) {
+        coalesced_snapshots_++;
+        return -2;
+    }
+    bool full = send_full_;
+    encode_snapshot(monitor_info);
+    queue_frame(full ? REMOTE_FRAME_FULL : REMOTE_FRAME_DELTA);
+    send_full_ = false;
+    if (flush(now) < 0) {
+        disconnect(now);
+        return -1;
+    }
+    return 0;
+}
+
+RemoteCollector::~RemoteCollector() {
+    while (!connections_.empty()) {
+        close_connection(connections_.begin()->first);
+    }
+    if (listen_fd_ >= 0) close(listen_fd_);
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+    if (unix_path_[0]) unlink(unix_path_);
+}
+
+int RemoteCollector::listen(const char* address) {
+    RemoteAddress remote;
+    if (remote.parse(address) < 0) return -1;
+    listen_fd_ = socket(remote.family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        ERROR_LOG("create listen socket failed, err: %s", strerror(errno));
+        return -1;
+    }
+    if (remote.family == AF_UNIX) {
+        // 清理上一次运行遗留的 socket 文件
+        const char* path = reinterpret_cast<struct sockaddr_un*>(&remote.addr)->sun_path;
+        unlink(path);
+        snprintf(unix_path_, sizeof(unix_path_), "%s", path);
+    } else {
+        int one = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&remote.addr), remote.addr_len) < 0
+        || ::listen(listen_fd_, SOMAXCONN) < 0) {
+        ERROR_LOG("listen on: %s failed, err: %s", address, strerror(errno));
+        unix_path_[0] = '\0';
+        return -1;
+    }
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        ERROR_LOG("epoll_create1 failed, err: %s", strerror(errno));
+        return -1;
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = listen_fd_;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &event) < 0) {
+        ERROR_LOG("epoll_ctl add listen fd failed, err: %s", strerror(errno));
+        return -1;
+    }
+    INFO_LOG("collector listening on: %s", address);
+    return 0;
+}
+
+int RemoteCollector::poll(int timeout_ms) {
+    struct epoll_event events[REMOTE_MAX_EVENTS];
+    int count = epoll_wait(epoll_fd_, events, REMOTE_MAX_EVENTS, timeout_ms);
+    if (count < 0) {
+        if (errno == EINTR) return 0;
+        ERROR_LOG("epoll_wait failed, err: %s", strerror(errno));
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        int fd = events[i].data.fd;
+        if (fd == listen_fd_) {
+            accept_connections();
+            continue;
+        }
+        auto iter = connections_.find(fd);
+        // 同一批事件中可能已经被关闭
+        if (iter == connections_.end()) continue;
+        if (read_connection(&iter->second) < 0) {
+            close_connection(fd);
+        }
+    }
+    return count;
+}
+
+int RemoteCollector::accept_connections() {
+    for (;;) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                WARN_LOG("accept failed, err: %s", strerror(errno));
+            }
+            return 0;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+            WARN_LOG("epoll_ctl add fd: %d failed, err: %s", fd, strerror(errno));
+            close(fd);
+            continue;
+        }
+        Connection& conn = connections_[fd];
+        conn.fd = fd;
+        conn.host = nullptr;
+        conn.begin = 0;
+        conn.end = 0;
+    }
+}
+
+int RemoteCollector::read_connection(Connection* conn) {
+    // 电平触发，每个事件只读一次，避免一个发送很快的 agent 饿死其他连接
+    if (conn->buffer.size() - conn->end < REMOTE_READ_CHUNK) {
+        if (conn->begin > 0) {
+            memmove(conn->buffer.data(), conn->buffer.data() + conn->begin, conn->end - conn->begin);
+            conn->end -= conn->begin;
+            conn->begin = 0;
+        }
+        if (conn->buffer.size() - conn->end < REMOTE_READ_CHUNK) {
+            conn->buffer.resize(conn->end + REMOTE_READ_CHUNK);
+        }
+    }
+    ssize_t res = read(conn->fd, conn->buffer.data() + conn->end, conn->buffer.size() - conn->end);
+    if (res < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+        WARN_LOG("read from agent fd: %d failed, err: %s", conn->fd, strerror(errno));
+        return -1;
+    }
+    if (res == 0) return -1;
+    conn->end += res;
+
+    while (conn->end - conn->begin >= sizeof(RemoteFrameHeader)) {
+        RemoteFrameHeader header;
+        memcpy(&header, conn->buffer.data() + conn->begin, sizeof(header));
+        if (header.magic != REMOTE_FRAME_MAGIC || header.version != REMOTE_PROTOCOL_VERSION
+            || header.length > REMOTE_MAX_FRAME_LENGTH) {
+            WARN_LOG("invalid frame from agent fd: %d, magic: %x, version: %u, length: %u",
+                conn->fd, header.magic, header.version, header.length);
+            return -1;
+        }
+        size_t frame_length = sizeof(header) + header.length;
+        if (conn->end - conn->begin < frame_length) break;
+        if (handle_frame(conn, header, conn->buffer.data() + conn->begin + sizeof(header)) < 0) {
+            return -1;
+        }
+        conn->begin += frame_length;
+    }
+    if (conn->begin == conn->end) {
+        conn->begin = 0;
+        conn->end = 0;
+    }
+    return 0;
+}
+
+int RemoteCollector::handle_frame(Connection* conn, const RemoteFrameHeader& header, const char* payload) {
+    if (header.type == REMOTE_FRAME_HELLO) {
+        if (conn->host) {
+            WARN_LOG("duplicate hello from agent fd: %d", conn->fd);
+            return -1;
+        }
+        RemoteDecoder decoder(payload, header.length);
+        size_t length = 0;
+        const char* name = decoder.get_string(&length);
+        uint64_t agent_pid = decoder.get_varint();
+        if (!decoder.ok() || length == 0 || length > REMOTE_HOST_NAME_LENGTH) {
+            WARN_LOG("invalid hello from agent fd: %d", conn->fd);
+            return -1;
+        }
+        RemoteHostView& host = hosts_[std::string(name, length)];
+        if (host.host_name.empty()) {
+            host.host_name.assign(name, length);
+        }
+        // 同名主机的旧连接（例如 agent 重启后旧连接还没有被发现断开）被新连接取代
+        if (host.connection_fd >= 0) {
+            WARN_LOG("host: %s reconnected, close old connection fd: %d", host.host_name.c_str(),
+                host.connection_fd);
+            close_connection(host.connection_fd);
+        }
+        host.connection_fd = conn->fd;
+        conn->host = &host;
+        INFO_LOG("agent connected, host: %s, pid: %lu, fd: %d", host.host_name.c_str(), agent_pid, conn->fd);
+        return 0;
+    }
+    if (!conn->host) {
+        WARN_LOG("snapshot before hello from agent fd: %d", conn->fd);
+        return -1;
+    }
+    if (header.type != REMOTE_FRAME_FULL && header.type != REMOTE_FRAME_DELTA) {
+        WARN_LOG("unknown frame type: %u from host: %s", header.type, conn->host->host_name.c_str());
+        return -1;
+    }
+    conn->host->bytes += sizeof(header) + header.length;
+    if (apply_snapshot(conn->host, header.type == REMOTE_FRAME_FULL, payload, header.length) < 0) {
+        WARN_LOG("corrupted snapshot from host: %s", conn->host->host_name.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+int RemoteCollector::apply_snapshot(RemoteHostView* host, bool full, const char* payload, size_t length) {
+    if (full) {
+        clear_host_tasks(host);
+        memset(host->sys_values, 0, sizeof(host->sys_values));
+    }
+    RemoteDecoder decoder(payload, length);
+    uint64_t mask = decoder.get_varint();
+    for (int i = 0; i < REMOTE_SYS_FIELDS; i++) {
+        if (mask & (1ULL << i)) host->sys_values[i] = decoder.get_delta(host->sys_values[i]);
+    }
+
+    uint32_t pid = 0;
+    for (;;) {
+        mask = decoder.get_varint();
+        if (!decoder.ok()) return -1;
+        if (mask == 0) break;
+        pid = decoder.get_delta(pid);
+        // 新任务的字段与 id 都为 0
+        RemoteTaskView& task = host->tasks.try_emplace(static_cast<pid_t>(pid)).first->second;
+        for (int i = 0; i < REMOTE_TASK_FIELDS; i++) {
+            if (mask & (1ULL << i)) task.values[i] = decoder.get_delta(task.values[i]);
+        }
+        if (mask & REMOTE_TASK_STRINGS_BIT) {
+            size_t cmdline_length = 0;
+            size_t user_length = 0;
+            const char* cmdline = decoder.get_string(&cmdline_length);
+            const char* user = decoder.get_string(&user_length);
+            uint32_t cmdline_id = string_arena_.intern(cmdline, cmdline_length);
+            uint32_t user_id = string_arena_.intern(user, user_length);
+            string_arena_.release(task.cmdline_id);
+            string_arena_.release(task.user_id);
+            task.cmdline_id = cmdline_id;
+            task.user_id = user_id;
+        }
+    }
+
+    uint64_t removed = decoder.get_varint();
+    pid = 0;
+    for (uint64_t i = 0; i < removed && decoder.ok(); i++) {
+        pid = decoder.get_delta(pid);
+        auto iter = host->tasks.find(static_cast<pid_t>(pid));
+        if (iter == host->tasks.end()) continue;
+        string_arena_.release(iter->second.cmdline_id);
+        string_arena_.release(iter->second.user_id);
+        host->tasks.erase(iter);
+    }
+    if (!decoder.ok() || !decoder.done()) return -1;
+    host->last_update_ms = now_ms();
+    host->frames++;
+    return 0;
+}
+
+void RemoteCollector::close_connection(int fd) {
+    auto iter = connections_.find(fd);
+    if (iter == connections_.end()) return;
+    RemoteHostView* host = iter->second.host;
+    if (host && host->connection_fd == fd) {
+        INFO_LOG("agent disconnected, host: %s", host->host_name.c_str());
+        host->connection_fd = -1;
+    }
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections_.erase(iter);
+}
+
+void RemoteCollector::clear_host_tasks(RemoteHostView* host) {
+    for (const auto& item : host->tasks) {
+        string_arena_.release(item.second.cmdline_id);
+        string_arena_.release(item.second.user_id);
+    }
+    host->tasks.clear();
+}
+
+void RemoteCollector::expire_hosts(uint64_t expire_ms) {
+    uint64_t now = now_ms();
+    for (auto iter = hosts_.begin(); iter != hosts_.end();) {
+        RemoteHostView& host = iter->second;
+        if (host.connection_fd < 0 && now > host.last_update_ms + expire_ms) {
+            INFO_LOG("expire host: %s", host.host_name.c_str());
+            clear_host_tasks(&host);
+            iter = hosts_.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+void RemoteCollector::get_top_tasks_by_cpu(size_t n, std::vector<RemoteTaskRef>* result) const {
+    result->clear();
+    if (n == 0) return;
+    // 小顶堆保存当前最大的 n 个，不需要把所有主机的任务复制出来排序
+    auto greater = [](const RemoteTaskRef& a, const RemoteTaskRef& b) {
+        return a.task->values[REMOTE_TASK_PERCENT_CPU] > b.task->values[REMOTE_TASK_PERCENT_CPU];
+    };
+    for (const auto& host_item : hosts_) {
+        for (const auto& task_item : host_item.second.tasks) {
+            RemoteTaskRef ref{&host_item.second, task_item.first, &task_item.second};
+            if (result->size() < n) {
+                result->push_back(ref);
+                std::push_heap(result->begin(), result->end(), greater);
+            } else if (greater(ref, result->front())) {
+                std::pop_heap(result->begin(), result->end(), greater);
+                result->back() = ref;
+                std::push_heap(result->begin(), result->end(), greater);
+            }
+        }
+    }
+    std::sort_heap(result->begin(), result->end(), greater);
+}
@@ -0,0 +1,462 @@
+/**
+ * @file monitor_info_remote.h
+ * @author zhangyi
+ * @brief 远程汇聚：agent 把快照以二进制增量的方式发送给 collector
+ * @version 0.1
+ * @date 2022-12-28
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "monitor_info.h"
+
+// 帧头的魔数与协议版本，编码变化时需要升级版本号
+#define REMOTE_FRAME_MAGIC 0x52504f54U  // "TOPR"
+#define REMOTE_PROTOCOL_VERSION 1
+// 单个帧的最大长度，超过时 collector 断开连接
+#define REMOTE_MAX_FRAME_LENGTH (64 * 1024 * 1024)
+// 主机名的最大长度
+#define REMOTE_HOST_NAME_LENGTH 63
+// agent 的连接超时时间
+#define REMOTE_CONNECT_TIMEOUT_MS 3000
+// agent 的发送缓冲区持续没有进展的时间超过该值时断开，重连后发送全量快照
+#define REMOTE_STALL_TIMEOUT_MS 30000
+// agent 重连的退避时间，每次失败翻倍，连接成功后恢复
+#define REMOTE_RECONNECT_MIN_MS 1000
+#define REMOTE_RECONNECT_MAX_MS 60000
+// collector 单次 epoll_wait 处理的最多事件个数
+#define REMOTE_MAX_EVENTS 256
+// collector 单次 read 的字节数
+#define REMOTE_READ_CHUNK (256 * 1024)
+
+// 帧的类型
+enum RemoteFrameType : uint8_t {
+    REMOTE_FRAME_HELLO = 1,     // 连接建立后的第一帧，携带主机名
+    REMOTE_FRAME_FULL,          // 全量快照，collector 先清空该主机的数据
+    REMOTE_FRAME_DELTA,         // 增量快照
+};
+
+/**
+ * @brief 帧头，之后紧跟 length 字节的负载
+ * @note 按小端序直接写入，agent 与 collector 需要字节序一致
+ */
+struct RemoteFrameHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t type;
+    uint16_t reserved;
+    uint32_t length;
+};
+
+// 系统级的字段，百分比乘以 100 后取整
+enum RemoteSysField {
+    REMOTE_SYS_TIME_MS = 0,
+    REMOTE_SYS_TOTAL_MEM,
+    REMOTE_SYS_USED_MEM,
+    REMOTE_SYS_AVAILABLE_MEM,
+    REMOTE_SYS_TOTAL_SWAP,
+    REMOTE_SYS_USED_SWAP,
+    REMOTE_SYS_ACTIVE_CPUS,
+    REMOTE_SYS_CPU_BUSY,
+    REMOTE_SYS_CPU_USER,
+    REMOTE_SYS_CPU_SYSTEM,
+    REMOTE_SYS_CPU_IO_WAIT,
+    REMOTE_SYS_CPU_STEAL,
+    REMOTE_SYS_TASK_COUNT,
+    REMOTE_SYS_FIELDS,
+};
+
+// 任务级的字段，百分比乘以 100 后取整，速率取整为每秒字节数
+enum RemoteTaskField {
+    REMOTE_TASK_PPID = 0,
+    REMOTE_TASK_TGID,
+    REMOTE_TASK_UID,
+    REMOTE_TASK_UTIME,
+    REMOTE_TASK_STIME,
+    REMOTE_TASK_PERCENT_CPU,
+    REMOTE_TASK_PERCENT_MEM,
+    REMOTE_TASK_VIRTUAL_MEM,
+    REMOTE_TASK_RESIDENT_MEM,
+    REMOTE_TASK_IO_READ_BYTES,
+    REMOTE_TASK_IO_WRITE_BYTES,
+    REMOTE_TASK_IO_READ_BPS,
+    REMOTE_TASK_IO_WRITE_BPS,
+    REMOTE_TASK_NET_TCP_CONNS,
+    REMOTE_TASK_NET_SEND_BPS,
+    REMOTE_TASK_NET_RECV_BPS,
+    REMOTE_TASK_FIELDS,
+};
+
+// 任务字段掩码中表示之后跟着命令行与用户名的位
+#define REMOTE_TASK_STRINGS_BIT (1U << REMOTE_TASK_FIELDS)
+
+static_assert(REMOTE_SYS_FIELDS <= 32, "sys field mask must fit in 32 bits");
+static_assert(REMOTE_TASK_FIELDS < 32, "task field mask must fit in 32 bits");
+
+/**
+ * @brief 远程地址
+ * @note 格式为 tcp:<host>:<port>、unix:<path>，或者省略前缀的 <host>:<port>
+ */
+struct RemoteAddress {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = 0;
+    int family = 0;
+
+    /**
+     * @brief 解析地址字符串
+     *
+     * @return int 小于 0 表示格式错误或主机名无法解析
+     */
+    int parse(const char* spec);
+};
+
+/**
+ * @brief 增量编码器，负载由 varint 组成
+ * @note 无符号数使用 LEB128，有符号的差值先做 zigzag 变换
+ */
+class RemoteEncoder {
+ public:
+    /**
+     * @brief 清空并预留帧头的位置
+     *
+     */
+    inline void reset() {
+        buffer_.assign(sizeof(RemoteFrameHeader), 0);
+    }
+
+    inline void put_varint(uint64_t value) {
+        while (value >= 0x80) {
+            buffer_.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        buffer_.push_back(static_cast<char>(value));
+    }
+
+    inline void put_delta(uint64_t value, uint64_t last) {
+        int64_t delta = static_cast<int64_t>(value - last);
+        put_varint((static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+    }
+
+    inline void put_string(const char* str, size_t length) {
+        put_varint(length);
+        buffer_.insert(buffer_.end(), str, str + length);
+    }
+
+    inline std::vector<char>& buffer() {
+        return buffer_;
+    }
+
+ private:
+    std::vector<char> buffer_;
+};
+
+/**
+ * @brief 增量解码器，越界时 ok() 返回 false，之后的读取都返回 0
+ *
+ */
+class RemoteDecoder {
+ public:
+    RemoteDecoder(const char* data, size_t length) : pos_(data), end_(data + length) {}
+
+    inline uint64_t get_varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos_ >= end_) {
+                ok_ = false;
+                return 0;
+            }
+            uint8_t byte = static_cast<uint8_t>(*pos_++);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok_ = false;
+        return 0;
+    }
+
+    inline uint64_t get_delta(uint64_t last) {
+        uint64_t zigzag = get_varint();
+        int64_t delta = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+        return last + static_cast<uint64_t>(delta);
+    }
+
+    /**
+     * @brief 读取一个字符串，返回的指针指向原始数据，不以 '\0' 结尾
+     *
+     */
+    inline const char* get_string(size_t* length) {
+        *length = get_varint();
+        if (!ok_ || *length > static_cast<size_t>(end_ - pos_)) {
+            ok_ = false;
+            *length = 0;
+            return "";
+        }
+        const char* str = pos_;
+        pos_ += *length;
+        return str;
+    }
+
+    inline bool ok() const {
+        return ok_;
+    }
+
+    inline bool done() const {
+        return pos_ == end_;
+    }
+
+ private:
+    const char* pos_;
+    const char* end_;
+    bool ok_ = true;
+};
+
+/**
+ * @brief 采集端，把每次的快照发送给 collector
+ * @note 每个任务记录上一次发送的字段值，只发送变化的字段及其差值，任务消失时发送一次删除。
+ *       连接与发送都是非阻塞的，在采集线程中调用也不会等待 collector：
+ *         - connect 在后台完成，失败后按指数退避（REMOTE_RECONNECT_MIN_MS 到 REMOTE_RECONNECT_MAX_MS）重连，
+ *           重连后的第一帧为全量快照
+ *         - 发送缓冲区中最多有一帧，上一帧还没有发完时本次快照不编码，变化合并到下一帧的增量中
+ *         - 缓冲区超过 REMOTE_STALL_TIMEOUT_MS 没有任何进展时断开
+ */
+class RemoteAgent {
+ public:
+    RemoteAgent() = default;
+    ~RemoteAgent();
+    RemoteAgent(const RemoteAgent&) = delete;
+    RemoteAgent& operator=(const RemoteAgent&) = delete;
+
+    /**
+     * @brief 设置 collector 的地址与上报的主机名
+     *
+     * @param host_name 为空时使用 gethostname 的结果
+     * @return int 小于 0 表示地址无效
+     */
+    int initialize(const char* address, const char* host_name);
+
+    /**
+     * @brief 发送一份快照，不阻塞
+     *
+     * @return int 0 表示已放入发送缓冲区；-1 表示没有连接（正在连接或等待重连）；
+     *         -2 表示上一帧还没有发完，本次快照被合并到下一帧
+     */
+    int send_snapshot(const SysMonitorInfo& monitor_info);
+
+    /**
+     * @brief 累计发送的字节数
+     *
+     */
+    inline uint64_t bytes_sent() const {
+        return bytes_sent_;
+    }
+
+    /**
+     * @brief 因发送缓冲区未清空而合并到下一帧的快照个数
+     *
+     */
+    inline uint64_t coalesced_snapshots() const {
+        return coalesced_snapshots_;
+    }
+
+ private:
+    struct TaskState {
+        uint64_t values[REMOTE_TASK_FIELDS];
+        uint32_t cmdline_id;
+        uint32_t user_id;
+        uint64_t seq;
+    };
+
+    enum ConnectState : uint8_t {
+        CONNECT_NONE = 0,
+        CONNECT_IN_PROGRESS,
+        CONNECT_DONE,
+    };
+
+    /**
+     * @brief 推进连接状态：按退避时间发起连接，或检查进行中的连接是否完成
+     *
+     * @return int 小于 0 表示还没有可用的连接
+     */
+    int update_connection(uint64_t now_ms);
+    int start_connect(uint64_t now_ms);
+    void on_connected(uint64_t now_ms);
+    /**
+     * @brief 断开连接并安排下一次重连
+     *
+     */
+    void disconnect(uint64_t now_ms);
+    void encode_snapshot(const SysMonitorInfo& monitor_info);
+    /**
+     * @brief 把 encoder_ 中的帧追加到发送缓冲区，帧头的位置在编码前预留
+     *
+     */
+    void queue_frame(RemoteFrameType type);
+    /**
+     * @brief 非阻塞地发送缓冲区中的数据
+     *
+     * @return int 小于 0 表示连接出错
+     */
+    int flush(uint64_t now_ms);
+
+ private:
+    RemoteAddress address_;
+    char host_name_[REMOTE_HOST_NAME_LENGTH+1] = {0};
+    int fd_ = -1;
+    ConnectState connect_state_ = CONNECT_NONE;
+    uint64_t connect_start_ms_ = 0;
+    // 下一次允许发起连接的时间与当前的退避时间
+    uint64_t next_connect_ms_ = 0;
+    uint64_t backoff_ms_ = REMOTE_RECONNECT_MIN_MS;
+    // 连接失败只输出一次日志，连接成功后重置
+    bool connect_warned_ = false;
+    // 待发送的数据，out_pos_ 之前的部分已经发送
+    std::vector<char> out_;
+    size_t out_pos_ = 0;
+    // 最后一次发送有进展（或者开始等待）的时间
+    uint64_t last_progress_ms_ = 0;
+    uint64_t coalesced_snapshots_ = 0;
+    // 与上一次发送的快照比较，断开后清空
+    std::unordered_map<pid_t, TaskState> tasks_;
+    uint64_t sys_values_[REMOTE_SYS_FIELDS] = {0};
+    uint64_t seq_ = 0;
+    // 连接后的第一帧为全量快照
+    bool send_full_ = true;
+    std::vector<pid_t> removed_;
+    RemoteEncoder encoder_;
+    uint64_t bytes_sent_ = 0;
+};
+
+/**
+ * @brief collector 中一个任务的数据
+ * @note 命令行与用户名保存在 RemoteCollector 的字符串池中，所有主机共享
+ */
+struct RemoteTaskView {
+    uint64_t values[REMOTE_TASK_FIELDS];
+    uint32_t cmdline_id;
+    uint32_t user_id;
+};
+
+/**
+ * @brief collector 中一个主机的合并视图
+ *
+ */
+struct RemoteHostView {
+    std::string host_name;
+    // 当前连接的 fd，-1 表示已断开
+    int connection_fd = -1;
+    // 最后一次收到快照时本地的单调时钟，单位为 ms
+    uint64_t last_update_ms = 0;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t sys_values[REMOTE_SYS_FIELDS] = {0};
+    std::unordered_map<pid_t, RemoteTaskView> tasks;
+};
+
+/**
+ * @brief 跨主机排序时的一个任务
+ *
+ */
+struct RemoteTaskRef {
+    const RemoteHostView* host;
+    pid_t pid;
+    const RemoteTaskView* task;
+};
+
+/**
+ * @brief 汇聚端，使用 epoll 同时接收多个 agent 的数据流，维护每个主机的合并视图
+ * @note 单线程，查询接口与 poll 在同一个线程中调用
+ */
+class RemoteCollector {
+ public:
+    RemoteCollector() = default;
+    ~RemoteCollector();
+    RemoteCollector(const RemoteCollector&) = delete;
+    RemoteCollector& operator=(const RemoteCollector&) = delete;
+
+    /**
+     * @brief 在地址上监听
+     *
+     * @return int 小于 0 表示失败
+     */
+    int listen(const char* address);
+
+    /**
+     * @brief 处理一次网络事件
+     *
+     * @param timeout_ms 没有事件时的最长等待时间
+     * @return int 处理的事件个数，小于 0 表示失败
+     */
+    int poll(int timeout_ms);
+
+    /**
+     * @brief 所有主机（包括已断开的），以主机名为 key
+     *
+     */
+    inline const std::unordered_map<std::string, RemoteHostView>& hosts() const {
+        return hosts_;
+    }
+
+    inline const StringArena& string_arena() const {
+        return string_arena_;
+    }
+
+    /**
+     * @brief 所有主机中 cpu 使用率最高的 n 个任务
+     *
+     */
+    void get_top_tasks_by_cpu(size_t n, std::vector<RemoteTaskRef>* result) const;
+
+    /**
+     * @brief 删除断开超过 expire_ms 的主机
+     *
+     */
+    void expire_hosts(uint64_t expire_ms);
+
+    /**
+     * @brief 当前的连接个数
+     *
+     */
+    inline size_t connection_count() const {
+        return connections_.size();
+    }
+
+ private:
+    struct Connection {
+        int fd;
+        // 收到 HELLO 之前为空
+        RemoteHostView* host;
+        // 未处理的数据为 buffer[begin, end)
+        std::vector<char> buffer;
+        size_t begin;
+        size_t end;
+    };
+
+    int accept_connections();
+    /**
+     * @brief 读取数据并处理完整的帧
+     *
+     * @return int 小于 0 表示需要关闭连接
+     */
+    int read_connection(Connection* conn);
+    int handle_frame(Connection* conn, const RemoteFrameHeader& header, const char* payload);
+    int apply_snapshot(RemoteHostView* host, bool full, const char* payload, size_t length);
+    void close_connection(int fd);
+    void clear_host_tasks(RemoteHostView* host);
+
+ private:
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    char unix_path_[108] = {0};
+    std::unordered_map<int, Connection> connections_;
+    std::unordered_map<std::string, RemoteHostView> hosts_;
+    StringArena string_arena_;
+};
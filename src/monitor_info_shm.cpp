@@ -0,0 +1,286 @@
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <new>
+#include "common.h"
+#include "monitor_info_shm.h"
+
+// 槽位内各个数组按 cache line 对齐
+#define SHM_ALIGN(x) (((x) + 63) & ~static_cast<uint64_t>(63))
+
+ShmSnapshotPublisher::~ShmSnapshotPublisher() {
+    destroy();
+}
+
+/**
+ * @brief 判断已存在的同名区域是否还有存活的写者
+ *
+ */
+static bool shm_writer_alive(const char* name) {
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) return false;
+    struct stat st;
+    bool alive = false;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(ShmSnapshotHeader)) {
+        void* region = mmap(nullptr, sizeof(ShmSnapshotHeader), PROT_READ, MAP_SHARED, fd, 0);
+        if (region != MAP_FAILED) {
+            const ShmSnapshotHeader* header = reinterpret_cast<const ShmSnapshotHeader*>(region);
+            pid_t pid = header->writer_pid;
+            // 没有权限发信号（EPERM）同样说明进程存在
+            alive = pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+            munmap(region, sizeof(ShmSnapshotHeader));
+        }
+    }
+    ::close(fd);
+    return alive;
+}
+
+int ShmSnapshotPublisher::create(const char* name, uint32_t max_cpus, uint32_t max_tasks) {
+    if (region_) return 0;
+    if (!name || name[0] != '/' || strlen(name) >= sizeof(name_)) {
+        ERROR_LOG("invalid shm name: %s", name ? name : "null");
+        return -1;
+    }
+    uint64_t cpu_offset = SHM_ALIGN(sizeof(ShmSnapshotSlot));
+    uint64_t task_offset = SHM_ALIGN(cpu_offset + sizeof(ShmCpuInfo) * max_cpus);
+    uint64_t slot_size = SHM_ALIGN(task_offset + sizeof(ShmTaskInfo) * max_tasks);
+    uint64_t header_size = SHM_ALIGN(sizeof(ShmSnapshotHeader));
+    uint64_t region_size = header_size + slot_size * 2;
+
+    // 必须新建区域：对已被读者映射的区域 ftruncate 会使读者访问时收到 SIGBUS
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        if (shm_writer_alive(name)) {
+            ERROR_LOG("shm: %s is owned by another running writer", name);
+            return -2;
+        }
+        WARN_LOG("remove stale shm: %s left by an exited writer", name);
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    }
+    if (fd < 0) {
+        ERROR_LOG("shm_open: %s failed, err: %s", name, strerror(errno));
+        return -2;
+    }
+    if (ftruncate(fd, region_size) < 0) {
+        ERROR_LOG("ftruncate shm: %s failed, err: %s", name, strerror(errno));
+        ::close(fd);
+        return -3;
+    }
+    void* region = mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (region == MAP_FAILED) {
+        ERROR_LOG("mmap shm: %s failed, err: %s", name, strerror(errno));
+        return -4;
+    }
+    // 先把魔数清零，读者在初始化完成之前不会接受这块区域
+    ShmSnapshotHeader* header = new (region) ShmSnapshotHeader;
+    header->magic = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->version = SHM_SNAPSHOT_VERSION;
+    header->max_cpus = max_cpus;
+    header->max_tasks = max_tasks;
+    header->region_size = region_size;
+    header->slot_offset[0] = header_size;
+    header->slot_offset[1] = header_size + slot_size;
+    header->cpu_offset = cpu_offset;
+    header->task_offset = task_offset;
+    header->writer_pid = getpid();
+    header->active_slot.store(0, std::memory_order_relaxed);
+    header->publish_count.store(0, std::memory_order_relaxed);
+    for (int i = 0; i < 2; i++) {
+        char* slot_addr = reinterpret_cast<char*>(region) + header->slot_offset[i];
+        ShmSnapshotSlot* slot = new (slot_addr) ShmSnapshotSlot;
+        slot->seq.store(0, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SHM_SNAPSHOT_MAGIC;
+
+    snprintf(name_, sizeof(name_), "%s", name);
+    region_ = region;
+    region_size_ = region_size;
+    return 0;
+}
+
+int ShmSnapshotPublisher::publish(const SysMonitorInfo& monitor_info) {
+    if (!region_) return -1;
+    ShmSnapshotHeader* header = reinterpret_cast<ShmSnapshotHeader*>(region_);
+    // 写入当前没有被读者使用的槽位
+    uint32_t slot_index = header->active_slot.load(std::memory_order_relaxed) ^ 1;
+    char* slot_addr = reinterpret_cast<char*>(region_) + header->slot_offset[slot_index];
+    ShmSnapshotSlot* slot = reinterpret_cast<ShmSnapshotSlot*>(slot_addr);
+    ShmCpuInfo* cpus = reinterpret_cast<ShmCpuInfo*>(slot_addr + header->cpu_offset);
+    ShmTaskInfo* tasks = reinterpret_cast<ShmTaskInfo*>(slot_addr + header->task_offset);
+
+    uint64_t seq = slot->seq.load(std::memory_order_relaxed);
+    slot->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->curr_time_ms = monitor_info.curr_time_ms;
+    slot->total_mem = monitor_info.total_mem;
+    slot->used_mem = monitor_info.used_mem;
+    slot->buffers_mem = monitor_info.buffers_mem;
+    slot->cached_mem = monitor_info.cached_mem;
+    slot->shared_mem = monitor_info.shared_mem;
+    slot->avilable_mem = monitor_info.avilable_mem;
+    slot->total_swap = monitor_info.total_swap;
+    slot->used_swap = monitor_info.used_swap;
+    slot->cached_swap = monitor_info.cached_swap;
+    slot->active_cpus = monitor_info.active_cpus;
+    slot->existing_cpus = monitor_info.existing_cpus;
+
+    uint32_t cpu_count = MINIMUM(monitor_info.sys_cpu_data.size(), header->max_cpus);
+    const CpuDataArray& cpu_data = monitor_info.sys_cpu_data;
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        ShmCpuInfo& dst = cpus[i];
+        dst.total_period = cpu_data.period(CPU_TIME_TOTAL, i);
+        dst.user_period = cpu_data.period(CPU_TIME_USER, i);
+        dst.system_period = cpu_data.period(CPU_TIME_SYSTEM, i);
+        dst.system_all_period = cpu_data.period(CPU_TIME_SYSTEM_ALL, i);
+        dst.idle_all_period = cpu_data.period(CPU_TIME_IDLE_ALL, i);
+        dst.idle_period = cpu_data.period(CPU_TIME_IDLE, i);
+        dst.nice_period = cpu_data.period(CPU_TIME_NICE, i);
+        dst.io_wait_period = cpu_data.period(CPU_TIME_IO_WAIT, i);
+        dst.irq_period = cpu_data.period(CPU_TIME_IRQ, i);
+        dst.soft_irq_period = cpu_data.period(CPU_TIME_SOFT_IRQ, i);
+        dst.steal_period = cpu_data.period(CPU_TIME_STEAL, i);
+        dst.guest_period = cpu_data.period(CPU_TIME_GUEST, i);
+        dst.on_line = cpu_data.on_line(i);
+    }
+    slot->cpu_count = cpu_count;
+
+    uint32_t task_count = MINIMUM(monitor_info.all_process_info.size(), header->max_tasks);
+    const StringArena& strings = *monitor_info.string_arena;
+    for (uint32_t i = 0; i < task_count; i++) {
+        const ProcessInfo& src = *monitor_info.all_process_info[i];
+        ShmTaskInfo& dst = tasks[i];
+        dst.pid = src.pid;
+        dst.ppid = src.ppid;
+        dst.tgid = src.tgid;
+        dst.uid = src.uid;
+        snprintf(dst.cmdline, sizeof(dst.cmdline), "%s", strings.get(src.cmdline_id));
+        snprintf(dst.user, sizeof(dst.user), "%s", strings.get(src.user_id));
+        dst.utime = src.utime;
+        dst.stime = src.stime;
+        dst.cutime = src.cutime;
+        dst.cstime = src.cstime;
+        dst.percent_cpu = src.percent_cpu;
+        dst.percent_mem = src.percent_mem;
+        dst.virtual_mem = src.virtual_mem;
+        dst.resident_mem = src.resident_mem;
+        dst.shared_mem = src.shared_mem;
+        dst.text_mem = src.text_mem;
+        dst.data_mem = src.data_mem;
+        dst.io_read_bytes = src.io_read_bytes;
+        dst.io_write_bytes = src.io_write_bytes;
+        dst.io_rate_read_bps = src.io_rate_read_bps;
+        dst.io_rate_write_bps = src.io_rate_write_bps;
+    }
+    slot->task_count = task_count;
+    slot->dropped_tasks = monitor_info.all_process_info.size() - task_count;
+
+    slot->seq.store(seq + 2, std::memory_order_release);
+    header->active_slot.store(slot_index, std::memory_order_release);
+    header->publish_count.fetch_add(1, std::memory_order_release);
+    return 0;
+}
+
+void ShmSnapshotPublisher::destroy() {
+    if (!region_) return;
+    munmap(region_, region_size_);
+    shm_unlink(name_);
+    region_ = nullptr;
+    region_size_ = 0;
+}
+
+ShmSnapshotReader::~ShmSnapshotReader() {
+    close();
+}
+
+int ShmSnapshotReader::open(const char* name) {
+    if (region_) return 0;
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(ShmSnapshotHeader)) {
+        ::close(fd);
+        return -2;
+    }
+    void* region = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (region == MAP_FAILED) {
+        ERROR_LOG("mmap shm: %s failed, err: %s", name, strerror(errno));
+        return -3;
+    }
+    const ShmSnapshotHeader* header = reinterpret_cast<const ShmSnapshotHeader*>(region);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->magic != SHM_SNAPSHOT_MAGIC || header->version != SHM_SNAPSHOT_VERSION
+        || header->region_size > static_cast<uint64_t>(st.st_size)) {
+        munmap(region, st.st_size);
+        return -4;
+    }
+    // 头部来自其他进程，所有偏移与容量都要落在区域之内才可以解引用
+    uint64_t cpu_end = header->cpu_offset + sizeof(ShmCpuInfo) * static_cast<uint64_t>(header->max_cpus);
+    uint64_t task_end = header->task_offset + sizeof(ShmTaskInfo) * static_cast<uint64_t>(header->max_tasks);
+    bool valid = header->cpu_offset >= sizeof(ShmSnapshotSlot) && header->task_offset >= cpu_end;
+    for (int i = 0; i < 2 && valid; i++) {
+        valid = header->slot_offset[i] >= sizeof(ShmSnapshotHeader) && header->slot_offset[i] % 8 == 0
+            && header->slot_offset[i] + task_end <= header->region_size;
+    }
+    if (!valid) {
+        ERROR_LOG("invalid layout of shm: %s", name);
+        munmap(region, st.st_size);
+        return -5;
+    }
+    region_ = region;
+    region_size_ = st.st_size;
+    return 0;
+}
+
+void ShmSnapshotReader::close() {
+    if (!region_) return;
+    munmap(const_cast<void*>(region_), region_size_);
+    region_ = nullptr;
+    region_size_ = 0;
+}
+
+bool ShmSnapshotReader::acquire(ShmSnapshotView* view) const {
+    if (!region_) return false;
+    const ShmSnapshotHeader* header = reinterpret_cast<const ShmSnapshotHeader*>(region_);
+    if (header->publish_count.load(std::memory_order_acquire) == 0) return false;
+    for (;;) {
+        uint32_t slot_index = header->active_slot.load(std::memory_order_acquire);
+        const char* slot_addr = reinterpret_cast<const char*>(region_) + header->slot_offset[slot_index & 1];
+        const ShmSnapshotSlot* slot = reinterpret_cast<const ShmSnapshotSlot*>(slot_addr);
+        uint64_t seq = slot->seq.load(std::memory_order_acquire);
+        // 写者已经开始覆盖这个槽位，重新读取 active_slot
+        if (seq & 1) continue;
+        view->slot = slot;
+        view->cpus = reinterpret_cast<const ShmCpuInfo*>(slot_addr + header->cpu_offset);
+        view->tasks = reinterpret_cast<const ShmTaskInfo*>(slot_addr + header->task_offset);
+        // 个数可能在读取之后被写者覆盖，截断到容量，保证遍历不越界；数据是否一致由 validate 判断
+        view->cpu_count = MINIMUM(slot->cpu_count, header->max_cpus);
+        view->task_count = MINIMUM(slot->task_count, header->max_tasks);
+        view->seq = seq;
+        return true;
+    }
+}
+
+bool ShmSnapshotReader::validate(const ShmSnapshotView& view) const {
+    if (!view.slot) return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return view.slot->seq.load(std::memory_order_relaxed) == view.seq;
+}
+
+uint64_t ShmSnapshotReader::publish_count() const {
+    if (!region_) return 0;
+    const ShmSnapshotHeader* header = reinterpret_cast<const ShmSnapshotHeader*>(region_);
+    return header->publish_count.load(std::memory_order_acquire);
+}
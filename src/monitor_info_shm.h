@@ -0,0 +1,232 @@
+/**
+ * @file monitor_info_shm.h
+ * @author zhangyi
+ * @brief 通过 POSIX 共享内存发布监控快照，供进程外的多个读者使用
+ * @version 0.1
+ * @date 2022-12-08
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <atomic>
+#include "monitor_info.h"
+
+// 共享内存区域的魔数与版本，布局变化时需要升级版本号
+#define SHM_SNAPSHOT_MAGIC 0x43504f54U  // "TOPC"
+#define SHM_SNAPSHOT_VERSION 2
+// 默认的共享内存名字
+#define SHM_SNAPSHOT_DEFAULT_NAME "/top_cpp_snapshot"
+// 默认的容量
+#define SHM_SNAPSHOT_DEFAULT_MAX_CPUS 1024
+#define SHM_SNAPSHOT_DEFAULT_MAX_TASKS 65536
+// 用户名的最大长度，超出的部分被截断
+#define SHM_USER_NAME_LENGTH 31
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shm seqlock requires lock-free 64-bit atomics");
+
+/**
+ * @brief 共享内存中一个 cpu 的周期数据
+ *
+ */
+struct ShmCpuInfo {
+    uint64_t total_period;
+    uint64_t user_period;
+    uint64_t system_period;
+    uint64_t system_all_period;
+    uint64_t idle_all_period;
+    uint64_t idle_period;
+    uint64_t nice_period;
+    uint64_t io_wait_period;
+    uint64_t irq_period;
+    uint64_t soft_irq_period;
+    uint64_t steal_period;
+    uint64_t guest_period;
+    uint8_t on_line;
+    uint8_t reserved[7];
+};
+
+/**
+ * @brief 共享内存中一个任务的监控数据
+ * @note 字段含义与 ProcessInfo 一致，字符串直接展开，超长的命令行被截断
+ */
+struct ShmTaskInfo {
+    int32_t pid;
+    int32_t ppid;
+    int32_t tgid;
+    uint32_t uid;
+    char cmdline[MAX_COMMAND_LENGTH+1];
+    char user[SHM_USER_NAME_LENGTH+1];
+    uint64_t utime;
+    uint64_t stime;
+    uint64_t cutime;
+    uint64_t cstime;
+    float percent_cpu;
+    float percent_mem;
+    uint64_t virtual_mem;
+    uint64_t resident_mem;
+    uint64_t shared_mem;
+    uint64_t text_mem;
+    uint64_t data_mem;
+    uint64_t io_read_bytes;
+    uint64_t io_write_bytes;
+    double io_rate_read_bps;
+    double io_rate_write_bps;
+};
+
+/**
+ * @brief 一个快照槽位
+ * @note 槽位之后紧跟 cpu_count 个 ShmCpuInfo 和 task_count 个 ShmTaskInfo，
+ *       偏移由 ShmSnapshotHeader 中的 cpu_offset、task_offset 给出。
+ *       seq 为奇数表示写者正在写入该槽位
+ */
+struct ShmSnapshotSlot {
+    std::atomic<uint64_t> seq;
+    uint64_t curr_time_ms;
+    uint64_t total_mem;
+    uint64_t used_mem;
+    uint64_t buffers_mem;
+    uint64_t cached_mem;
+    uint64_t shared_mem;
+    uint64_t avilable_mem;
+    uint64_t total_swap;
+    uint64_t used_swap;
+    uint64_t cached_swap;
+    uint32_t active_cpus;
+    uint32_t existing_cpus;
+    uint32_t cpu_count;
+    uint32_t task_count;
+    // 因容量不足而没有写入的任务个数
+    uint32_t dropped_tasks;
+    uint32_t reserved;
+};
+
+/**
+ * @brief 共享内存区域的头部
+ * @note 写者交替写两个槽位，写完后切换 active_slot，读者只读 active_slot 指向的槽位，
+ *       正常情况下读者与写者不会访问同一个槽位
+ */
+struct ShmSnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t max_cpus;
+    uint32_t max_tasks;
+    uint64_t region_size;
+    uint64_t slot_offset[2];
+    uint64_t cpu_offset;  // 相对于槽位起始位置
+    uint64_t task_offset;  // 相对于槽位起始位置
+    int32_t writer_pid;
+    std::atomic<uint32_t> active_slot;
+    // 已发布的快照个数，为 0 表示还没有可读的快照
+    std::atomic<uint64_t> publish_count;
+};
+
+/**
+ * @brief 读者看到的一份快照，直接指向共享内存，不做拷贝
+ * @note 使用完之后需要调用 ShmSnapshotReader::validate 判断期间是否被写者覆盖
+ */
+struct ShmSnapshotView {
+    const ShmSnapshotSlot* slot = nullptr;
+    const ShmCpuInfo* cpus = nullptr;
+    const ShmTaskInfo* tasks = nullptr;
+    // 已按区域的容量截断的个数，读取数组时使用这两个值，而不是槽位中可能被覆盖的值
+    uint32_t cpu_count = 0;
+    uint32_t task_count = 0;
+    uint64_t seq = 0;
+};
+
+/**
+ * @brief 快照的发布者（写者），同一个名字只能有一个写者
+ * @note 以 O_EXCL 创建共享内存，不会改变正在被读者映射的区域的大小。
+ *       同名区域的写者仍然存活时拒绝启动，写者已经退出（残留的区域）时删除后重新创建
+ */
+class ShmSnapshotPublisher {
+ public:
+    ShmSnapshotPublisher() = default;
+    ~ShmSnapshotPublisher();
+    ShmSnapshotPublisher(const ShmSnapshotPublisher&) = delete;
+    ShmSnapshotPublisher& operator=(const ShmSnapshotPublisher&) = delete;
+
+    /**
+     * @brief 创建共享内存区域
+     *
+     * @param name 共享内存的名字，以 '/' 开头
+     * @param max_cpus 最多保存的 cpu 个数（包括汇总的 cpu）
+     * @param max_tasks 最多保存的任务个数
+     * @return int 小于 0 表示失败
+     */
+    int create(const char* name, uint32_t max_cpus, uint32_t max_tasks);
+
+    /**
+     * @brief 发布一份快照
+     *
+     */
+    int publish(const SysMonitorInfo& monitor_info);
+
+    /**
+     * @brief 解除映射并删除共享内存
+     *
+     */
+    void destroy();
+
+ private:
+    char name_[256] = {0};
+    void* region_ = nullptr;
+    size_t region_size_ = 0;
+};
+
+/**
+ * @brief 快照的读者，可以有任意多个
+ * @note 读取过程不需要系统调用，也不需要拷贝
+ */
+class ShmSnapshotReader {
+ public:
+    ShmSnapshotReader() = default;
+    ~ShmSnapshotReader();
+    ShmSnapshotReader(const ShmSnapshotReader&) = delete;
+    ShmSnapshotReader& operator=(const ShmSnapshotReader&) = delete;
+
+    /**
+     * @brief 以只读方式映射共享内存区域
+     *
+     * @return int 小于 0 表示失败，例如写者还没有启动、版本不匹配或者头部的偏移超出区域
+     */
+    int open(const char* name);
+
+    /**
+     * @brief 解除映射
+     *
+     */
+    void close();
+
+    /**
+     * @brief 获取最新的一份快照
+     *
+     * @return true 获取成功
+     * @return false 还没有快照发布
+     */
+    bool acquire(ShmSnapshotView* view) const;
+
+    /**
+     * @brief 判断快照在读取期间是否被写者覆盖
+     *
+     * @return true 读到的数据是一致的
+     * @return false 需要重新 acquire 并读取
+     */
+    bool validate(const ShmSnapshotView& view) const;
+
+    /**
+     * @brief 已发布的快照个数，可用于判断是否有新快照
+     *
+     */
+    uint64_t publish_count() const;
+
+ private:
+    const void* region_ = nullptr;
+    size_t region_size_ = 0;
+};
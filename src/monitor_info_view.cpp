@@ -0,0 +1,31 @@
+#include "common.h"
+#include "monitor_info_collect.h"
+#include "monitor_info_view.h"
+
+SnapshotCollector::SnapshotCollector() : collection_(new MonitorInfoCollection()) {}
+
+SnapshotCollector::~SnapshotCollector() = default;
+
+void SnapshotCollector::set_task_net_enabled(bool enabled) {
+    collection_->set_task_net_enabled(enabled);
+}
+
+void SnapshotCollector::set_max_detailed_tasks(size_t max_tasks) {
+    collection_->set_max_detailed_tasks(max_tasks);
+}
+
+int SnapshotCollector::initialize() {
+    return collection_->initialize();
+}
+
+SnapshotView SnapshotCollector::collect() {
+    return SnapshotView(collection_->finish_once_monitor());
+}
+
+void SnapshotCollector::set_log_level(LOG_LEVEL level) {
+    Util::set_log_level(level);
+}
+
+void SnapshotCollector::set_log_sink(LogSink sink, void* arg) {
+    Util::set_log_sink(sink, arg);
+}
@@ -0,0 +1,253 @@
+/**
+ * @file monitor_info_view.h
+ * @author zhangyi
+ * @brief 嵌入使用时访问快照的只读视图
+ * @version 0.1
+ * @date 2023-01-08
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <iterator>
+#include <memory>
+#include <vector>
+#include "monitor_info.h"
+#include "top_cpp_log.h"
+
+class MonitorInfoCollection;
+
+/**
+ * @brief 一个任务的视图，只保存指针，复制的开销与指针相同
+ * @note 字符串直接指向快照的字符串池，不复制
+ */
+class TaskView {
+ public:
+    TaskView(const ProcessInfo* task, const StringArena* arena) : task_(task), arena_(arena) {}
+
+    inline pid_t pid() const {
+        return task_->pid;
+    }
+
+    inline pid_t tgid() const {
+        return task_->tgid;
+    }
+
+    inline pid_t ppid() const {
+        return task_->ppid;
+    }
+
+    inline bool is_thread() const {
+        return task_->pid != task_->tgid;
+    }
+
+    inline uint32_t uid() const {
+        return task_->uid;
+    }
+
+    inline const char* comm() const {
+        return arena_->get(task_->comm_id);
+    }
+
+    inline const char* cmdline() const {
+        return arena_->get(task_->cmdline_id);
+    }
+
+    inline const char* user() const {
+        return arena_->get(task_->user_id);
+    }
+
+    inline float percent_cpu() const {
+        return task_->percent_cpu;
+    }
+
+    // 分摊到任务的 package 与 dram 功率（瓦），没有 RAPL 时为 0
+    inline float energy_watts() const {
+        return task_->energy_watts;
+    }
+
+    // 最后一次运行所在的 cpu，未知时为 -1
+    inline int32_t processor() const {
+        return task_->processor;
+    }
+
+    inline float percent_mem() const {
+        return task_->percent_mem;
+    }
+
+    // 单位为 KB
+    inline uint64_t resident_mem() const {
+        return task_->resident_mem;
+    }
+
+    inline uint64_t virtual_mem() const {
+        return task_->virtual_mem;
+    }
+
+    // 单位为字节每秒
+    inline double io_read_bps() const {
+        return task_->io_rate_read_bps;
+    }
+
+    inline double io_write_bps() const {
+        return task_->io_rate_write_bps;
+    }
+
+    // 完整的监控数据，用于访问以上没有列出的字段
+    inline const ProcessInfo& info() const {
+        return *task_;
+    }
+
+ private:
+    const ProcessInfo* task_;
+    const StringArena* arena_;
+};
+
+/**
+ * @brief 遍历快照中所有任务的迭代器，解引用得到 TaskView
+ *
+ */
+class TaskIterator {
+ public:
+    typedef std::vector<std::shared_ptr<ProcessInfo>>::const_iterator BaseIterator;
+    typedef std::forward_iterator_tag iterator_category;
+    typedef TaskView value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const TaskView* pointer;
+    typedef TaskView reference;
+
+    TaskIterator(BaseIterator iter, const StringArena* arena) : iter_(iter), arena_(arena) {}
+
+    inline TaskView operator*() const {
+        return TaskView(iter_->get(), arena_);
+    }
+
+    inline TaskIterator& operator++() {
+        ++iter_;
+        return *this;
+    }
+
+    inline TaskIterator operator++(int) {
+        TaskIterator old = *this;
+        ++iter_;
+        return old;
+    }
+
+    inline bool operator==(const TaskIterator& other) const {
+        return iter_ == other.iter_;
+    }
+
+    inline bool operator!=(const TaskIterator& other) const {
+        return iter_ != other.iter_;
+    }
+
+ private:
+    BaseIterator iter_;
+    const StringArena* arena_;
+};
+
+/**
+ * @brief 一次采集结果的只读视图
+ * @note 视图直接引用采集对象内部的快照，不复制任何数据。
+ *       快照会被同一个采集对象的下一次 finish_once_monitor 原地更新，视图只在两次采集之间有效
+ */
+class SnapshotView {
+ public:
+    explicit SnapshotView(std::shared_ptr<SysMonitorInfo> info) : info_(std::move(info)) {}
+
+    inline bool valid() const {
+        return info_ != nullptr;
+    }
+
+    inline TaskIterator begin() const {
+        return TaskIterator(info_->all_process_info.begin(), info_->string_arena.get());
+    }
+
+    inline TaskIterator end() const {
+        return TaskIterator(info_->all_process_info.end(), info_->string_arena.get());
+    }
+
+    // 任务（包括线程）的个数
+    inline size_t size() const {
+        return info_->all_process_info.size();
+    }
+
+    inline TaskView at(size_t index) const {
+        return TaskView(info_->all_process_info[index].get(), info_->string_arena.get());
+    }
+
+    /**
+     * @brief 按 pid 查找任务
+     *
+     * @return bool 任务不存在时返回 false
+     */
+    inline bool find(pid_t pid, TaskView* view) const {
+        auto iter = info_->all_process_info_table.find(pid);
+        if (iter == info_->all_process_info_table.end()) return false;
+        *view = TaskView(iter->second.get(), info_->string_arena.get());
+        return true;
+    }
+
+    // 每个 cpu 的数据，下标 0 为所有 cpu 的汇总
+    inline const CpuDataArray& cpu_data() const {
+        return info_->sys_cpu_data;
+    }
+
+    // 完整的系统监控数据
+    inline const SysMonitorInfo& info() const {
+        return *info_;
+    }
+
+ private:
+    std::shared_ptr<SysMonitorInfo> info_;
+};
+
+/**
+ * @brief 嵌入使用的采集对象，只需要安装的头文件即可使用
+ * @note 内部持有一个独立的 MonitorInfoCollection，每个对象有独立的配置与状态，
+ *       同一个对象不能在多个线程中同时使用。库不会退出进程，失败都通过返回值报告
+ */
+class SnapshotCollector {
+ public:
+    SnapshotCollector();
+    ~SnapshotCollector();
+    SnapshotCollector(const SnapshotCollector&) = delete;
+    SnapshotCollector& operator=(const SnapshotCollector&) = delete;
+
+    // 以下配置需要在 initialize 之前调用
+    void set_task_net_enabled(bool enabled);
+    void set_max_detailed_tasks(size_t max_tasks);
+
+    /**
+     * @brief 初始化采集对象
+     *
+     * @return int 小于 0 表示失败
+     */
+    int initialize();
+
+    /**
+     * @brief 完成一次采集，第一次采集没有上一次的计数，使用率与速率为 0
+     *
+     * @return SnapshotView 失败时 valid() 为 false，视图在下一次 collect 之前有效
+     */
+    SnapshotView collect();
+
+    /**
+     * @brief 设置库的日志级别，高于该级别的日志不输出，默认为 LOG_INFO_LEVEL
+     * @note 进程内全局，对所有采集对象与 C 接口生效
+     */
+    static void set_log_level(LOG_LEVEL level);
+
+    /**
+     * @brief 设置库的日志输出回调，默认输出到 stdout
+     * @note 进程内全局；sink 为 nullptr 时恢复默认
+     */
+    static void set_log_sink(LogSink sink, void* arg);
+
+ private:
+    std::unique_ptr<MonitorInfoCollection> collection_;
+};
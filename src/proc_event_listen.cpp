@@ -0,0 +1,250 @@
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include "common.h"
+#include "proc_event_listen.h"
+#include "task_proc_parse.h"
+
+// 接收缓冲区的大小，fork 风暴时尽量避免溢出
+#define PROC_EVENT_RCVBUF_SIZE (4 * 1024 * 1024)
+// 监听线程检查退出标志的间隔
+#define PROC_EVENT_RECV_TIMEOUT_MS 200
+
+ProcEventListener::~ProcEventListener() {
+    stop();
+}
+
+int ProcEventListener::start() {
+    if (is_running()) return 0;
+    long clk_tck = sysconf(_SC_CLK_TCK);
+    if (clk_tck > 0) jiffy_ = clk_tck;
+    sock_fd_ = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (sock_fd_ < 0) {
+        WARN_LOG("create netlink connector socket failed, err: %s", strerror(errno));
+        return -1;
+    }
+    int rcvbuf = PROC_EVENT_RCVBUF_SIZE;
+    setsockopt(sock_fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = PROC_EVENT_RECV_TIMEOUT_MS * 1000;
+    setsockopt(sock_fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    addr.nl_pid = 0;
+    if (bind(sock_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        WARN_LOG("bind netlink connector socket failed, err: %s", strerror(errno));
+        close(sock_fd_);
+        sock_fd_ = -1;
+        return -2;
+    }
+
+    // 向内核订阅 proc 事件
+    char buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))];
+    memset(buf, 0, sizeof(buf));
+    struct nlmsghdr* nl_hdr = reinterpret_cast<struct nlmsghdr*>(buf);
+    struct cn_msg* cn_hdr = reinterpret_cast<struct cn_msg*>(NLMSG_DATA(nl_hdr));
+    nl_hdr->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op));
+    nl_hdr->nlmsg_type = NLMSG_DONE;
+    nl_hdr->nlmsg_pid = getpid();
+    cn_hdr->id.idx = CN_IDX_PROC;
+    cn_hdr->id.val = CN_VAL_PROC;
+    cn_hdr->len = sizeof(enum proc_cn_mcast_op);
+    enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+    memcpy(cn_hdr->data, &op, sizeof(op));
+    if (send(sock_fd_, nl_hdr, nl_hdr->nlmsg_len, 0) < 0) {
+        WARN_LOG("subscribe proc connector failed, err: %s", strerror(errno));
+        close(sock_fd_);
+        sock_fd_ = -1;
+        return -3;
+    }
+
+    running_.store(true);
+    listen_thread_ = std::thread(&ProcEventListener::listen_loop, this);
+    return 0;
+}
+
+void ProcEventListener::stop() {
+    if (!running_.exchange(false)) return;
+    if (listen_thread_.joinable()) {
+        listen_thread_.join();
+    }
+    if (sock_fd_ >= 0) {
+        close(sock_fd_);
+        sock_fd_ = -1;
+    }
+}
+
+void ProcEventListener::reset_live_tasks() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    live_tasks_.clear();
+    lost_events_ = false;
+}
+
+void ProcEventListener::add_live_tasks(const std::unordered_map<pid_t, pid_t>& tasks) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& item : tasks) {
+        live_tasks_.emplace(item.first, item.second);
+    }
+}
+
+size_t ProcEventListener::memory_bytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return Util::hash_map_bytes(live_tasks_) + exited_tasks_.capacity() * sizeof(ExitedTaskInfo)
+        + exec_tasks_.capacity() * sizeof(pid_t);
+}
+
+bool ProcEventListener::get_live_tasks(std::vector<std::pair<pid_t, pid_t>>* tasks) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (lost_events_) return false;
+    tasks->clear();
+    tasks->reserve(live_tasks_.size());
+    for (const auto& item : live_tasks_) {
+        tasks->emplace_back(item.first, item.second);
+    }
+    return true;
+}
+
+void ProcEventListener::remove_live_task(pid_t pid) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    live_tasks_.erase(pid);
+}
+
+void ProcEventListener::drain_exited_tasks(std::vector<ExitedTaskInfo>* exited) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exited->swap(exited_tasks_);
+    exited_tasks_.clear();
+}
+
+void ProcEventListener::drain_exec_tasks(std::vector<pid_t>* tasks) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks->swap(exec_tasks_);
+    exec_tasks_.clear();
+}
+
+ProcEventStats ProcEventListener::get_event_stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return event_stats_;
+}
+
+void ProcEventListener::listen_loop() {
+    // 按 nlmsghdr 对齐的接收缓冲区，一次可以收到多条消息
+    alignas(struct nlmsghdr) char buf[8192];
+    while (running_.load(std::memory_order_relaxed)) {
+        ssize_t len = recv(sock_fd_, buf, sizeof(buf), 0);
+        if (len < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+                continue;
+            }
+            if (errno == ENOBUFS) {
+                // 事件有丢失，存活集合不再可信，需要采集线程重新遍历 /proc
+                std::lock_guard<std::mutex> lock(mutex_);
+                lost_events_ = true;
+                event_stats_.resync_count++;
+                continue;
+            }
+            ERROR_LOG("recv proc connector event failed, err: %s", strerror(errno));
+            break;
+        }
+        if (len == 0) continue;
+
+        struct nlmsghdr* nl_hdr = reinterpret_cast<struct nlmsghdr*>(buf);
+        for (; NLMSG_OK(nl_hdr, static_cast<size_t>(len)); nl_hdr = NLMSG_NEXT(nl_hdr, len)) {
+            if (nl_hdr->nlmsg_type == NLMSG_ERROR || nl_hdr->nlmsg_type == NLMSG_NOOP) {
+                continue;
+            }
+            const struct cn_msg* cn_hdr = reinterpret_cast<const struct cn_msg*>(NLMSG_DATA(nl_hdr));
+            if (cn_hdr->id.idx != CN_IDX_PROC || cn_hdr->id.val != CN_VAL_PROC) {
+                continue;
+            }
+            handle_event(cn_hdr->data, cn_hdr->len);
+        }
+    }
+    running_.store(false);
+}
+
+void ProcEventListener::handle_event(const void* data, size_t len) {
+    if (len < sizeof(struct proc_event)) return;
+    const struct proc_event* ev = reinterpret_cast<const struct proc_event*>(data);
+    switch (ev->what) {
+    case proc_event::PROC_EVENT_FORK:
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            live_tasks_[ev->event_data.fork.child_pid] = ev->event_data.fork.child_tgid;
+            event_stats_.fork_events++;
+        }
+        break;
+    case proc_event::PROC_EVENT_EXEC:
+        {
+            // exec 之后非主线程全部退出，执行 exec 的线程接管 tgid
+            std::lock_guard<std::mutex> lock(mutex_);
+            live_tasks_[ev->event_data.exec.process_pid] = ev->event_data.exec.process_tgid;
+            exec_tasks_.push_back(ev->event_data.exec.process_pid);
+            event_stats_.exec_events++;
+        }
+        break;
+    case proc_event::PROC_EVENT_COMM:
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            event_stats_.comm_events++;
+        }
+        break;
+    case proc_event::PROC_EVENT_EXIT:
+        {
+            ExitedTaskInfo info;
+            memset(&info, 0, sizeof(info));
+            info.pid = ev->event_data.exit.process_pid;
+            info.tgid = ev->event_data.exit.process_tgid;
+            info.ppid = ev->event_data.exit.parent_tgid;
+            info.exit_code = ev->event_data.exit.exit_code;
+            info.exit_signal = ev->event_data.exit.exit_signal;
+            struct timeval tv;
+            Util::get_real_time(&tv, &info.exit_time_ms);
+            // 任务此时可能还是僵尸状态，尽量读取最终的计数
+            read_exiting_task(&info);
+            std::lock_guard<std::mutex> lock(mutex_);
+            live_tasks_.erase(info.pid);
+            exited_tasks_.emplace_back(info);
+            event_stats_.exit_events++;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void ProcEventListener::read_exiting_task(ExitedTaskInfo* info) {
+    char path[64];
+    snprintf(path, sizeof(path), PROC_DIR "/%d/task/%d", info->tgid, info->pid);
+    int task_fd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+    if (task_fd < 0) return;
+    char buf[MAX_BYTES_ONCE_READ+1];
+    ssize_t res = Util::read_file(task_fd, "stat", buf, sizeof(buf));
+    TaskStatFields stat;
+    if (res > 0 && parse_task_stat(buf, &stat) == 0) {
+        size_t length = MINIMUM(stat.comm_length, static_cast<size_t>(MAX_COMMAND_LENGTH));
+        memcpy(info->cmdline, stat.comm, length);
+        info->cmdline[length] = '\0';
+        info->utime = stat.utime * 100 / jiffy_;
+        info->stime = stat.stime * 100 / jiffy_;
+        info->counters_valid = true;
+    }
+    if (Util::read_file(task_fd, "io", buf, sizeof(buf)) > 0) {
+        TaskIoFields io;
+        parse_task_io(buf, &io);
+        info->io_read_bytes = io.read_bytes;
+        info->io_write_bytes = io.write_bytes;
+    }
+    close(task_fd);
+}
@@ -0,0 +1,126 @@
+/**
+ * @file proc_event_listen.h
+ * @author zhangyi
+ * @brief 通过 netlink proc connector 监听任务的生命周期事件
+ * @version 0.1
+ * @date 2022-12-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#pragma once
+
+#include <sys/types.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include "monitor_info.h"
+
+/**
+ * @brief 监听内核 PROC_EVENT_FORK/EXEC/EXIT/COMM 事件
+ * @note 在独立线程中增量维护存活的任务集合，采集时可以跳过对 /proc 目录的遍历；
+ *       同时记录扫描间隔中退出的任务。需要 CAP_NET_ADMIN 权限，不可用时 start 返回失败
+ */
+class ProcEventListener {
+ public:
+    ProcEventListener() = default;
+    ~ProcEventListener();
+    ProcEventListener(const ProcEventListener&) = delete;
+    ProcEventListener& operator=(const ProcEventListener&) = delete;
+
+    /**
+     * @brief 连接 proc connector 并启动监听线程
+     *
+     * @return int 小于 0 表示 connector 不可用
+     */
+    int start();
+
+    /**
+     * @brief 停止监听线程
+     *
+     */
+    void stop();
+
+    inline bool is_running() const {
+        return running_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 清空存活任务集合，准备重新同步
+     * @note 之后需要完整遍历一次 /proc 并调用 add_live_tasks，
+     *       遍历期间到达的事件会保留在集合中
+     */
+    void reset_live_tasks();
+
+    /**
+     * @brief 将一次完整的目录遍历结果合并到存活任务集合中
+     *
+     * @param tasks 任务集合，key 为任务 id，value 为所属进程 id（tgid）
+     */
+    void add_live_tasks(const std::unordered_map<pid_t, pid_t>& tasks);
+
+    /**
+     * @brief 获取存活任务集合的拷贝
+     *
+     * @param tasks 输出参数
+     * @return true 集合可信
+     * @return false 发生过事件丢失，调用方需要重新同步
+     */
+    bool get_live_tasks(std::vector<std::pair<pid_t, pid_t>>* tasks);
+
+    /**
+     * @brief 将任务从存活集合中移除
+     * @note 用于采集时发现任务目录已不存在的情况
+     */
+    void remove_live_task(pid_t pid);
+
+    /**
+     * @brief 存活任务集合与尚未取走的事件占用的内存（字节）
+     *
+     */
+    size_t memory_bytes();
+
+    /**
+     * @brief 取出上次调用之后退出的任务
+     *
+     */
+    void drain_exited_tasks(std::vector<ExitedTaskInfo>* exited);
+
+    /**
+     * @brief 取出上次调用之后执行了 exec 的任务
+     *
+     */
+    void drain_exec_tasks(std::vector<pid_t>* tasks);
+
+    /**
+     * @brief 取出累计的事件计数
+     *
+     */
+    ProcEventStats get_event_stats();
+
+ private:
+    void listen_loop();
+    void handle_event(const void* data, size_t len);
+    void read_exiting_task(ExitedTaskInfo* info);
+
+ private:
+    int sock_fd_ = -1;
+    // 一个时间周期的时长（sysconf(_SC_CLK_TCK)）
+    uint64_t jiffy_ = 100;
+    std::thread listen_thread_;
+    std::atomic<bool> running_{false};
+
+    std::mutex mutex_;
+    // 存活的任务集合，key 为任务 id，value 为 tgid
+    std::unordered_map<pid_t, pid_t> live_tasks_;
+    // 尚未被取走的退出任务
+    std::vector<ExitedTaskInfo> exited_tasks_;
+    // 尚未被取走的执行了 exec 的任务
+    std::vector<pid_t> exec_tasks_;
+    ProcEventStats event_stats_;
+    // 是否发生了事件丢失（接收缓冲区溢出）
+    bool lost_events_ = false;
+};
@@ -0,0 +1,149 @@
+#include "common.h"
+#include "string_arena.h"
+
+// 索引的初始容量，必须是 2 的幂
+#define STRING_ARENA_INIT_INDEX 1024
+// 索引中表示已删除的值
+#define STRING_ARENA_TOMBSTONE UINT32_MAX
+// 废弃空间超过该值并且超过总空间的一半时压缩
+#define STRING_ARENA_COMPACT_BYTES (64 * 1024)
+
+StringArena::StringArena() {
+    // id 0 为空字符串
+    data_.push_back('\0');
+    entries_.push_back(Entry{0, 0, hash_string("", 0), 1});
+    index_.assign(STRING_ARENA_INIT_INDEX, 0);
+    index_[entries_[0].hash & (index_.size() - 1)] = 1;
+    index_used_ = 1;
+}
+
+uint32_t StringArena::hash_string(const char* str, size_t length) {
+    // FNV-1a
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= static_cast<uint8_t>(str[i]);
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+uint32_t StringArena::intern(const char* str, size_t length) {
+    if (length == 0) return STRING_ID_EMPTY;
+    uint32_t hash = hash_string(str, length);
+    size_t mask = index_.size() - 1;
+    size_t insert_pos = SIZE_MAX;
+    size_t pos = hash & mask;
+    for (;; pos = (pos + 1) & mask) {
+        uint32_t value = index_[pos];
+        if (value == 0) break;
+        if (value == STRING_ARENA_TOMBSTONE) {
+            if (insert_pos == SIZE_MAX) insert_pos = pos;
+            continue;
+        }
+        Entry& entry = entries_[value - 1];
+        if (entry.hash == hash && entry.length == length
+            && memcmp(&data_[entry.offset], str, length) == 0) {
+            entry.refs++;
+            return value - 1;
+        }
+    }
+    if (insert_pos == SIZE_MAX) {
+        insert_pos = pos;
+        index_used_++;
+    }
+
+    // str 可能指向 data_ 内部，扩容前先记录偏移
+    size_t self_offset = SIZE_MAX;
+    if (str >= data_.data() && str < data_.data() + data_.size()) {
+        self_offset = str - data_.data();
+    }
+    // resize 按倍数扩容，不能用 reserve(size + length)，那样每次都会重新分配
+    size_t offset = data_.size();
+    data_.resize(offset + length + 1);
+    if (self_offset != SIZE_MAX) {
+        str = data_.data() + self_offset;
+    }
+    memcpy(&data_[offset], str, length);
+    data_[offset + length] = '\0';
+    Entry entry{static_cast<uint32_t>(offset), static_cast<uint32_t>(length), hash, 1};
+
+    uint32_t id;
+    if (!free_ids_.empty()) {
+        id = free_ids_.back();
+        free_ids_.pop_back();
+        entries_[id] = entry;
+    } else {
+        id = entries_.size();
+        entries_.push_back(entry);
+    }
+    index_[insert_pos] = id + 1;
+    // 负载因子不超过 50%
+    if (index_used_ * 2 > index_.size()) {
+        size_t capacity = index_.size();
+        while (live_count() * 4 > capacity) capacity *= 2;
+        rehash(capacity);
+    }
+    return id;
+}
+
+void StringArena::acquire(uint32_t id) {
+    if (id == STRING_ID_EMPTY) return;
+    entries_[id].refs++;
+}
+
+void StringArena::release(uint32_t id) {
+    if (id == STRING_ID_EMPTY || id >= entries_.size()) return;
+    Entry& entry = entries_[id];
+    if (entry.refs == 0) {
+        ERROR_LOG("release string id: %u without reference", id);
+        return;
+    }
+    if (--entry.refs > 0) return;
+    index_[find_index(id)] = STRING_ARENA_TOMBSTONE;
+    dead_bytes_ += entry.length + 1;
+    // 释放之后 get 返回空字符串
+    entry.offset = 0;
+    entry.length = 0;
+    free_ids_.push_back(id);
+    if (dead_bytes_ > STRING_ARENA_COMPACT_BYTES && dead_bytes_ * 2 > data_.size()) {
+        compact();
+    }
+}
+
+size_t StringArena::find_index(uint32_t id) const {
+    size_t mask = index_.size() - 1;
+    for (size_t pos = entries_[id].hash & mask; ; pos = (pos + 1) & mask) {
+        if (index_[pos] == id + 1) return pos;
+    }
+}
+
+void StringArena::rehash(size_t capacity) {
+    index_.assign(capacity, 0);
+    size_t mask = capacity - 1;
+    index_used_ = 0;
+    for (uint32_t id = 0; id < entries_.size(); id++) {
+        if (id != STRING_ID_EMPTY && entries_[id].refs == 0) continue;
+        size_t pos = entries_[id].hash & mask;
+        while (index_[pos] != 0) pos = (pos + 1) & mask;
+        index_[pos] = id + 1;
+        index_used_++;
+    }
+}
+
+void StringArena::compact() {
+    // 复制到新的空间，id 与索引都不变，只更新偏移
+    std::vector<char> data;
+    data.reserve(data_.size() - dead_bytes_);
+    data.push_back('\0');
+    for (Entry& entry : entries_) {
+        if (entry.length == 0) {
+            entry.offset = 0;
+            continue;
+        }
+        uint32_t offset = data.size();
+        data.insert(data.end(), &data_[entry.offset], &data_[entry.offset] + entry.length + 1);
+        entry.offset = offset;
+    }
+    data_.swap(data);
+    dead_bytes_ = 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file string_arena.h
+ * @author zhangyi
+ * @brief 字符串驻留池
+ * @version 0.1
+ * @date 2022-12-26
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+// 空字符串的 id，始终存在
+#define STRING_ID_EMPTY 0
+
+/**
+ * @brief 字符串驻留池
+ * @note 相同内容的字符串只保存一份，使用者只保存 uint32_t 的 id。
+ *       所有字符串连续存放在一块内存中，id 通过引用计数管理，
+ *       引用计数为 0 的 id 会被复用，废弃的空间过多时原地压缩（id 不变）。
+ *       get 返回的指针在下一次 intern 之前有效
+ */
+class StringArena {
+ public:
+    StringArena();
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    /**
+     * @brief 驻留一个字符串，引用计数加一
+     *
+     * @return uint32_t 字符串的 id
+     */
+    uint32_t intern(const char* str, size_t length);
+
+    inline uint32_t intern(const char* str) {
+        return intern(str, strlen(str));
+    }
+
+    /**
+     * @brief 引用计数加一，用于复制 id
+     *
+     */
+    void acquire(uint32_t id);
+
+    /**
+     * @brief 引用计数减一，为 0 时释放
+     *
+     */
+    void release(uint32_t id);
+
+    inline const char* get(uint32_t id) const {
+        return &data_[entries_[id].offset];
+    }
+
+    inline size_t length(uint32_t id) const {
+        return entries_[id].length;
+    }
+
+    /**
+     * @brief 被引用的字符串个数
+     *
+     */
+    inline size_t live_count() const {
+        return entries_.size() - free_ids_.size();
+    }
+
+    /**
+     * @brief 占用的字符串空间（字节）
+     *
+     */
+    inline size_t data_bytes() const {
+        return data_.size();
+    }
+
+    /**
+     * @brief 所有内部结构实际占用的内存（字节）
+     *
+     */
+    inline size_t memory_bytes() const {
+        return data_.capacity() + entries_.capacity() * sizeof(Entry)
+            + free_ids_.capacity() * sizeof(uint32_t) + index_.capacity() * sizeof(uint32_t);
+    }
+
+ private:
+    struct Entry {
+        uint32_t offset;
+        uint32_t length;
+        uint32_t hash;
+        uint32_t refs;
+    };
+
+    static uint32_t hash_string(const char* str, size_t length);
+    /**
+     * @brief 在索引中查找 id 所在的位置
+     *
+     */
+    size_t find_index(uint32_t id) const;
+    void rehash(size_t capacity);
+    void compact();
+
+ private:
+    // 所有字符串，每个以 '\0' 结尾
+    std::vector<char> data_;
+    std::vector<Entry> entries_;
+    std::vector<uint32_t> free_ids_;
+    // 开放寻址的索引，值为 id + 1，0 表示空位
+    std::vector<uint32_t> index_;
+    // 索引中被占用的位置（包括删除标记）
+    size_t index_used_ = 0;
+    // 已释放的字符串占用的空间
+    size_t dead_bytes_ = 0;
+};
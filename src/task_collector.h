@@ -0,0 +1,274 @@
+/**
+ * @file task_collector.h
+ * @author zhangyi
+ * @brief 编译期组合的任务采集器
+ * @version 0.1
+ * @date 2023-01-07
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+#include "common.h"
+#include "monitor_info.h"
+#include "task_proc_parse.h"
+
+/**
+ * @brief 读取一个任务时各采集器共享的上下文
+ *
+ */
+struct TaskCollectContext {
+    int proc_fd;  // "/proc/<pid>" 或 "/proc/<tgid>/task/<pid>" 的 fd
+    pid_t pid;
+    pid_t tgid;
+    uint64_t elapsed_ns;  // 距离上一次读取该任务的时间，第一次读取时为 0
+    uint64_t jiffy;  // 一个时间周期的时长（sysconf(_SC_CLK_TCK)）
+    const TaskStatFields* stat;  // 已经解析的 stat，每个任务都会读取，用于判断 pid 是否被复用
+};
+
+/*
+ * 采集器的约定：
+ *   - Fields：采集器在任务记录中增加的字段，没有字段（空结构体）的采集器不会被调用
+ *   - needs_threads：是否需要读取线程，任意一个采集器需要时遍历 /proc/<pid>/task
+ *   - collect(context, fields, prev)：读取一个任务，prev 为上一次的字段，第一次读取时为 nullptr；
+ *     返回 false 表示任务已经退出
+ */
+
+/**
+ * @brief cpu 时间与使用率，来自已经读取的 stat
+ *
+ */
+struct CpuCollector {
+    struct Fields {
+        uint64_t utime;  // 单位为时钟周期
+        uint64_t stime;
+        float percent_cpu;
+    };
+    static constexpr bool needs_threads = false;
+
+    static inline bool collect(const TaskCollectContext& context, Fields* fields, const Fields* prev) {
+        fields->utime = context.stat->utime;
+        fields->stime = context.stat->stime;
+        fields->percent_cpu = 0.0F;
+        if (prev && context.elapsed_ns) {
+            uint64_t last = prev->utime + prev->stime;
+            uint64_t curr = fields->utime + fields->stime;
+            fields->percent_cpu = curr > last ? (curr - last) * 1E11 / context.jiffy / context.elapsed_ns : 0.0F;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief 常驻内存与虚拟内存，读取 statm
+ *
+ */
+struct RssCollector {
+    struct Fields {
+        uint64_t virtual_mem;  // 单位为 KB
+        uint64_t resident_mem;
+    };
+    static constexpr bool needs_threads = false;
+
+    static inline bool collect(const TaskCollectContext& context, Fields* fields, const Fields*) {
+        static const uint64_t page_size_kb = sysconf(_SC_PAGESIZE) / 1024;
+        char buf[256];
+        if (Util::read_file(context.proc_fd, "statm", buf, sizeof(buf)) <= 0) return false;
+        TaskStatmFields statm;
+        if (parse_task_statm(buf, &statm) < 0) return false;
+        fields->virtual_mem = statm.virtual_mem * page_size_kb;
+        fields->resident_mem = statm.resident_mem * page_size_kb;
+        return true;
+    }
+};
+
+/**
+ * @brief 实际读写磁盘的字节数与速率，读取 io（需要权限，读取失败时保持为 0）
+ *
+ */
+struct IoCollector {
+    struct Fields {
+        uint64_t io_read_bytes;
+        uint64_t io_write_bytes;
+        double io_rate_read_bps;
+        double io_rate_write_bps;
+    };
+    static constexpr bool needs_threads = false;
+
+    static inline bool collect(const TaskCollectContext& context, Fields* fields, const Fields* prev) {
+        char buf[1024];
+        fields->io_read_bytes = 0;
+        fields->io_write_bytes = 0;
+        fields->io_rate_read_bps = 0;
+        fields->io_rate_write_bps = 0;
+        if (Util::read_file(context.proc_fd, "io", buf, sizeof(buf)) <= 0) return true;
+        TaskIoFields io;
+        parse_task_io(buf, &io);
+        fields->io_read_bytes = io.read_bytes;
+        fields->io_write_bytes = io.write_bytes;
+        if (prev && context.elapsed_ns) {
+            fields->io_rate_read_bps = fields->io_read_bytes > prev->io_read_bytes ? (
+                (fields->io_read_bytes - prev->io_read_bytes) * 1E9 / context.elapsed_ns) : 0;
+            fields->io_rate_write_bps = fields->io_write_bytes > prev->io_write_bytes ? (
+                (fields->io_write_bytes - prev->io_write_bytes) * 1E9 / context.elapsed_ns) : 0;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief 同时采集线程，没有字段
+ *
+ */
+struct ThreadCollector {
+    struct Fields {};
+    static constexpr bool needs_threads = true;
+
+    static inline bool collect(const TaskCollectContext&, Fields*, const Fields*) {
+        return true;
+    }
+};
+
+/**
+ * @brief 一个任务的记录，只包含所选采集器的字段
+ *
+ */
+template <typename... Collectors>
+struct TaskRecord : Collectors::Fields... {
+    pid_t pid;
+    pid_t tgid;
+    // 与 pid 一起唯一标识一个任务
+    uint64_t start_time;
+    uint64_t sample_time_ns;
+};
+
+/**
+ * @brief 由若干采集器在编译期组合而成的任务采集
+ * @note 每个任务依次调用所选采集器（折叠表达式展开，没有虚函数调用与运行时分支），
+ *       没有选中的文件不会被读取，任务记录中也没有对应的字段；stat 总是读取，用于判断 pid 是否被复用。
+ *       文件的解析与 MonitorInfoCollection 共用 task_proc_parse.h 中的函数。
+ *       适合只需要少量指标的嵌入场景；事件驱动、目标过滤、告警等功能仍由 MonitorInfoCollection 提供
+ */
+template <typename... Collectors>
+class TaskCollectorSet {
+ public:
+    typedef TaskRecord<Collectors...> Record;
+    static constexpr bool needs_threads = (Collectors::needs_threads || ... || false);
+
+    TaskCollectorSet() = default;
+    ~TaskCollectorSet() {
+        if (proc_dir_fd_ >= 0) close(proc_dir_fd_);
+    }
+    TaskCollectorSet(const TaskCollectorSet&) = delete;
+    TaskCollectorSet& operator=(const TaskCollectorSet&) = delete;
+
+    int initialize(const char* proc_dir = PROC_DIR) {
+        jiffy_ = sysconf(_SC_CLK_TCK);
+        proc_dir_fd_ = open(proc_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (proc_dir_fd_ < 0) {
+            ERROR_LOG("open dir: %s failed, err: %s", proc_dir, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief 完成一次采集，结果按 pid 从小到大排列
+     *
+     */
+    int collect() {
+        next_records_.clear();
+        walk(proc_dir_fd_, 0);
+        // /proc 中的进程基本有序，线程插在所属进程之后，排序的开销很小
+        std::sort(next_records_.begin(), next_records_.end(), [](const Record& a, const Record& b) {
+            return a.pid < b.pid;
+        });
+        records_.swap(next_records_);
+        return 0;
+    }
+
+    inline const std::vector<Record>& tasks() const {
+        return records_;
+    }
+
+ private:
+    void walk(int dir_fd, pid_t tgid) {
+        int fd = openat(dir_fd, tgid ? "task" : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) return;
+        DIR* dir = fdopendir(fd);
+        if (!dir) {
+            close(fd);
+            return;
+        }
+        const struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+            pid_t pid = strtol(entry->d_name, nullptr, 10);
+            // 主线程与进程是同一个任务
+            if (tgid && pid == tgid) continue;
+            int proc_fd = openat(dirfd(dir), entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (proc_fd < 0) continue;
+            if constexpr (needs_threads) {
+                if (!tgid) walk(proc_fd, pid);
+            }
+            visit(proc_fd, pid, tgid ? tgid : pid);
+            close(proc_fd);
+        }
+        closedir(dir);
+    }
+
+    void visit(int proc_fd, pid_t pid, pid_t tgid) {
+        uint64_t now_ns = Util::get_monotonic_ns();
+        char buf[MAX_BYTES_ONCE_READ+1];
+        TaskStatFields stat;
+        // 任务在读取之前退出
+        if (Util::read_file(proc_fd, "stat", buf, sizeof(buf)) <= 0 || parse_task_stat(buf, &stat) < 0) return;
+        // 上一次的记录按 pid 有序，二分查找；启动时间不同说明 pid 被复用，上一次的记录属于另一个任务
+        auto iter = std::lower_bound(records_.begin(), records_.end(), pid, [](const Record& record, pid_t key) {
+            return record.pid < key;
+        });
+        const Record* prev = (iter != records_.end() && iter->pid == pid && iter->start_time == stat.start_time) ? (
+            &*iter) : nullptr;
+        next_records_.emplace_back();
+        Record& record = next_records_.back();
+        record.pid = pid;
+        record.tgid = tgid;
+        record.start_time = stat.start_time;
+        record.sample_time_ns = now_ns;
+        TaskCollectContext context{proc_fd, pid, tgid,
+            prev && now_ns > prev->sample_time_ns ? now_ns - prev->sample_time_ns : 0, jiffy_, &stat};
+        if (!(visit_one<Collectors>(context, &record, prev) && ...)) {
+            // 任务在读取过程中退出
+            next_records_.pop_back();
+        }
+    }
+
+    template <typename Collector>
+    static inline bool visit_one(const TaskCollectContext& context, Record* record, const Record* prev) {
+        typedef typename Collector::Fields Fields;
+        if constexpr (std::is_empty<Fields>::value) {
+            return true;
+        } else {
+            return Collector::collect(context, static_cast<Fields*>(record),
+                prev ? static_cast<const Fields*>(prev) : nullptr);
+        }
+    }
+
+ private:
+    int proc_dir_fd_ = -1;
+    uint64_t jiffy_ = 100;
+    std::vector<Record> records_;
+    std::vector<Record> next_records_;
+};
@@ -0,0 +1,128 @@
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include "common.h"
+#include "task_fd_collect.h"
+
+// getdents64 返回的目录项，glibc 2.30 之前没有封装
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+void TaskFdCollection::initialize(uint32_t tier_ticks, bool type_breakdown) {
+    tier_ticks_ = tier_ticks ? tier_ticks : TASK_FD_DEFAULT_TIER_TICKS;
+    type_breakdown_ = type_breakdown;
+    ticks_ = 0;
+}
+
+int TaskFdCollection::collect(int proc_dir_fd, SysMonitorInfo* monitor_info) {
+    // 第一次采集立即统计，之后每隔 tier_ticks_ 次统计一次
+    if (ticks_++ % tier_ticks_ != 0) return 0;
+    if (dents_buffer_.empty()) dents_buffer_.resize(TASK_FD_DENTS_BUFFER_SIZE);
+    for (const auto& task : monitor_info->all_process_info) {
+        ProcessInfo* process = task.get();
+        if (process->pid != process->tgid) continue;
+        if (count_fds(proc_dir_fd, process) < 0) {
+            process->fd_valid = false;
+            continue;
+        }
+        read_fd_limit(proc_dir_fd, process);
+        process->percent_fd = process->fd_limit ? (
+            process->fd_count * 100.0F / process->fd_limit) : 0.0F;
+        process->fd_valid = true;
+    }
+    return 1;
+}
+
+void TaskFdCollection::get_top_tasks_by_fd_usage(const SysMonitorInfo& monitor_info, size_t n,
+    std::vector<const ProcessInfo*>* result) {
+    result->clear();
+    for (const auto& task : monitor_info.all_process_info) {
+        if (task->fd_valid) result->push_back(task.get());
+    }
+    n = MINIMUM(n, result->size());
+    std::partial_sort(result->begin(), result->begin() + n, result->end(),
+        [](const ProcessInfo* a, const ProcessInfo* b) {
+            if (a->percent_fd != b->percent_fd) return a->percent_fd > b->percent_fd;
+            return a->fd_count > b->fd_count;
+        });
+    result->resize(n);
+}
+
+int TaskFdCollection::count_fds(int proc_dir_fd, ProcessInfo* process) {
+    char path[32];
+    snprintf(path, sizeof(path), "%d/fd", process->pid);
+    // 没有权限（其他用户的进程）或者进程已经退出
+    int fd_dir_fd = openat(proc_dir_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd_dir_fd < 0) return -1;
+    uint32_t count = 0;
+    process->fd_sockets = 0;
+    process->fd_pipes = 0;
+    process->fd_files = 0;
+    process->fd_eventfds = 0;
+    process->fd_anon_inodes = 0;
+    for (;;) {
+        long res = syscall(SYS_getdents64, fd_dir_fd, dents_buffer_.data(), dents_buffer_.size());
+        if (res < 0) {
+            WARN_LOG("getdents64 %s failed, err: %s", path, strerror(errno));
+            close(fd_dir_fd);
+            return -1;
+        }
+        if (res == 0) break;
+        for (long offset = 0; offset < res;) {
+            const LinuxDirent64* entry = reinterpret_cast<const LinuxDirent64*>(&dents_buffer_[offset]);
+            offset += entry->d_reclen;
+            // 跳过 "." 与 ".."
+            if (entry->d_name[0] == '.') continue;
+            count++;
+            if (type_breakdown_) classify_fd(fd_dir_fd, entry->d_name, process);
+        }
+    }
+    close(fd_dir_fd);
+    process->fd_count = count;
+    return 0;
+}
+
+void TaskFdCollection::classify_fd(int fd_dir_fd, const char* name, ProcessInfo* process) {
+    char link[64];
+    ssize_t length = readlinkat(fd_dir_fd, name, link, sizeof(link) - 1);
+    if (length <= 0) return;
+    link[length] = '\0';
+    // 普通文件与设备文件为绝对路径，其他为 "<type>:[inode]" 或 "anon_inode:[name]"
+    if (link[0] == '/') {
+        process->fd_files++;
+    } else if (Util::wrap_strncmp(link, "socket:")) {
+        process->fd_sockets++;
+    } else if (Util::wrap_strncmp(link, "pipe:")) {
+        process->fd_pipes++;
+    } else if (Util::wrap_strncmp(link, "anon_inode:")) {
+        if (strstr(link, "eventfd")) {
+            process->fd_eventfds++;
+        } else {
+            process->fd_anon_inodes++;
+        }
+    }
+}
+
+int TaskFdCollection::read_fd_limit(int proc_dir_fd, ProcessInfo* process) {
+    char path[32];
+    snprintf(path, sizeof(path), "%d/limits", process->pid);
+    ssize_t res = Util::read_file(proc_dir_fd, path, &read_buffer_);
+    if (res <= 0) return -1;
+    // 格式为 "Max open files            1024                 1048576              files"
+    const char* key = "Max open files";
+    char* location = strstr(&read_buffer_[0], key);
+    if (!location) return -1;
+    location += strlen(key);
+    while (*location == ' ') location++;
+    process->fd_limit = Util::wrap_strncmp(location, "unlimited") ? 0 : Util::parse_uint64(&location);
+    return 0;
+}
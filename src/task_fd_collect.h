@@ -0,0 +1,88 @@
+/**
+ * @file task_fd_collect.h
+ * @author zhangyi
+ * @brief 进程级别的文件描述符统计
+ * @version 0.1
+ * @date 2023-01-05
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include "monitor_info.h"
+
+// 默认每隔多少次采集统计一次 fd
+#define TASK_FD_DEFAULT_TIER_TICKS 5
+// getdents64 的缓冲区大小，一次调用可以读出约 2000 个 fd
+#define TASK_FD_DENTS_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief 统计每个进程打开的 fd 个数、类型分布以及 RLIMIT_NOFILE
+ * @note fd 个数通过 getdents64 读取 /proc/pid/fd 得到，只计数不 stat，开销与 fd 个数成正比；
+ *       只有开启类型统计时才对每个 fd 调用 readlink。统计比 cpu 扫描慢，每隔 tier_ticks 次采集做一次，
+ *       中间的采集沿用上一次的结果。线程与进程共享 fd 表，只统计进程
+ */
+class TaskFdCollection {
+ public:
+    TaskFdCollection() = default;
+    TaskFdCollection(const TaskFdCollection&) = delete;
+    TaskFdCollection& operator=(const TaskFdCollection&) = delete;
+
+    /**
+     * @brief 设置采集的频率与是否统计类型
+     *
+     * @param tier_ticks 每隔多少次采集统计一次，为 0 时使用默认值
+     * @param type_breakdown 是否通过 readlink 统计每种类型的 fd 个数
+     */
+    void initialize(uint32_t tier_ticks, bool type_breakdown);
+
+    /**
+     * @brief 完成一次所有进程的 fd 统计
+     * @note 需要在任务扫描完成之后调用，不到统计的周期时直接返回
+     * @param proc_dir_fd "/proc" 目录的 fd
+     * @return int 1 表示本次进行了统计
+     */
+    int collect(int proc_dir_fd, SysMonitorInfo* monitor_info);
+
+    inline bool type_breakdown() const {
+        return type_breakdown_;
+    }
+
+    /**
+     * @brief 按 fd 个数占软限制的比例获取排名靠前的进程
+     * @note 比例相同（例如没有限制）时按 fd 个数排序
+     * @param n 最多返回的个数
+     * @param result 输出参数，从大到小排序
+     */
+    static void get_top_tasks_by_fd_usage(const SysMonitorInfo& monitor_info, size_t n,
+        std::vector<const ProcessInfo*>* result);
+
+ private:
+    /**
+     * @brief 遍历 /proc/pid/fd，统计 fd 个数与类型
+     *
+     */
+    int count_fds(int proc_dir_fd, ProcessInfo* process);
+
+    /**
+     * @brief 从 /proc/pid/limits 读取 "Max open files" 的软限制
+     *
+     */
+    int read_fd_limit(int proc_dir_fd, ProcessInfo* process);
+
+    void classify_fd(int fd_dir_fd, const char* name, ProcessInfo* process);
+
+ private:
+    uint32_t tier_ticks_ = TASK_FD_DEFAULT_TIER_TICKS;
+    uint32_t ticks_ = 0;
+    bool type_breakdown_ = false;
+    // 复用的缓冲区
+    std::vector<char> dents_buffer_;
+    std::string read_buffer_;
+};
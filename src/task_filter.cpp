@@ -0,0 +1,249 @@
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <algorithm>
+#include "common.h"
+#include "monitor_info.h"
+#include "task_filter.h"
+#include "task_proc_parse.h"
+
+TaskFilter::~TaskFilter() {
+    for (int fd : cgroup_fds_) close(fd);
+    for (regex_t& pattern : patterns_) regfree(&pattern);
+}
+
+int TaskFilter::add_pids(const char* pid_list) {
+    const char* p = pid_list;
+    for (;;) {
+        char* end = nullptr;
+        long pid = strtol(p, &end, 10);
+        if (end == p || pid <= 0 || (*end != ',' && *end != '\0')) {
+            ERROR_LOG("invalid pid list: %s", pid_list);
+            return -1;
+        }
+        pids_.push_back(pid);
+        if (*end == '\0') break;
+        p = end + 1;
+    }
+    return 0;
+}
+
+int TaskFilter::add_descendants(pid_t root) {
+    if (root <= 0) {
+        ERROR_LOG("invalid root pid: %d", root);
+        return -1;
+    }
+    if (roots_.empty()) {
+        // 需要 CONFIG_PROC_CHILDREN，以自己的主线程检测
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/task/%d/children", getpid());
+        children_supported_ = access(path, R_OK) == 0;
+        if (!children_supported_) {
+            WARN_LOG("%s is not supported, descendants are discovered by scanning /proc", path);
+        }
+    }
+    roots_.push_back(root);
+    return 0;
+}
+
+int TaskFilter::add_cgroup(const char* path) {
+    if (cgroup_fds_.size() >= TASK_FILTER_MAX_CGROUPS) {
+        ERROR_LOG("too many cgroups, max: %d", TASK_FILTER_MAX_CGROUPS);
+        return -1;
+    }
+    std::string full_path = path[0] == '/' ? path : std::string(CGROUP_ROOT_DIR "/") + path;
+    int fd = open(full_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        ERROR_LOG("open cgroup: %s failed, err: %s", full_path.c_str(), strerror(errno));
+        return -1;
+    }
+    cgroup_fds_.push_back(fd);
+    return 0;
+}
+
+int TaskFilter::add_cmdline_pattern(const char* pattern) {
+    if (patterns_.size() >= TASK_FILTER_MAX_PATTERNS) {
+        ERROR_LOG("too many cmdline patterns, max: %d", TASK_FILTER_MAX_PATTERNS);
+        return -1;
+    }
+    regex_t regex;
+    int res = regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB);
+    if (res != 0) {
+        char message[128];
+        regerror(res, &regex, message, sizeof(message));
+        ERROR_LOG("invalid cmdline pattern: %s, err: %s", pattern, message);
+        return -1;
+    }
+    patterns_.push_back(regex);
+    return 0;
+}
+
+void TaskFilter::invalidate(const std::vector<pid_t>& pids) {
+    if (patterns_.empty()) return;
+    pending_pids_.insert(pending_pids_.end(), pids.begin(), pids.end());
+}
+
+bool TaskFilter::contains(pid_t tgid) const {
+    return std::binary_search(targets_.begin(), targets_.end(), tgid);
+}
+
+const std::vector<pid_t>& TaskFilter::refresh(int proc_dir_fd) {
+    bool need_rescan = !patterns_.empty() || (!roots_.empty() && !children_supported_);
+    if (need_rescan && (force_rescan_ || ++ticks_since_rescan_ >= rescan_ticks_)) {
+        rescan(proc_dir_fd);
+        force_rescan_ = false;
+        ticks_since_rescan_ = 0;
+    }
+    // exec 之后的进程（包括 fork 之后 exec 的新进程）立即匹配，不需要等下一次遍历
+    for (pid_t pid : pending_pids_) {
+        cmdline_matched_[pid] = match_cmdline(proc_dir_fd, pid);
+    }
+    pending_pids_.clear();
+
+    targets_.assign(pids_.begin(), pids_.end());
+    for (int fd : cgroup_fds_) {
+        add_cgroup_tasks(fd);
+    }
+    for (pid_t root : roots_) {
+        add_descendant_tasks(proc_dir_fd, root);
+    }
+    for (const auto& item : cmdline_matched_) {
+        if (item.second) targets_.push_back(item.first);
+    }
+    std::sort(targets_.begin(), targets_.end());
+    targets_.erase(std::unique(targets_.begin(), targets_.end()), targets_.end());
+    return targets_;
+}
+
+void TaskFilter::add_cgroup_tasks(int cgroup_fd) {
+    ssize_t res = Util::read_file(cgroup_fd, "cgroup.procs", &read_buffer_);
+    if (res < 0) {
+        WARN_LOG("read cgroup.procs failed, err: %s", strerror(-res));
+        return;
+    }
+    // 每行一个线程组 id
+    char* location = &read_buffer_[0];
+    char* end = location + res;
+    while (location < end) {
+        uint64_t pid = Util::parse_uint64(&location);
+        if (pid) targets_.push_back(pid);
+        while (location < end && (*location < '0' || *location > '9')) location++;
+    }
+}
+
+void TaskFilter::add_descendant_tasks(int proc_dir_fd, pid_t root) {
+    queue_.clear();
+    queue_.push_back(root);
+    // 广度优先，queue_ 在遍历过程中追加
+    for (size_t i = 0; i < queue_.size(); i++) {
+        pid_t pid = queue_[i];
+        targets_.push_back(pid);
+        if (children_supported_) {
+            get_children(proc_dir_fd, pid, &queue_);
+            continue;
+        }
+        auto iter = children_map_.find(pid);
+        if (iter != children_map_.end()) {
+            queue_.insert(queue_.end(), iter->second.begin(), iter->second.end());
+        }
+    }
+}
+
+int TaskFilter::get_children(int proc_dir_fd, pid_t pid, std::vector<pid_t>* children) {
+    // children 文件是按线程记录的，需要遍历进程的所有线程
+    char path[64];
+    snprintf(path, sizeof(path), "%d/task", pid);
+    int task_fd = openat(proc_dir_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (task_fd < 0) return 0;
+    DIR* dir = fdopendir(task_fd);
+    if (!dir) {
+        close(task_fd);
+        return 0;
+    }
+    const struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+        // 按整数格式化线程号，路径长度有确定的上限
+        pid_t tid = atoi(entry->d_name);
+        snprintf(path, sizeof(path), "%d/children", tid);
+        ssize_t res = Util::read_file(task_fd, path, &read_buffer_);
+        if (res <= 0) continue;
+        char* location = &read_buffer_[0];
+        char* end = location + res;
+        while (location < end) {
+            uint64_t child = Util::parse_uint64(&location);
+            if (child) children->push_back(child);
+            while (location < end && (*location < '0' || *location > '9')) location++;
+        }
+    }
+    closedir(dir);
+    return 0;
+}
+
+void TaskFilter::rescan(int proc_dir_fd) {
+    int dir_fd = openat(proc_dir_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) {
+        ERROR_LOG("open %s failed, err: %s", PROC_DIR, strerror(errno));
+        return;
+    }
+    DIR* dir = fdopendir(dir_fd);
+    if (!dir) {
+        close(dir_fd);
+        return;
+    }
+    bool need_parents = !roots_.empty() && !children_supported_;
+    if (need_parents) children_map_.clear();
+    // 只保留仍然存在的进程，已缓存的匹配结果不重新计算
+    std::unordered_map<pid_t, bool> matched;
+    matched.reserve(cmdline_matched_.size());
+    char buf[MAX_BYTES_ONCE_READ+1];
+    const struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+        pid_t pid = strtol(entry->d_name, nullptr, 10);
+        if (!patterns_.empty()) {
+            auto iter = cmdline_matched_.find(pid);
+            matched.emplace(pid, iter != cmdline_matched_.end() ? iter->second : match_cmdline(proc_dir_fd, pid));
+        }
+        if (need_parents) {
+            char path[32];
+            snprintf(path, sizeof(path), "%d/stat", pid);
+            ssize_t res = Util::read_file(proc_dir_fd, path, buf, sizeof(buf));
+            TaskStatFields stat;
+            if (res <= 0 || parse_task_stat(buf, &stat) < 0) continue;
+            children_map_[stat.ppid].push_back(pid);
+        }
+    }
+    closedir(dir);
+    if (!patterns_.empty()) cmdline_matched_.swap(matched);
+}
+
+bool TaskFilter::match_cmdline(int proc_dir_fd, pid_t pid) {
+    char path[32];
+    snprintf(path, sizeof(path), "%d/cmdline", pid);
+    ssize_t res = Util::read_file(proc_dir_fd, path, &read_buffer_);
+    if (res < 0) return false;
+    size_t length = MINIMUM(static_cast<size_t>(res), MAX_CMDLINE_LENGTH);
+    // 与显示的命令行一致：参数之间以空格分隔，内核线程为 "[comm]"
+    for (size_t i = 0; i < length; i++) {
+        if (read_buffer_[i] == '\0' || read_buffer_[i] == '\n') read_buffer_[i] = ' ';
+    }
+    while (length > 0 && read_buffer_[length - 1] == ' ') length--;
+    read_buffer_[length] = '\0';
+    if (length == 0) {
+        char comm[MAX_COMMAND_LENGTH+1];
+        snprintf(path, sizeof(path), "%d/comm", pid);
+        res = Util::read_file(proc_dir_fd, path, comm, sizeof(comm));
+        if (res <= 0) return false;
+        if (comm[res - 1] == '\n') comm[res - 1] = '\0';
+        read_buffer_ = std::string("[") + comm + "]";
+    }
+    for (const regex_t& pattern : patterns_) {
+        if (regexec(&pattern, read_buffer_.c_str(), 0, nullptr, 0) == 0) return true;
+    }
+    return false;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file task_filter.h
+ * @author zhangyi
+ * @brief 只监控指定的目标进程
+ * @version 0.1
+ * @date 2022-12-30
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <regex.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// 最多的 cgroup、命令行正则个数
+#define TASK_FILTER_MAX_CGROUPS 16
+#define TASK_FILTER_MAX_PATTERNS 16
+// cgroup v2 的挂载点，相对路径的 cgroup 以此为根
+#define CGROUP_ROOT_DIR "/sys/fs/cgroup"
+// 需要遍历 /proc 的发现（命令行匹配、没有 children 文件时的子孙进程）每隔多少次采集做一次
+#define TASK_FILTER_DEFAULT_RESCAN_TICKS 5
+
+/**
+ * @brief 目标进程过滤器
+ * @note 目标为以下条件的并集：指定的 pid、某个进程及其所有子孙进程、cgroup 中的进程、
+ *       命令行匹配正则的进程。每次采集只返回目标进程（线程组 id），采集的开销与目标个数成正比：
+ *       - pid 列表不需要发现，不存在的 pid 在打开 /proc/<pid> 时跳过
+ *       - cgroup 的目录 fd 被缓存，每次只读一次 cgroup.procs
+ *       - 子孙进程通过 /proc/<pid>/task/<tid>/children 从根开始逐层查找，
+ *         内核不支持 children 文件时每隔 rescan_ticks 次遍历一次 /proc 建立父子关系
+ *       - 命令行匹配的结果按 pid 缓存，每隔 rescan_ticks 次遍历一次 /proc 目录，
+ *         只对新出现的进程读取命令行；发生 exec 的进程通过 invalidate 重新匹配
+ */
+class TaskFilter {
+ public:
+    TaskFilter() = default;
+    ~TaskFilter();
+    TaskFilter(const TaskFilter&) = delete;
+    TaskFilter& operator=(const TaskFilter&) = delete;
+
+    /**
+     * @brief 添加以逗号分隔的 pid 列表
+     *
+     * @return int 小于 0 表示格式错误
+     */
+    int add_pids(const char* pid_list);
+
+    /**
+     * @brief 添加一个进程及其所有子孙进程
+     *
+     */
+    int add_descendants(pid_t root);
+
+    /**
+     * @brief 添加一个 cgroup 中的所有进程
+     *
+     * @param path cgroup 目录，相对路径以 CGROUP_ROOT_DIR 为根
+     */
+    int add_cgroup(const char* path);
+
+    /**
+     * @brief 添加一个命令行的正则（POSIX 扩展正则）
+     *
+     */
+    int add_cmdline_pattern(const char* pattern);
+
+    inline void set_rescan_ticks(uint32_t ticks) {
+        rescan_ticks_ = ticks ? ticks : 1;
+    }
+
+    /**
+     * @brief 是否配置了任何条件，没有条件时监控所有任务
+     *
+     */
+    inline bool enabled() const {
+        return !pids_.empty() || !roots_.empty() || !cgroup_fds_.empty() || !patterns_.empty();
+    }
+
+    /**
+     * @brief 任务发生了 exec，下一次 refresh 时重新匹配命令行
+     *
+     */
+    void invalidate(const std::vector<pid_t>& pids);
+
+    /**
+     * @brief 更新并返回本次采集的目标进程
+     *
+     * @param proc_dir_fd "/proc" 目录的 fd
+     * @return 从小到大排列、没有重复的线程组 id
+     */
+    const std::vector<pid_t>& refresh(int proc_dir_fd);
+
+    /**
+     * @brief 线程组是否为上一次 refresh 的目标
+     *
+     */
+    bool contains(pid_t tgid) const;
+
+ private:
+    void add_cgroup_tasks(int cgroup_fd);
+    void add_descendant_tasks(int proc_dir_fd, pid_t root);
+    /**
+     * @brief 通过 children 文件获取一个进程的所有直接子进程
+     *
+     * @return int 小于 0 表示内核不支持 children 文件
+     */
+    int get_children(int proc_dir_fd, pid_t pid, std::vector<pid_t>* children);
+    /**
+     * @brief 遍历 /proc，更新命令行匹配的缓存与父子关系
+     *
+     */
+    void rescan(int proc_dir_fd);
+    bool match_cmdline(int proc_dir_fd, pid_t pid);
+
+ private:
+    std::vector<pid_t> pids_;
+    std::vector<pid_t> roots_;
+    std::vector<int> cgroup_fds_;
+    std::vector<regex_t> patterns_;
+    uint32_t rescan_ticks_ = TASK_FILTER_DEFAULT_RESCAN_TICKS;
+    uint32_t ticks_since_rescan_ = 0;
+    bool force_rescan_ = true;
+    // 内核是否支持 /proc/<pid>/task/<tid>/children
+    bool children_supported_ = true;
+    // pid -> 命令行是否匹配
+    std::unordered_map<pid_t, bool> cmdline_matched_;
+    // 发生了 exec、需要重新匹配命令行的进程
+    std::vector<pid_t> pending_pids_;
+    // 不支持 children 文件时，最近一次遍历得到的 ppid -> 子进程
+    std::unordered_map<pid_t, std::vector<pid_t>> children_map_;
+    // 本次的目标
+    std::vector<pid_t> targets_;
+    // 复用的缓冲区
+    std::string read_buffer_;
+    std::vector<pid_t> queue_;
+};
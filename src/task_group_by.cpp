@@ -0,0 +1,214 @@
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include "common.h"
+#include "task_group_by.h"
+
+// 遍历任务时提前预取的距离
+#define TASK_GROUP_PREFETCH_DISTANCE 8
+
+static const char* task_group_key_names[TASK_GROUP_KEY_COUNT] = {
+    "tgid", "ppid", "pgrp", "session", "uid", "comm",
+};
+
+static const char* task_group_metric_names[TASK_GROUP_METRIC_COUNT] = {
+    "cpu", "mem", "rss", "vsz", "io_read", "io_write", "net_send", "net_recv", "tcp_conns", "udp_conns", "fds",
+};
+
+static inline uint64_t task_key(TaskGroupKey key, const ProcessInfo& task) {
+    switch (key) {
+    case TASK_GROUP_KEY_TGID: return task.tgid;
+    case TASK_GROUP_KEY_PPID: return task.ppid;
+    case TASK_GROUP_KEY_PGRP: return task.pgrp;
+    case TASK_GROUP_KEY_SESSION: return task.session;
+    case TASK_GROUP_KEY_UID: return task.uid;
+    case TASK_GROUP_KEY_COMM: return task.comm_id;
+    default: return 0;
+    }
+}
+
+static inline double task_metric(TaskGroupMetric metric, const ProcessInfo& task) {
+    switch (metric) {
+    case TASK_GROUP_METRIC_CPU: return task.percent_cpu;
+    case TASK_GROUP_METRIC_MEM: return task.percent_mem;
+    case TASK_GROUP_METRIC_RSS: return task.resident_mem * 1024.0;
+    case TASK_GROUP_METRIC_VSZ: return task.virtual_mem * 1024.0;
+    // 任务第一次读取 io 时速率为 NaN，按 0 处理，否则分组的和与排序都会被破坏
+    case TASK_GROUP_METRIC_IO_READ: return std::isnan(task.io_rate_read_bps) ? 0.0 : task.io_rate_read_bps;
+    case TASK_GROUP_METRIC_IO_WRITE: return std::isnan(task.io_rate_write_bps) ? 0.0 : task.io_rate_write_bps;
+    case TASK_GROUP_METRIC_NET_SEND: return task.net_rate_send_bps;
+    case TASK_GROUP_METRIC_NET_RECV: return task.net_rate_recv_bps;
+    case TASK_GROUP_METRIC_TCP_CONNS: return task.net_tcp_conns;
+    case TASK_GROUP_METRIC_UDP_CONNS: return task.net_udp_conns;
+    case TASK_GROUP_METRIC_FDS: return task.fd_count;
+    default: return 0;
+    }
+}
+
+// splitmix64 的最后一步，使相邻的 pid、uid 分散到不同的槽位
+static inline uint64_t mix_hash(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+static inline double aggregate_value(const TaskGroup& group, size_t metric_index, TaskGroupAggregate aggregate) {
+    switch (aggregate) {
+    case TASK_GROUP_AGG_SUM: return group.sums[metric_index];
+    case TASK_GROUP_AGG_MAX: return group.maxima[metric_index];
+    default: return group.count;
+    }
+}
+
+const char* TaskGroupBy::key_name(TaskGroupKey key) {
+    return key < TASK_GROUP_KEY_COUNT ? task_group_key_names[key] : "unknown";
+}
+
+const char* TaskGroupBy::metric_name(TaskGroupMetric metric) {
+    return metric < TASK_GROUP_METRIC_COUNT ? task_group_metric_names[metric] : "unknown";
+}
+
+int TaskGroupBy::add_key(TaskGroupKey key) {
+    if (key >= TASK_GROUP_KEY_COUNT || keys_.size() >= TASK_GROUP_MAX_KEYS) {
+        ERROR_LOG("invalid group key: %d, max keys: %d", key, TASK_GROUP_MAX_KEYS);
+        return -1;
+    }
+    keys_.push_back(key);
+    return 0;
+}
+
+int TaskGroupBy::add_metric(TaskGroupMetric metric) {
+    if (metric >= TASK_GROUP_METRIC_COUNT || metrics_.size() >= TASK_GROUP_MAX_METRICS) {
+        ERROR_LOG("invalid group metric: %d, max metrics: %d", metric, TASK_GROUP_MAX_METRICS);
+        return -1;
+    }
+    metrics_.push_back(metric);
+    return 0;
+}
+
+int TaskGroupBy::parse(const char* spec) {
+    keys_.clear();
+    metrics_.clear();
+    const char* separator = strchr(spec, ':');
+    std::string key_list = separator ? std::string(spec, separator - spec) : std::string(spec);
+    std::string metric_list = separator ? std::string(separator + 1) : std::string("cpu,rss");
+    size_t begin = 0;
+    while (begin <= key_list.size()) {
+        size_t end = key_list.find(',', begin);
+        if (end == std::string::npos) end = key_list.size();
+        std::string name = key_list.substr(begin, end - begin);
+        int key = 0;
+        while (key < TASK_GROUP_KEY_COUNT && name != task_group_key_names[key]) key++;
+        if (key == TASK_GROUP_KEY_COUNT) {
+            ERROR_LOG("unknown group key: %s", name.c_str());
+            return -1;
+        }
+        if (add_key(static_cast<TaskGroupKey>(key)) < 0) return -1;
+        begin = end + 1;
+    }
+    begin = 0;
+    while (begin <= metric_list.size()) {
+        size_t end = metric_list.find(',', begin);
+        if (end == std::string::npos) end = metric_list.size();
+        std::string name = metric_list.substr(begin, end - begin);
+        int metric = 0;
+        while (metric < TASK_GROUP_METRIC_COUNT && name != task_group_metric_names[metric]) metric++;
+        if (metric == TASK_GROUP_METRIC_COUNT) {
+            ERROR_LOG("unknown group metric: %s", name.c_str());
+            return -1;
+        }
+        if (add_metric(static_cast<TaskGroupMetric>(metric)) < 0) return -1;
+        begin = end + 1;
+    }
+    return 0;
+}
+
+void TaskGroupBy::grow() {
+    // 槽位个数翻倍，使用保存的哈希值重新插入，不需要重新计算
+    std::vector<Slot> slots(MAXIMUM(slots_.size() * 2, static_cast<size_t>(TASK_GROUP_INITIAL_SLOTS)), Slot{0, 0});
+    size_t mask = slots.size() - 1;
+    for (const Slot& slot : slots_) {
+        if (slot.group == 0) continue;
+        size_t i = slot.hash & mask;
+        while (slots[i].group != 0) i = (i + 1) & mask;
+        slots[i] = slot;
+    }
+    slots_.swap(slots);
+}
+
+TaskGroup* TaskGroupBy::find_or_insert(const uint64_t* keys, uint32_t hash) {
+    // 负载因子不超过 1/2，线性探测的平均长度很短
+    if ((groups_.size() + 1) * 2 > slots_.size()) grow();
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Slot& slot = slots_[i];
+        if (slot.group == 0) {
+            groups_.emplace_back();
+            TaskGroup& group = groups_.back();
+            memcpy(group.keys, keys, sizeof(group.keys));
+            group.count = 0;
+            // 所有指标都是非负数，最大值从 0 开始
+            memset(group.sums, 0, sizeof(group.sums));
+            memset(group.maxima, 0, sizeof(group.maxima));
+            slot.hash = hash;
+            slot.group = groups_.size();
+            return &group;
+        }
+        if (slot.hash == hash) {
+            TaskGroup& group = groups_[slot.group - 1];
+            if (memcmp(group.keys, keys, sizeof(group.keys)) == 0) return &group;
+        }
+    }
+}
+
+void TaskGroupBy::aggregate(const SysMonitorInfo& monitor_info) {
+    groups_.clear();
+    if (slots_.empty()) {
+        slots_.assign(TASK_GROUP_INITIAL_SLOTS, Slot{0, 0});
+    } else {
+        memset(slots_.data(), 0, sizeof(Slot) * slots_.size());
+    }
+    size_t key_count = keys_.size();
+    size_t metric_count = metrics_.size();
+    uint64_t keys[TASK_GROUP_MAX_KEYS];
+    const auto& tasks = monitor_info.all_process_info;
+    for (size_t index = 0; index < tasks.size(); index++) {
+        // 任务对象分散在堆上，提前预取后面的任务，减少遍历时的 cache miss
+        if (index + TASK_GROUP_PREFETCH_DISTANCE < tasks.size()) {
+            __builtin_prefetch(tasks[index + TASK_GROUP_PREFETCH_DISTANCE].get());
+        }
+        const ProcessInfo& task = *tasks[index];
+        if (!include_threads_ && task.pid != task.tgid) continue;
+        // 未使用的键为 0，比较时可以直接比较整个数组
+        memset(keys, 0, sizeof(keys));
+        uint64_t hash = key_count;
+        for (size_t i = 0; i < key_count; i++) {
+            keys[i] = task_key(keys_[i], task);
+            hash = mix_hash(hash ^ keys[i]);
+        }
+        TaskGroup* group = find_or_insert(keys, static_cast<uint32_t>(hash));
+        group->count++;
+        for (size_t i = 0; i < metric_count; i++) {
+            double value = task_metric(metrics_[i], task);
+            group->sums[i] += value;
+            if (value > group->maxima[i]) group->maxima[i] = value;
+        }
+    }
+}
+
+void TaskGroupBy::get_top_groups(size_t metric_index, TaskGroupAggregate aggregate, size_t n,
+    std::vector<const TaskGroup*>* result) const {
+    result->clear();
+    if (aggregate != TASK_GROUP_AGG_COUNT && metric_index >= metrics_.size()) return;
+    result->reserve(groups_.size());
+    for (const TaskGroup& group : groups_) {
+        result->push_back(&group);
+    }
+    n = MINIMUM(n, result->size());
+    std::partial_sort(result->begin(), result->begin() + n, result->end(),
+        [metric_index, aggregate](const TaskGroup* a, const TaskGroup* b) {
+            return aggregate_value(*a, metric_index, aggregate) > aggregate_value(*b, metric_index, aggregate);
+        });
+    result->resize(n);
+}
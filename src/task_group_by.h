@@ -0,0 +1,154 @@
+/**
+ * @file task_group_by.h
+ * @author zhangyi
+ * @brief 按任务属性分组汇总
+ * @version 0.1
+ * @date 2023-01-06
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+#include "monitor_info.h"
+
+// 最多的分组键、汇总指标个数
+#define TASK_GROUP_MAX_KEYS 4
+#define TASK_GROUP_MAX_METRICS 8
+// 哈希表的初始槽位个数（2 的幂）
+#define TASK_GROUP_INITIAL_SLOTS 256
+
+/**
+ * @brief 分组键
+ *
+ */
+enum TaskGroupKey : uint8_t {
+    TASK_GROUP_KEY_TGID = 0,
+    TASK_GROUP_KEY_PPID,
+    TASK_GROUP_KEY_PGRP,
+    TASK_GROUP_KEY_SESSION,
+    TASK_GROUP_KEY_UID,
+    TASK_GROUP_KEY_COMM,  // 以字符串池中的 id 作为键，相同的任务名 id 相同
+    TASK_GROUP_KEY_COUNT,
+};
+
+/**
+ * @brief 可以汇总的指标，名字与告警规则中的任务指标一致
+ * @note 内存、吞吐的单位为字节、字节每秒
+ */
+enum TaskGroupMetric : uint8_t {
+    TASK_GROUP_METRIC_CPU = 0,
+    TASK_GROUP_METRIC_MEM,
+    TASK_GROUP_METRIC_RSS,
+    TASK_GROUP_METRIC_VSZ,
+    TASK_GROUP_METRIC_IO_READ,
+    TASK_GROUP_METRIC_IO_WRITE,
+    TASK_GROUP_METRIC_NET_SEND,
+    TASK_GROUP_METRIC_NET_RECV,
+    TASK_GROUP_METRIC_TCP_CONNS,
+    TASK_GROUP_METRIC_UDP_CONNS,
+    TASK_GROUP_METRIC_FDS,
+    TASK_GROUP_METRIC_COUNT,
+};
+
+/**
+ * @brief 排序使用的汇总方式
+ *
+ */
+enum TaskGroupAggregate : uint8_t {
+    TASK_GROUP_AGG_SUM = 0,
+    TASK_GROUP_AGG_MAX,
+    TASK_GROUP_AGG_COUNT,  // 组内的任务个数，与指标无关
+};
+
+/**
+ * @brief 一个分组的汇总结果
+ * @note keys、sums、maxima 的下标与 TaskGroupBy 中配置的键、指标的顺序对应
+ */
+struct TaskGroup {
+    uint64_t keys[TASK_GROUP_MAX_KEYS];
+    uint32_t count;
+    double sums[TASK_GROUP_MAX_METRICS];
+    double maxima[TASK_GROUP_MAX_METRICS];
+};
+
+/**
+ * @brief 按一个或多个键对任务分组，一次遍历得到每组的任务个数以及每个指标的和与最大值
+ * @note 分组保存在连续的数组中，通过开放寻址（线性探测）的哈希表查找，哈希表与分组数组在多次采集之间复用，
+ *       稳定状态下不分配内存。默认只汇总进程（pid == tgid），进程的 cpu 时间已经包含所有线程
+ */
+class TaskGroupBy {
+ public:
+    TaskGroupBy() = default;
+
+    /**
+     * @brief 解析以逗号分隔的键与指标，例如 "comm,uid:cpu,rss"，省略指标时为 "cpu,rss"
+     * @note 会清空之前的配置
+     * @return int 小于 0 表示格式错误
+     */
+    int parse(const char* spec);
+
+    int add_key(TaskGroupKey key);
+    int add_metric(TaskGroupMetric metric);
+
+    /**
+     * @brief 是否同时汇总线程，按 tgid 分组时可以得到每个进程的线程数
+     * @note 汇总线程时内存类的指标会被重复计算
+     */
+    inline void set_include_threads(bool include_threads) {
+        include_threads_ = include_threads;
+    }
+
+    inline const std::vector<TaskGroupKey>& keys() const {
+        return keys_;
+    }
+
+    inline const std::vector<TaskGroupMetric>& metrics() const {
+        return metrics_;
+    }
+
+    /**
+     * @brief 对快照中的所有任务分组汇总，结果覆盖上一次的分组
+     *
+     */
+    void aggregate(const SysMonitorInfo& monitor_info);
+
+    // 上一次 aggregate 的所有分组，顺序不确定
+    inline const std::vector<TaskGroup>& groups() const {
+        return groups_;
+    }
+
+    /**
+     * @brief 按某个指标的汇总值获取排名靠前的分组
+     *
+     * @param metric_index 指标在 metrics() 中的下标，TASK_GROUP_AGG_COUNT 时忽略
+     * @param n 最多返回的个数
+     * @param result 输出参数，从大到小排序
+     */
+    void get_top_groups(size_t metric_index, TaskGroupAggregate aggregate, size_t n,
+        std::vector<const TaskGroup*>* result) const;
+
+    static const char* key_name(TaskGroupKey key);
+    static const char* metric_name(TaskGroupMetric metric);
+
+ private:
+    // 哈希表的槽位，group 为分组数组的下标加一，0 表示空
+    struct Slot {
+        uint32_t hash;
+        uint32_t group;
+    };
+
+    TaskGroup* find_or_insert(const uint64_t* keys, uint32_t hash);
+    void grow();
+
+ private:
+    std::vector<TaskGroupKey> keys_;
+    std::vector<TaskGroupMetric> metrics_;
+    bool include_threads_ = false;
+    std::vector<Slot> slots_;
+    std::vector<TaskGroup> groups_;
+};
@@ -0,0 +1,376 @@
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <linux/tcp.h>
+#include "common.h"
+#include "task_net_collect.h"
+
+// 旧内核上 fd 目录的大小恒为 0，此时每隔多少个周期强制重新遍历一次 fd 目录
+#define NET_FD_REFRESH_TICKS 10
+// tcp 的 LISTEN 状态
+#define NET_TCP_LISTEN_STATE 10
+
+TaskNetCollection::~TaskNetCollection() {
+    if (diag_fd_ >= 0) {
+        close(diag_fd_);
+    }
+}
+
+/**
+ * @brief sock_diag 的错误是否说明内核不支持或没有权限，而不是暂时性的错误（EINTR、ENOBUFS 等）
+ *
+ */
+static inline bool diag_error_permanent(int err) {
+    // 没有加载 inet_diag 模块时 NLMSG_ERROR 返回 ENOENT
+    return err == EPROTONOSUPPORT || err == EAFNOSUPPORT || err == EACCES || err == EPERM
+        || err == ENOENT || err == EOPNOTSUPP;
+}
+
+int TaskNetCollection::collect(int proc_dir_fd, SysMonitorInfo* monitor_info) {
+    seq_++;
+    // 获取当前所有的 socket
+    if (diag_unavailable_ || dump_sockets_by_diag(proc_dir_fd) < 0) {
+        if (!diag_unavailable_) {
+            int err = errno;
+            if (diag_error_permanent(err)) {
+                WARN_LOG("sock_diag unavailable, fall back to /proc/net, tcp bytes will not be collected, err: %s",
+                    strerror(err));
+                diag_unavailable_ = true;
+            } else {
+                // 暂时性的错误只影响本周期，socket 中可能残留未读完的应答，下一次重新创建
+                WARN_LOG("sock_diag dump failed, use /proc/net for this interval, err: %s", strerror(err));
+                close(diag_fd_);
+                diag_fd_ = -1;
+            }
+        }
+        dump_sockets_by_proc(proc_dir_fd);
+    }
+    // 速率以两次获取 socket 列表的实际间隔为分母，不受系统时间调整与进程扫描耗时的影响
+    uint64_t dump_time_ns = Util::get_monotonic_ns();
+    uint64_t time_delta_ns = (last_dump_time_ns_ && dump_time_ns > last_dump_time_ns_) ? (
+        dump_time_ns - last_dump_time_ns_) : 0;
+    last_dump_time_ns_ = dump_time_ns;
+    // 清理已经关闭的 socket，并记录找不到所属进程的 socket 出现的时间
+    uint64_t oldest_unresolved_seq = 0;
+    for (auto iter = sockets_.begin(); iter != sockets_.end();) {
+        SocketInfo& sock = iter->second;
+        if (sock.seen_seq != seq_) {
+            inode_owner_.erase(iter->first);
+            iter = sockets_.erase(iter);
+            continue;
+        }
+        if (inode_owner_.find(iter->first) != inode_owner_.end()) {
+            sock.unresolved_seq = 0;
+        } else if (!sock.orphan) {
+            if (sock.unresolved_seq == 0) sock.unresolved_seq = seq_;
+            if (oldest_unresolved_seq == 0 || sock.unresolved_seq < oldest_unresolved_seq) {
+                oldest_unresolved_seq = sock.unresolved_seq;
+            }
+        }
+        ++iter;
+    }
+    // 通常新 socket 所属的进程 fd 个数发生了变化，会在下面被重新遍历；
+    // 只有长时间找不到（例如关闭一个 fd 的同时打开了一个 socket）时才遍历所有进程，并且限制频率
+    bool full_walk = oldest_unresolved_seq && seq_ - oldest_unresolved_seq >= NET_FD_REFRESH_TICKS
+        && seq_ - last_full_walk_seq_ >= NET_FD_REFRESH_TICKS;
+    if (full_walk) last_full_walk_seq_ = seq_;
+
+    for (const auto& proc : monitor_info->all_process_info) {
+        // 线程与进程共享 fd 表，只统计进程
+        if (proc->pid != proc->tgid) continue;
+        auto& cache = process_sockets_[proc->pid];
+        if (cache.last_walk_seq == 0) {
+            cache.fd_dir_size = -1;
+            cache.fd_dir_mtime_ns = -1;
+        }
+        cache.seen_seq = seq_;
+        char path[32];
+        snprintf(path, sizeof(path), "%d/fd", proc->pid);
+        struct stat st;
+        if (fstatat(proc_dir_fd, path, &st, 0) < 0) continue;
+        // 新内核上 fd 目录的大小为打开的 fd 个数，个数与修改时间都不变时认为 fd 没有变化
+        int64_t mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        bool need_walk = cache.last_walk_seq == 0 || full_walk || mtime_ns != cache.fd_dir_mtime_ns;
+        if (st.st_size > 0) {
+            need_walk = need_walk || st.st_size != cache.fd_dir_size;
+        } else {
+            need_walk = need_walk || seq_ - cache.last_walk_seq >= NET_FD_REFRESH_TICKS;
+        }
+        if (need_walk) {
+            cache.fd_dir_size = st.st_size;
+            cache.fd_dir_mtime_ns = mtime_ns;
+            walk_process_fd(proc_dir_fd, proc->pid, &cache);
+        }
+
+        uint32_t tcp_conns = 0, udp_conns = 0;
+        uint64_t bytes_sent = 0, bytes_received = 0, delta_sent = 0, delta_received = 0;
+        for (uint64_t inode : cache.inodes) {
+            auto owner = inode_owner_.find(inode);
+            if (owner == inode_owner_.end() || owner->second != proc->pid) continue;
+            auto iter = sockets_.find(inode);
+            if (iter == sockets_.end()) continue;
+            const SocketInfo& sock = iter->second;
+            if (sock.protocol == IPPROTO_TCP) {
+                if (!sock.listening) tcp_conns++;
+                bytes_sent += sock.bytes_sent;
+                bytes_received += sock.bytes_received;
+                delta_sent += sock.delta_sent;
+                delta_received += sock.delta_received;
+            } else {
+                udp_conns++;
+            }
+        }
+        proc->net_tcp_conns = tcp_conns;
+        proc->net_udp_conns = udp_conns;
+        proc->net_tcp_bytes_sent = bytes_sent;
+        proc->net_tcp_bytes_received = bytes_received;
+        proc->net_rate_send_bps = time_delta_ns ? delta_sent * 1E9 / time_delta_ns : NAN;
+        proc->net_rate_recv_bps = time_delta_ns ? delta_received * 1E9 / time_delta_ns : NAN;
+    }
+    // 所有进程都遍历过之后仍然找不到所属进程的 socket（例如属于其他 net namespace 的进程、
+    // 内核持有的 socket），不再因为它们触发遍历
+    if (full_walk) {
+        for (auto& item : sockets_) {
+            if (inode_owner_.find(item.first) == inode_owner_.end()) {
+                item.second.orphan = true;
+            }
+        }
+    }
+    // 清理已经退出的进程
+    for (auto iter = process_sockets_.begin(); iter != process_sockets_.end();) {
+        if (iter->second.seen_seq != seq_) {
+            for (uint64_t inode : iter->second.inodes) {
+                auto owner = inode_owner_.find(inode);
+                if (owner != inode_owner_.end() && owner->second == iter->first) {
+                    inode_owner_.erase(owner);
+                }
+            }
+            iter = process_sockets_.erase(iter);
+            continue;
+        }
+        ++iter;
+    }
+    return 0;
+}
+
+size_t TaskNetCollection::memory_bytes() const {
+    size_t bytes = Util::hash_map_bytes(sockets_) + Util::hash_map_bytes(process_sockets_)
+        + Util::hash_map_bytes(inode_owner_);
+    for (const auto& item : process_sockets_) {
+        bytes += item.second.inodes.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+void TaskNetCollection::update_socket(uint64_t inode, uint8_t protocol, bool listening, bool has_bytes,
+    uint64_t bytes_sent, uint64_t bytes_received) {
+    // inode 为 0 的 socket 已经没有进程持有，例如 TIME_WAIT
+    if (inode == 0) return;
+    auto iter = sockets_.find(inode);
+    if (iter == sockets_.end()) {
+        SocketInfo sock;
+        sock.protocol = protocol;
+        sock.listening = listening;
+        sock.bytes_sent = bytes_sent;
+        sock.bytes_received = bytes_received;
+        // 第一次采集时无法区分字节是否产生于本周期，不计入增量
+        sock.delta_sent = last_dump_time_ns_ ? bytes_sent : 0;
+        sock.delta_received = last_dump_time_ns_ ? bytes_received : 0;
+        sock.orphan = false;
+        sock.unresolved_seq = 0;
+        sock.seen_seq = seq_;
+        sockets_.emplace(inode, sock);
+        return;
+    }
+    SocketInfo& sock = iter->second;
+    sock.listening = listening;
+    sock.seen_seq = seq_;
+    if (!has_bytes) {
+        // sock_diag 暂时失败的周期没有字节计数，保留累计值，下一次恢复后计算增量
+        sock.delta_sent = 0;
+        sock.delta_received = 0;
+        return;
+    }
+    sock.delta_sent = bytes_sent > sock.bytes_sent ? bytes_sent - sock.bytes_sent : 0;
+    sock.delta_received = bytes_received > sock.bytes_received ? bytes_received - sock.bytes_received : 0;
+    sock.bytes_sent = bytes_sent;
+    sock.bytes_received = bytes_received;
+}
+
+int TaskNetCollection::dump_sockets_by_diag(int proc_dir_fd) {
+    if (diag_fd_ < 0) {
+        diag_fd_ = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+        if (diag_fd_ < 0) {
+            return -1;
+        }
+    }
+    // 失败时 errno 保存了原因，由调用者区分暂时性的错误
+    if (dump_sockets_by_diag(AF_INET, IPPROTO_TCP) < 0) return -2;
+    if (dump_sockets_by_diag(AF_INET6, IPPROTO_TCP) < 0) return -3;
+    // udp_diag 是独立的内核模块，可能没有加载，此时 udp 单独回退到 /proc/net
+    if (dump_sockets_by_diag(AF_INET, IPPROTO_UDP) < 0) {
+        dump_sockets_by_proc(proc_dir_fd, "net/udp", IPPROTO_UDP);
+    }
+    if (dump_sockets_by_diag(AF_INET6, IPPROTO_UDP) < 0) {
+        dump_sockets_by_proc(proc_dir_fd, "net/udp6", IPPROTO_UDP);
+    }
+    return 0;
+}
+
+int TaskNetCollection::dump_sockets_by_diag(uint8_t family, uint8_t protocol) {
+    struct {
+        struct nlmsghdr nlh;
+        struct inet_diag_req_v2 req;
+    } request;
+    memset(&request, 0, sizeof(request));
+    request.nlh.nlmsg_len = sizeof(request);
+    request.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    request.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.nlh.nlmsg_seq = seq_;
+    request.req.sdiag_family = family;
+    request.req.sdiag_protocol = protocol;
+    request.req.idiag_states = ~0U;
+    // 只有 tcp 需要 tcp_info 中的字节计数
+    if (protocol == IPPROTO_TCP) {
+        request.req.idiag_ext = 1 << (INET_DIAG_INFO - 1);
+    }
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (sendto(diag_fd_, &request, sizeof(request), 0,
+        reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        return -1;
+    }
+
+    alignas(struct nlmsghdr) char buf[32768];
+    for (;;) {
+        ssize_t len = recv(diag_fd_, buf, sizeof(buf), 0);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            return -2;
+        }
+        if (len == 0) {
+            errno = EPROTO;
+            return -3;
+        }
+        struct nlmsghdr* nlh = reinterpret_cast<struct nlmsghdr*>(buf);
+        for (; NLMSG_OK(nlh, static_cast<size_t>(len)); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type == NLMSG_DONE) return 0;
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                const struct nlmsgerr* err = reinterpret_cast<const struct nlmsgerr*>(NLMSG_DATA(nlh));
+                errno = err->error < 0 ? -err->error : EPROTO;
+                return -4;
+            }
+            const struct inet_diag_msg* msg = reinterpret_cast<const struct inet_diag_msg*>(NLMSG_DATA(nlh));
+            uint64_t bytes_sent = 0, bytes_received = 0;
+            int attr_len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*msg));
+            const struct rtattr* attr = reinterpret_cast<const struct rtattr*>(msg + 1);
+            for (; RTA_OK(attr, attr_len); attr = RTA_NEXT(attr, attr_len)) {
+                if (attr->rta_type != INET_DIAG_INFO) continue;
+                // 旧内核的 tcp_info 可能没有字节计数字段
+                const struct tcp_info* info = reinterpret_cast<const struct tcp_info*>(RTA_DATA(attr));
+                if (RTA_PAYLOAD(attr) >= offsetof(struct tcp_info, tcpi_bytes_received) + sizeof(uint64_t)) {
+                    bytes_sent = info->tcpi_bytes_acked;
+                    bytes_received = info->tcpi_bytes_received;
+                }
+            }
+            bool listening = protocol == IPPROTO_TCP && msg->idiag_state == NET_TCP_LISTEN_STATE;
+            update_socket(msg->idiag_inode, protocol, listening, true, bytes_sent, bytes_received);
+        }
+    }
+}
+
+int TaskNetCollection::dump_sockets_by_proc(int proc_dir_fd) {
+    dump_sockets_by_proc(proc_dir_fd, "net/tcp", IPPROTO_TCP);
+    dump_sockets_by_proc(proc_dir_fd, "net/tcp6", IPPROTO_TCP);
+    dump_sockets_by_proc(proc_dir_fd, "net/udp", IPPROTO_UDP);
+    dump_sockets_by_proc(proc_dir_fd, "net/udp6", IPPROTO_UDP);
+    return 0;
+}
+
+int TaskNetCollection::dump_sockets_by_proc(int proc_dir_fd, const char* path_name, uint8_t protocol) {
+    FILE* file = Util::fopenat(proc_dir_fd, path_name, "r");
+    if (!file) {
+        return -1;
+    }
+    char buf[PROC_LINE_MAX_LENGTH + 1];
+    // 跳过表头
+    if (!fgets(buf, sizeof(buf), file)) {
+        fclose(file);
+        return -2;
+    }
+    // 每行的格式为：sl local_address rem_address st tx_queue:rx_queue tr:tm->when retrnsmt uid timeout inode
+    while (fgets(buf, sizeof(buf), file)) {
+        char* location = buf;
+        int index = 0;
+        uint64_t state = 0;
+        uint64_t inode = 0;
+        while (*location && index <= 9) {
+            while (*location == ' ') location++;
+            if (index == 3) {
+                state = strtoull(location, &location, 16);
+            } else if (index == 9) {
+                inode = strtoull(location, &location, 10);
+            } else {
+                while (*location && *location != ' ') location++;
+            }
+            index++;
+        }
+        if (index <= 9) continue;
+        update_socket(inode, protocol, protocol == IPPROTO_TCP && state == NET_TCP_LISTEN_STATE, false, 0, 0);
+    }
+    fclose(file);
+    return 0;
+}
+
+int TaskNetCollection::walk_process_fd(int proc_dir_fd, pid_t pid, ProcessSockets* sockets) {
+    char path[32];
+    snprintf(path, sizeof(path), "%d/fd", pid);
+    int dir_fd = openat(proc_dir_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) {
+        return -1;
+    }
+    DIR* dir = fdopendir(dir_fd);
+    if (!dir) {
+        close(dir_fd);
+        return -2;
+    }
+    // 先释放旧的 inode 归属
+    for (uint64_t inode : sockets->inodes) {
+        auto owner = inode_owner_.find(inode);
+        if (owner != inode_owner_.end() && owner->second == pid) {
+            inode_owner_.erase(owner);
+        }
+    }
+    sockets->inodes.clear();
+    const struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+        char link[64];
+        ssize_t len = readlinkat(dir_fd, entry->d_name, link, sizeof(link) - 1);
+        if (len <= 0) continue;
+        link[len] = '\0';
+        // socket 的链接格式为 "socket:[inode]"
+        if (!Util::wrap_strncmp(link, "socket:[")) continue;
+        uint64_t inode = strtoull(link + strlen("socket:["), nullptr, 10);
+        sockets->inodes.emplace_back(inode);
+        // 已经归属其他进程的 socket（例如 fork 之后父子进程共享）不再重复归属
+        inode_owner_.emplace(inode, pid);
+    }
+    closedir(dir);
+    sockets->last_walk_seq = seq_;
+    return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file task_net_collect.h
+ * @author zhangyi
+ * @brief 进程级别的网络监控信息收集
+ * @version 0.1
+ * @date 2022-12-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#pragma once
+
+#include <sys/types.h>
+#include <vector>
+#include <unordered_map>
+#include "monitor_info.h"
+
+/**
+ * @brief 通过 socket inode 将连接归属到进程
+ * @note 连接信息优先通过 NETLINK_SOCK_DIAG 获取（带 tcp_info 字节计数），
+ *       不可用时回退到解析 /proc/net/{tcp,tcp6,udp,udp6}（只有连接数）。
+ *       进程持有的 socket inode 会被缓存，只有新进程以及 fd 目录的大小或修改时间变化的进程才重新遍历。
+ *       找不到所属进程的 socket 不会触发所有进程的遍历：持续 NET_FD_REFRESH_TICKS 个周期仍找不到时，
+ *       才遍历一次所有进程（同样限制频率），之后仍然找不到的 socket 不再参与判断。
+ *       fork 之后多个进程可能持有同一个 socket，每个 inode 只计入第一个遍历到它的进程，
+ *       该进程退出或关闭 socket 后由其他持有者在下一次遍历时接管，所有进程的连接数与字节数之和不会重复
+ */
+class TaskNetCollection {
+ public:
+    TaskNetCollection() = default;
+    ~TaskNetCollection();
+    TaskNetCollection(const TaskNetCollection&) = delete;
+    TaskNetCollection& operator=(const TaskNetCollection&) = delete;
+
+    /**
+     * @brief 完成一次所有进程的网络监控
+     *
+     * @param proc_dir_fd "/proc" 目录的 fd
+     * @param monitor_info 已完成进程扫描的监控信息
+     */
+    int collect(int proc_dir_fd, SysMonitorInfo* monitor_info);
+
+    /**
+     * @brief socket 与每个进程的缓存占用的内存（字节）
+     * @note 进程的缓存只保存快照中有完整信息的进程，随完整信息的任务个数增减
+     */
+    size_t memory_bytes() const;
+
+ private:
+    // 一个 socket 的信息
+    struct SocketInfo {
+        uint8_t protocol;  // IPPROTO_TCP 或 IPPROTO_UDP
+        bool listening;
+        uint64_t bytes_sent;
+        uint64_t bytes_received;
+        // 本周期相对上一周期的字节增量
+        uint64_t delta_sent;
+        uint64_t delta_received;
+        // 遍历所有进程之后仍然找不到所属的进程
+        bool orphan;
+        // 第一次发现找不到所属进程时的序号，0 表示已经找到
+        uint64_t unresolved_seq;
+        uint64_t seen_seq;
+    };
+
+    // 一个进程持有的 socket 的缓存
+    struct ProcessSockets {
+        std::vector<uint64_t> inodes;
+        // fd 目录的大小（新内核上为打开的 fd 个数，旧内核上为 0）与修改时间
+        int64_t fd_dir_size;
+        int64_t fd_dir_mtime_ns;
+        uint64_t last_walk_seq;
+        uint64_t seen_seq;
+    };
+
+    /**
+     * @brief 通过 sock_diag 获取所有 tcp、udp socket
+     *
+     */
+    int dump_sockets_by_diag(int proc_dir_fd);
+    int dump_sockets_by_diag(uint8_t family, uint8_t protocol);
+
+    /**
+     * @brief 通过 /proc/net 获取所有 tcp、udp socket
+     *
+     */
+    int dump_sockets_by_proc(int proc_dir_fd);
+    int dump_sockets_by_proc(int proc_dir_fd, const char* path_name, uint8_t protocol);
+
+    /**
+     * @brief 更新一个 socket
+     *
+     * @param has_bytes 字节计数是否有效，来自 /proc/net 时无效，保留上一次 sock_diag 的计数
+     */
+    void update_socket(uint64_t inode, uint8_t protocol, bool listening, bool has_bytes,
+        uint64_t bytes_sent, uint64_t bytes_received);
+
+    /**
+     * @brief 遍历 /proc/pid/fd，获取进程持有的所有 socket inode
+     *
+     */
+    int walk_process_fd(int proc_dir_fd, pid_t pid, ProcessSockets* sockets);
+
+ private:
+    int diag_fd_ = -1;
+    bool diag_unavailable_ = false;
+    uint64_t seq_ = 0;
+    // 上一次获取 socket 列表时的单调时钟，单位为 ns
+    uint64_t last_dump_time_ns_ = 0;
+    // inode -> socket 信息
+    std::unordered_map<uint64_t, SocketInfo> sockets_;
+    // pid -> 进程持有的 socket
+    std::unordered_map<pid_t, ProcessSockets> process_sockets_;
+    // inode -> socket 归属的进程（多个进程持有时为第一个），用于去重以及发现无主的新 socket
+    std::unordered_map<uint64_t, pid_t> inode_owner_;
+    // 上一次因无主的 socket 而遍历所有进程的序号
+    uint64_t last_full_walk_seq_ = 0;
+};
@@ -0,0 +1,303 @@
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <algorithm>
+#include "common.h"
+#include "task_perf_collect.h"
+
+// 一个事件
+struct PerfEventConfig {
+    uint32_t type;
+    uint64_t config;
+};
+
+// 硬件模式的事件，顺序与 ProcessInfo 中的字段对应，第一个为组长
+static const PerfEventConfig hardware_events[] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+// 软件模式的事件
+static const PerfEventConfig software_events[] = {
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static_assert(ARRAY_SIZE(hardware_events) <= PERF_MAX_GROUP_EVENTS, "too many hardware events");
+static_assert(ARRAY_SIZE(software_events) <= PERF_MAX_GROUP_EVENTS, "too many software events");
+
+static inline const PerfEventConfig* mode_events(PerfMode mode, size_t* count) {
+    if (mode == PERF_MODE_HARDWARE) {
+        *count = ARRAY_SIZE(hardware_events);
+        return hardware_events;
+    }
+    *count = ARRAY_SIZE(software_events);
+    return software_events;
+}
+
+static inline int perf_event_open(struct perf_event_attr* attr, pid_t pid, int cpu, int group_fd) {
+    return syscall(SYS_perf_event_open, attr, pid, cpu, group_fd, PERF_FLAG_FD_CLOEXEC);
+}
+
+TaskPerfCollection::~TaskPerfCollection() {
+    for (auto& item : groups_) {
+        close_task(&item.second);
+    }
+}
+
+int TaskPerfCollection::initialize(size_t max_tasks) {
+    max_tasks_ = max_tasks ? max_tasks : PERF_DEFAULT_MAX_TASKS;
+    struct rlimit limit;
+    size_t fd_limit = PERF_FD_LIMIT_UNLIMITED;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        fd_limit = limit.rlim_cur;
+    }
+    fd_budget_ = fd_limit > PERF_FD_RESERVE ? fd_limit - PERF_FD_RESERVE : 0;
+    // 优先使用硬件事件，权限不足（perf_event_paranoid）时只统计用户态
+    for (PerfMode mode : {PERF_MODE_HARDWARE, PERF_MODE_SOFTWARE}) {
+        mode_ = mode;
+        exclude_kernel_ = false;
+        int err = probe();
+        if (err == EACCES || err == EPERM) {
+            exclude_kernel_ = true;
+            err = probe();
+        }
+        if (err == 0) {
+            mode_events(mode_, &group_fds_);
+            size_t max_groups = fd_budget_ / group_fds_;
+            if (max_groups == 0) {
+                WARN_LOG("no fd left for perf events, RLIMIT_NOFILE: %zu, reserved: %d", fd_limit, PERF_FD_RESERVE);
+                break;
+            }
+            // 保留的 max_tasks * PERF_KEEP_FACTOR 个任务平分预算，每个任务至少能跟踪主线程
+            max_tasks_ = MINIMUM(max_tasks_, max_groups);
+            max_task_threads_ = max_groups / (max_tasks_ * PERF_KEEP_FACTOR);
+            max_task_threads_ = MAXIMUM(MINIMUM(max_task_threads_, static_cast<size_t>(PERF_MAX_TASK_THREADS)),
+                static_cast<size_t>(1));
+            INFO_LOG("perf events enabled, mode: %s%s, max tasks: %zu, max threads per task: %zu, fd budget: %zu",
+                mode == PERF_MODE_HARDWARE ? "hardware" : "software",
+                exclude_kernel_ ? " (user space only)" : "", max_tasks_, max_task_threads_, fd_budget_);
+            return 0;
+        }
+        WARN_LOG("%s perf events unavailable, err: %s", mode == PERF_MODE_HARDWARE ? "hardware" : "software",
+            strerror(err));
+    }
+    mode_ = PERF_MODE_NONE;
+    return -1;
+}
+
+int TaskPerfCollection::probe() {
+    PerfGroup group;
+    if (open_group(0, &group) < 0) return errno;
+    close_group(&group);
+    return 0;
+}
+
+int TaskPerfCollection::open_group(pid_t tid, PerfGroup* group) {
+    size_t count = 0;
+    const PerfEventConfig* events = mode_events(mode_, &count);
+    for (int& fd : group->fds) fd = -1;
+    struct perf_event_attr attr;
+    for (size_t i = 0; i < count; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.exclude_kernel = exclude_kernel_;
+        attr.exclude_hv = 1;
+        group->fds[i] = perf_event_open(&attr, tid, -1, i == 0 ? -1 : group->fds[0]);
+        if (group->fds[i] < 0) {
+            int err = errno;
+            close_group(group);
+            errno = err;
+            return -1;
+        }
+        open_fds_++;
+    }
+    // 计数从 0 开始，新线程打开之后的计数都属于本周期
+    memset(group->last_values, 0, sizeof(group->last_values));
+    group->last_enabled = 0;
+    group->last_running = 0;
+    return 0;
+}
+
+void TaskPerfCollection::close_group(PerfGroup* group) {
+    // 先关闭成员再关闭组长
+    for (int i = PERF_MAX_GROUP_EVENTS - 1; i >= 0; i--) {
+        if (group->fds[i] >= 0) {
+            close(group->fds[i]);
+            group->fds[i] = -1;
+            open_fds_--;
+        }
+    }
+}
+
+void TaskPerfCollection::close_task(TaskGroups* groups) {
+    for (auto& item : groups->threads) {
+        close_group(&item.second);
+    }
+    groups->threads.clear();
+}
+
+size_t TaskPerfCollection::update_threads(const ProcessInfo& task, TaskGroups* groups, bool* can_open) {
+    tids_.clear();
+    if (task.pid == task.tgid) {
+        char path[64];
+        snprintf(path, sizeof(path), PROC_DIR "/%d/task", task.pid);
+        DIR* dir = opendir(path);
+        if (dir) {
+            const struct dirent* entry;
+            while ((entry = readdir(dir)) != nullptr) {
+                if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+                tids_.push_back(atoi(entry->d_name));
+            }
+            closedir(dir);
+        }
+    }
+    // 线程条目只统计自己
+    if (tids_.empty()) tids_.push_back(task.pid);
+
+    for (pid_t tid : tids_) {
+        auto iter = groups->threads.find(tid);
+        if (iter == groups->threads.end()) {
+            if (!*can_open || groups->threads.size() >= max_task_threads_) continue;
+            // fd 预算用完之后不再打开，留给采集器读取 /proc
+            if (open_fds_ + group_fds_ > fd_budget_) {
+                *can_open = false;
+                continue;
+            }
+            PerfGroup group;
+            if (open_group(tid, &group) < 0) {
+                if (errno == EMFILE || errno == ENFILE) {
+                    WARN_LOG("perf_event_open failed, err: %s", strerror(errno));
+                    *can_open = false;
+                }
+                continue;
+            }
+            iter = groups->threads.emplace(tid, group).first;
+        }
+        iter->second.seen_seq = seq_;
+    }
+    return groups->threads.size();
+}
+
+void TaskPerfCollection::read_group(PerfGroup* group, size_t count, uint64_t* deltas) {
+    // 格式为 nr、time_enabled、time_running，之后是每个事件的值
+    uint64_t buffer[3 + PERF_MAX_GROUP_EVENTS];
+    ssize_t res = read(group->fds[0], buffer, sizeof(buffer));
+    if (res < static_cast<ssize_t>((3 + count) * sizeof(uint64_t)) || buffer[0] != count) return;
+    uint64_t enabled = buffer[1];
+    uint64_t running = buffer[2];
+    const uint64_t* values = buffer + 3;
+    uint64_t delta_enabled = enabled - group->last_enabled;
+    uint64_t delta_running = running - group->last_running;
+    // 计数器被复用时按实际计数的时间比例放大
+    double scale = delta_running ? static_cast<double>(delta_enabled) / delta_running : 0.0;
+    for (size_t i = 0; i < count; i++) {
+        deltas[i] += static_cast<uint64_t>((values[i] - group->last_values[i]) * scale);
+    }
+    memcpy(group->last_values, values, sizeof(uint64_t) * count);
+    group->last_enabled = enabled;
+    group->last_running = running;
+}
+
+void TaskPerfCollection::read_task(TaskGroups* groups, ProcessInfo* task) {
+    size_t count = 0;
+    mode_events(mode_, &count);
+    uint64_t deltas[PERF_MAX_GROUP_EVENTS] = {0};
+    for (auto iter = groups->threads.begin(); iter != groups->threads.end();) {
+        PerfGroup& group = iter->second;
+        // 已经退出的线程仍然可以读出最后的计数，读完之后关闭
+        read_group(&group, count, deltas);
+        if (group.seen_seq != seq_) {
+            close_group(&group);
+            iter = groups->threads.erase(iter);
+            continue;
+        }
+        ++iter;
+    }
+    // 第一个周期的计数不完整
+    task->perf_valid = groups->has_last;
+    groups->has_last = true;
+
+    if (mode_ == PERF_MODE_HARDWARE) {
+        task->perf_cycles = deltas[0];
+        task->perf_instructions = deltas[1];
+        task->perf_cache_misses = deltas[2];
+        task->perf_branch_misses = deltas[3];
+        task->perf_ipc = deltas[0] ? static_cast<float>(deltas[1]) / deltas[0] : 0.0F;
+        task->perf_mpki = deltas[1] ? deltas[2] * 1000.0F / deltas[1] : 0.0F;
+    } else {
+        task->perf_task_clock_ns = deltas[0];
+        task->perf_context_switches = deltas[1];
+        task->perf_page_faults = deltas[2];
+    }
+}
+
+int TaskPerfCollection::collect(SysMonitorInfo* monitor_info) {
+    monitor_info->perf_mode = mode_;
+    if (mode_ == PERF_MODE_NONE) return -1;
+    seq_++;
+
+    // 按 cpu 使用率选择跟踪的任务，空闲的任务不跟踪
+    candidates_.clear();
+    for (const auto& task : monitor_info->all_process_info) {
+        if (task->percent_cpu > 0) candidates_.push_back(task);
+    }
+    size_t keep_limit = MINIMUM(candidates_.size(), max_tasks_ * PERF_KEEP_FACTOR);
+    std::partial_sort(candidates_.begin(), candidates_.begin() + keep_limit, candidates_.end(),
+        [](const std::shared_ptr<ProcessInfo>& a, const std::shared_ptr<ProcessInfo>& b) {
+            return a->percent_cpu > b->percent_cpu;
+        });
+    bool can_open = true;
+    for (size_t i = 0; i < keep_limit; i++) {
+        const auto& task = candidates_[i];
+        auto iter = groups_.find(task->pid);
+        if (iter != groups_.end() && iter->second.task.lock() != task) {
+            // pid 被复用，旧的计数组属于已经退出的任务
+            close_task(&iter->second);
+            groups_.erase(iter);
+            iter = groups_.end();
+        }
+        if (iter == groups_.end()) {
+            // 排名在 max_tasks 之后的任务只保留已有的计数组
+            if (i >= max_tasks_ || !can_open) continue;
+            iter = groups_.emplace(task->pid, TaskGroups()).first;
+            iter->second.task = task;
+        }
+        // 一个线程的计数组都没有打开（例如没有权限）时不跟踪该任务
+        if (update_threads(*task, &iter->second, &can_open) == 0) {
+            groups_.erase(iter);
+            continue;
+        }
+        iter->second.seen_seq = seq_;
+    }
+
+    // 关闭不再跟踪的计数组，读取其余的计数组
+    for (auto iter = groups_.begin(); iter != groups_.end();) {
+        TaskGroups& groups = iter->second;
+        auto task = groups.task.lock();
+        if (groups.seen_seq != seq_) {
+            if (task) task->perf_valid = false;
+            close_task(&groups);
+            iter = groups_.erase(iter);
+            continue;
+        }
+        read_task(&groups, task.get());
+        ++iter;
+    }
+    monitor_info->perf_tracked_tasks = groups_.size();
+    return 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file task_perf_collect.h
+ * @author zhangyi
+ * @brief 任务级别的性能计数收集（perf_event_open）
+ * @version 0.1
+ * @date 2023-01-03
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include "monitor_info.h"
+
+// 一个计数组中最多的事件个数
+#define PERF_MAX_GROUP_EVENTS 4
+// 默认跟踪的任务个数
+#define PERF_DEFAULT_MAX_TASKS 64
+// 已跟踪的任务只要排名不低于 max_tasks 的该倍数就继续跟踪，避免在边界上反复打开关闭
+#define PERF_KEEP_FACTOR 2
+// 一个进程最多跟踪的线程个数，超过的线程不计入进程的计数
+#define PERF_MAX_TASK_THREADS 256
+// 为 /proc、socket、共享内存等保留的 fd 个数，RLIMIT_NOFILE 减去该值为计数组可用的 fd 个数
+#define PERF_FD_RESERVE 256
+// RLIMIT_NOFILE 没有限制时按内核默认的 fs.nr_open 计算
+#define PERF_FD_LIMIT_UNLIMITED 1048576
+
+/**
+ * @brief 通过 perf_event_open 统计任务的 IPC、MPKI
+ * @note 不带 inherit 的计数组只统计一个线程，所以进程的每个线程各打开一个计数组，
+ *       每次采集对每个组长调用一次 read（PERF_FORMAT_GROUP）读出所有事件，再把各线程的增量相加；
+ *       线程条目只打开自己的计数组。进程的线程列表每次采集时从 /proc/<pid>/task 刷新，
+ *       新线程从打开时开始计数，退出的线程在读出最后的计数后关闭。
+ *       只跟踪 cpu 使用率最高的 max_tasks 个任务，任务退出或排名下降时关闭计数组。
+ *       计数组可用的 fd 个数为 RLIMIT_NOFILE 减去 PERF_FD_RESERVE，任务个数与每个任务的线程个数按它确定，
+ *       用完之后不再打开新的计数组，不会等到 EMFILE 时才停止，采集器读取 /proc 所需的 fd 不受影响
+ *       没有硬件 PMU 时（例如虚拟机、CI）回退到软件事件
+ */
+class TaskPerfCollection {
+ public:
+    TaskPerfCollection() = default;
+    ~TaskPerfCollection();
+    TaskPerfCollection(const TaskPerfCollection&) = delete;
+    TaskPerfCollection& operator=(const TaskPerfCollection&) = delete;
+
+    /**
+     * @brief 检测可用的事件
+     *
+     * @param max_tasks 最多同时跟踪的任务个数
+     * @return int 小于 0 表示 perf_event_open 完全不可用
+     */
+    int initialize(size_t max_tasks);
+
+    /**
+     * @brief 完成一次性能计数的采集
+     * @note 需要在任务扫描完成之后调用，依赖任务的 cpu 使用率选择跟踪的任务
+     */
+    int collect(SysMonitorInfo* monitor_info);
+
+    inline PerfMode mode() const {
+        return mode_;
+    }
+
+ private:
+    // 一个线程的计数组，计数从打开时的 0 开始
+    struct PerfGroup {
+        int fds[PERF_MAX_GROUP_EVENTS];
+        uint64_t last_values[PERF_MAX_GROUP_EVENTS];
+        uint64_t last_enabled;
+        uint64_t last_running;
+        uint64_t seen_seq;
+    };
+
+    // 一个被跟踪任务的所有线程的计数组
+    struct TaskGroups {
+        // 跟踪的任务，pid 被复用时与扫描到的任务不一致
+        std::weak_ptr<ProcessInfo> task;
+        // tid -> 计数组
+        std::unordered_map<pid_t, PerfGroup> threads;
+        bool has_last = false;
+        uint64_t seen_seq = 0;
+    };
+
+    /**
+     * @brief 在自己身上打开一次当前模式的计数组，用于检测
+     *
+     * @return int 0 表示成功，否则为 errno
+     */
+    int probe();
+    int open_group(pid_t tid, PerfGroup* group);
+    void close_group(PerfGroup* group);
+    void close_task(TaskGroups* groups);
+    /**
+     * @brief 刷新任务的线程列表，为新线程打开计数组
+     *
+     * @param can_open 为 false 时不再打开新的计数组；fd 用尽时被置为 false
+     * @return size_t 任务已打开的计数组个数
+     */
+    size_t update_threads(const ProcessInfo& task, TaskGroups* groups, bool* can_open);
+    /**
+     * @brief 读出一个线程上一个周期的计数增量并累加到 deltas
+     *
+     */
+    void read_group(PerfGroup* group, size_t count, uint64_t* deltas);
+    /**
+     * @brief 读出任务所有线程的计数并汇总到任务，关闭已经退出的线程的计数组
+     *
+     */
+    void read_task(TaskGroups* groups, ProcessInfo* task);
+
+ private:
+    PerfMode mode_ = PERF_MODE_NONE;
+    // 权限不足时只统计用户态
+    bool exclude_kernel_ = false;
+    size_t max_tasks_ = PERF_DEFAULT_MAX_TASKS;
+    uint64_t seq_ = 0;
+    // 计数组可用的 fd 个数与已经打开的 fd 个数
+    size_t fd_budget_ = 0;
+    size_t open_fds_ = 0;
+    // 一个计数组的 fd 个数
+    size_t group_fds_ = 0;
+    // 每个任务最多跟踪的线程个数，由 fd 预算确定
+    size_t max_task_threads_ = PERF_MAX_TASK_THREADS;
+    // pid -> 任务的计数组
+    std::unordered_map<pid_t, TaskGroups> groups_;
+    std::vector<std::shared_ptr<ProcessInfo>> candidates_;
+    // 读取线程列表的缓存
+    std::vector<pid_t> tids_;
+};
@@ -0,0 +1,98 @@
+#include <string.h>
+#include <stdlib.h>
+#include "common.h"
+#include "task_proc_parse.h"
+
+// 跳过 count 个可能为负数的字段
+static inline void skip_fields(char** location, int count) {
+    for (int i = 0; i < count; i++) {
+        while (**location == ' ') (*location)++;
+        if (**location == '-') (*location)++;
+        Util::parse_uint64(location);
+    }
+}
+
+int parse_task_stat(char* buf, TaskStatFields* fields) {
+    char* location = buf;
+    fields->pid = Util::parse_uint64(&location);
+    // 任务名在第一个 '(' 与最后一个 ')' 之间，其中可能包含空格和括号
+    char* begin = strchr(location, '(');
+    char* end = strrchr(location, ')');
+    if (!begin || !end || end < begin || end[1] == '\0') return -1;
+    begin++;
+    fields->comm = begin;
+    fields->comm_length = end - begin;
+    // 跳过 ") "，之后为任务的状态
+    location = end + 2;
+    fields->state = *location;
+    while (*location && *location != ' ') location++;
+    fields->ppid = Util::parse_uint64(&location);
+    fields->pgrp = Util::parse_uint64(&location);
+    fields->session = Util::parse_uint64(&location);
+    // 跳过 tty_nr、tpgid、flags、minflt、cminflt、majflt、cmajflt，tty_nr、tpgid 可能为负数
+    skip_fields(&location, 7);
+    fields->utime = Util::parse_uint64(&location);
+    fields->stime = Util::parse_uint64(&location);
+    fields->cutime = Util::parse_uint64(&location);
+    fields->cstime = Util::parse_uint64(&location);
+    // 跳过 priority、nice、num_threads、itrealvalue，priority、nice 可能为负数
+    skip_fields(&location, 4);
+    fields->start_time = Util::parse_uint64(&location);
+    // 跳过 vsize 到 exit_signal 的 16 个字段
+    skip_fields(&location, 16);
+    while (*location == ' ') location++;
+    fields->processor = (*location >= '0' && *location <= '9') ? (
+        static_cast<int32_t>(Util::parse_uint64(&location))) : -1;
+    return 0;
+}
+
+int parse_task_statm(char* buf, TaskStatmFields* fields) {
+    uint64_t values[7];
+    char* location = buf;
+    for (uint64_t& value : values) {
+        while (*location == ' ') location++;
+        if (*location < '0' || *location > '9') return -1;
+        value = Util::parse_uint64(&location);
+    }
+    fields->virtual_mem = values[0];
+    fields->resident_mem = values[1];
+    fields->shared_mem = values[2];
+    fields->text_mem = values[3];
+    // values[4] 为 library，values[6] 为 dirty pages，Linux 2.6 之后总是 0
+    fields->data_mem = values[5];
+    return 0;
+}
+
+void parse_task_io(char* buf, TaskIoFields* fields) {
+    memset(fields, 0, sizeof(*fields));
+    const char* line;
+    while ((line = strsep(&buf, "\n")) != nullptr) {
+        switch (line[0]) {
+        case 'r':
+            if (line[1] == 'c' && Util::wrap_strncmp(line+2, "har: ")) {
+                fields->read_char = strtoull(line+7, nullptr, 10);
+            } else if (Util::wrap_strncmp(line+1, "ead_bytes: ")) {
+                fields->read_bytes = strtoull(line+12, nullptr, 10);
+            }
+            break;
+        case 'w':
+            if (line[1] == 'c' && Util::wrap_strncmp(line+2, "har: ")) {
+                fields->write_char = strtoull(line+7, nullptr, 10);
+            } else if (Util::wrap_strncmp(line+1, "rite_bytes: ")) {
+                fields->write_bytes = strtoull(line+13, nullptr, 10);
+            }
+            break;
+        case 's':
+            if (line[4] == 'r' && Util::wrap_strncmp(line+1, "yscr: ")) {
+                fields->read_syscalls = strtoull(line+7, nullptr, 10);
+            } else if (Util::wrap_strncmp(line+1, "yscw: ")) {
+                fields->write_syscalls = strtoull(line+7, nullptr, 10);
+            }
+            break;
+        case 'c':
+            if (Util::wrap_strncmp(line+1, "ancelled_write_bytes: ")) {
+                fields->cancelled_write_bytes = strtoull(line+23, nullptr, 10);
+            }
+        }
+    }
+}
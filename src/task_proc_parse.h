@@ -0,0 +1,86 @@
+/**
+ * @file task_proc_parse.h
+ * @author zhangyi
+ * @brief 解析任务的 /proc/<pid>/stat、statm、io，完整采集与编译期组合采集器共用
+ * @version 0.1
+ * @date 2023-01-07
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * @brief stat 中采集需要的字段
+ * @note cpu 时间的单位为时钟周期（sysconf(_SC_CLK_TCK)），由调用者换算
+ */
+struct TaskStatFields {
+    pid_t pid;
+    // 任务名，指向被解析的缓冲区内部，不以空字符结尾
+    const char* comm;
+    size_t comm_length;
+    // 任务的状态，如 'R'、'S'、'D'
+    char state;
+    pid_t ppid;
+    pid_t pgrp;
+    pid_t session;
+    uint64_t utime;
+    uint64_t stime;
+    uint64_t cutime;
+    uint64_t cstime;
+    // 启动时间（系统启动后的时钟周期数），与 pid 一起唯一标识一个任务
+    uint64_t start_time;
+    // 最后一次运行所在的 cpu，很旧的内核没有该字段时为 -1
+    int32_t processor;
+};
+
+/**
+ * @brief statm 中的字段，单位为页
+ *
+ */
+struct TaskStatmFields {
+    uint64_t virtual_mem;
+    uint64_t resident_mem;
+    uint64_t shared_mem;
+    uint64_t text_mem;
+    uint64_t data_mem;
+};
+
+/**
+ * @brief io 中的字段，缺少的行为 0
+ *
+ */
+struct TaskIoFields {
+    uint64_t read_char;
+    uint64_t write_char;
+    uint64_t read_syscalls;
+    uint64_t write_syscalls;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    uint64_t cancelled_write_bytes;
+};
+
+/**
+ * @brief 解析以空字符结尾的 stat 内容
+ *
+ * @return int 小于 0 表示格式有误
+ */
+int parse_task_stat(char* buf, TaskStatFields* fields);
+
+/**
+ * @brief 解析以空字符结尾的 statm 内容
+ *
+ * @return int 小于 0 表示字段不足 7 个
+ */
+int parse_task_statm(char* buf, TaskStatmFields* fields);
+
+/**
+ * @brief 解析以空字符结尾的 io 内容
+ * @note 解析过程中会修改 buf
+ */
+void parse_task_io(char* buf, TaskIoFields* fields);
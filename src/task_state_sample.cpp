@@ -0,0 +1,221 @@
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <algorithm>
+#include "common.h"
+#include "task_state_sample.h"
+#include "task_proc_parse.h"
+
+TaskStateSampler::~TaskStateSampler() {
+    stop();
+}
+
+int TaskStateSampler::start(int proc_dir_fd, size_t max_tasks, uint32_t sample_hz, uint32_t budget,
+    uint32_t interval_ms) {
+    if (proc_dir_fd < 0 || interval_ms == 0) return -1;
+    proc_dir_fd_ = proc_dir_fd;
+    max_tasks_ = max_tasks ? max_tasks : TASK_SAMPLE_DEFAULT_MAX_TASKS;
+    sample_hz = sample_hz ? sample_hz : TASK_SAMPLE_DEFAULT_HZ;
+    budget = budget ? budget : TASK_SAMPLE_DEFAULT_BUDGET;
+    period_us_ = 1000000 / sample_hz;
+    // 把每个间隔的预算平均分配到每一轮
+    uint64_t rounds = MAXIMUM(static_cast<uint64_t>(sample_hz) * interval_ms / 1000, 1ULL);
+    samples_per_round_ = MAXIMUM(budget / rounds, 1ULL);
+    running_.store(true);
+    sample_thread_ = std::thread(&TaskStateSampler::sample_loop, this);
+    INFO_LOG("task state sampler enabled, max tasks: %zu, %u Hz, %zu samples per round",
+        max_tasks_, sample_hz, samples_per_round_);
+    return 0;
+}
+
+void TaskStateSampler::stop() {
+    if (!running_.exchange(false)) return;
+    if (sample_thread_.joinable()) {
+        sample_thread_.join();
+    }
+}
+
+void TaskStateSampler::collect(SysMonitorInfo* monitor_info) {
+    // 按 cpu 使用率选择下一个间隔的目标，线程的采样按进程汇总
+    candidates_.clear();
+    for (const auto& task : monitor_info->all_process_info) {
+        if (task->pid == task->tgid && task->percent_cpu > 0) candidates_.push_back(task);
+    }
+    size_t count = MINIMUM(candidates_.size(), max_tasks_);
+    std::partial_sort(candidates_.begin(), candidates_.begin() + count, candidates_.end(),
+        [](const std::shared_ptr<ProcessInfo>& a, const std::shared_ptr<ProcessInfo>& b) {
+            return a->percent_cpu > b->percent_cpu;
+        });
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        histograms_.swap(drained_);
+        targets_.clear();
+        for (size_t i = 0; i < count; i++) {
+            targets_.push_back(candidates_[i]->pid);
+        }
+        targets_seq_++;
+    }
+
+    auto& profiles = monitor_info->task_samples;
+    profiles.clear();
+    for (const auto& item : drained_) {
+        if (item.second.samples == 0) continue;
+        profiles.emplace_back();
+        build_profile(item.first, item.second, &profiles.back());
+    }
+    std::sort(profiles.begin(), profiles.end(), [](const TaskSampleProfile& a, const TaskSampleProfile& b) {
+        return a.pid < b.pid;
+    });
+    // 下一次交换时复用 drained_ 的空间
+    drained_.clear();
+}
+
+void TaskStateSampler::build_profile(pid_t pid, const Histogram& histogram, TaskSampleProfile* profile) {
+    memset(profile, 0, sizeof(*profile));
+    profile->pid = pid;
+    profile->samples = histogram.samples;
+    memcpy(profile->state_counts, histogram.state_counts, sizeof(profile->state_counts));
+
+    std::vector<std::pair<int32_t, SyscallCount>> syscalls(histogram.syscalls.begin(), histogram.syscalls.end());
+    size_t count = MINIMUM(syscalls.size(), static_cast<size_t>(TASK_SAMPLE_TOP_ENTRIES));
+    std::partial_sort(syscalls.begin(), syscalls.begin() + count, syscalls.end(),
+        [](const std::pair<int32_t, SyscallCount>& a, const std::pair<int32_t, SyscallCount>& b) {
+            return a.second.count > b.second.count;
+        });
+    for (size_t i = 0; i < count; i++) {
+        profile->syscalls[i].nr = syscalls[i].first;
+        profile->syscalls[i].count = syscalls[i].second.count;
+        profile->syscalls[i].arg0 = syscalls[i].second.arg0;
+    }
+    profile->syscall_entries = count;
+
+    std::vector<std::pair<const std::string*, uint32_t>> wchans;
+    wchans.reserve(histogram.wchans.size());
+    for (const auto& item : histogram.wchans) {
+        wchans.emplace_back(&item.first, item.second);
+    }
+    count = MINIMUM(wchans.size(), static_cast<size_t>(TASK_SAMPLE_TOP_ENTRIES));
+    std::partial_sort(wchans.begin(), wchans.begin() + count, wchans.end(),
+        [](const std::pair<const std::string*, uint32_t>& a, const std::pair<const std::string*, uint32_t>& b) {
+            return a.second > b.second;
+        });
+    for (size_t i = 0; i < count; i++) {
+        snprintf(profile->wchans[i].name, sizeof(profile->wchans[i].name), "%s", wchans[i].first->c_str());
+        profile->wchans[i].count = wchans[i].second;
+    }
+    profile->wchan_entries = count;
+}
+
+void TaskStateSampler::sample_loop() {
+    std::vector<pid_t> targets;
+    while (running_.load(std::memory_order_relaxed)) {
+        usleep(period_us_);
+        uint64_t targets_seq;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            targets_seq = targets_seq_;
+            if (targets_seq != threads_seq_) targets = targets_;
+        }
+        if (targets_seq != threads_seq_) {
+            refresh_threads(targets);
+            threads_seq_ = targets_seq;
+        }
+        if (threads_.empty()) continue;
+
+        // 在锁外读取文件，只在合并时加锁
+        batch_.clear();
+        size_t count = MINIMUM(samples_per_round_, threads_.size());
+        for (size_t i = 0; i < count; i++) {
+            if (cursor_ >= threads_.size()) cursor_ = 0;
+            const auto& thread = threads_[cursor_++];
+            batch_.emplace_back();
+            if (!sample_thread(thread.first, thread.second, &batch_.back())) batch_.pop_back();
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        // 目标已经切换，这一轮的采样属于上一个间隔，丢弃
+        if (targets_seq_ != targets_seq) continue;
+        for (const Sample& sample : batch_) {
+            Histogram& histogram = histograms_[sample.tgid];
+            histogram.samples++;
+            histogram.state_counts[sample.state]++;
+            if (sample.has_syscall) {
+                SyscallCount& syscall = histogram.syscalls[sample.nr];
+                syscall.count++;
+                syscall.arg0 = sample.arg0;
+            }
+            if (sample.wchan[0] != '\0') {
+                histogram.wchans[sample.wchan]++;
+            }
+        }
+    }
+}
+
+void TaskStateSampler::refresh_threads(const std::vector<pid_t>& targets) {
+    threads_.clear();
+    cursor_ = 0;
+    char path[32];
+    for (pid_t tgid : targets) {
+        snprintf(path, sizeof(path), "%d/task", tgid);
+        int task_fd = openat(proc_dir_fd_, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (task_fd < 0) continue;
+        DIR* dir = fdopendir(task_fd);
+        if (!dir) {
+            close(task_fd);
+            continue;
+        }
+        const struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+            threads_.emplace_back(tgid, strtol(entry->d_name, nullptr, 10));
+        }
+        closedir(dir);
+    }
+}
+
+bool TaskStateSampler::sample_thread(pid_t tgid, pid_t tid, Sample* sample) {
+    char path[64];
+    char buf[MAX_BYTES_ONCE_READ+1];
+    snprintf(path, sizeof(path), "%d/task/%d/stat", tgid, tid);
+    ssize_t res = Util::read_file(proc_dir_fd_, path, buf, sizeof(buf));
+    if (res <= 0) return false;
+    TaskStatFields stat;
+    if (parse_task_stat(buf, &stat) < 0) return false;
+    sample->tgid = tgid;
+    switch (stat.state) {
+    case 'R': sample->state = TASK_SAMPLE_RUNNING; break;
+    case 'S': sample->state = TASK_SAMPLE_SLEEPING; break;
+    case 'D': sample->state = TASK_SAMPLE_DISK_SLEEP; break;
+    default: sample->state = TASK_SAMPLE_OTHER; break;
+    }
+
+    // 格式为 "running"、"-1 sp pc"（不在系统调用中）或 "nr arg0 ... arg5 sp pc"
+    sample->has_syscall = false;
+    snprintf(path, sizeof(path), "%d/task/%d/syscall", tgid, tid);
+    res = Util::read_file(proc_dir_fd_, path, buf, sizeof(buf));
+    if (res > 0 && buf[0] != 'r') {
+        buf[MINIMUM(static_cast<size_t>(res), sizeof(buf) - 1)] = '\0';
+        char* end = nullptr;
+        long nr = strtol(buf, &end, 10);
+        if (end != buf) {
+            sample->has_syscall = true;
+            sample->nr = nr < 0 ? TASK_SAMPLE_SYSCALL_USER : nr;
+            sample->arg0 = nr < 0 ? 0 : strtoull(end, nullptr, 16);
+        }
+    }
+
+    // 运行中的线程的 wchan 为 "0"
+    sample->wchan[0] = '\0';
+    if (sample->state == TASK_SAMPLE_RUNNING) return true;
+    snprintf(path, sizeof(path), "%d/task/%d/wchan", tgid, tid);
+    res = Util::read_file(proc_dir_fd_, path, sample->wchan, sizeof(sample->wchan));
+    if (res <= 0 || (res == 1 && sample->wchan[0] == '0')) {
+        sample->wchan[0] = '\0';
+        return true;
+    }
+    sample->wchan[MINIMUM(static_cast<size_t>(res), sizeof(sample->wchan) - 1)] = '\0';
+    return true;
+}
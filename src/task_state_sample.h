@@ -0,0 +1,127 @@
+/**
+ * @file task_state_sample.h
+ * @author zhangyi
+ * @brief cpu 使用率最高的进程的状态采样（wchan、state、syscall）
+ * @version 0.1
+ * @date 2023-01-06
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include "monitor_info.h"
+
+// 默认采样的进程个数
+#define TASK_SAMPLE_DEFAULT_MAX_TASKS 4
+// 默认每秒采样的轮数
+#define TASK_SAMPLE_DEFAULT_HZ 50
+// 默认每个采集间隔最多采样的线程次数（每次读取 stat、wchan、syscall 三个文件）
+#define TASK_SAMPLE_DEFAULT_BUDGET 2000
+
+/**
+ * @brief 在后台线程中以较高的频率对目标进程的所有线程采样
+ * @note 每次采集时选出 cpu 使用率最高的 max_tasks 个进程作为下一个间隔的目标，
+ *       同时取出上一个间隔的直方图。每个间隔的采样次数不超过 budget，
+ *       线程数较多时每轮只采样一部分线程，下一轮从上次的位置继续。
+ *       读取 /proc/<pid>/task/<tid>/syscall 需要 ptrace 权限
+ */
+class TaskStateSampler {
+ public:
+    TaskStateSampler() = default;
+    ~TaskStateSampler();
+    TaskStateSampler(const TaskStateSampler&) = delete;
+    TaskStateSampler& operator=(const TaskStateSampler&) = delete;
+
+    /**
+     * @brief 启动采样线程
+     *
+     * @param proc_dir_fd "/proc" 目录的 fd，需要在 stop 之后才能关闭
+     * @param max_tasks 每个间隔采样的进程个数
+     * @param sample_hz 每秒采样的轮数
+     * @param budget 每个采集间隔最多采样的线程次数
+     * @param interval_ms 采集间隔
+     */
+    int start(int proc_dir_fd, size_t max_tasks, uint32_t sample_hz, uint32_t budget, uint32_t interval_ms);
+
+    void stop();
+
+    /**
+     * @brief 取出上一个间隔的直方图，并选择下一个间隔的目标
+     * @note 需要在任务扫描完成之后调用，依赖任务的 cpu 使用率
+     */
+    void collect(SysMonitorInfo* monitor_info);
+
+ private:
+    struct SyscallCount {
+        uint32_t count;
+        uint64_t arg0;
+    };
+
+    // 一个进程的采样累计
+    struct Histogram {
+        uint32_t samples = 0;
+        uint32_t state_counts[TASK_SAMPLE_STATE_COUNT] = {0};
+        std::unordered_map<int32_t, SyscallCount> syscalls;
+        std::unordered_map<std::string, uint32_t> wchans;
+    };
+
+    // 一个线程的一次采样
+    struct Sample {
+        pid_t tgid;
+        uint8_t state;
+        // 线程在运行时没有系统调用与 wchan
+        bool has_syscall;
+        int32_t nr;
+        uint64_t arg0;
+        char wchan[TASK_SAMPLE_WCHAN_LENGTH+1];
+    };
+
+    void sample_loop();
+
+    /**
+     * @brief 目标变化之后重新获取目标进程的所有线程
+     *
+     */
+    void refresh_threads(const std::vector<pid_t>& targets);
+
+    bool sample_thread(pid_t tgid, pid_t tid, Sample* sample);
+
+    static void build_profile(pid_t pid, const Histogram& histogram, TaskSampleProfile* profile);
+
+ private:
+    int proc_dir_fd_ = -1;
+    size_t max_tasks_ = TASK_SAMPLE_DEFAULT_MAX_TASKS;
+    uint32_t period_us_ = 1000000 / TASK_SAMPLE_DEFAULT_HZ;
+    // 每轮最多采样的线程个数
+    size_t samples_per_round_ = 1;
+    std::thread sample_thread_;
+    std::atomic<bool> running_{false};
+
+    std::mutex mutex_;
+    // 本间隔的目标进程与其版本号
+    std::vector<pid_t> targets_;
+    uint64_t targets_seq_ = 0;
+    // pid -> 本间隔的采样累计
+    std::unordered_map<pid_t, Histogram> histograms_;
+
+    // 以下只在采样线程中使用
+    uint64_t threads_seq_ = 0;
+    // (tgid, tid)
+    std::vector<std::pair<pid_t, pid_t>> threads_;
+    size_t cursor_ = 0;
+    std::vector<Sample> batch_;
+
+    // 以下只在采集线程中使用
+    std::unordered_map<pid_t, Histogram> drained_;
+    std::vector<std::shared_ptr<ProcessInfo>> candidates_;
+};
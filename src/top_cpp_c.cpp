@@ -0,0 +1,105 @@
+#include <new>
+#include "common.h"
+#include "monitor_info_collect.h"
+#include "monitor_info_view.h"
+#include "top_cpp_c.h"
+
+struct top_cpp_collector {
+    MonitorInfoCollection collection;
+    // 最近一次采集的结果，采集之前为空
+    std::shared_ptr<SysMonitorInfo> snapshot;
+};
+
+static void fill_task(const TaskView& view, top_cpp_task* task) {
+    task->pid = view.pid();
+    task->tgid = view.tgid();
+    task->ppid = view.ppid();
+    task->uid = view.uid();
+    task->comm = view.comm();
+    task->cmdline = view.cmdline();
+    task->user = view.user();
+    task->percent_cpu = view.percent_cpu();
+    task->percent_mem = view.percent_mem();
+    task->resident_mem_kb = view.resident_mem();
+    task->virtual_mem_kb = view.virtual_mem();
+    task->io_read_bps = view.io_read_bps();
+    task->io_write_bps = view.io_write_bps();
+}
+
+static_assert(TOP_CPP_LOG_FATAL == LOG_FATAL_LEVEL && TOP_CPP_LOG_DEBUG == LOG_DEBUG_LEVEL,
+    "C log levels must match LOG_LEVEL");
+
+void top_cpp_set_log_level(int level) {
+    level = MAXIMUM(MINIMUM(level, TOP_CPP_LOG_DEBUG), TOP_CPP_LOG_FATAL);
+    Util::set_log_level(static_cast<LOG_LEVEL>(level));
+}
+
+void top_cpp_set_log_callback(top_cpp_log_callback callback, void* user_data) {
+    // 回调的类型与 LogSink 相同
+    Util::set_log_sink(callback, user_data);
+}
+
+top_cpp_collector* top_cpp_create(void) {
+    return new (std::nothrow) top_cpp_collector();
+}
+
+void top_cpp_destroy(top_cpp_collector* collector) {
+    delete collector;
+}
+
+void top_cpp_set_task_net_enabled(top_cpp_collector* collector, int enabled) {
+    collector->collection.set_task_net_enabled(enabled != 0);
+}
+
+void top_cpp_set_max_detailed_tasks(top_cpp_collector* collector, size_t max_tasks) {
+    collector->collection.set_max_detailed_tasks(max_tasks);
+}
+
+int top_cpp_initialize(top_cpp_collector* collector) {
+    return collector->collection.initialize();
+}
+
+int top_cpp_collect(top_cpp_collector* collector) {
+    collector->snapshot = collector->collection.finish_once_monitor();
+    return collector->snapshot ? 0 : -1;
+}
+
+int top_cpp_get_sys_info(const top_cpp_collector* collector, top_cpp_sys_info* info) {
+    if (!collector->snapshot) return -1;
+    const SysMonitorInfo& snapshot = *collector->snapshot;
+    info->curr_time_ms = snapshot.curr_time_ms;
+    info->total_mem_kb = snapshot.total_mem;
+    info->used_mem_kb = snapshot.used_mem;
+    info->active_cpus = snapshot.active_cpus;
+    info->existing_cpus = snapshot.existing_cpus;
+    info->cpu_busy_percent = snapshot.sys_cpu_data.empty() ? 0.0F : (
+        snapshot.sys_cpu_data.percent(CPU_PERCENT_BUSY, 0));
+    info->task_count = snapshot.all_process_info.size();
+    return 0;
+}
+
+int top_cpp_get_task(const top_cpp_collector* collector, size_t index, top_cpp_task* task) {
+    if (!collector->snapshot) return -1;
+    SnapshotView view(collector->snapshot);
+    if (index >= view.size()) return -1;
+    fill_task(view.at(index), task);
+    return 0;
+}
+
+int top_cpp_find_task(const top_cpp_collector* collector, int32_t pid, top_cpp_task* task) {
+    if (!collector->snapshot) return -1;
+    SnapshotView view(collector->snapshot);
+    TaskView task_view(nullptr, nullptr);
+    if (!view.find(pid, &task_view)) return -1;
+    fill_task(task_view, task);
+    return 0;
+}
+
+void top_cpp_foreach_task(const top_cpp_collector* collector, top_cpp_task_callback callback, void* user_data) {
+    if (!collector->snapshot) return;
+    top_cpp_task task;
+    for (const TaskView& view : SnapshotView(collector->snapshot)) {
+        fill_task(view, &task);
+        if (callback(&task, user_data) != 0) break;
+    }
+}
@@ -0,0 +1,100 @@
+/**
+ * @file top_cpp_c.h
+ * @author zhangyi
+ * @brief libtopcpp 的 C 接口，用于其他语言通过 FFI 嵌入
+ * @version 0.1
+ * @date 2023-01-08
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef TOP_CPP_C_H_
+#define TOP_CPP_C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 接口版本，结构体增加字段时加一 */
+#define TOP_CPP_C_API_VERSION 1
+
+/* 采集对象，每个对象有独立的配置与状态，同一个对象不能在多个线程中同时使用 */
+typedef struct top_cpp_collector top_cpp_collector;
+
+/* 系统整体的监控数据 */
+typedef struct top_cpp_sys_info {
+    uint64_t curr_time_ms;
+    uint64_t total_mem_kb;
+    uint64_t used_mem_kb;
+    uint32_t active_cpus;
+    uint32_t existing_cpus;
+    /* 所有 cpu 的忙碌时间占比（百分比） */
+    float cpu_busy_percent;
+    /* 任务（包括线程）的个数 */
+    size_t task_count;
+} top_cpp_sys_info;
+
+/* 一个任务的监控数据，字符串指向采集对象内部，在下一次 top_cpp_collect 之前有效 */
+typedef struct top_cpp_task {
+    int32_t pid;
+    int32_t tgid;
+    int32_t ppid;
+    uint32_t uid;
+    const char* comm;
+    const char* cmdline;
+    const char* user;
+    float percent_cpu;
+    float percent_mem;
+    uint64_t resident_mem_kb;
+    uint64_t virtual_mem_kb;
+    double io_read_bps;
+    double io_write_bps;
+} top_cpp_task;
+
+/* 日志级别，高于设置的级别的日志不输出 */
+#define TOP_CPP_LOG_FATAL 0
+#define TOP_CPP_LOG_ERROR 1
+#define TOP_CPP_LOG_WARN 2
+#define TOP_CPP_LOG_INFO 3
+#define TOP_CPP_LOG_DEBUG 4
+
+/* 日志回调，message 不包含换行，只在回调期间有效；可能在库内部的线程中调用，不能在回调中再次设置日志 */
+typedef void (*top_cpp_log_callback)(int level, const char* message, void* user_data);
+
+/* 遍历任务的回调，返回非 0 时停止遍历 */
+typedef int (*top_cpp_task_callback)(const top_cpp_task* task, void* user_data);
+
+/* 设置日志级别，进程内所有采集对象共用，默认为 TOP_CPP_LOG_INFO */
+void top_cpp_set_log_level(int level);
+/* 设置日志回调，callback 为 NULL 时恢复默认（输出到 stdout）；库不会因为错误退出进程 */
+void top_cpp_set_log_callback(top_cpp_log_callback callback, void* user_data);
+
+/* 创建采集对象，失败时返回 NULL */
+top_cpp_collector* top_cpp_create(void);
+void top_cpp_destroy(top_cpp_collector* collector);
+
+/* 以下配置需要在 top_cpp_initialize 之前调用 */
+void top_cpp_set_task_net_enabled(top_cpp_collector* collector, int enabled);
+void top_cpp_set_max_detailed_tasks(top_cpp_collector* collector, size_t max_tasks);
+
+/* 返回值小于 0 表示失败 */
+int top_cpp_initialize(top_cpp_collector* collector);
+
+/* 完成一次采集，第一次采集没有上一次的计数，使用率与速率为 0 */
+int top_cpp_collect(top_cpp_collector* collector);
+
+/* 获取最近一次采集的结果 */
+int top_cpp_get_sys_info(const top_cpp_collector* collector, top_cpp_sys_info* info);
+int top_cpp_get_task(const top_cpp_collector* collector, size_t index, top_cpp_task* task);
+int top_cpp_find_task(const top_cpp_collector* collector, int32_t pid, top_cpp_task* task);
+void top_cpp_foreach_task(const top_cpp_collector* collector, top_cpp_task_callback callback, void* user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // TOP_CPP_C_H_
@@ -0,0 +1,28 @@
+/**
+ * @file top_cpp_log.h
+ * @author zhangyi
+ * @brief 日志级别与日志输出回调的定义，库内部与嵌入接口共用
+ * @version 0.1
+ * @date 2023-01-08
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+// 定义日志级别，数值与 C 接口的 TOP_CPP_LOG_* 相同
+enum LOG_LEVEL {
+    LOG_FATAL_LEVEL = 0,
+    LOG_ERROR_LEVEL,
+    LOG_WARN_LEVEL,
+    LOG_INFO_LEVEL,
+    LOG_DEBUG_LEVEL,
+};
+
+/**
+ * @brief 日志输出的回调
+ * @note level 为 LOG_LEVEL 的值，message 不包含换行，只在回调期间有效；
+ *       采集线程、进程事件线程等都可能调用，回调需要自己保证线程安全，并且不能再次设置日志
+ */
+typedef void (*LogSink)(int level, const char* message, void* arg);
@@ -0,0 +1,80 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <vector>
+#include "common.h"
+#include "user_name_cache.h"
+
+// getpwuid_r 缓冲区的默认大小
+#define GETPW_BUFFER_SIZE 16384
+
+UserNameCache::~UserNameCache() {
+    clear();
+}
+
+uint32_t UserNameCache::get_name_id(uid_t uid) {
+    auto iter = names_.find(uid);
+    if (iter != names_.end()) return iter->second;
+    // 用户可能是新添加的
+    if (reload_passwd()) {
+        iter = names_.find(uid);
+        if (iter != names_.end()) return iter->second;
+    }
+    char name[32];
+    long size = sysconf(_SC_GETPW_R_SIZE_MAX);
+    std::vector<char> buffer(size > 0 ? size : GETPW_BUFFER_SIZE);
+    struct passwd pwd;
+    struct passwd* result = nullptr;
+    if (getpwuid_r(uid, &pwd, buffer.data(), buffer.size(), &result) == 0 && result) {
+        snprintf(name, sizeof(name), "%s", result->pw_name);
+    } else {
+        // 找不到的 uid 也缓存，避免重复查询
+        snprintf(name, sizeof(name), "%u", uid);
+    }
+    uint32_t id = arena_->intern(name);
+    names_.emplace(uid, id);
+    return id;
+}
+
+bool UserNameCache::reload_passwd() {
+    struct stat st;
+    if (stat(PASSWD_FILE, &st) < 0) return false;
+    if (st.st_mtim.tv_sec == passwd_mtime_.tv_sec && st.st_mtim.tv_nsec == passwd_mtime_.tv_nsec) {
+        return false;
+    }
+    FILE* file = fopen(PASSWD_FILE, "re");
+    if (!file) {
+        WARN_LOG("open file: %s failed, err: %s", PASSWD_FILE, strerror(errno));
+        return false;
+    }
+    passwd_mtime_ = st.st_mtim;
+    clear();
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        // name:password:uid:gid:gecos:home:shell
+        char* name_end = strchr(line, ':');
+        if (!name_end || name_end == line) continue;
+        char* uid_begin = strchr(name_end + 1, ':');
+        if (!uid_begin) continue;
+        uid_begin++;
+        char* uid_end = nullptr;
+        unsigned long uid = strtoul(uid_begin, &uid_end, 10);
+        if (uid_end == uid_begin || *uid_end != ':') continue;
+        // 同一个 uid 以第一次出现的名字为准，与 getpwuid 一致
+        if (names_.count(uid)) continue;
+        names_.emplace(uid, arena_->intern(line, name_end - line));
+    }
+    fclose(file);
+    return true;
+}
+
+void UserNameCache::clear() {
+    for (const auto& item : names_) {
+        arena_->release(item.second);
+    }
+    names_.clear();
+}
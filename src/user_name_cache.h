@@ -0,0 +1,65 @@
+/**
+ * @file user_name_cache.h
+ * @author zhangyi
+ * @brief uid 到用户名的缓存
+ * @version 0.1
+ * @date 2022-12-26
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unordered_map>
+#include "common.h"
+#include "string_arena.h"
+
+// /etc/passwd 文件
+#define PASSWD_FILE "/etc/passwd"
+
+/**
+ * @brief uid 到用户名的缓存
+ * @note 第一次使用时解析整个 /etc/passwd，找不到的 uid 在 /etc/passwd 变化时重新加载，
+ *       仍然找不到时通过 getpwuid_r 查询（LDAP 等 NSS 用户），都失败时使用 uid 的数字。
+ *       用户名保存在字符串池中，缓存持有一个引用，重新加载时释放；
+ *       需要长期保存 id 的使用者（例如 ProcessInfo::user_id）必须自己 acquire，不再使用时 release
+ */
+class UserNameCache {
+ public:
+    explicit UserNameCache(StringArena* arena) : arena_(arena) {}
+    ~UserNameCache();
+    UserNameCache(const UserNameCache&) = delete;
+    UserNameCache& operator=(const UserNameCache&) = delete;
+
+    /**
+     * @brief 获取用户名在字符串池中的 id
+     *
+     */
+    uint32_t get_name_id(uid_t uid);
+
+    /**
+     * @brief 缓存自身占用的内存（字节），用户名本身计入字符串池
+     *
+     */
+    inline size_t memory_bytes() const {
+        return Util::hash_map_bytes(names_);
+    }
+
+ private:
+    /**
+     * @brief /etc/passwd 有变化时重新加载
+     *
+     * @return true 重新加载了
+     */
+    bool reload_passwd();
+    void clear();
+
+ private:
+    StringArena* arena_;
+    std::unordered_map<uid_t, uint32_t> names_;
+    struct timespec passwd_mtime_ = {0, 0};
+};
@@ -0,0 +1,142 @@
+/**
+ * @file energy_collect_test.cpp
+ * @author zhangyi
+ * @brief 用 tests/fixtures/energy 中的 sysfs 检查 RAPL 计数回绕、多 package 与按线程分摊
+ * @version 0.1
+ * @date 2023-01-09
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <memory>
+#include <string>
+#include <filesystem>
+#include "common.h"
+#include "cpu_data_array.h"
+#include "energy_collect.h"
+#include "monitor_info.h"
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+#define CHECK_NEAR(a, b)                                                    \
+    CHECK(fabs((a) - (b)) <= 1E-5 * MAXIMUM(fabs(a), fabs(b)) + 1E-9)
+
+static void write_value(const std::string& path, uint64_t value) {
+    FILE* fp = fopen(path.c_str(), "w");
+    if (!fp) {
+        fprintf(stderr, "open %s failed\n", path.c_str());
+        exit(2);
+    }
+    fprintf(fp, "%lu\n", value);
+    fclose(fp);
+}
+
+// cpu0、cpu1 在 package 0 上，各繁忙 50%；cpu2、cpu3 在 package 1 上，分别繁忙 100% 与 0%
+static void fill_cpu_data(CpuDataArray* cpu_data) {
+    static const uint64_t busy[] = {50, 50, 100, 0};
+    cpu_data->resize(5);
+    cpu_data->begin_update();
+    uint64_t total_busy = 0;
+    for (size_t cpu = 0; cpu < 4; cpu++) {
+        cpu_data->set_on_line(cpu + 1, true);
+        cpu_data->set_next_time(CPU_TIME_TOTAL, cpu + 1, 100);
+        cpu_data->set_next_time(CPU_TIME_IDLE_ALL, cpu + 1, 100 - busy[cpu]);
+        total_busy += busy[cpu];
+    }
+    cpu_data->set_on_line(0, true);
+    cpu_data->set_next_time(CPU_TIME_TOTAL, 0, 400);
+    cpu_data->set_next_time(CPU_TIME_IDLE_ALL, 0, 400 - total_busy);
+    cpu_data->finish_update();
+}
+
+static std::shared_ptr<ProcessInfo> make_task(pid_t pid, pid_t tgid, int32_t processor, float percent_cpu) {
+    auto task = std::make_shared<ProcessInfo>();
+    task->pid = pid;
+    task->tgid = tgid;
+    task->processor = processor;
+    task->percent_cpu = percent_cpu;
+    task->energy_watts = 0;
+    return task;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s fixture_dir\n", argv[0]);
+        return 2;
+    }
+    // 计数文件在测试中会被改写，复制一份到临时目录
+    char tmp_dir[] = "/tmp/top_cpp_energy_XXXXXX";
+    if (!mkdtemp(tmp_dir)) {
+        perror("mkdtemp");
+        return 2;
+    }
+    std::string sys_root = std::string(tmp_dir) + "/sys";
+    std::filesystem::copy(std::string(argv[1]) + "/sys", sys_root, std::filesystem::copy_options::recursive);
+    std::string powercap = sys_root + "/class/powercap";
+
+    CpuDataArray cpu_data;
+    fill_cpu_data(&cpu_data);
+    EnergyCollection energy;
+    energy.set_sys_root(sys_root.c_str());
+    std::vector<EnergyPackageData> packages;
+    CHECK(energy.collect(cpu_data, &packages) == 0);
+    // psys 与 package 无关，被忽略
+    CHECK(packages.size() == 2);
+    if (packages.size() != 2) return 1;
+    CHECK(packages[0].package_id == 0 && packages[1].package_id == 1);
+    CHECK(packages[0].has_domain[ENERGY_DOMAIN_PACKAGE] && packages[0].has_domain[ENERGY_DOMAIN_DRAM]);
+    CHECK(packages[1].has_domain[ENERGY_DOMAIN_PACKAGE] && !packages[1].has_domain[ENERGY_DOMAIN_DRAM]);
+
+    // package 0 的计数从 999999900 回绕到 200，max_energy_range_uj 为 999999999，增量为 99 + 1 + 200
+    write_value(powercap + "/intel-rapl:0/energy_uj", 200);
+    write_value(powercap + "/intel-rapl:0:0/energy_uj", 5600000);
+    write_value(powercap + "/intel-rapl:1/energy_uj", 21000000);
+    usleep(20000);
+    CHECK(energy.collect(cpu_data, &packages) == 0);
+    CHECK(packages[0].energy_uj[ENERGY_DOMAIN_PACKAGE] == 300);
+    CHECK(packages[0].energy_uj[ENERGY_DOMAIN_DRAM] == 600000);
+    CHECK(packages[1].energy_uj[ENERGY_DOMAIN_PACKAGE] == 1000000);
+    CHECK_NEAR(packages[0].busy_cpus, 1.0);
+    CHECK_NEAR(packages[1].busy_cpus, 1.0);
+    CHECK(packages[1].watts[ENERGY_DOMAIN_PACKAGE] > 0);
+    CHECK_NEAR(packages[0].watts[ENERGY_DOMAIN_PACKAGE] * 1000000, packages[1].watts[ENERGY_DOMAIN_PACKAGE] * 300);
+
+    // 进程 100 共 60%：线程 101 在 cpu0 上 20%，线程 102 在 cpu2 上 30%，主线程自己在 cpu0 上 10%
+    SysMonitorInfo monitor_info;
+    monitor_info.energy_packages = packages;
+    auto process = make_task(100, 100, 0, 60);
+    auto thread_a = make_task(101, 100, 0, 20);
+    auto thread_b = make_task(102, 100, 2, 30);
+    // 单线程进程 200 在 cpu3 上 40%
+    auto single = make_task(200, 200, 3, 40);
+    monitor_info.all_process_info = {process, thread_a, thread_b, single};
+    energy.attribute(&monitor_info);
+
+    double package0 = packages[0].watts[ENERGY_DOMAIN_PACKAGE] + packages[0].watts[ENERGY_DOMAIN_DRAM];
+    double package1 = packages[1].watts[ENERGY_DOMAIN_PACKAGE];
+    CHECK_NEAR(thread_a->energy_watts, package0 * 0.2);
+    CHECK_NEAR(thread_b->energy_watts, package1 * 0.3);
+    CHECK_NEAR(process->energy_watts, package0 * 0.1 + thread_a->energy_watts + thread_b->energy_watts);
+    CHECK_NEAR(single->energy_watts, package1 * 0.4);
+
+    std::filesystem::remove_all(tmp_dir);
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("energy collect: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <unistd.h>
+#include "top_cpp_c.h"
+
+/* C 接口的示例：在进程内采集，输出 cpu 使用率超过 1% 的任务 */
+static int print_busy_task(const top_cpp_task* task, void* user_data) {
+    int* count = (int*)user_data;
+    if (task->percent_cpu > 1.0F) {
+        printf("%d, user: %s, comm: %s, cpu usage: %.2f, rss: %lu KB\n", task->pid, task->user, task->comm,
+            task->percent_cpu, (unsigned long)task->resident_mem_kb);
+        (*count)++;
+    }
+    return 0;
+}
+
+int main(void) {
+    top_cpp_collector* collector = top_cpp_create();
+    if (!collector || top_cpp_initialize(collector) < 0) {
+        fprintf(stderr, "initialize top_cpp collector failed\n");
+        top_cpp_destroy(collector);
+        return -1;
+    }
+    /* 第一次采集建立基线 */
+    top_cpp_collect(collector);
+    for (int round = 0; round < 3; round++) {
+        sleep(1);
+        if (top_cpp_collect(collector) < 0) break;
+        top_cpp_sys_info info;
+        top_cpp_get_sys_info(collector, &info);
+        printf("cpu busy: %.2f%%, mem: %lu/%lu KB, tasks: %zu\n", info.cpu_busy_percent,
+            (unsigned long)info.used_mem_kb, (unsigned long)info.total_mem_kb, info.task_count);
+        int count = 0;
+        top_cpp_foreach_task(collector, print_busy_task, &count);
+    }
+    top_cpp_destroy(collector);
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <iostream>
+#include "task_collector.h"
+#include "monitor_info_collect.h"
+#include "common.h"
+
+// 压测工具：比较编译期组合的采集器与 MonitorInfoCollection 完整采集一次 /proc 的耗时
+template <typename CollectorSet>
+static void bench_collector_set(const char* name, unsigned int rounds) {
+    CollectorSet collector;
+    if (collector.initialize() < 0) return;
+    // 第一次采集建立基线，不计入耗时
+    collector.collect();
+    uint64_t start_ns = Util::get_monotonic_ns();
+    for (unsigned int i = 0; i < rounds; i++) {
+        collector.collect();
+    }
+    uint64_t elapsed_ns = Util::get_monotonic_ns() - start_ns;
+    std::cout << name << ": tasks: " << collector.tasks().size() << ", record size: "
+        << sizeof(typename CollectorSet::Record) << " bytes, "
+        << elapsed_ns / 1E6 / rounds << " ms per collection" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int rounds = 20;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:h")) != -1) {
+        switch (opt) {
+        case 'r':
+            rounds = strtoul(optarg, nullptr, 10);
+            break;
+        default:
+            std::cout << "usage: " << argv[0] << " [-r rounds]" << std::endl;
+            return opt == 'h' ? 0 : -1;
+        }
+    }
+    if (rounds == 0) rounds = 1;
+    bench_collector_set<TaskCollectorSet<CpuCollector>>("cpu", rounds);
+    bench_collector_set<TaskCollectorSet<CpuCollector, RssCollector>>("cpu,rss", rounds);
+    bench_collector_set<TaskCollectorSet<CpuCollector, RssCollector, IoCollector, ThreadCollector>>(
+        "cpu,rss,io,threads", rounds);
+
+    MonitorInfoCollection& collection = MonitorInfoCollection::get_instance();
+    if (collection.initialize() < 0) return -1;
+    collection.finish_once_monitor();
+    uint64_t start_ns = Util::get_monotonic_ns();
+    size_t tasks = 0;
+    for (unsigned int i = 0; i < rounds; i++) {
+        tasks = collection.finish_once_monitor()->all_process_info.size();
+    }
+    uint64_t elapsed_ns = Util::get_monotonic_ns() - start_ns;
+    std::cout << "all-in-one: tasks: " << tasks << ", record size: " << sizeof(ProcessInfo) << " bytes, "
+        << elapsed_ns / 1E6 / rounds << " ms per collection" << std::endl;
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+#include "task_collector.h"
+#include "common.h"
+
+// 精简版的 top_cpp：采集器在编译期选定，由 CMake 的 profile 目标定义 TOP_CPP_PROFILE_*
+#if defined(TOP_CPP_PROFILE_CPU_RSS)
+typedef TaskCollectorSet<CpuCollector, RssCollector> ProfileCollectorSet;
+#define TOP_CPP_PROFILE_NAME "cpu,rss"
+#elif defined(TOP_CPP_PROFILE_CPU_IO_THREADS)
+typedef TaskCollectorSet<CpuCollector, RssCollector, IoCollector, ThreadCollector> ProfileCollectorSet;
+#define TOP_CPP_PROFILE_NAME "cpu,rss,io,threads"
+#else
+typedef TaskCollectorSet<CpuCollector> ProfileCollectorSet;
+#define TOP_CPP_PROFILE_NAME "cpu"
+#endif
+
+typedef ProfileCollectorSet::Record ProfileRecord;
+
+// 输出的任务个数
+#define LITE_TOP_TASKS 20
+// 默认的采集间隔
+#define LITE_DEFAULT_INTERVAL_MS 2000
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void handle_stop_signal(int) {
+    g_stop = 1;
+}
+
+/**
+ * @brief 输出一个任务，只输出 profile 中包含的字段
+ * @note 模板函数中 if constexpr 不成立的分支才不会被实例化
+ */
+template <typename RecordT>
+static void output_record(std::ostream& os, const RecordT& record) {
+    os << record.pid << ", tgid: " << record.tgid << ", cpu usage: " << record.percent_cpu;
+    if constexpr (std::is_base_of<RssCollector::Fields, RecordT>::value) {
+        os << ", rss: " << record.resident_mem << " KB";
+    }
+    if constexpr (std::is_base_of<IoCollector::Fields, RecordT>::value) {
+        os << ", io read: " << record.io_rate_read_bps << " B/s, io write: " << record.io_rate_write_bps << " B/s";
+    }
+    os << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    unsigned long interval_ms = LITE_DEFAULT_INTERVAL_MS;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:h")) != -1) {
+        switch (opt) {
+        case 'i':
+            interval_ms = strtoul(optarg, nullptr, 10);
+            if (interval_ms == 0) {
+                std::cout << "invalid interval: " << optarg << std::endl;
+                return -1;
+            }
+            break;
+        default:
+            std::cout << "usage: " << argv[0] << " [-i interval_ms]" << std::endl
+                << "  collectors: " << TOP_CPP_PROFILE_NAME << std::endl;
+            return opt == 'h' ? 0 : -1;
+        }
+    }
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+    ProfileCollectorSet collector;
+    if (collector.initialize() < 0) return -1;
+    std::vector<const ProfileRecord*> top_tasks;
+    while (!g_stop) {
+        collector.collect();
+        top_tasks.clear();
+        for (const auto& record : collector.tasks()) {
+            top_tasks.push_back(&record);
+        }
+        size_t n = MINIMUM(top_tasks.size(), static_cast<size_t>(LITE_TOP_TASKS));
+        std::partial_sort(top_tasks.begin(), top_tasks.begin() + n, top_tasks.end(),
+            [](const ProfileRecord* a, const ProfileRecord* b) {
+                return a->percent_cpu > b->percent_cpu;
+            });
+        std::cout << "tasks: " << collector.tasks().size() << std::endl;
+        for (size_t i = 0; i < n && top_tasks[i]->percent_cpu > 0.0001; i++) {
+            output_record(std::cout, *top_tasks[i]);
+        }
+        usleep(interval_ms * 1000);
+    }
+    return 0;
+}
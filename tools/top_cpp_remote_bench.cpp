@@ -0,0 +1,117 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "monitor_info_remote.h"
+#include "common.h"
+
+// 压测工具：在一个进程内模拟多个 agent，向 collector 发送合成的快照，
+// 用于在单机上验证 collector 的吞吐（例如 top_cpp -C unix:/tmp/top_cpp.sock）
+static uint64_t monotonic_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+int main(int argc, char* argv[]) {
+    const char* address = nullptr;
+    unsigned int agent_count = 10;
+    unsigned int task_count = 10000;
+    unsigned int interval_ms = 1000;
+    unsigned int change_percent = 20;
+    unsigned int rounds = 10;
+    int opt;
+    while ((opt = getopt(argc, argv, "a:n:t:i:p:r:h")) != -1) {
+        switch (opt) {
+        case 'a':
+            address = optarg;
+            break;
+        case 'n':
+            agent_count = strtoul(optarg, nullptr, 10);
+            break;
+        case 't':
+            task_count = strtoul(optarg, nullptr, 10);
+            break;
+        case 'i':
+            interval_ms = strtoul(optarg, nullptr, 10);
+            break;
+        case 'p':
+            change_percent = strtoul(optarg, nullptr, 10);
+            break;
+        case 'r':
+            rounds = strtoul(optarg, nullptr, 10);
+            break;
+        default:
+            std::cout << "usage: " << argv[0] << " -a address [-n agents] [-t tasks_per_agent]"
+                << " [-i interval_ms] [-p changed_task_percent] [-r rounds]" << std::endl;
+            return opt == 'h' ? 0 : -1;
+        }
+    }
+    if (!address) {
+        std::cout << "-a address is required" << std::endl;
+        return -1;
+    }
+
+    // 所有 agent 共享同一份合成快照，每个 agent 各自维护增量状态
+    SysMonitorInfo monitor_info;
+    monitor_info.total_mem = 64ULL * 1024 * 1024;
+    monitor_info.used_mem = 16ULL * 1024 * 1024;
+    monitor_info.active_cpus = 64;
+    uint32_t user_id = monitor_info.string_arena->intern("bench");
+    char cmdline[128];
+    for (unsigned int i = 0; i < task_count; i++) {
+        auto task = std::make_shared<ProcessInfo>();
+        task->pid = 1000 + i;
+        task->ppid = 1;
+        task->tgid = task->pid;
+        task->uid = 1000;
+        int length = snprintf(cmdline, sizeof(cmdline), "/usr/bin/bench_worker --id=%u --mode=synthetic", i);
+        task->cmdline_id = monitor_info.string_arena->intern(cmdline, length);
+        monitor_info.string_arena->acquire(user_id);
+        task->user_id = user_id;
+        task->resident_mem = 1024 + i;
+        task->virtual_mem = 4096 + i;
+        monitor_info.all_process_info.push_back(task);
+    }
+
+    std::vector<std::unique_ptr<RemoteAgent>> agents;
+    char host_name[REMOTE_HOST_NAME_LENGTH+1];
+    for (unsigned int i = 0; i < agent_count; i++) {
+        agents.emplace_back(new RemoteAgent());
+        snprintf(host_name, sizeof(host_name), "bench-%u", i);
+        if (agents.back()->initialize(address, host_name) < 0) return -1;
+    }
+
+    unsigned int changed = task_count * change_percent / 100;
+    unsigned int offset = 0;
+    for (unsigned int round = 0; round < rounds; round++) {
+        uint64_t start_us = monotonic_us();
+        struct timeval tv;
+        Util::get_real_time(&tv, &monitor_info.curr_time_ms);
+        // 每轮有一部分任务的 cpu 时间与内存发生变化
+        for (unsigned int i = 0; i < changed && task_count > 0; i++) {
+            ProcessInfo& task = *monitor_info.all_process_info[(offset + i) % task_count];
+            task.utime += 1 + i % 7;
+            task.stime += i % 3;
+            task.percent_cpu = (i % 1000) / 10.0F;
+            task.resident_mem += (i % 5) * 4;
+        }
+        offset += changed;
+        int failed = 0;
+        for (auto& agent : agents) {
+            if (agent->send_snapshot(monitor_info) < 0) failed++;
+        }
+        uint64_t elapsed_us = monotonic_us() - start_us;
+        uint64_t bytes = 0;
+        for (auto& agent : agents) bytes += agent->bytes_sent();
+        std::cout << "round: " << round << ", agents: " << agent_count << ", failed: " << failed
+            << ", send time: " << elapsed_us / 1000.0 << " ms, total sent: " << bytes << " bytes" << std::endl;
+        if (elapsed_us < interval_ms * 1000ULL) {
+            usleep(interval_ms * 1000ULL - elapsed_us);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <iostream>
+#include <sstream>
+#include "monitor_info_output.h"
+#include "monitor_info_preprocess.h"
+#include "monitor_info_shm.h"
+#include "common.h"
+
+// 只读客户端：从共享内存读取 top_cpp 发布的快照，输出与 top_cpp 相同
+int main(int argc, char* argv[]) {
+    const char* shm_name = SHM_SNAPSHOT_DEFAULT_NAME;
+    unsigned int interval = 2;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:i:h")) != -1) {
+        switch (opt) {
+        case 's':
+            shm_name = optarg;
+            break;
+        case 'i':
+            interval = strtoul(optarg, nullptr, 10);
+            break;
+        default:
+            std::cout << "usage: " << argv[0] << " [-s shm_name] [-i interval_sec]" << std::endl;
+            return opt == 'h' ? 0 : -1;
+        }
+    }
+
+    ShmSnapshotReader reader;
+    while (reader.open(shm_name) < 0) {
+        INFO_LOG("waiting for top_cpp to publish shm: %s", shm_name);
+        sleep(1);
+    }
+    uint64_t last_publish_count = 0;
+    for (;;) {
+        // 快照没有更新则不重复输出
+        if (reader.publish_count() == last_publish_count) {
+            usleep(100 * 1000);
+            continue;
+        }
+        std::ostringstream os;
+        ShmSnapshotView view;
+        bool acquired;
+        do {
+            os.str("");
+            acquired = reader.acquire(&view);
+            if (!acquired) break;
+            if (view.cpu_count > 0) {
+                output_cpu_usage(os, MonitorInfoPreprocess::cpu_usage(
+                    view.cpus[0].total_period, view.cpus[0].idle_all_period));
+            }
+            for (uint32_t i = 0; i < view.task_count; i++) {
+                output_task_info(os, view.tasks[i], view.tasks[i].cmdline, view.tasks[i].user);
+            }
+        } while (!reader.validate(view));
+        // 没有拿到快照时不输出半成品
+        if (!acquired) {
+            usleep(100 * 1000);
+            continue;
+        }
+        last_publish_count = reader.publish_count();
+        std::cout << os.str() << std::flush;
+        sleep(interval);
+    }
+}